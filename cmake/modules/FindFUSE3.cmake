@@ -0,0 +1,42 @@
+# - Try to find libfuse 3
+# Once done this will define
+#
+#  FUSE3_FOUND - system has libfuse 3
+#  FUSE3_INCLUDE_DIRS - the libfuse 3 include directory
+#  FUSE3_LIBRARIES - Link these to use libfuse 3
+#
+#  Redistribution and use is allowed according to the terms of the New
+#  BSD license.
+#  For details see the accompanying COPYING-CMAKE-SCRIPTS file.
+#
+
+find_package(PkgConfig)
+if (PKG_CONFIG_FOUND)
+  pkg_check_modules(_FUSE3 fuse3)
+endif (PKG_CONFIG_FOUND)
+
+find_path(FUSE3_INCLUDE_DIR
+  NAMES
+    fuse.h
+  PATHS
+    ${_FUSE3_INCLUDE_DIRS}
+  PATH_SUFFIXES
+    fuse3
+)
+mark_as_advanced(FUSE3_INCLUDE_DIR)
+
+find_library(FUSE3_LIBRARY
+  NAMES
+    fuse3
+  PATHS
+    ${_FUSE3_LIBDIR}
+)
+mark_as_advanced(FUSE3_LIBRARY)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(FUSE3 DEFAULT_MSG FUSE3_INCLUDE_DIR FUSE3_LIBRARY)
+
+if (FUSE3_FOUND)
+  set(FUSE3_INCLUDE_DIRS ${FUSE3_INCLUDE_DIR})
+  set(FUSE3_LIBRARIES ${FUSE3_LIBRARY})
+endif (FUSE3_FOUND)
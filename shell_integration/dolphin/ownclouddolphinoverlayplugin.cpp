@@ -33,12 +33,20 @@ class OwncloudDolphinPlugin : public KOverlayIconPlugin
     using StatusMap = QHash<QByteArray, QByteArray>;
     StatusMap m_status;
 
+    // Names to ask the status of, by directory, sent together by sendPendingRequests()
+    QHash<QByteArray, QByteArray> m_pendingRequests;
+    QTimer m_requestTimer;
+
 public:
 
     OwncloudDolphinPlugin() {
         auto helper = OwncloudDolphinPluginHelper::instance();
         QObject::connect(helper, &OwncloudDolphinPluginHelper::commandRecieved,
                          this, &OwncloudDolphinPlugin::slotCommandRecieved);
+        m_requestTimer.setSingleShot(true);
+        m_requestTimer.setInterval(0);
+        QObject::connect(&m_requestTimer, &QTimer::timeout,
+                         this, &OwncloudDolphinPlugin::sendPendingRequests);
     }
 
     QStringList getOverlays(const QUrl& url) override {
@@ -50,7 +58,18 @@ public:
         QDir localPath(url.toLocalFile());
         const QByteArray localFile = localPath.canonicalPath().toUtf8();
 
-        helper->sendCommand(QByteArray("RETRIEVE_FILE_STATUS:" + localFile + "\n"));
+        const int lastSlash = localFile.lastIndexOf('/');
+        if (helper->supportsDirectoryStatus() && lastSlash > 0) {
+            // Dolphin asks for every file of a directory it shows, ask the
+            // client for all of them at once
+            QByteArray &names = m_pendingRequests[localFile.left(lastSlash)];
+            names += '\x1e';
+            names += localFile.mid(lastSlash + 1);
+            if (!m_requestTimer.isActive())
+                m_requestTimer.start();
+        } else {
+            helper->sendCommand(QByteArray("RETRIEVE_FILE_STATUS:" + localFile + "\n"));
+        }
 
         StatusMap::iterator it = m_status.find(localFile);
         if (it != m_status.constEnd()) {
@@ -80,8 +99,37 @@ private:
         return r;
     }
 
+    void sendPendingRequests() {
+        auto helper = OwncloudDolphinPluginHelper::instance();
+        for (auto it = m_pendingRequests.constBegin(); it != m_pendingRequests.constEnd(); ++it)
+            helper->sendCommand(QByteArray("RETRIEVE_DIRECTORY_STATUS:" + it.key() + it.value() + "\n"));
+        m_pendingRequests.clear();
+    }
+
+    void updateStatus(const QByteArray &name, const QByteArray &newStatus) {
+        QByteArray &status = m_status[name]; // reference to the item in the hash
+        if (status == newStatus)
+            return;
+        status = newStatus;
+
+        emit overlaysChanged(QUrl::fromLocalFile(QString::fromUtf8(name)), overlaysForString(status));
+    }
+
     void slotCommandRecieved(const QByteArray &line) {
 
+        if (line.startsWith("DIRECTORY_STATUS:")) {
+            // DIRECTORY_STATUS:directory followed by \x1estatus:name entries
+            const QList<QByteArray> entries = line.mid(line.indexOf(':') + 1).split('\x1e');
+            const QByteArray directory = entries.value(0) + '/';
+            for (int i = 1; i < entries.size(); ++i) {
+                const int colon = entries[i].indexOf(':');
+                if (colon <= 0 || colon == entries[i].size() - 1)
+                    continue;
+                updateStatus(directory + entries[i].mid(colon + 1), entries[i].left(colon));
+            }
+            return;
+        }
+
         QList<QByteArray> tokens = line.split(':');
         if (tokens.count() < 3)
             return;
@@ -92,13 +140,7 @@ private:
 
         // We can't use tokens[2] because the filename might contain ':'
         int secondColon = line.indexOf(":", line.indexOf(":") + 1);
-        const QByteArray name = line.mid(secondColon + 1);
-        QByteArray &status = m_status[name]; // reference to the item in the hash
-        if (status == tokens[1])
-            return;
-        status = tokens[1];
-
-        emit overlaysChanged(QUrl::fromLocalFile(QString::fromUtf8(name)), overlaysForString(status));
+        updateStatus(line.mid(secondColon + 1), tokens[1]);
     }
 };
 
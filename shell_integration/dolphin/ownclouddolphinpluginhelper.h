@@ -52,6 +52,12 @@ public:
 
     QByteArray version() { return _version; }
 
+    /// Whether the client answers RETRIEVE_DIRECTORY_STATUS, added in socket API version 1.2
+    bool supportsDirectoryStatus() const
+    {
+        return _version.startsWith("1.") && _version.mid(2).toInt() >= 2;
+    }
+
 signals:
     void commandRecieved(const QByteArray &cmd);
 
@@ -23,11 +23,20 @@
 #include <QLoggingCategory>
 #include <qtconcurrentrun.h>
 #include <QCryptographicHash>
+#include <QPointer>
+#include <QThread>
+#include <QThreadPool>
+
+#include <limits>
 
 #ifdef ZLIB_FOUND
 #include <zlib.h>
 #endif
 
+#ifdef OPENSSL_FOUND
+#include <openssl/evp.h>
+#endif
+
 /** \file checksums.cpp
  *
  * \brief Computing and validating file checksums
@@ -82,6 +91,15 @@
  * - SHA256
  * - SHA3-256 (requires Qt 5.9)
  *
+ * Computation
+ * -----------
+ *
+ * ChecksumCalculator computes any number of these in a single pass over
+ * the file, so an upload that needs a content checksum and a different
+ * transmission checksum only reads the file once. Asynchronous
+ * computations run on a dedicated, bounded thread pool, see
+ * ComputeChecksum::threadPool().
+ *
  */
 
 namespace OCC {
@@ -132,6 +150,194 @@ QByteArray calcAdler32(QIODevice *device)
 }
 #endif
 
+struct ChecksumCalculator::Algorithm
+{
+    enum class Kind {
+        Unknown,
+        Adler32,
+        OpenSsl,
+        Qt,
+    };
+
+    Kind kind = Kind::Unknown;
+#ifdef ZLIB_FOUND
+    uLong adler = 0;
+#endif
+#ifdef OPENSSL_FOUND
+    EVP_MD_CTX *evpContext = nullptr;
+#endif
+    std::unique_ptr<QCryptographicHash> qtHash;
+
+    ~Algorithm()
+    {
+#ifdef OPENSSL_FOUND
+        EVP_MD_CTX_free(evpContext);
+#endif
+    }
+};
+
+const qint64 ChecksumCalculator::bufferSize = 1024 * 1024; // 1 MiB
+
+#ifdef OPENSSL_FOUND
+static const EVP_MD *openSslDigest(const QByteArray &checksumType)
+{
+    if (checksumType == checkSumMD5C)
+        return EVP_md5();
+    if (checksumType == checkSumSHA1C)
+        return EVP_sha1();
+    if (checksumType == checkSumSHA2C)
+        return EVP_sha256();
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    if (checksumType == checkSumSHA3C)
+        return EVP_sha3_256();
+#endif
+    return nullptr;
+}
+#endif
+
+static bool qtHashAlgorithm(const QByteArray &checksumType, QCryptographicHash::Algorithm *algorithm)
+{
+    if (checksumType == checkSumMD5C) {
+        *algorithm = QCryptographicHash::Md5;
+    } else if (checksumType == checkSumSHA1C) {
+        *algorithm = QCryptographicHash::Sha1;
+    } else if (checksumType == checkSumSHA2C) {
+        *algorithm = QCryptographicHash::Sha256;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 9, 0)
+    } else if (checksumType == checkSumSHA3C) {
+        *algorithm = QCryptographicHash::Sha3_256;
+#endif
+    } else {
+        return false;
+    }
+    return true;
+}
+
+ChecksumCalculator::ChecksumCalculator(const QByteArrayList &checksumTypes)
+{
+    for (const auto &type : checksumTypes) {
+        auto algorithm = std::make_unique<Algorithm>();
+        QCryptographicHash::Algorithm qtAlgorithm;
+#ifdef ZLIB_FOUND
+        if (type == checkSumAdlerC) {
+            algorithm->kind = Algorithm::Kind::Adler32;
+            algorithm->adler = adler32(0L, Z_NULL, 0);
+            _algorithms.push_back(std::move(algorithm));
+            continue;
+        }
+#endif
+#ifdef OPENSSL_FOUND
+        if (auto digest = openSslDigest(type)) {
+            algorithm->evpContext = EVP_MD_CTX_new();
+            if (algorithm->evpContext && EVP_DigestInit_ex(algorithm->evpContext, digest, nullptr) == 1) {
+                algorithm->kind = Algorithm::Kind::OpenSsl;
+                _algorithms.push_back(std::move(algorithm));
+                continue;
+            }
+            qCWarning(lcChecksums) << "Could not initialize OpenSSL digest for" << type << ", using fallback";
+        }
+#endif
+        if (qtHashAlgorithm(type, &qtAlgorithm)) {
+            algorithm->kind = Algorithm::Kind::Qt;
+            algorithm->qtHash = std::make_unique<QCryptographicHash>(qtAlgorithm);
+        }
+        _algorithms.push_back(std::move(algorithm));
+    }
+}
+
+ChecksumCalculator::~ChecksumCalculator() = default;
+
+bool ChecksumCalculator::isSupported(const QByteArray &checksumType)
+{
+    QCryptographicHash::Algorithm qtAlgorithm;
+#ifdef ZLIB_FOUND
+    if (checksumType == checkSumAdlerC)
+        return true;
+#endif
+    return qtHashAlgorithm(checksumType, &qtAlgorithm);
+}
+
+void ChecksumCalculator::addData(const char *data, qint64 length)
+{
+    _bytesAdded += length;
+    for (const auto &algorithm : _algorithms) {
+        switch (algorithm->kind) {
+        case Algorithm::Kind::Adler32:
+#ifdef ZLIB_FOUND
+            for (qint64 done = 0; done < length;) {
+                const auto chunk = static_cast<uInt>(qMin<qint64>(length - done, std::numeric_limits<uInt>::max()));
+                algorithm->adler = adler32(algorithm->adler, reinterpret_cast<const Bytef *>(data + done), chunk);
+                done += chunk;
+            }
+#endif
+            break;
+        case Algorithm::Kind::OpenSsl:
+#ifdef OPENSSL_FOUND
+            EVP_DigestUpdate(algorithm->evpContext, data, static_cast<size_t>(length));
+#endif
+            break;
+        case Algorithm::Kind::Qt:
+            algorithm->qtHash->addData(data, static_cast<int>(length));
+            break;
+        case Algorithm::Kind::Unknown:
+            break;
+        }
+    }
+}
+
+bool ChecksumCalculator::addData(QIODevice *device)
+{
+    if (!device->isReadable())
+        return false;
+
+    // Page aligned, so the kernel can copy whole pages into it
+    std::unique_ptr<char, void (*)(void *)> buffer(
+        static_cast<char *>(qMallocAligned(static_cast<size_t>(bufferSize), 4096)), &qFreeAligned);
+    if (!buffer)
+        return false;
+
+    qint64 length = 0;
+    while ((length = device->read(buffer.get(), bufferSize)) > 0) {
+        addData(buffer.get(), length);
+    }
+    return device->atEnd();
+}
+
+QByteArrayList ChecksumCalculator::results()
+{
+    QByteArrayList results;
+    results.reserve(static_cast<int>(_algorithms.size()));
+    for (const auto &algorithm : _algorithms) {
+        switch (algorithm->kind) {
+        case Algorithm::Kind::Adler32:
+#ifdef ZLIB_FOUND
+            // Like calcAdler32(), empty data has no Adler32 checksum
+            results.append(_bytesAdded == 0 ? QByteArray() : QByteArray::number(static_cast<qulonglong>(algorithm->adler), 16));
+#endif
+            break;
+        case Algorithm::Kind::OpenSsl: {
+#ifdef OPENSSL_FOUND
+            unsigned char digest[EVP_MAX_MD_SIZE];
+            unsigned int digestLength = 0;
+            if (EVP_DigestFinal_ex(algorithm->evpContext, digest, &digestLength) == 1) {
+                results.append(QByteArray(reinterpret_cast<const char *>(digest), static_cast<int>(digestLength)).toHex());
+            } else {
+                results.append(QByteArray());
+            }
+#endif
+            break;
+        }
+        case Algorithm::Kind::Qt:
+            results.append(algorithm->qtHash->result().toHex());
+            break;
+        case Algorithm::Kind::Unknown:
+            results.append(QByteArray());
+            break;
+        }
+    }
+    return results;
+}
+
 QByteArray makeChecksumHeader(const QByteArray &checksumType, const QByteArray &checksum)
 {
     if (checksumType.isEmpty() || checksum.isEmpty())
@@ -199,8 +405,11 @@ static bool checksumComputationEnabled()
     return enabled;
 }
 
+Q_GLOBAL_STATIC(QThreadPool, checksumThreadPool)
+
 ComputeChecksum::ComputeChecksum(QObject *parent)
     : QObject(parent)
+    , _checksumTypes({ QByteArray() })
 {
 }
 
@@ -208,12 +417,29 @@ ComputeChecksum::~ComputeChecksum() = default;
 
 void ComputeChecksum::setChecksumType(const QByteArray &type)
 {
-    _checksumType = type;
+    _checksumTypes = QByteArrayList{ type };
 }
 
 QByteArray ComputeChecksum::checksumType() const
 {
-    return _checksumType;
+    return _checksumTypes.value(0);
+}
+
+void ComputeChecksum::setChecksumTypes(const QByteArrayList &types)
+{
+    ENFORCE(!types.isEmpty());
+    _checksumTypes = types;
+}
+
+QThreadPool *ComputeChecksum::threadPool()
+{
+    static const bool initialized = []() {
+        // Checksumming is mostly bound by the disk, more threads would just make it seek
+        checksumThreadPool()->setMaxThreadCount(qBound(2, QThread::idealThreadCount() / 2, 4));
+        return true;
+    }();
+    Q_UNUSED(initialized)
+    return checksumThreadPool();
 }
 
 void ComputeChecksum::start(const QString &filePath)
@@ -242,8 +468,8 @@ void ComputeChecksum::startImpl(std::unique_ptr<QIODevice> device)
     auto sharedDevice = QSharedPointer<QIODevice>(device.release());
 
     // Bug: The thread will keep running even if ComputeChecksum is deleted.
-    auto type = checksumType();
-    _watcher.setFuture(QtConcurrent::run([sharedDevice, type]() {
+    auto types = checksumTypes();
+    _watcher.setFuture(QtConcurrent::run(threadPool(), [sharedDevice, types]() {
         if (!sharedDevice->open(QIODevice::ReadOnly)) {
             if (auto file = qobject_cast<QFile *>(sharedDevice.data())) {
                 qCWarning(lcChecksums) << "Could not open file" << file->fileName()
@@ -252,9 +478,9 @@ void ComputeChecksum::startImpl(std::unique_ptr<QIODevice> device)
                 qCWarning(lcChecksums) << "Could not open device" << sharedDevice.data()
                         << "for reading to compute a checksum" << sharedDevice->errorString();
             }
-            return QByteArray();
+            return QByteArrayList();
         }
-        auto result = ComputeChecksum::computeNow(sharedDevice.data(), type);
+        auto result = ComputeChecksum::computeNow(sharedDevice.data(), types);
         sharedDevice->close();
         return result;
     }));
@@ -273,43 +499,60 @@ QByteArray ComputeChecksum::computeNowOnFile(const QString &filePath, const QByt
 
 QByteArray ComputeChecksum::computeNow(QIODevice *device, const QByteArray &checksumType)
 {
+    return computeNow(device, QByteArrayList{ checksumType }).value(0);
+}
+
+QByteArrayList ComputeChecksum::computeNow(QIODevice *device, const QByteArrayList &checksumTypes)
+{
+    QByteArrayList nullResults;
+    for (int i = 0; i < checksumTypes.size(); ++i)
+        nullResults.append(QByteArray());
+
     if (!checksumComputationEnabled()) {
         qCWarning(lcChecksums) << "Checksum computation disabled by environment variable";
-        return QByteArray();
+        return nullResults;
     }
 
-    if (checksumType == checkSumMD5C) {
-        return calcMd5(device);
-    } else if (checksumType == checkSumSHA1C) {
-        return calcSha1(device);
-    } else if (checksumType == checkSumSHA2C) {
-        return calcCryptoHash(device, QCryptographicHash::Sha256);
-    }
-#if QT_VERSION >= QT_VERSION_CHECK(5, 9, 0)
-    else if (checksumType == checkSumSHA3C) {
-        return calcCryptoHash(device, QCryptographicHash::Sha3_256);
-    }
-#endif
-#ifdef ZLIB_FOUND
-    else if (checksumType == checkSumAdlerC) {
-        return calcAdler32(device);
+    bool anySupported = false;
+    for (const auto &type : checksumTypes) {
+        if (ChecksumCalculator::isSupported(type)) {
+            anySupported = true;
+        } else if (!type.isEmpty()) {
+            qCWarning(lcChecksums) << "Unknown checksum type:" << type;
+        }
     }
-#endif
-    // for an unknown checksum or no checksum, we're done right now
-    if (!checksumType.isEmpty()) {
-        qCWarning(lcChecksums) << "Unknown checksum type:" << checksumType;
+    // for unknown checksums or no checksum, we're done right now
+    if (!anySupported)
+        return nullResults;
+
+    ChecksumCalculator calculator(checksumTypes);
+    if (!calculator.addData(device)) {
+        qCWarning(lcChecksums) << "Could not read device" << device << "to compute checksums" << checksumTypes << device->errorString();
+        return nullResults;
     }
-    return QByteArray();
+    return calculator.results();
 }
 
 void ComputeChecksum::slotCalculationDone()
 {
-    QByteArray checksum = _watcher.future().result();
+    QByteArrayList checksums = _watcher.future().result();
+    QByteArrayList types = _checksumTypes;
+    for (int i = 0; i < types.size(); ++i) {
+        if (checksums.size() <= i)
+            checksums.append(QByteArray());
+        if (checksums.at(i).isNull())
+            types[i].clear();
+    }
+
+    QPointer<ComputeChecksum> guard = this;
+    const QByteArray checksum = checksums.value(0);
     if (!checksum.isNull()) {
-        emit done(_checksumType, checksum);
+        emit done(checksumType(), checksum);
     } else {
         emit done(QByteArray(), QByteArray());
     }
+    if (guard)
+        emit allDone(types, checksums);
 }
 
 
@@ -23,11 +23,14 @@
 
 #include <QObject>
 #include <QByteArray>
+#include <QByteArrayList>
 #include <QFutureWatcher>
 
 #include <memory>
+#include <vector>
 
 class QFile;
+class QThreadPool;
 
 namespace OCC {
 
@@ -72,6 +75,42 @@ QByteArray OCSYNC_EXPORT calcSha1(QIODevice *device);
 QByteArray OCSYNC_EXPORT calcAdler32(QIODevice *device);
 #endif
 
+/**
+ * @brief Computes several checksum algorithms in a single pass over the data
+ * @ingroup libsync
+ *
+ * MD5 and the SHA family go through OpenSSL when available, which selects
+ * SIMD and SHA extension code paths for the running CPU. Adler32 uses zlib.
+ * Otherwise QCryptographicHash is used.
+ */
+class OCSYNC_EXPORT ChecksumCalculator
+{
+public:
+    /// Unknown types are ignored and produce a null result
+    explicit ChecksumCalculator(const QByteArrayList &checksumTypes);
+    ~ChecksumCalculator();
+
+    void addData(const char *data, qint64 length);
+
+    /// Reads the device to its end, returns false on read errors
+    bool addData(QIODevice *device);
+
+    /// The hex encoded results, in the order of the types given to the constructor
+    QByteArrayList results();
+
+    /// Whether \a checksumType can be computed
+    static bool isSupported(const QByteArray &checksumType);
+
+    /// Read buffer size used by addData(QIODevice *)
+    static const qint64 bufferSize;
+
+private:
+    Q_DISABLE_COPY(ChecksumCalculator)
+    struct Algorithm;
+    std::vector<std::unique_ptr<Algorithm>> _algorithms;
+    qint64 _bytesAdded = 0;
+};
+
 /**
  * Computes the checksum of a file.
  * \ingroup libsync
@@ -90,6 +129,16 @@ public:
 
     QByteArray checksumType() const;
 
+    /**
+     * Sets several checksum types that are computed in one pass over the data.
+     *
+     * The first type is the one reported through done(), allDone() reports
+     * all of them.
+     */
+    void setChecksumTypes(const QByteArrayList &types);
+
+    QByteArrayList checksumTypes() const { return _checksumTypes; }
+
     /**
      * Computes the checksum for the given file path.
      *
@@ -112,24 +161,47 @@ public:
      */
     static QByteArray computeNow(QIODevice *device, const QByteArray &checksumType);
 
+    /**
+     * Computes several checksums synchronously, reading the device only once.
+     *
+     * The result has one entry per type, null for unknown types and on errors.
+     */
+    static QByteArrayList computeNow(QIODevice *device, const QByteArrayList &checksumTypes);
+
     /**
      * Computes the checksum synchronously on file. Convenience wrapper for computeNow().
      */
     static QByteArray computeNowOnFile(const QString &filePath, const QByteArray &checksumType);
 
+    /**
+     * The thread pool asynchronous computations run on.
+     *
+     * It is separate from the global pool and bounded so that checksumming
+     * many files at once doesn't starve other background work or thrash
+     * the disk.
+     */
+    static QThreadPool *threadPool();
+
 signals:
     void done(const QByteArray &checksumType, const QByteArray &checksum);
 
+    /**
+     * Emitted after done() with the results for all types set with setChecksumTypes().
+     *
+     * Types whose checksum couldn't be computed are reported with an empty type.
+     */
+    void allDone(const QByteArrayList &checksumTypes, const QByteArrayList &checksums);
+
 private slots:
     void slotCalculationDone();
 
 private:
     void startImpl(std::unique_ptr<QIODevice> device);
 
-    QByteArray _checksumType;
+    QByteArrayList _checksumTypes;
 
     // watcher for the checksum calculation thread
-    QFutureWatcher<QByteArray> _watcher;
+    QFutureWatcher<QByteArrayList> _watcher;
 };
 
 /**
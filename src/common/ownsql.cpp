@@ -214,6 +214,15 @@ bool SqlDatabase::commit()
     return _errId == SQLITE_OK;
 }
 
+bool SqlDatabase::rollback()
+{
+    if (!_db) {
+        return false;
+    }
+    SQLITE_DO(sqlite3_exec(_db, "ROLLBACK", nullptr, nullptr, nullptr));
+    return _errId == SQLITE_OK;
+}
+
 sqlite3 *SqlDatabase::sqliteDb()
 {
     return _db;
@@ -426,6 +435,77 @@ void SqlQuery::bindValueInternal(int pos, const QVariant &value)
     ASSERT(res == SQLITE_OK);
 }
 
+void SqlQuery::checkBindResult(int pos, int res)
+{
+    if (res != SQLITE_OK) {
+        qCWarning(lcSql) << "ERROR binding SQL value at" << pos << "error:" << res;
+    }
+    ASSERT(res == SQLITE_OK);
+}
+
+void SqlQuery::bindValue(int pos, int value)
+{
+    qCDebug(lcSql) << "SQL bind" << pos << value;
+    if (!_stmt) {
+        ASSERT(false);
+        return;
+    }
+    checkBindResult(pos, sqlite3_bind_int(_stmt, pos, value));
+}
+
+void SqlQuery::bindValue(int pos, qint64 value)
+{
+    qCDebug(lcSql) << "SQL bind" << pos << value;
+    if (!_stmt) {
+        ASSERT(false);
+        return;
+    }
+    checkBindResult(pos, sqlite3_bind_int64(_stmt, pos, value));
+}
+
+void SqlQuery::bindValue(int pos, quint64 value)
+{
+    // Stored as the signed 64 bit value with the same bits, like QVariant::toLongLong() does
+    bindValue(pos, static_cast<qint64>(value));
+}
+
+void SqlQuery::bindValue(int pos, const QByteArray &value)
+{
+    bindValue(pos, SqlByteView(value.constData(), value.size()));
+}
+
+void SqlQuery::bindValue(int pos, SqlByteView value)
+{
+    qCDebug(lcSql) << "SQL bind" << pos << QByteArray::fromRawData(value.data(), value.size());
+    if (!_stmt) {
+        ASSERT(false);
+        return;
+    }
+    checkBindResult(pos, sqlite3_bind_text(_stmt, pos, value.data(), value.size(), SQLITE_TRANSIENT));
+}
+
+void SqlQuery::bindValue(int pos, QStringView value)
+{
+    qCDebug(lcSql) << "SQL bind" << pos << value;
+    if (!_stmt) {
+        ASSERT(false);
+        return;
+    }
+    int res = 0;
+    if (!value.isNull()) {
+        res = sqlite3_bind_text16(_stmt, pos, value.utf16(),
+            static_cast<int>(value.size()) * static_cast<int>(sizeof(QChar)), SQLITE_TRANSIENT);
+    } else {
+        res = sqlite3_bind_null(_stmt, pos);
+    }
+    checkBindResult(pos, res);
+}
+
+void SqlQuery::bindValue(int pos, const QString &value)
+{
+    bindValue(pos, QStringView(value));
+}
+
 bool SqlQuery::nullValue(int index)
 {
     return sqlite3_column_type(_stmt, index) == SQLITE_NULL;
@@ -452,6 +532,21 @@ QByteArray SqlQuery::baValue(int index)
         sqlite3_column_bytes(_stmt, index));
 }
 
+SqlByteView SqlQuery::baValueView(int index)
+{
+    // sqlite3_column_text() is zero-terminated, unlike sqlite3_column_blob()
+    const auto data = reinterpret_cast<const char *>(sqlite3_column_text(_stmt, index));
+    return SqlByteView(data, sqlite3_column_bytes(_stmt, index));
+}
+
+QStringView SqlQuery::stringValueView(int index)
+{
+    const auto data = static_cast<const ushort *>(sqlite3_column_text16(_stmt, index));
+    if (!data)
+        return QStringView();
+    return QStringView(data, sqlite3_column_bytes16(_stmt, index) / static_cast<int>(sizeof(ushort)));
+}
+
 QString SqlQuery::error() const
 {
     return _error;
@@ -21,8 +21,11 @@
 
 #include <QLoggingCategory>
 #include <QObject>
+#include <QStringView>
 #include <QVariant>
 
+#include <cstring>
+
 #include "ocsynclib.h"
 
 struct sqlite3;
@@ -33,6 +36,56 @@ OCSYNC_EXPORT Q_DECLARE_LOGGING_CATEGORY(lcSql)
 
 class SqlQuery;
 
+/**
+ * @brief Non-owning view of a text column value
+ * @ingroup libsync
+ *
+ * Points into sqlite's buffer for the current row and does not allocate.
+ * The data is zero-terminated. A view is only valid until its query steps
+ * to the next row or is reset or finished; use toByteArray() to keep the
+ * value around.
+ */
+class SqlByteView
+{
+public:
+    SqlByteView() = default;
+    SqlByteView(const char *data, int size)
+        : _data(data)
+        , _size(size)
+    {
+    }
+
+    const char *data() const { return _data ? _data : ""; }
+    int size() const { return _size; }
+    bool isEmpty() const { return _size == 0; }
+
+    QByteArray toByteArray() const { return QByteArray(_data, _size); }
+    QString toString() const { return QString::fromUtf8(_data, _size); }
+
+    bool startsWith(const QByteArray &prefix) const
+    {
+        return prefix.size() <= _size && memcmp(data(), prefix.constData(), static_cast<size_t>(prefix.size())) == 0;
+    }
+
+    /// Like QByteArray::indexOf()
+    int indexOf(char c, int from = 0) const
+    {
+        if (from < 0 || from >= _size)
+            return -1;
+        const void *found = memchr(data() + from, c, static_cast<size_t>(_size - from));
+        return found ? static_cast<int>(static_cast<const char *>(found) - data()) : -1;
+    }
+
+    friend bool operator==(SqlByteView a, const QByteArray &b)
+    {
+        return a._size == b.size() && memcmp(a.data(), b.constData(), static_cast<size_t>(a._size)) == 0;
+    }
+
+private:
+    const char *_data = nullptr;
+    int _size = 0;
+};
+
 /**
  * @brief The SqlDatabase class
  * @ingroup libsync
@@ -49,6 +102,7 @@ public:
     bool openReadOnly(const QString &filename);
     bool transaction();
     bool commit();
+    bool rollback();
     void close();
     QString error() const;
     sqlite3 *sqliteDb();
@@ -127,6 +181,16 @@ public:
     int intValue(int index);
     quint64 int64Value(int index);
     QByteArray baValue(int index);
+
+    /**
+     * Zero-copy variants of baValue() and stringValue().
+     *
+     * The views point into sqlite's buffer for the current row, see SqlByteView.
+     * Don't mix both variants for the same column of a row: converting between
+     * UTF-8 and UTF-16 invalidates previously returned views of that column.
+     */
+    SqlByteView baValueView(int index);
+    QStringView stringValueView(int index);
     bool isSelect();
     bool isPragma();
     bool exec();
@@ -141,8 +205,7 @@ public:
     template<class T, typename std::enable_if<std::is_enum<T>::value, int>::type = 0>
     void bindValue(int pos, const T &value)
     {
-        qCDebug(lcSql) << "SQL bind" << pos << value;
-        bindValueInternal(pos, static_cast<int>(value));
+        bindValue(pos, static_cast<int>(value));
     }
 
     template<class T, typename std::enable_if<!std::is_enum<T>::value, int>::type = 0>
@@ -152,6 +215,20 @@ public:
         bindValueInternal(pos, value);
     }
 
+    /**
+     * Typed overloads that bind directly without going through QVariant.
+     *
+     * Text is always copied by sqlite, so temporaries are fine. A null QString
+     * binds NULL, like the QVariant based overload.
+     */
+    void bindValue(int pos, int value);
+    void bindValue(int pos, qint64 value);
+    void bindValue(int pos, quint64 value);
+    void bindValue(int pos, const QByteArray &value);
+    void bindValue(int pos, SqlByteView value);
+    void bindValue(int pos, QStringView value);
+    void bindValue(int pos, const QString &value);
+
     const QByteArray &lastQuery() const;
     int numRowsAffected();
     void reset_and_clear_bindings();
@@ -159,6 +236,7 @@ public:
 
 private:
     void bindValueInternal(int pos, const QVariant &value);
+    void checkBindResult(int pos, int res);
 
     SqlDatabase *_sqldb = nullptr;
     sqlite3 *_db = nullptr;
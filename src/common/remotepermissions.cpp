@@ -68,6 +68,15 @@ RemotePermissions RemotePermissions::fromDbValue(const QByteArray &value)
     return perm;
 }
 
+RemotePermissions RemotePermissions::fromDbValue(const char *value)
+{
+    if (!value || !*value)
+        return {};
+    RemotePermissions perm;
+    perm.fromArray(value);
+    return perm;
+}
+
 RemotePermissions RemotePermissions::fromServerString(const QString &value)
 {
     RemotePermissions perm;
@@ -71,6 +71,9 @@ public:
     /// read value that was written with toDbValue()
     static RemotePermissions fromDbValue(const QByteArray &);
 
+    /// same as above for a zero-terminated string, avoids a QByteArray allocation
+    static RemotePermissions fromDbValue(const char *);
+
     /// read a permissions string received from the server, never null
     static RemotePermissions fromServerString(const QString &);
 
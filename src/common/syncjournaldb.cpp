@@ -21,9 +21,11 @@
 #include <QLoggingCategory>
 #include <QStringList>
 #include <QElapsedTimer>
+#include <QTimer>
 #include <QUrl>
 #include <QDir>
 #include <sqlite3.h>
+#include <algorithm>
 #include <cstring>
 
 #include "common/syncjournaldb.h"
@@ -51,19 +53,28 @@ Q_LOGGING_CATEGORY(lcDb, "nextcloud.sync.database", QtInfoMsg)
         " FROM metadata" \
         "  LEFT JOIN checksumtype as contentchecksumtype ON metadata.contentChecksumTypeId == contentchecksumtype.id"
 
+// Copies a column into a record field. When a record is reused for the next
+// row and nobody kept a copy of the field, its buffer is reused as well.
+static void assignColumn(QByteArray &field, SqlByteView value)
+{
+    field.resize(value.size());
+    if (!value.isEmpty())
+        memcpy(field.data(), value.data(), static_cast<size_t>(value.size()));
+}
+
 static void fillFileRecordFromGetQuery(SyncJournalFileRecord &rec, SqlQuery &query)
 {
-    rec._path = query.baValue(0);
+    assignColumn(rec._path, query.baValueView(0));
     rec._inode = query.int64Value(1);
     rec._modtime = query.int64Value(2);
     rec._type = static_cast<ItemType>(query.intValue(3));
-    rec._etag = query.baValue(4);
-    rec._fileId = query.baValue(5);
-    rec._remotePerm = RemotePermissions::fromDbValue(query.baValue(6));
+    assignColumn(rec._etag, query.baValueView(4));
+    assignColumn(rec._fileId, query.baValueView(5));
+    rec._remotePerm = RemotePermissions::fromDbValue(query.baValueView(6).data());
     rec._fileSize = query.int64Value(7);
     rec._serverHasIgnoredFiles = (query.intValue(8) > 0);
-    rec._checksumHeader = query.baValue(9);
-    rec._e2eMangledName = query.baValue(10);
+    assignColumn(rec._checksumHeader, query.baValueView(9));
+    assignColumn(rec._e2eMangledName, query.baValueView(10));
     rec._isE2eEncrypted = query.intValue(11) > 0;
 }
 
@@ -199,7 +210,7 @@ bool SyncJournalDb::maybeMigrateDb(const QString &localPath, const QString &abso
 bool SyncJournalDb::exists()
 {
     QMutexLocker locker(&_mutex);
-    return (!_dbFile.isEmpty() && QFile::exists(_dbFile));
+    return (!_dbFile.isEmpty() && QFile::exists(openPath()));
 }
 
 QString SyncJournalDb::databaseFilePath() const
@@ -207,6 +218,17 @@ QString SyncJournalDb::databaseFilePath() const
     return _dbFile;
 }
 
+void SyncJournalDb::setDatabaseOpenPath(const QString &path)
+{
+    QMutexLocker locker(&_mutex);
+    const auto newPath = path == _dbFile ? QString() : path;
+    if (newPath == _dbOpenPath)
+        return;
+    if (_db.isOpen())
+        close();
+    _dbOpenPath = newPath;
+}
+
 // Note that this does not change the size of the -wal file, but it is supposed to make
 // the normal .db faster since the changes from the wal will be incorporated into it.
 // Then the next sync (and the SocketAPI) will have a faster access.
@@ -247,6 +269,19 @@ void SyncJournalDb::commitTransaction()
     }
 }
 
+void SyncJournalDb::rollbackTransaction()
+{
+    if (_transaction == 1) {
+        if (!_db.rollback()) {
+            qCWarning(lcDb) << "ERROR rolling back the database transaction:" << _db.error();
+        }
+        // A failed ROLLBACK means sqlite ended the transaction already
+        _transaction = 0;
+    } else {
+        qCDebug(lcDb) << "No database Transaction to roll back";
+    }
+}
+
 bool SyncJournalDb::sqlFail(const QString &log, const SqlQuery &query)
 {
     commitTransaction();
@@ -268,8 +303,8 @@ bool SyncJournalDb::checkConnect()
     if (_db.isOpen()) {
         // Unfortunately the sqlite isOpen check can return true even when the underlying storage
         // has become unavailable - and then some operations may cause crashes. See #6049
-        if (!QFile::exists(_dbFile)) {
-            qCWarning(lcDb) << "Database open, but file" << _dbFile << "does not exist";
+        if (!QFile::exists(openPath())) {
+            qCWarning(lcDb) << "Database open, but file" << openPath() << "does not exist";
             close();
             return false;
         }
@@ -282,14 +317,14 @@ bool SyncJournalDb::checkConnect()
     }
 
     // The database file is created by this call (SQLITE_OPEN_CREATE)
-    if (!_db.openOrCreateReadWrite(_dbFile)) {
+    if (!_db.openOrCreateReadWrite(openPath())) {
         QString error = _db.error();
         qCWarning(lcDb) << "Error opening the db:" << error;
         return false;
     }
 
-    if (!QFile::exists(_dbFile)) {
-        qCWarning(lcDb) << "Database file" << _dbFile << "does not exist";
+    if (!QFile::exists(openPath())) {
+        qCWarning(lcDb) << "Database file" << openPath() << "does not exist";
         return false;
     }
 
@@ -485,6 +520,14 @@ bool SyncJournalDb::checkConnect()
         return sqlFail(QStringLiteral("Create table datafingerprint"), createQuery);
     }
 
+    // create the synctoken table.
+    createQuery.prepare("CREATE TABLE IF NOT EXISTS synctoken("
+                        "token TEXT UNIQUE"
+                        ");");
+    if (!createQuery.exec()) {
+        return sqlFail(QStringLiteral("Create table synctoken"), createQuery);
+    }
+
     // create the flags table.
     createQuery.prepare("CREATE TABLE IF NOT EXISTS flags ("
                         "path TEXT PRIMARY KEY,"
@@ -624,6 +667,8 @@ void SyncJournalDb::close()
     QMutexLocker locker(&_mutex);
     qCInfo(lcDb) << "Closing DB" << _dbFile;
 
+    flushPendingFileRecordsLocked();
+
     commitTransaction();
 
     _db.close();
@@ -892,6 +937,33 @@ qint64 SyncJournalDb::getPHash(const QByteArray &file)
     return h;
 }
 
+// Number of bound parameters per row of the metadata insert statement
+static const int fileRecordColumnCount = 18;
+
+// SQLITE_MAX_VARIABLE_NUMBER defaults to 999 for sqlite versions before 3.32
+static const int maxFileRecordBatchRows = 999 / fileRecordColumnCount;
+
+static QByteArray setFileRecordSql(int rows)
+{
+    QByteArray sql = QByteArrayLiteral(
+        "INSERT OR REPLACE INTO metadata "
+        "(phash, pathlen, path, inode, uid, gid, mode, modtime, type, md5, fileid, remotePerm, filesize, ignoredChildrenRemote, contentChecksum, contentChecksumTypeId, e2eMangledName, isE2eEncrypted) "
+        "VALUES ");
+    for (int row = 0; row < rows; ++row) {
+        if (row > 0)
+            sql += ',';
+        sql += '(';
+        for (int column = 1; column <= fileRecordColumnCount; ++column) {
+            if (column > 1)
+                sql += ',';
+            sql += '?' + QByteArray::number(row * fileRecordColumnCount + column);
+        }
+        sql += ')';
+    }
+    sql += ';';
+    return sql;
+}
+
 bool SyncJournalDb::setFileRecord(const SyncJournalFileRecord &_record)
 {
     SyncJournalFileRecord record = _record;
@@ -909,71 +981,198 @@ bool SyncJournalDb::setFileRecord(const SyncJournalFileRecord &_record)
         }
     }
 
+    if (_writeBehindBatchSize > 1) {
+        qCDebug(lcDb) << "Queueing file record for path:" << record._path << "etag:" << record._etag;
+
+        auto it = _pendingFileRecordIndex.constFind(record._path);
+        if (it != _pendingFileRecordIndex.constEnd()) {
+            _pendingFileRecords[*it] = record;
+        } else {
+            if (_pendingFileRecords.isEmpty()) {
+                _pendingFileRecordsAge.start();
+                scheduleFileRecordFlush();
+            }
+            _pendingFileRecordIndex.insert(record._path, _pendingFileRecords.size());
+            _pendingFileRecords.append(record);
+        }
+
+        if (_pendingFileRecords.size() >= _writeBehindBatchSize
+            || _pendingFileRecordsAge.hasExpired(_writeBehindMaxAge.count())) {
+            return flushPendingFileRecordsLocked();
+        }
+        return true;
+    }
+
     qCInfo(lcDb) << "Updating file record for path:" << record._path << "inode:" << record._inode
                  << "modtime:" << record._modtime << "type:" << record._type
                  << "etag:" << record._etag << "fileId:" << record._fileId << "remotePerm:" << record._remotePerm.toString()
                  << "fileSize:" << record._fileSize << "checksum:" << record._checksumHeader
                  << "e2eMangledName:" << record._e2eMangledName << "isE2eEncrypted:" << record._isE2eEncrypted;
 
-    qlonglong phash = getPHash(record._path);
-    if (checkConnect()) {
-        int plen = record._path.length();
-
-        QByteArray etag(record._etag);
-        if (etag.isEmpty())
-            etag = "";
-        QByteArray fileId(record._fileId);
-        if (fileId.isEmpty())
-            fileId = "";
-        QByteArray remotePerm = record._remotePerm.toDbValue();
-        QByteArray checksumType, checksum;
-        parseChecksumHeader(record._checksumHeader, &checksumType, &checksum);
-        int contentChecksumTypeId = mapChecksumType(checksumType);
-
-        if (!_setFileRecordQuery.initOrReset(QByteArrayLiteral(
-            "INSERT OR REPLACE INTO metadata "
-            "(phash, pathlen, path, inode, uid, gid, mode, modtime, type, md5, fileid, remotePerm, filesize, ignoredChildrenRemote, contentChecksum, contentChecksumTypeId, e2eMangledName, isE2eEncrypted) "
-            "VALUES (?1 , ?2, ?3 , ?4 , ?5 , ?6 , ?7,  ?8 , ?9 , ?10, ?11, ?12, ?13, ?14, ?15, ?16, ?17, ?18);"), _db)) {
+    return writeFileRecords(&record, 1);
+}
+
+bool SyncJournalDb::writeFileRecords(const SyncJournalFileRecord *records, int count)
+{
+    if (!checkConnect()) {
+        qCWarning(lcDb) << "Failed to connect database.";
+        return false; // checkConnect failed.
+    }
+
+    const int batchRows = qMin(_writeBehindBatchSize, maxFileRecordBatchRows);
+    while (count > 0) {
+        SqlQuery *query = &_setFileRecordQuery;
+        int rows = 1;
+        if (batchRows > 1 && count >= batchRows) {
+            if (_setFileRecordBatchQueryRows != batchRows) {
+                // The batch size changed, the statement has to be prepared again
+                _setFileRecordBatchQuery.finish();
+                _setFileRecordBatchQueryRows = batchRows;
+            }
+            query = &_setFileRecordBatchQuery;
+            rows = batchRows;
+        }
+        if (!query->initOrReset(setFileRecordSql(rows), _db)) {
             return false;
         }
 
-        _setFileRecordQuery.bindValue(1, phash);
-        _setFileRecordQuery.bindValue(2, plen);
-        _setFileRecordQuery.bindValue(3, record._path);
-        _setFileRecordQuery.bindValue(4, record._inode);
-        _setFileRecordQuery.bindValue(5, 0); // uid Not used
-        _setFileRecordQuery.bindValue(6, 0); // gid Not used
-        _setFileRecordQuery.bindValue(7, 0); // mode Not used
-        _setFileRecordQuery.bindValue(8, record._modtime);
-        _setFileRecordQuery.bindValue(9, record._type);
-        _setFileRecordQuery.bindValue(10, etag);
-        _setFileRecordQuery.bindValue(11, fileId);
-        _setFileRecordQuery.bindValue(12, remotePerm);
-        _setFileRecordQuery.bindValue(13, record._fileSize);
-        _setFileRecordQuery.bindValue(14, record._serverHasIgnoredFiles ? 1 : 0);
-        _setFileRecordQuery.bindValue(15, checksum);
-        _setFileRecordQuery.bindValue(16, contentChecksumTypeId);
-        _setFileRecordQuery.bindValue(17, record._e2eMangledName);
-        _setFileRecordQuery.bindValue(18, record._isE2eEncrypted);
-
-        if (!_setFileRecordQuery.exec()) {
+        for (int row = 0; row < rows; ++row) {
+            const SyncJournalFileRecord &record = records[row];
+            const int offset = row * fileRecordColumnCount;
+
+            qlonglong phash = getPHash(record._path);
+            int plen = record._path.length();
+
+            QByteArray etag(record._etag);
+            if (etag.isEmpty())
+                etag = "";
+            QByteArray fileId(record._fileId);
+            if (fileId.isEmpty())
+                fileId = "";
+            QByteArray remotePerm = record._remotePerm.toDbValue();
+            QByteArray checksumType, checksum;
+            parseChecksumHeader(record._checksumHeader, &checksumType, &checksum);
+            int contentChecksumTypeId = mapChecksumType(checksumType);
+
+            query->bindValue(offset + 1, phash);
+            query->bindValue(offset + 2, plen);
+            query->bindValue(offset + 3, record._path);
+            query->bindValue(offset + 4, record._inode);
+            query->bindValue(offset + 5, 0); // uid Not used
+            query->bindValue(offset + 6, 0); // gid Not used
+            query->bindValue(offset + 7, 0); // mode Not used
+            query->bindValue(offset + 8, record._modtime);
+            query->bindValue(offset + 9, record._type);
+            query->bindValue(offset + 10, etag);
+            query->bindValue(offset + 11, fileId);
+            query->bindValue(offset + 12, remotePerm);
+            query->bindValue(offset + 13, record._fileSize);
+            query->bindValue(offset + 14, record._serverHasIgnoredFiles ? 1 : 0);
+            query->bindValue(offset + 15, checksum);
+            query->bindValue(offset + 16, contentChecksumTypeId);
+            query->bindValue(offset + 17, record._e2eMangledName);
+            query->bindValue(offset + 18, record._isE2eEncrypted);
+        }
+
+        if (!query->exec()) {
             return false;
         }
 
-        // Can't be true anymore.
-        _metadataTableIsEmpty = false;
+        records += rows;
+        count -= rows;
+    }
+
+    // Can't be true anymore.
+    _metadataTableIsEmpty = false;
+
+    return true;
+}
 
+void SyncJournalDb::setFileRecordWriteBehind(int batchSize, std::chrono::milliseconds maxAge)
+{
+    QMutexLocker locker(&_mutex);
+    if (batchSize <= 1) {
+        // Don't leave records behind that would no longer be flushed
+        flushPendingFileRecordsLocked();
+    }
+    _writeBehindBatchSize = batchSize;
+    _writeBehindMaxAge = maxAge;
+}
+
+bool SyncJournalDb::flushPendingFileRecords()
+{
+    QMutexLocker locker(&_mutex);
+    return flushPendingFileRecordsLocked();
+}
+
+bool SyncJournalDb::flushPendingFileRecordsLocked()
+{
+    if (_pendingFileRecords.isEmpty())
         return true;
-    } else {
-        qCWarning(lcDb) << "Failed to connect database.";
-        return false; // checkConnect failed.
+
+    const int count = _pendingFileRecords.size();
+    qCInfo(lcDb) << "Writing" << count << "queued file records, oldest queued"
+                 << _pendingFileRecordsAge.elapsed() << "ms ago";
+
+    // Write the whole batch in one transaction. Keep a transaction open
+    // afterwards only if one was running before.
+    const bool hadTransaction = _transaction == 1;
+    if (!checkConnect()) {
+        qCWarning(lcDb) << "Failed to connect database, keeping" << count << "queued file records";
+        return false;
+    }
+    startTransaction();
+    // The rows are replaced, writing them again on the next attempt is harmless
+    if (!writeFileRecords(_pendingFileRecords.constData(), count)) {
+        qCWarning(lcDb) << "Failed to write" << count << "queued file records, keeping them";
+        // Drop the part of the batch that was written, unless it belongs to
+        // a transaction that ran before
+        if (!hadTransaction)
+            rollbackTransaction();
+        return false;
     }
+    commitInternal(QStringLiteral("write-behind file records"), hadTransaction);
+    _pendingFileRecords.clear();
+    _pendingFileRecordIndex.clear();
+    return true;
+}
+
+void SyncJournalDb::dropPendingFileRecordsLocked(const QByteArray &path, bool recursively)
+{
+    if (_pendingFileRecords.isEmpty())
+        return;
+    const QByteArray prefix = path + '/';
+    auto isDropped = [&](const SyncJournalFileRecord &record) {
+        return record._path == path || (recursively && (path.isEmpty() || record._path.startsWith(prefix)));
+    };
+    _pendingFileRecords.erase(std::remove_if(_pendingFileRecords.begin(), _pendingFileRecords.end(), isDropped),
+        _pendingFileRecords.end());
+    _pendingFileRecordIndex.clear();
+    for (int i = 0; i < _pendingFileRecords.size(); ++i)
+        _pendingFileRecordIndex.insert(_pendingFileRecords.at(i)._path, i);
+}
+
+void SyncJournalDb::scheduleFileRecordFlush()
+{
+    // setFileRecord() may run in any thread, the timer runs in the journal's
+    const auto delay = _writeBehindMaxAge;
+    QMetaObject::invokeMethod(this, [this, delay] {
+        QTimer::singleShot(int(delay.count()), this, [this] {
+            QMutexLocker locker(&_mutex);
+            // Try again later if the database is unavailable
+            if (!flushPendingFileRecordsLocked())
+                scheduleFileRecordFlush();
+        });
+    }, Qt::QueuedConnection);
 }
 
 // TODO: filename -> QBytearray?
 bool SyncJournalDb::deleteFileRecord(const QString &filename, bool recursively)
 {
     QMutexLocker locker(&_mutex);
+    // Queued records that can't be written right now must not come back later
+    dropPendingFileRecordsLocked(filename.toUtf8(), recursively);
+    flushPendingFileRecordsLocked();
 
     if (checkConnect()) {
         // if (!recursively) {
@@ -1013,6 +1212,13 @@ bool SyncJournalDb::getFileRecord(const QByteArray &filename, SyncJournalFileRec
     rec->_path.clear();
     Q_ASSERT(!rec->isValid());
 
+    // Records queued by write-behind are newer than anything in the db
+    auto pending = _pendingFileRecordIndex.constFind(filename);
+    if (pending != _pendingFileRecordIndex.constEnd()) {
+        *rec = _pendingFileRecords.at(*pending);
+        return true;
+    }
+
     if (_metadataTableIsEmpty)
         return true; // no error, yet nothing found (rec->isValid() == false)
 
@@ -1047,6 +1253,7 @@ bool SyncJournalDb::getFileRecord(const QByteArray &filename, SyncJournalFileRec
 bool SyncJournalDb::getFileRecordByE2eMangledName(const QString &mangledName, SyncJournalFileRecord *rec)
 {
     QMutexLocker locker(&_mutex);
+    flushPendingFileRecordsLocked();
 
     // Reset the output var in case the caller is reusing it.
     Q_ASSERT(rec);
@@ -1090,6 +1297,7 @@ bool SyncJournalDb::getFileRecordByE2eMangledName(const QString &mangledName, Sy
 bool SyncJournalDb::getFileRecordByInode(quint64 inode, SyncJournalFileRecord *rec)
 {
     QMutexLocker locker(&_mutex);
+    flushPendingFileRecordsLocked();
 
     // Reset the output var in case the caller is reusing it.
     Q_ASSERT(rec);
@@ -1122,6 +1330,7 @@ bool SyncJournalDb::getFileRecordByInode(quint64 inode, SyncJournalFileRecord *r
 bool SyncJournalDb::getFileRecordsByFileId(const QByteArray &fileId, const std::function<void(const SyncJournalFileRecord &)> &rowCallback)
 {
     QMutexLocker locker(&_mutex);
+    flushPendingFileRecordsLocked();
 
     if (fileId.isEmpty() || _metadataTableIsEmpty)
         return true; // no error, yet nothing found (rec->isValid() == false)
@@ -1137,6 +1346,7 @@ bool SyncJournalDb::getFileRecordsByFileId(const QByteArray &fileId, const std::
     if (!_getFileRecordQueryByFileId.exec())
         return false;
 
+    SyncJournalFileRecord rec;
     forever {
         auto next = _getFileRecordQueryByFileId.next();
         if (!next.ok)
@@ -1144,7 +1354,6 @@ bool SyncJournalDb::getFileRecordsByFileId(const QByteArray &fileId, const std::
         if (!next.hasData)
             break;
 
-        SyncJournalFileRecord rec;
         fillFileRecordFromGetQuery(rec, _getFileRecordQueryByFileId);
         rowCallback(rec);
     }
@@ -1155,6 +1364,7 @@ bool SyncJournalDb::getFileRecordsByFileId(const QByteArray &fileId, const std::
 bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback)
 {
     QMutexLocker locker(&_mutex);
+    flushPendingFileRecordsLocked();
 
     if (_metadataTableIsEmpty)
         return true; // no error, yet nothing found
@@ -1196,6 +1406,7 @@ bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::functio
         return false;
     }
 
+    SyncJournalFileRecord rec;
     forever {
         auto next = query->next();
         if (!next.ok)
@@ -1203,7 +1414,6 @@ bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::functio
         if (!next.hasData)
             break;
 
-        SyncJournalFileRecord rec;
         fillFileRecordFromGetQuery(rec, *query);
         rowCallback(rec);
     }
@@ -1215,6 +1425,7 @@ bool SyncJournalDb::listFilesInPath(const QByteArray& path,
                                     const std::function<void (const SyncJournalFileRecord &)>& rowCallback)
 {
     QMutexLocker locker(&_mutex);
+    flushPendingFileRecordsLocked();
 
     if (_metadataTableIsEmpty)
         return true;
@@ -1231,6 +1442,7 @@ bool SyncJournalDb::listFilesInPath(const QByteArray& path,
     if (!_listFilesInPathQuery.exec())
         return false;
 
+    SyncJournalFileRecord rec;
     forever {
         auto next = _listFilesInPathQuery.next();
         if (!next.ok)
@@ -1238,12 +1450,13 @@ bool SyncJournalDb::listFilesInPath(const QByteArray& path,
         if (!next.hasData)
             break;
 
-        SyncJournalFileRecord rec;
-        fillFileRecordFromGetQuery(rec, _listFilesInPathQuery);
-        if (!rec._path.startsWith(path) || rec._path.indexOf("/", path.size() + 1) > 0) {
-            qWarning(lcDb) << "hash collision" << path << rec._path;
+        // Check for collisions before copying anything out of the row
+        const auto rowPath = _listFilesInPathQuery.baValueView(0);
+        if (!rowPath.startsWith(path) || rowPath.indexOf('/', path.size() + 1) > 0) {
+            qWarning(lcDb) << "hash collision" << path << rowPath.toByteArray();
             continue;
         }
+        fillFileRecordFromGetQuery(rec, _listFilesInPathQuery);
         rowCallback(rec);
     }
 
@@ -1274,6 +1487,7 @@ bool SyncJournalDb::updateFileRecordChecksum(const QString &filename,
     const QByteArray &contentChecksumType)
 {
     QMutexLocker locker(&_mutex);
+    flushPendingFileRecordsLocked();
 
     qCInfo(lcDb) << "Updating file checksum" << filename << contentChecksum << contentChecksumType;
 
@@ -1302,6 +1516,7 @@ bool SyncJournalDb::updateLocalMetadata(const QString &filename,
 
 {
     QMutexLocker locker(&_mutex);
+    flushPendingFileRecordsLocked();
 
     qCInfo(lcDb) << "Updating local metadata for:" << filename << modtime << size << inode;
 
@@ -1329,6 +1544,7 @@ bool SyncJournalDb::updateLocalMetadata(const QString &filename,
 Optional<SyncJournalDb::HasHydratedDehydrated> SyncJournalDb::hasHydratedOrDehydratedFiles(const QByteArray &filename)
 {
     QMutexLocker locker(&_mutex);
+    flushPendingFileRecordsLocked();
     if (!checkConnect())
         return {};
 
@@ -1657,6 +1873,7 @@ bool SyncJournalDb::deleteStaleErrorBlacklistEntries(const QSet<QString> &keep)
 void SyncJournalDb::deleteStaleFlagsEntries()
 {
     QMutexLocker locker(&_mutex);
+    flushPendingFileRecordsLocked();
     if (!checkConnect())
         return;
 
@@ -1887,6 +2104,7 @@ void SyncJournalDb::setSelectiveSyncList(SyncJournalDb::SelectiveSyncListType ty
 void SyncJournalDb::avoidRenamesOnNextSync(const QByteArray &path)
 {
     QMutexLocker locker(&_mutex);
+    flushPendingFileRecordsLocked();
 
     if (!checkConnect()) {
         return;
@@ -1905,6 +2123,7 @@ void SyncJournalDb::avoidRenamesOnNextSync(const QByteArray &path)
 void SyncJournalDb::schedulePathForRemoteDiscovery(const QByteArray &fileName)
 {
     QMutexLocker locker(&_mutex);
+    flushPendingFileRecordsLocked();
 
     if (!checkConnect()) {
         return;
@@ -1926,6 +2145,8 @@ void SyncJournalDb::schedulePathForRemoteDiscovery(const QByteArray &fileName)
     // parent folders for this sync
     argument.append('/');
     _etagStorageFilter.append(argument);
+
+    invalidateSyncTokenLocked();
 }
 
 void SyncJournalDb::clearEtagStorageFilter()
@@ -1936,6 +2157,7 @@ void SyncJournalDb::clearEtagStorageFilter()
 void SyncJournalDb::forceRemoteDiscoveryNextSync()
 {
     QMutexLocker locker(&_mutex);
+    flushPendingFileRecordsLocked();
 
     if (!checkConnect()) {
         return;
@@ -1950,6 +2172,16 @@ void SyncJournalDb::forceRemoteDiscoveryNextSyncLocked()
     SqlQuery deleteRemoteFolderEtagsQuery(_db);
     deleteRemoteFolderEtagsQuery.prepare("UPDATE metadata SET md5='_invalid_' WHERE type=2;");
     deleteRemoteFolderEtagsQuery.exec();
+
+    invalidateSyncTokenLocked();
+}
+
+void SyncJournalDb::invalidateSyncTokenLocked()
+{
+    _syncTokenInvalidations.ref();
+    SqlQuery query(_db);
+    query.prepare("DELETE FROM synctoken;");
+    query.exec();
 }
 
 
@@ -2049,6 +2281,46 @@ void SyncJournalDb::setDataFingerprint(const QByteArray &dataFingerprint)
     _setDataFingerprintQuery2.exec();
 }
 
+QByteArray SyncJournalDb::syncToken()
+{
+    QMutexLocker locker(&_mutex);
+    if (!checkConnect()) {
+        return QByteArray();
+    }
+
+    if (!_getSyncTokenQuery.initOrReset(QByteArrayLiteral("SELECT token FROM synctoken"), _db))
+        return QByteArray();
+
+    if (!_getSyncTokenQuery.exec()) {
+        return QByteArray();
+    }
+
+    if (!_getSyncTokenQuery.next().hasData) {
+        return QByteArray();
+    }
+    return _getSyncTokenQuery.baValue(0);
+}
+
+void SyncJournalDb::setSyncToken(const QByteArray &syncToken)
+{
+    QMutexLocker locker(&_mutex);
+    if (!checkConnect()) {
+        return;
+    }
+
+    if (!_setSyncTokenQuery1.initOrReset(QByteArrayLiteral("DELETE FROM synctoken;"), _db)
+        || !_setSyncTokenQuery2.initOrReset(QByteArrayLiteral("INSERT INTO synctoken (token) VALUES (?1);"), _db)) {
+        return;
+    }
+
+    _setSyncTokenQuery1.exec();
+
+    if (syncToken.isEmpty())
+        return;
+    _setSyncTokenQuery2.bindValue(1, syncToken);
+    _setSyncTokenQuery2.exec();
+}
+
 void SyncJournalDb::setConflictRecord(const ConflictRecord &record)
 {
     QMutexLocker locker(&_mutex);
@@ -2139,14 +2411,19 @@ QByteArray SyncJournalDb::conflictFileBaseName(const QByteArray &conflictName)
 void SyncJournalDb::clearFileTable()
 {
     QMutexLocker lock(&_mutex);
+    _pendingFileRecords.clear();
+    _pendingFileRecordIndex.clear();
     SqlQuery query(_db);
     query.prepare("DELETE FROM metadata;");
     query.exec();
+
+    invalidateSyncTokenLocked();
 }
 
 void SyncJournalDb::markVirtualFileForDownloadRecursively(const QByteArray &path)
 {
     QMutexLocker lock(&_mutex);
+    flushPendingFileRecordsLocked();
     if (!checkConnect())
         return;
 
@@ -2164,6 +2441,8 @@ void SyncJournalDb::markVirtualFileForDownloadRecursively(const QByteArray &path
                   "(" IS_PREFIX_PATH_OF("?1", "path") " OR ?1 == '' OR " IS_PREFIX_PATH_OR_EQUAL("path", "?1") ") AND type == 2;");
     query.bindValue(1, path);
     query.exec();
+
+    invalidateSyncTokenLocked();
 }
 
 Optional<PinState> SyncJournalDb::PinStateInterface::rawForPath(const QByteArray &path)
@@ -2320,6 +2599,10 @@ SyncJournalDb::PinStateInterface SyncJournalDb::internalPinStates()
 void SyncJournalDb::commit(const QString &context, bool startTrans)
 {
     QMutexLocker lock(&_mutex);
+    // Committing without a follow-up transaction marks the end of a sync run,
+    // that's when queued file records must reach the disk.
+    if (!startTrans)
+        flushPendingFileRecordsLocked();
     commitInternal(context, startTrans);
 }
 
@@ -20,9 +20,13 @@
 #define SYNCJOURNALDB_H
 
 #include <QObject>
+#include <QAtomicInt>
 #include <qmutex.h>
 #include <QDateTime>
 #include <QHash>
+#include <QElapsedTimer>
+#include <QVector>
+#include <chrono>
 #include <functional>
 
 #include "common/utility.h"
@@ -66,6 +70,24 @@ public:
     bool listFilesInPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback);
     bool setFileRecord(const SyncJournalFileRecord &record);
 
+    /**
+     * Configures write-behind for setFileRecord().
+     *
+     * With a batchSize above 1, setFileRecord() only queues the record in memory.
+     * The queue is written with a multi-row statement in its own transaction once
+     * batchSize records are pending or the oldest pending record is older than
+     * maxAge, then also by a timer in the journal's thread. getFileRecord() sees
+     * queued records, every other metadata query flushes the queue first. Records
+     * that fail to be written stay queued for the next attempt.
+     *
+     * A crash loses at most one batch; the next sync rediscovers those items.
+     * A batchSize of 0 or 1 disables write-behind, which is the default.
+     */
+    void setFileRecordWriteBehind(int batchSize, std::chrono::milliseconds maxAge = std::chrono::seconds(1));
+
+    /** Writes all file records queued by write-behind to the database. */
+    bool flushPendingFileRecords();
+
     bool deleteFileRecord(const QString &filename, bool recursively = false);
     bool updateFileRecordChecksum(const QString &filename,
         const QByteArray &contentChecksum,
@@ -88,6 +110,14 @@ public:
 
     QString databaseFilePath() const;
 
+    /** Opens the database file through \a path instead of databaseFilePath()
+     *
+     * It's the same file, reached in another way, see Vfs::underlyingPath().
+     * Closes the database if the path changes, an empty path goes back to
+     * databaseFilePath().
+     */
+    void setDatabaseOpenPath(const QString &path);
+
     static qint64 getPHash(const QByteArray &);
 
     void setErrorBlacklistEntry(const SyncJournalErrorBlacklistRecord &item);
@@ -231,6 +261,23 @@ public:
     void setDataFingerprint(const QByteArray &dataFingerprint);
     QByteArray dataFingerprint();
 
+    /**
+     * The server sync token (RFC 6578) of the last sync that saw all remote changes.
+     *
+     * Used for incremental remote discovery. It is cleared whenever parts of the
+     * tree are scheduled for remote discovery, since the changes reported by the
+     * server would not cover those.
+     */
+    void setSyncToken(const QByteArray &syncToken);
+    QByteArray syncToken();
+
+    /**
+     * Increases every time the sync token is cleared because of a scheduled
+     * remote discovery. A sync run must not store the token it got from the
+     * server if this changed while it was running.
+     */
+    int syncTokenInvalidations() const { return _syncTokenInvalidations.loadAcquire(); }
+
 
     // Conflict record functions
 
@@ -373,19 +420,35 @@ private:
     void commitInternal(const QString &context, bool startTrans = true);
     void startTransaction();
     void commitTransaction();
+    void rollbackTransaction();
     QVector<QByteArray> tableColumns(const QByteArray &table);
     bool checkConnect();
 
+    // The non-locking parts of setFileRecord() and flushPendingFileRecords()
+    bool writeFileRecords(const SyncJournalFileRecord *records, int count);
+    bool flushPendingFileRecordsLocked();
+    // Removes the queued records of path, and below it if recursively
+    void dropPendingFileRecordsLocked(const QByteArray &path, bool recursively);
+    // Flushes the queue after _writeBehindMaxAge even if no more records come in
+    void scheduleFileRecordFlush();
+
     // Same as forceRemoteDiscoveryNextSync but without acquiring the lock
     void forceRemoteDiscoveryNextSyncLocked();
 
+    // Drops the sync token, see syncTokenInvalidations()
+    void invalidateSyncTokenLocked();
+
     // Returns the integer id of the checksum type
     //
     // Returns 0 on failure and for empty checksum types.
     int mapChecksumType(const QByteArray &checksumType);
 
+    /// The path the database file is opened through
+    QString openPath() const { return _dbOpenPath.isEmpty() ? _dbFile : _dbOpenPath; }
+
     SqlDatabase _db;
     QString _dbFile;
+    QString _dbOpenPath; // see setDatabaseOpenPath()
     QMutex _mutex; // Public functions are protected with the mutex.
     QMap<QByteArray, int> _checksymTypeCache;
     int _transaction;
@@ -399,6 +462,8 @@ private:
     SqlQuery _getAllFilesQuery;
     SqlQuery _listFilesInPathQuery;
     SqlQuery _setFileRecordQuery;
+    SqlQuery _setFileRecordBatchQuery;
+    int _setFileRecordBatchQueryRows = 0;
     SqlQuery _setFileRecordChecksumQuery;
     SqlQuery _setFileRecordLocalMetadataQuery;
     SqlQuery _getDownloadInfoQuery;
@@ -418,6 +483,9 @@ private:
     SqlQuery _getDataFingerprintQuery;
     SqlQuery _setDataFingerprintQuery1;
     SqlQuery _setDataFingerprintQuery2;
+    SqlQuery _getSyncTokenQuery;
+    SqlQuery _setSyncTokenQuery1;
+    SqlQuery _setSyncTokenQuery2;
     SqlQuery _getConflictRecordQuery;
     SqlQuery _setConflictRecordQuery;
     SqlQuery _deleteConflictRecordQuery;
@@ -443,12 +511,25 @@ private:
      */
     QList<QByteArray> _etagStorageFilter;
 
+    QAtomicInt _syncTokenInvalidations;
+
     /** The journal mode to use for the db.
      *
      * Typically WAL initially, but may be set to other modes via environment
      * variable, for specific filesystems, or when WAL fails in a particular way.
      */
     QByteArray _journalMode;
+
+    /* File records queued by setFileRecord() in write-behind mode.
+     *
+     * _pendingFileRecordIndex maps a path to its index in _pendingFileRecords
+     * so repeated updates of the same path replace the queued entry.
+     */
+    QVector<SyncJournalFileRecord> _pendingFileRecords;
+    QHash<QByteArray, int> _pendingFileRecordIndex;
+    QElapsedTimer _pendingFileRecordsAge;
+    int _writeBehindBatchSize = 0;
+    std::chrono::milliseconds _writeBehindMaxAge = std::chrono::seconds(1);
 };
 
 bool OCSYNC_EXPORT
@@ -22,6 +22,7 @@
 
 #include "common/filesystembase.h"
 
+#include <QFileInfo>
 #include <QPluginLoader>
 #include <QLoggingCategory>
 
@@ -55,6 +56,8 @@ QString Vfs::modeToString(Mode mode)
         return QStringLiteral("wincfapi");
     case XAttr:
         return QStringLiteral("xattr");
+    case Fuse:
+        return QStringLiteral("fuse");
     }
     return QStringLiteral("off");
 }
@@ -68,6 +71,8 @@ Optional<Vfs::Mode> Vfs::modeFromString(const QString &str)
         return WithSuffix;
     } else if (str == QLatin1String("wincfapi")) {
         return WindowsCfApi;
+    } else if (str == QLatin1String("fuse")) {
+        return Fuse;
     }
     return {};
 }
@@ -149,6 +154,8 @@ static QString modeToPluginName(Vfs::Mode mode)
         return QStringLiteral("win");
     if (mode == Vfs::XAttr)
         return QStringLiteral("xattr");
+    if (mode == Vfs::Fuse)
+        return QStringLiteral("fuse");
     return QString();
 }
 
@@ -177,6 +184,15 @@ Vfs::Mode OCC::bestAvailableVfsMode()
         return Vfs::WindowsCfApi;
     }
 
+#ifdef Q_OS_LINUX
+    // The FUSE backend is experimental and only used when asked for explicitly,
+    // and only where the session may mount
+    static const bool fuseRequested = qgetenv("OWNCLOUD_VFS_FUSE") == "1";
+    if (fuseRequested && isVfsPluginAvailable(Vfs::Fuse) && QFileInfo(QStringLiteral("/dev/fuse")).isWritable()) {
+        return Vfs::Fuse;
+    }
+#endif
+
     if (isVfsPluginAvailable(Vfs::WithSuffix)) {
         return Vfs::WithSuffix;
     }
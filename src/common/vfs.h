@@ -96,6 +96,7 @@ public:
         WithSuffix,
         WindowsCfApi,
         XAttr,
+        Fuse,
     };
     Q_ENUM(Mode)
     static QString modeToString(Mode mode);
@@ -140,6 +141,14 @@ public:
     /// Deregister the folder with the sync provider, like when a folder is removed.
     virtual void unregisterFolder() = 0;
 
+    /** The path the client itself reaches \a path in the sync folder through
+     *
+     * Usually \a path. Plugins that mount over the sync folder return a path
+     * that bypasses the mount: the sync engine and the journal must not depend
+     * on the plugin's handlers, which may wait for them.
+     */
+    virtual QString underlyingPath(const QString &path) const { return path; }
+
 
     /** Whether the socket api should show pin state options
      *
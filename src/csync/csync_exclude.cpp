@@ -242,17 +242,23 @@ ExcludedFiles::~ExcludedFiles() = default;
 
 void ExcludedFiles::addExcludeFilePath(const QString &path)
 {
+    QMutexLocker locker(&_mutex);
     _excludeFiles[_localPath].append(path);
 }
 
 void ExcludedFiles::addInTreeExcludeFilePath(const QString &path)
 {
+    QMutexLocker locker(&_mutex);
     BasePathString basePath = leftIncludeLast(path, QLatin1Char('/'));
-    _excludeFiles[basePath].append(path);
+    auto &files = _excludeFiles[basePath];
+    // Traversal may check a directory more than once
+    if (!files.contains(path))
+        files.append(path);
 }
 
 void ExcludedFiles::setExcludeConflictFiles(bool onoff)
 {
+    QMutexLocker locker(&_mutex);
     _excludeConflictFiles = onoff;
 }
 
@@ -263,6 +269,7 @@ void ExcludedFiles::addManualExclude(const QString &expr)
 
 void ExcludedFiles::addManualExclude(const QString &expr, const QString &basePath)
 {
+    QMutexLocker locker(&_mutex);
     Q_ASSERT(basePath.endsWith(QLatin1Char('/')));
 
     auto key = basePath;
@@ -273,23 +280,27 @@ void ExcludedFiles::addManualExclude(const QString &expr, const QString &basePat
 
 void ExcludedFiles::clearManualExcludes()
 {
+    QMutexLocker locker(&_mutex);
     _manualExcludes.clear();
     reloadExcludeFiles();
 }
 
 void ExcludedFiles::setWildcardsMatchSlash(bool onoff)
 {
+    QMutexLocker locker(&_mutex);
     _wildcardsMatchSlash = onoff;
     prepare();
 }
 
 void ExcludedFiles::setClientVersion(ExcludedFiles::Version version)
 {
+    QMutexLocker locker(&_mutex);
     _clientVersion = version;
 }
 
 bool ExcludedFiles::loadExcludeFile(const QString &basePath, const QString & file)
 {
+    QMutexLocker locker(&_mutex);
     QFile f(file);
     if (!f.open(QIODevice::ReadOnly))
         return false;
@@ -318,6 +329,7 @@ bool ExcludedFiles::loadExcludeFile(const QString &basePath, const QString & fil
 
 bool ExcludedFiles::reloadExcludeFiles()
 {
+    QMutexLocker locker(&_mutex);
     _allExcludes.clear();
     // clear all regex
     _bnameTraversalRegexFile.clear();
@@ -375,6 +387,7 @@ bool ExcludedFiles::isExcluded(
     const QString &basePath,
     bool excludeHidden) const
 {
+    QMutexLocker locker(&_mutex);
     if (!filePath.startsWith(basePath, Utility::fsCasePreserving() ? Qt::CaseInsensitive : Qt::CaseSensitive)) {
         // Mark paths we're not responsible for as excluded...
         return true;
@@ -413,6 +426,7 @@ bool ExcludedFiles::isExcluded(
 
 CSYNC_EXCLUDE_TYPE ExcludedFiles::traversalPatternMatch(const QString &path, ItemType filetype)
 {
+    QMutexLocker locker(&_mutex);
     auto match = _csync_excluded_common(path, _excludeConflictFiles);
     if (match != CSYNC_NOT_EXCLUDED)
         return match;
@@ -444,9 +458,13 @@ CSYNC_EXCLUDE_TYPE ExcludedFiles::traversalPatternMatch(const QString &path, Ite
         QRegularExpressionMatch m;
         if (filetype == ItemTypeDirectory
             && _bnameTraversalRegexDir.contains(basePath)) {
+            if (!_bnameFilterDir[basePath].mayMatch(bnameStr))
+                return CSYNC_NOT_EXCLUDED;
             m = _bnameTraversalRegexDir[basePath].match(bnameStr);
         } else if (filetype == ItemTypeFile
             && _bnameTraversalRegexFile.contains(basePath)) {
+            if (!_bnameFilterFile[basePath].mayMatch(bnameStr))
+                return CSYNC_NOT_EXCLUDED;
             m = _bnameTraversalRegexFile[basePath].match(bnameStr);
         } else {
             continue;
@@ -487,6 +505,19 @@ CSYNC_EXCLUDE_TYPE ExcludedFiles::traversalPatternMatch(const QString &path, Ite
     return CSYNC_NOT_EXCLUDED;
 }
 
+static bool anyComponentMayMatch(const ExcludeBnameFilter &filter, const QString &path)
+{
+    int start = 0;
+    while (true) {
+        const int end = path.indexOf(QLatin1Char('/'), start);
+        if (filter.mayMatch(path.midRef(start, end < 0 ? -1 : end - start)))
+            return true;
+        if (end < 0)
+            return false;
+        start = end + 1;
+    }
+}
+
 CSYNC_EXCLUDE_TYPE ExcludedFiles::fullPatternMatch(const QString &p, ItemType filetype) const
 {
     auto match = _csync_excluded_common(p, _excludeConflictFiles);
@@ -504,6 +535,14 @@ CSYNC_EXCLUDE_TYPE ExcludedFiles::fullPatternMatch(const QString &p, ItemType fi
     QString basePath(_localPath + path);
     while (basePath.size() > _localPath.size()) {
         basePath = leftIncludeLast(basePath, QLatin1Char('/'));
+        // Every match of the full regex ends at a path component that the
+        // bname filter accepts, unless wildcards or [...] can match a /.
+        if (!_wildcardsMatchSlash && _bnameFilterDir.contains(basePath)) {
+            const auto &filter = _bnameFilterDir[basePath];
+            if (!filter.hasBracketExpressions() && !anyComponentMayMatch(filter, p))
+                continue;
+        }
+
         QRegularExpressionMatch m;
         if (filetype == ItemTypeDirectory
             && _fullRegexDir.contains(basePath)) {
@@ -658,6 +697,155 @@ QString ExcludedFiles::extractBnameTrigger(const QString &exclude, bool wildcard
     return pattern;
 }
 
+ExcludeBnameFilter::ExcludeBnameFilter(Qt::CaseSensitivity cs)
+    : _cs(cs)
+    , _prefixTrie(1)
+    , _suffixTrie(1)
+{
+}
+
+void ExcludeBnameFilter::addPattern(const QString &pattern)
+{
+    // Split the pattern into literal runs and wildcards, following the
+    // translation done in ExcludedFiles::convertToRegexpSyntax().
+    QStringList literals{ QString() };
+    const auto len = pattern.size();
+    for (int i = 0; i < len; ++i) {
+        const QChar c = pattern[i];
+        if (c == QLatin1Char('*') || c == QLatin1Char('?')) {
+            literals.append(QString());
+            continue;
+        }
+        if (c == QLatin1Char('[')) {
+            auto j = i + 1;
+            for (; j < len; ++j) {
+                if (pattern[j] == QLatin1Char(']'))
+                    break;
+                if (j != len - 1 && pattern[j] == QLatin1Char('\\') && pattern[j + 1] == QLatin1Char(']'))
+                    ++j;
+            }
+            if (j != len) {
+                // A bracket expression matches a single character, like ?
+                _hasBracketExpressions = true;
+                literals.append(QString());
+                i = j;
+                continue;
+            }
+        } else if (c == QLatin1Char('\\') && i != len - 1) {
+            const QChar next = pattern[i + 1];
+            if (next != QLatin1Char('*') && next != QLatin1Char('?') && next != QLatin1Char('[') && next != QLatin1Char('\\'))
+                literals.last().append(c);
+            literals.last().append(next);
+            ++i;
+            continue;
+        }
+        literals.last().append(c);
+    }
+
+    Pattern compiled;
+    compiled.exact = literals.size() == 1;
+    compiled.prefix = literals.first();
+    compiled.suffix = compiled.exact ? QString() : literals.last();
+    for (int i = 1; i < literals.size() - 1; ++i) {
+        if (literals[i].size() > compiled.infix.size())
+            compiled.infix = literals[i];
+    }
+
+    const int index = static_cast<int>(_patterns.size());
+    _patterns.push_back(compiled);
+    if (!compiled.prefix.isEmpty() || compiled.exact) {
+        _prefixTrie[insert(_prefixTrie, compiled.prefix, false)].patterns.push_back(index);
+    } else if (!compiled.suffix.isEmpty()) {
+        _suffixTrie[insert(_suffixTrie, compiled.suffix, true)].patterns.push_back(index);
+    } else {
+        _unanchored.push_back(index);
+    }
+}
+
+ushort ExcludeBnameFilter::fold(QChar c) const
+{
+    return _cs == Qt::CaseSensitive ? c.unicode() : c.toCaseFolded().unicode();
+}
+
+int ExcludeBnameFilter::child(const std::vector<Node> &trie, int node, ushort c) const
+{
+    for (const auto &edge : trie[node].children) {
+        if (edge.first == c)
+            return edge.second;
+    }
+    return -1;
+}
+
+int ExcludeBnameFilter::insert(std::vector<Node> &trie, const QString &key, bool reverse)
+{
+    int node = 0;
+    for (int i = 0; i < key.size(); ++i) {
+        const ushort c = fold(key[reverse ? key.size() - 1 - i : i]);
+        int next = child(trie, node, c);
+        if (next < 0) {
+            next = static_cast<int>(trie.size());
+            trie[node].children.emplace_back(c, next);
+            trie.emplace_back();
+        }
+        node = next;
+    }
+    return node;
+}
+
+bool ExcludeBnameFilter::verify(const Pattern &pattern, const QStringRef &bname) const
+{
+    // The anchor that led here has already been compared
+    if (pattern.exact)
+        return bname.size() == pattern.prefix.size();
+    const auto middle = bname.size() - pattern.prefix.size() - pattern.suffix.size();
+    if (middle < 0)
+        return false;
+    if (!bname.endsWith(pattern.suffix, _cs) || !bname.startsWith(pattern.prefix, _cs))
+        return false;
+    return pattern.infix.isEmpty()
+        || bname.mid(pattern.prefix.size(), middle).contains(pattern.infix, _cs);
+}
+
+bool ExcludeBnameFilter::mayMatch(const QStringRef &bname) const
+{
+    // $ also matches before a trailing newline, leave that to the regex
+    if (bname.endsWith(QLatin1Char('\n')))
+        return true;
+    if (_cs == Qt::CaseInsensitive) {
+        // Case folding outside of the BMP is left to the regex as well
+        for (const QChar c : bname) {
+            if (c.isSurrogate())
+                return true;
+        }
+    }
+
+    for (int index : _unanchored) {
+        if (verify(_patterns[index], bname))
+            return true;
+    }
+
+    int node = 0;
+    for (int i = 0;; ++i) {
+        for (int index : _prefixTrie[node].patterns) {
+            if (verify(_patterns[index], bname))
+                return true;
+        }
+        if (i == bname.size() || (node = child(_prefixTrie, node, fold(bname.at(i)))) < 0)
+            break;
+    }
+
+    node = 0;
+    for (int i = bname.size() - 1;; --i) {
+        for (int index : _suffixTrie[node].patterns) {
+            if (verify(_patterns[index], bname))
+                return true;
+        }
+        if (i < 0 || (node = child(_suffixTrie, node, fold(bname.at(i)))) < 0)
+            break;
+    }
+    return false;
+}
+
 void ExcludedFiles::prepare()
 {
     // clear all regex
@@ -667,6 +855,8 @@ void ExcludedFiles::prepare()
     _fullTraversalRegexDir.clear();
     _fullRegexFile.clear();
     _fullRegexDir.clear();
+    _bnameFilterFile.clear();
+    _bnameFilterDir.clear();
 
     const auto keys = _allExcludes.keys();
     for (auto const & basePath : keys)
@@ -711,6 +901,10 @@ void ExcludedFiles::prepare(const BasePathString & basePath)
     QString bnameTriggerFileDir;
     QString bnameTriggerDir;
 
+    const auto caseSensitivity = OCC::Utility::fsCasePreserving() ? Qt::CaseInsensitive : Qt::CaseSensitive;
+    ExcludeBnameFilter bnameFilterFile(caseSensitivity);
+    ExcludeBnameFilter bnameFilterDir(caseSensitivity);
+
     auto regexAppend = [](QString &fileDirPattern, QString &dirPattern, const QString &appendMe, bool dirOnly) {
         QString &pattern = dirOnly ? dirPattern : fileDirPattern;
         if (!pattern.isEmpty())
@@ -752,6 +946,9 @@ void ExcludedFiles::prepare(const BasePathString & basePath)
         auto regexExclude = convertToRegexpSyntax(exclude, _wildcardsMatchSlash);
         if (!fullPath) {
             regexAppend(bnameFileDir, bnameDir, regexExclude, matchDirOnly);
+            if (!matchDirOnly)
+                bnameFilterFile.addPattern(exclude);
+            bnameFilterDir.addPattern(exclude);
         } else {
             regexAppend(fullFileDir, fullDir, regexExclude, matchDirOnly);
 
@@ -759,6 +956,9 @@ void ExcludedFiles::prepare(const BasePathString & basePath)
             QString bnameExclude = extractBnameTrigger(exclude, _wildcardsMatchSlash);
             auto regexBname = convertToRegexpSyntax(bnameExclude, true);
             regexAppend(bnameTriggerFileDir, bnameTriggerDir, regexBname, matchDirOnly);
+            if (!matchDirOnly)
+                bnameFilterFile.addPattern(bnameExclude);
+            bnameFilterDir.addPattern(bnameExclude);
         }
     }
 
@@ -839,6 +1039,9 @@ void ExcludedFiles::prepare(const BasePathString & basePath)
                        "(?:^|/)(?:%7|%8)(?:$|/))")
             .arg(fullFileDirKeep, fullDirKeep, bnameFileDirKeep, bnameDirKeep, fullFileDirRemove, fullDirRemove, bnameFileDirRemove, bnameDirRemove));
 
+    _bnameFilterFile[basePath] = bnameFilterFile;
+    _bnameFilterDir[basePath] = bnameFilterDir;
+
     QRegularExpression::PatternOptions patternOptions = QRegularExpression::NoPatternOption;
     if (OCC::Utility::fsCasePreserving())
         patternOptions |= QRegularExpression::CaseInsensitiveOption;
@@ -26,11 +26,13 @@
 #include "csync.h"
 
 #include <QObject>
+#include <QMutex>
 #include <QSet>
 #include <QString>
 #include <QRegularExpression>
 
 #include <functional>
+#include <vector>
 
 enum CSYNC_EXCLUDE_TYPE {
   CSYNC_NOT_EXCLUDED   = 0,
@@ -49,6 +51,59 @@ enum CSYNC_EXCLUDE_TYPE {
 
 class ExcludedFilesTest;
 
+/**
+ * Cheap pre-check for a list of exclude patterns that are matched against a bname.
+ *
+ * The patterns are compiled into a forward trie of their literal prefixes and a
+ * reverse trie of the literal suffixes of patterns that start with a wildcard.
+ * mayMatch() walks the bname through them once and only verifies the few
+ * patterns whose anchor was reached.
+ *
+ * The check is conservative: it may report a match that the regular expression
+ * generated for the same patterns would reject, but never the other way round.
+ * Patterns without any literal anchor (like "*") make every bname a candidate.
+ */
+class OCSYNC_EXPORT ExcludeBnameFilter
+{
+public:
+    explicit ExcludeBnameFilter(Qt::CaseSensitivity cs = Qt::CaseSensitive);
+
+    /// Adds a pattern in exclude file syntax, see ExcludedFiles::convertToRegexpSyntax()
+    void addPattern(const QString &pattern);
+
+    /// False if none of the patterns can match \a bname
+    bool mayMatch(const QStringRef &bname) const;
+
+    /// Whether a pattern contains a [...] expression, those may match a /
+    bool hasBracketExpressions() const { return _hasBracketExpressions; }
+
+private:
+    struct Pattern
+    {
+        QString prefix; // literal text before the first wildcard
+        QString suffix; // literal text after the last wildcard
+        QString infix; // longest literal text between them
+        bool exact; // no wildcard at all, prefix is the whole pattern
+    };
+    struct Node
+    {
+        std::vector<std::pair<ushort, int>> children;
+        std::vector<int> patterns;
+    };
+
+    int insert(std::vector<Node> &trie, const QString &key, bool reverse);
+    int child(const std::vector<Node> &trie, int node, ushort c) const;
+    ushort fold(QChar c) const;
+    bool verify(const Pattern &pattern, const QStringRef &bname) const;
+
+    Qt::CaseSensitivity _cs;
+    std::vector<Pattern> _patterns;
+    std::vector<Node> _prefixTrie;
+    std::vector<Node> _suffixTrie;
+    std::vector<int> _unanchored;
+    bool _hasBracketExpressions = false;
+};
+
 /**
  * Manages file/directory exclusion.
  *
@@ -61,6 +116,9 @@ class ExcludedFilesTest;
  * Excluded files and ignored files are the same thing. But the
  * selective sync blacklist functionality is a different thing
  * entirely.
+ *
+ * The public functions may be called from several threads, the local
+ * discovery walker checks directories from its worker threads.
  */
 class OCSYNC_EXPORT ExcludedFiles : public QObject
 {
@@ -223,6 +281,11 @@ private:
      * Note: The traversal matcher will return not-excluded on some paths that the
      * full matcher would exclude. Example: "b" is excluded. traversal("b/c")
      * returns not-excluded because "c" isn't a bname activation pattern.
+     *
+     * Most paths match none of the patterns. Before any regex is run the bname
+     * is checked against _bnameFilterFile/_bnameFilterDir, which rejects such
+     * paths with a trie lookup. The full matcher applies the same check to each
+     * path component where that is exact enough (see fullPatternMatch()).
      */
     void prepare(const BasePathString &basePath);
 
@@ -249,6 +312,9 @@ private:
     QMap<BasePathString, QRegularExpression> _fullTraversalRegexDir;
     QMap<BasePathString, QRegularExpression> _fullRegexFile;
     QMap<BasePathString, QRegularExpression> _fullRegexDir;
+    /// Pre-checks for the bname traversal regexes, see ExcludeBnameFilter
+    QMap<BasePathString, ExcludeBnameFilter> _bnameFilterFile;
+    QMap<BasePathString, ExcludeBnameFilter> _bnameFilterDir;
 
     bool _excludeConflictFiles = true;
 
@@ -266,6 +332,9 @@ private:
      */
     Version _clientVersion;
 
+    /// Recursive since loading an in-tree exclude file goes through the public functions
+    mutable QMutex _mutex { QMutex::Recursive };
+
     friend class TestExcludedFiles;
 };
 
@@ -29,6 +29,8 @@ class Vfs;
 }
 
 csync_vio_handle_t OCSYNC_EXPORT *csync_vio_local_opendir(const QString &name);
+/* Opens the directory \a name below the open directory \a parent, which may be read or closed independently */
+csync_vio_handle_t OCSYNC_EXPORT *csync_vio_local_opendir_at(csync_vio_handle_t *parent, const QString &name);
 int OCSYNC_EXPORT csync_vio_local_closedir(csync_vio_handle_t *dhandle);
 std::unique_ptr<csync_file_stat_t> OCSYNC_EXPORT csync_vio_local_readdir(csync_vio_handle_t *dhandle, OCC::Vfs *vfs);
 
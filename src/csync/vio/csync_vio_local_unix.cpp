@@ -24,6 +24,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <dirent.h>
+#include <unistd.h>
 #include <cstdio>
 
 #include <memory>
@@ -50,6 +51,7 @@ struct csync_vio_handle_t {
 };
 
 static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf);
+static void _csync_vio_local_fill_stat(const csync_stat_t &sb, csync_file_stat_t *buf);
 
 csync_vio_handle_t *csync_vio_local_opendir(const QString &name) {
     QScopedPointer<csync_vio_handle_t> handle(new csync_vio_handle_t{});
@@ -65,6 +67,29 @@ csync_vio_handle_t *csync_vio_local_opendir(const QString &name) {
     return handle.take();
 }
 
+csync_vio_handle_t *csync_vio_local_opendir_at(csync_vio_handle_t *parent, const QString &name) {
+    QScopedPointer<csync_vio_handle_t> handle(new csync_vio_handle_t{});
+
+    auto encodedName = QFile::encodeName(name);
+
+    // Relative to the already open parent, the kernel doesn't resolve the
+    // whole path again. Don't follow symlinks that replaced the directory.
+    const int fd = openat(dirfd(parent->dh), encodedName.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1) {
+        return nullptr;
+    }
+    handle->dh = fdopendir(fd);
+    if (!handle->dh) {
+        const int error = errno;
+        close(fd);
+        errno = error;
+        return nullptr;
+    }
+
+    handle->path = parent->path % '/' % encodedName;
+    return handle.take();
+}
+
 int csync_vio_local_closedir(csync_vio_handle_t *dhandle) {
     Q_ASSERT(dhandle);
     auto rc = _tclosedir(dhandle->dh);
@@ -85,9 +110,8 @@ std::unique_ptr<csync_file_stat_t> csync_vio_local_readdir(csync_vio_handle_t *h
 
   file_stat = std::make_unique<csync_file_stat_t>();
   file_stat->path = QFile::decodeName(dirent->d_name).toUtf8();
-  QByteArray fullPath = handle->path % '/' % QByteArray() % const_cast<const char *>(dirent->d_name);
   if (file_stat->path.isNull()) {
-      file_stat->original_path = fullPath;
+      file_stat->original_path = handle->path % '/' % QByteArray() % const_cast<const char *>(dirent->d_name);
       qCWarning(lcCSyncVIOLocal) << "Invalid characters in file/directory name, please rename:" << dirent->d_name << handle->path;
   }
 
@@ -115,9 +139,13 @@ std::unique_ptr<csync_file_stat_t> csync_vio_local_readdir(csync_vio_handle_t *h
   if (file_stat->path.isNull())
       return file_stat;
 
-  if (_csync_vio_local_stat_mb(fullPath.constData(), file_stat.get()) < 0) {
+  // Stat relative to the directory, not through the full path
+  csync_stat_t sb;
+  if (fstatat(dirfd(handle->dh), dirent->d_name, &sb, AT_SYMLINK_NOFOLLOW) < 0) {
       // Will get excluded by _csync_detect_update.
       file_stat->type = ItemTypeSkip;
+  } else {
+      _csync_vio_local_fill_stat(sb, file_stat.get());
   }
 
   // Override type for virtual files if desired
@@ -144,6 +172,12 @@ static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf
         return -1;
     }
 
+    _csync_vio_local_fill_stat(sb, buf);
+    return 0;
+}
+
+static void _csync_vio_local_fill_stat(const csync_stat_t &sb, csync_file_stat_t *buf)
+{
     switch (sb.st_mode & S_IFMT) {
     case S_IFDIR:
       buf->type = ItemTypeDirectory;
@@ -169,5 +203,4 @@ static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf
   buf->inode = sb.st_ino;
   buf->modtime = sb.st_mtime;
   buf->size = sb.st_size;
-  return 0;
 }
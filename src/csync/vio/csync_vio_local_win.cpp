@@ -50,6 +50,7 @@ struct csync_vio_handle_t {
   HANDLE hFind;
   int firstFind;
   QString path; // Always ends with '\'
+  QString name; // As passed to csync_vio_local_opendir()
 };
 
 static int _csync_vio_local_stat_mb(const mbchar_t *uri, csync_file_stat_t *buf);
@@ -77,9 +78,14 @@ csync_vio_handle_t *csync_vio_local_opendir(const QString &name) {
 
     dirname.chop(1); // remove the *
     handle->path = std::move(dirname);
+    handle->name = name;
     return handle.take();
 }
 
+csync_vio_handle_t *csync_vio_local_opendir_at(csync_vio_handle_t *parent, const QString &name) {
+    return csync_vio_local_opendir(parent->name + QLatin1Char('/') + name);
+}
+
 int csync_vio_local_closedir(csync_vio_handle_t *dhandle) {
     Q_ASSERT(dhandle);
     int rc = -1;
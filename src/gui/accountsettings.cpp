@@ -952,11 +952,9 @@ void AccountSettings::slotForceSyncCurrentFolder()
     FolderMan *folderMan = FolderMan::instance();
     if (auto selectedFolder = folderMan->folder(selectedFolderAlias())) {
         // Terminate and reschedule any running sync
-        for (auto f : folderMan->map()) {
-            if (f->isSyncRunning()) {
-                f->slotTerminateSync();
-                folderMan->scheduleFolder(f);
-            }
+        for (auto f : folderMan->currentSyncFolders()) {
+            f->slotTerminateSync();
+            folderMan->scheduleFolder(f);
         }
 
         selectedFolder->slotWipeErrorBlacklist(); // issue #6757
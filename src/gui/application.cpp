@@ -294,6 +294,8 @@ Application::Application(int &argc, char **argv)
         qCInfo(lcApplication) << "VFS windows plugin is available";
     if (isVfsPluginAvailable(Vfs::WithSuffix))
         qCInfo(lcApplication) << "VFS suffix plugin is available";
+    if (isVfsPluginAvailable(Vfs::Fuse))
+        qCInfo(lcApplication) << "VFS fuse plugin is available";
 
     _folderManager.reset(new FolderMan);
 
@@ -87,6 +87,7 @@ void HttpCredentialsGui::asyncAuthResult(OAuth::Result r, const QString &user,
     _password = token;
     _refreshToken = refreshToken;
     _ready = true;
+    updateRequestCredentials();
     persist();
     _asyncAuth.reset(nullptr);
     emit asked();
@@ -130,6 +131,7 @@ void HttpCredentialsGui::showDialog()
             _password = dialog->textValue();
             _refreshToken.clear();
             _ready = true;
+            updateRequestCredentials();
             persist();
         }
         emit asked();
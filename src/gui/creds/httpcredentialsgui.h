@@ -43,6 +43,7 @@ public:
         : HttpCredentials(user, password, clientCertBundle, clientCertPassword)
     {
         _refreshToken = refreshToken;
+        updateRequestCredentials();
     }
 
     /**
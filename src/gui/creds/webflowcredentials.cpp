@@ -35,32 +35,35 @@ namespace {
 class WebFlowCredentialsAccessManager : public AccessManager
 {
 public:
-    WebFlowCredentialsAccessManager(const WebFlowCredentials *cred, QObject *parent = nullptr)
+    WebFlowCredentialsAccessManager(std::shared_ptr<SharedRequestCredentials> cred, QObject *parent = nullptr)
         : AccessManager(parent)
-        , _cred(cred)
+        , _cred(std::move(cred))
     {
     }
 
 protected:
     QNetworkReply *createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData) override
     {
+        // May run in a sync thread while the credentials change
+        const auto cred = _cred->get();
+
         QNetworkRequest req(request);
         if (!req.attribute(WebFlowCredentials::DontAddCredentialsAttribute).toBool()) {
-            if (_cred && !_cred->password().isEmpty()) {
-                QByteArray credHash = QByteArray(_cred->user().toUtf8() + ":" + _cred->password().toUtf8()).toBase64();
+            if (!cred->password.isEmpty()) {
+                QByteArray credHash = QByteArray(cred->user.toUtf8() + ":" + cred->password.toUtf8()).toBase64();
                 req.setRawHeader("Authorization", "Basic " + credHash);
             }
         }
 
-        if (_cred && !_cred->_clientSslKey.isNull() && !_cred->_clientSslCertificate.isNull()) {
+        if (!cred->clientSslKey.isNull() && !cred->clientSslCertificate.isNull()) {
             // SSL configuration
             QSslConfiguration sslConfiguration = req.sslConfiguration();
-            sslConfiguration.setLocalCertificate(_cred->_clientSslCertificate);
-            sslConfiguration.setPrivateKey(_cred->_clientSslKey);
+            sslConfiguration.setLocalCertificate(cred->clientSslCertificate);
+            sslConfiguration.setPrivateKey(cred->clientSslKey);
 
             // Merge client side CA with system CA
             auto ca = sslConfiguration.systemCaCertificates();
-            ca.append(_cred->_clientSslCaCertificates);
+            ca.append(cred->clientSslCaCertificates);
             sslConfiguration.setCaCertificates(ca);
 
             req.setSslConfiguration(sslConfiguration);
@@ -72,7 +75,7 @@ protected:
 private:
     // The credentials object dies along with the account, while the QNAM might
     // outlive both.
-    QPointer<const WebFlowCredentials> _cred;
+    std::shared_ptr<SharedRequestCredentials> _cred;
 };
 
 #if defined(KEYCHAINCHUNK_ENABLE_INSECURE_FALLBACK)
@@ -96,7 +99,7 @@ WebFlowCredentials::WebFlowCredentials(const QString &user, const QString &passw
     , _ready(true)
     , _credentialsValid(true)
 {
-
+    updateRequestCredentials();
 }
 
 QString WebFlowCredentials::authType() const {
@@ -113,7 +116,7 @@ QString WebFlowCredentials::password() const {
 
 QNetworkAccessManager *WebFlowCredentials::createQNAM() const {
     qCInfo(lcWebFlowCredentials()) << "Get QNAM";
-    AccessManager *qnam = new WebFlowCredentialsAccessManager(this);
+    AccessManager *qnam = new WebFlowCredentialsAccessManager(_requestCredentials);
 
     connect(qnam, &AccessManager::authenticationRequired, this, &WebFlowCredentials::slotAuthentication);
     connect(qnam, &AccessManager::finished, this, &WebFlowCredentials::slotFinished);
@@ -199,6 +202,7 @@ void WebFlowCredentials::slotAskFromUserCredentialsProvided(const QString &user,
     _password = pass;
     _ready = true;
     _credentialsValid = true;
+    updateRequestCredentials();
     persist();
     emit asked();
 
@@ -394,9 +398,20 @@ void WebFlowCredentials::setAccount(Account *account) {
 
 QString WebFlowCredentials::fetchUser() {
     _user = _account->credentialSetting(userC).toString();
+    updateRequestCredentials();
     return _user;
 }
 
+void WebFlowCredentials::updateRequestCredentials() {
+    auto cred = std::make_shared<RequestCredentials>();
+    cred->user = _user;
+    cred->password = _password;
+    cred->clientSslKey = _clientSslKey;
+    cred->clientSslCertificate = _clientSslCertificate;
+    cred->clientSslCaCertificates = _clientSslCaCertificates;
+    _requestCredentials->set(std::move(cred));
+}
+
 void WebFlowCredentials::slotAuthentication(QNetworkReply *reply, QAuthenticator *authenticator) {
     Q_UNUSED(reply)
 
@@ -558,6 +573,7 @@ void WebFlowCredentials::slotReadPasswordJobDone(Job *incomingJob) {
     } else {
         _ready = false;
     }
+    updateRequestCredentials();
     emit fetched();
 
     // If keychain data was read from legacy location, wipe these entries and store new ones
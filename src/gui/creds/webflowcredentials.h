@@ -29,7 +29,6 @@ class WebFlowCredentialsDialog;
 class WebFlowCredentials : public AbstractCredentials
 {
     Q_OBJECT
-    friend class WebFlowCredentialsAccessManager;
 
 public:
     /// Don't add credentials if this is set on a QNetworkRequest
@@ -113,6 +112,9 @@ protected:
 
     QString fetchUser();
 
+    /// Hands the current user, password and client certificates to the access managers
+    void updateRequestCredentials();
+
     QString _user;
     QString _password;
     QSslKey _clientSslKey;
@@ -124,6 +126,8 @@ protected:
     bool _keychainMigration = false;
 
     WebFlowCredentialsDialog *_askDialog = nullptr;
+
+    std::shared_ptr<SharedRequestCredentials> _requestCredentials = std::make_shared<SharedRequestCredentials>();
 };
 
 } // namespace OCC
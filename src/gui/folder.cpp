@@ -27,6 +27,7 @@
 #include "syncresult.h"
 #include "clientproxy.h"
 #include "syncengine.h"
+#include "syncenginerelay.h"
 #include "syncrunfilelog.h"
 #include "socketapi.h"
 #include "theme.h"
@@ -45,6 +46,7 @@
 #include <QMessageBox>
 #include <QPushButton>
 #include <QApplication>
+#include <QThread>
 
 static const char versionC[] = "version";
 
@@ -88,22 +90,22 @@ Folder::Folder(const FolderDefinition &definition,
         qCWarning(lcFolder, "Could not read system exclude file");
 
     connect(_accountState.data(), &AccountState::isConnectedChanged, this, &Folder::canSyncChanged);
-    connect(_engine.data(), &SyncEngine::rootEtag, this, &Folder::etagRetrievedFromSyncEngine);
 
-    connect(_engine.data(), &SyncEngine::started, this, &Folder::slotSyncStarted, Qt::QueuedConnection);
-    connect(_engine.data(), &SyncEngine::finished, this, &Folder::slotSyncFinished, Qt::QueuedConnection);
+    _localDiscoveryTracker.reset(new LocalDiscoveryTracker);
 
-    connect(_engine.data(), &SyncEngine::aboutToRemoveAllFiles,
-        this, &Folder::slotAboutToRemoveAllFiles);
-    connect(_engine.data(), &SyncEngine::transmissionProgress, this, &Folder::slotTransmissionProgress);
-    connect(_engine.data(), &SyncEngine::itemCompleted,
-        this, &Folder::slotItemCompleted);
-    connect(_engine.data(), &SyncEngine::newBigFolder,
-        this, &Folder::slotNewBigFolderDiscovered);
-    connect(_engine.data(), &SyncEngine::seenLockedFile, FolderMan::instance(), &FolderMan::slotSyncOnceFileUnlocks);
-    connect(_engine.data(), &SyncEngine::aboutToPropagate,
-        this, &Folder::slotLogPropagationStart);
-    connect(_engine.data(), &SyncEngine::syncError, this, &Folder::slotSyncError);
+    bool folderSyncThreads = false;
+    QByteArray folderSyncThreadsEnv = qgetenv("OWNCLOUD_FOLDER_SYNC_THREADS");
+    if (!folderSyncThreadsEnv.isEmpty()) {
+        folderSyncThreads = folderSyncThreadsEnv != "0";
+    } else {
+        folderSyncThreads = ConfigFile().folderSyncThreads();
+    }
+    if (folderSyncThreads) {
+        startEngineThread();
+        connectEngineSignals(_engineRelay.data());
+    } else {
+        connectEngineSignals(_engine.data());
+    }
 
     _scheduleSelfTimer.setSingleShot(true);
     _scheduleSelfTimer.setInterval(SyncEngine::minimumFileAgeForUpload);
@@ -113,12 +115,6 @@ Folder::Folder(const FolderDefinition &definition,
     connect(ProgressDispatcher::instance(), &ProgressDispatcher::folderConflicts,
         this, &Folder::slotFolderConflicts);
 
-    _localDiscoveryTracker.reset(new LocalDiscoveryTracker);
-    connect(_engine.data(), &SyncEngine::finished,
-        _localDiscoveryTracker.data(), &LocalDiscoveryTracker::slotSyncFinished);
-    connect(_engine.data(), &SyncEngine::itemCompleted,
-        _localDiscoveryTracker.data(), &LocalDiscoveryTracker::slotItemCompleted);
-
     // Potentially upgrade suffix vfs to windows vfs
     ENFORCE(_vfs);
     if (_definition.virtualFilesMode == Vfs::WithSuffix
@@ -143,13 +139,71 @@ Folder::Folder(const FolderDefinition &definition,
 Folder::~Folder()
 {
     // If wipeForRemoval() was called the vfs has already shut down.
-    if (_vfs)
+    if (_vfs) {
+        // The engine may still use the journal while it aborts
+        _journal.setDatabaseOpenPath(QString());
         _vfs->stop();
+    }
 
     // Reset then engine first as it will abort and try to access members of the Folder
+    if (_engineThread)
+        stopEngineThread();
     _engine.reset();
 }
 
+template <typename Source>
+void Folder::connectEngineSignals(Source *source)
+{
+    connect(source, &Source::rootEtag, this, &Folder::etagRetrievedFromSyncEngine);
+
+    connect(source, &Source::started, this, &Folder::slotSyncStarted, Qt::QueuedConnection);
+    connect(source, &Source::finished, this, &Folder::slotSyncFinished, Qt::QueuedConnection);
+
+    connect(source, &Source::aboutToRemoveAllFiles,
+        this, &Folder::slotAboutToRemoveAllFiles);
+    connect(source, &Source::transmissionProgress, this, &Folder::slotTransmissionProgress);
+    connect(source, &Source::itemCompleted,
+        this, &Folder::slotItemCompleted);
+    connect(source, &Source::newBigFolder,
+        this, &Folder::slotNewBigFolderDiscovered);
+    connect(source, &Source::seenLockedFile, FolderMan::instance(), &FolderMan::slotSyncOnceFileUnlocks);
+    connect(source, &Source::aboutToPropagate,
+        this, &Folder::slotLogPropagationStart);
+    connect(source, &Source::syncError, this, &Folder::slotSyncError);
+
+    connect(source, &Source::finished,
+        _localDiscoveryTracker.data(), &LocalDiscoveryTracker::slotSyncFinished);
+    connect(source, &Source::itemCompleted,
+        _localDiscoveryTracker.data(), &LocalDiscoveryTracker::slotItemCompleted);
+}
+
+void Folder::startEngineThread()
+{
+    _engineRelay.reset(new SyncEngineRelay(_engine.data()));
+    _engine->syncFileStatusTracker().setRelay(_engineRelay.data());
+
+    _engineThread.reset(new QThread);
+    _engineThread->setObjectName(QStringLiteral("sync ") + alias());
+
+    _accountState->account()->addThreadNetworkAccessManager(_engineThread.data());
+
+    _engine->moveToThread(_engineThread.data());
+    _engineThread->start();
+}
+
+void Folder::stopEngineThread()
+{
+    // The engine aborts a running sync while it is deleted
+    auto engine = _engine.take();
+    auto account = _accountState->account().data();
+    QMetaObject::invokeMethod(engine, [engine, account] {
+        delete engine;
+        account->setThreadNetworkAccessManager(QThread::currentThread(), nullptr);
+        QThread::currentThread()->quit();
+    });
+    _engineThread->wait();
+}
+
 void Folder::checkLocalPath()
 {
     const QFileInfo fi(_definition.localPath);
@@ -501,6 +555,9 @@ void Folder::startVfs()
 
     _vfs->start(vfsParams);
 
+    // Not through a mount over the folder, see Vfs::underlyingPath()
+    _journal.setDatabaseOpenPath(_vfs->underlyingPath(_journal.databaseFilePath()));
+
     // Immediately mark the sqlite temporaries as excluded. They get recreated
     // on db-open and need to get marked again every time.
     QString stateDbFile = _journal.databaseFilePath();
@@ -540,10 +597,30 @@ int Folder::slotWipeErrorBlacklist()
 }
 
 void Folder::slotWatchedPathChanged(const QString &path, ChangeReason reason)
+{
+    slotWatchedPathsChanged({ path }, reason);
+}
+
+void Folder::slotWatchedPathsChanged(const QSet<QString> &paths, ChangeReason reason)
+{
+    bool changed = false;
+    for (const auto &path : paths)
+        changed |= processWatchedPathChange(path, reason);
+    if (!changed)
+        return;
+
+    _timeSinceLastLocalChange.start();
+
+    // Also schedule this folder for a sync, but only after some delay:
+    // The sync will not upload files that were changed too recently.
+    scheduleThisFolderSoon();
+}
+
+bool Folder::processWatchedPathChange(const QString &path, ChangeReason reason)
 {
     if (!path.startsWith(this->path())) {
         qCDebug(lcFolder) << "Changed path is not contained in folder, ignoring:" << path;
-        return;
+        return false;
     }
 
     auto relativePath = path.midRef(this->path().size());
@@ -566,7 +643,7 @@ void Folder::slotWatchedPathChanged(const QString &path, ChangeReason reason)
     // Use the path to figure out whether it was our own change
     if (_engine->wasFileTouched(path)) {
         qCDebug(lcFolder) << "Changed path was touched by SyncEngine, ignoring:" << path;
-        return;
+        return false;
     }
 #endif
 
@@ -590,16 +667,13 @@ void Folder::slotWatchedPathChanged(const QString &path, ChangeReason reason)
         }
         if (spurious) {
             qCInfo(lcFolder) << "Ignoring spurious notification for file" << relativePath;
-            return; // probably a spurious notification
+            return false; // probably a spurious notification
         }
     }
     warnOnNewExcludedItem(record, relativePath);
 
     emit watchedFileChangedExternally(path);
-
-    // Also schedule this folder for a sync, but only after some delay:
-    // The sync will not upload files that were changed too recently.
-    scheduleThisFolderSoon();
+    return true;
 }
 
 void Folder::implicitlyHydrateFile(const QString &relativepath)
@@ -643,8 +717,9 @@ void Folder::setVirtualFilesEnabled(bool enabled)
 
     if (newMode != _definition.virtualFilesMode) {
         // TODO: Must wait for current sync to finish!
-        SyncEngine::wipeVirtualFiles(path(), _journal, *_vfs);
+        SyncEngine::wipeVirtualFiles(_vfs->underlyingPath(path()), _journal, *_vfs);
 
+        _journal.setDatabaseOpenPath(QString());
         _vfs->stop();
         _vfs->unregisterFolder();
 
@@ -743,7 +818,7 @@ void Folder::slotTerminateSync()
     qCInfo(lcFolder) << "folder " << alias() << " Terminating!";
 
     if (_engine->isSyncRunning()) {
-        _engine->abort();
+        QMetaObject::invokeMethod(_engine.data(), [engine = _engine.data()] { engine->abort(); });
 
         setSyncState(SyncResult::SyncAbortRequested);
     }
@@ -759,7 +834,7 @@ void Folder::wipeForRemoval()
     _journal.close(); // close the sync journal
 
     // Remove db and temporaries
-    QString stateDbFile = _engine->journal()->databaseFilePath();
+    QString stateDbFile = _vfs->underlyingPath(_engine->journal()->databaseFilePath());
 
     QFile file(stateDbFile);
     if (file.exists()) {
@@ -778,6 +853,7 @@ void Folder::wipeForRemoval()
     QFile::remove(stateDbFile + "-wal");
     QFile::remove(stateDbFile + "-journal");
 
+    _journal.setDatabaseOpenPath(QString());
     _vfs->stop();
     _vfs->unregisterFolder();
     _vfs.reset(nullptr); // warning: folder now in an invalid state
@@ -895,6 +971,52 @@ void Folder::setSyncOptions()
         opt._targetChunkUploadDuration = cfgFile.targetChunkUploadDuration();
     }
 
+    QByteArray maxParallelChunksEnv = qgetenv("OWNCLOUD_MAX_PARALLEL_CHUNKS");
+    if (!maxParallelChunksEnv.isEmpty()) {
+        opt._maxParallelChunks = maxParallelChunksEnv.toInt();
+    } else {
+        opt._maxParallelChunks = cfgFile.maxParallelChunks();
+    }
+
+    QByteArray journalWriteBehindEnv = qgetenv("OWNCLOUD_JOURNAL_WRITE_BEHIND");
+    if (!journalWriteBehindEnv.isEmpty()) {
+        opt._journalWriteBehindBatchSize = journalWriteBehindEnv.toInt();
+    } else {
+        opt._journalWriteBehindBatchSize = cfgFile.journalWriteBehindBatchSize();
+    }
+    opt._journalWriteBehindInterval = cfgFile.journalWriteBehindInterval();
+
+    QByteArray downloadBufferSizeEnv = qgetenv("OWNCLOUD_DOWNLOAD_BUFFER_SIZE");
+    if (!downloadBufferSizeEnv.isEmpty()) {
+        opt._downloadBufferSize = downloadBufferSizeEnv.toLongLong();
+    } else {
+        opt._downloadBufferSize = cfgFile.downloadBufferSize();
+    }
+
+    QByteArray remoteSubtreeListingEnv = qgetenv("OWNCLOUD_REMOTE_SUBTREE_LISTING");
+    if (!remoteSubtreeListingEnv.isEmpty()) {
+        opt._remoteSubtreeListing = remoteSubtreeListingEnv != "0";
+    } else {
+        opt._remoteSubtreeListing = cfgFile.remoteSubtreeListing();
+    }
+
+    QByteArray localDiscoveryThreadsEnv = qgetenv("OWNCLOUD_LOCAL_DISCOVERY_THREADS");
+    if (!localDiscoveryThreadsEnv.isEmpty()) {
+        opt._localDiscoveryThreads = localDiscoveryThreadsEnv.toInt();
+    } else {
+        opt._localDiscoveryThreads = cfgFile.localDiscoveryThreads();
+    }
+
+    QByteArray pipelinedPropagationEnv = qgetenv("OWNCLOUD_PIPELINED_PROPAGATION");
+    if (!pipelinedPropagationEnv.isEmpty()) {
+        opt._pipelinedPropagation = pipelinedPropagationEnv != "0";
+    } else {
+        opt._pipelinedPropagation = cfgFile.pipelinedPropagation();
+    }
+
+    // Shared with the other folders that sync at the same time
+    opt._jobBudget = FolderMan::instance()->jobBudget();
+
     _engine->setSyncOptions(opt);
 }
 
@@ -917,7 +1039,10 @@ void Folder::setDirtyNetworkLimits()
         uploadLimit = 0;
     }
 
-    _engine->setNetworkLimits(uploadLimit, downloadLimit);
+    // Can change while a sync runs, possibly in another thread
+    QMetaObject::invokeMethod(_engine.data(), [engine = _engine.data(), uploadLimit, downloadLimit] {
+        engine->setNetworkLimits(uploadLimit, downloadLimit);
+    });
 }
 
 void Folder::slotSyncError(const QString &message, ErrorCategory category)
@@ -1212,8 +1337,8 @@ void Folder::registerFolderWatcher()
         return;
 
     _folderWatcher.reset(new FolderWatcher(this));
-    connect(_folderWatcher.data(), &FolderWatcher::pathChanged,
-        this, [this](const QString &path) { slotWatchedPathChanged(path, Folder::ChangeReason::Other); });
+    connect(_folderWatcher.data(), &FolderWatcher::pathsChanged,
+        this, [this](const QSet<QString> &paths) { slotWatchedPathsChanged(paths, Folder::ChangeReason::Other); });
     connect(_folderWatcher.data(), &FolderWatcher::lostChanges,
         this, &Folder::slotNextSyncFullLocalDiscovery);
     connect(_folderWatcher.data(), &FolderWatcher::becameUnreliable,
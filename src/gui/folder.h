@@ -37,6 +37,7 @@ namespace OCC {
 
 class Vfs;
 class SyncEngine;
+class SyncEngineRelay;
 class AccountState;
 class SyncRunFileLog;
 class FolderWatcher;
@@ -225,6 +226,13 @@ public:
     RequestEtagJob *etagJob() { return _requestEtagJob; }
     std::chrono::milliseconds msecSinceLastSync() const { return std::chrono::milliseconds(_timeSinceLastSyncDone.elapsed()); }
     std::chrono::milliseconds msecLastSyncDuration() const { return _lastSyncDuration; }
+    /// Time since the folder watcher last reported a local change, max() if there was none
+    std::chrono::milliseconds msecSinceLastLocalChange() const
+    {
+        return _timeSinceLastLocalChange.isValid()
+            ? std::chrono::milliseconds(_timeSinceLastLocalChange.elapsed())
+            : std::chrono::milliseconds::max();
+    }
     int consecutiveFollowUpSyncs() const { return _consecutiveFollowUpSyncs; }
     int consecutiveFailingSyncs() const { return _consecutiveFailingSyncs; }
 
@@ -332,6 +340,12 @@ public slots:
        */
     void slotWatchedPathChanged(const QString &path, ChangeReason reason);
 
+    /**
+     * Like slotWatchedPathChanged() for a batch of paths, schedules at
+     * most one sync for all of them.
+     */
+    void slotWatchedPathsChanged(const QSet<QString> &paths, ChangeReason reason);
+
     /**
      * Mark a virtual file as being requested for download, and start a sync.
      *
@@ -412,6 +426,24 @@ private slots:
 private:
     void connectSyncRoot();
 
+    /// Connects to the signals of the SyncEngine or SyncEngineRelay \a source
+    template <typename Source>
+    void connectEngineSignals(Source *source);
+
+    /** Moves _engine to a thread of its own, see ConfigFile::folderSyncThreads()
+     *
+     * The relay hands its signals over to this thread, the status tracker
+     * stays here. The engine's requests go through a QNAM of its thread.
+     */
+    void startEngineThread();
+
+    /// Deletes _engine in its thread and ends the thread
+    void stopEngineThread();
+
+    /** Records a change reported by the folder watcher, returns false if it
+     *  was ignored because it came from our own sync or was spurious */
+    bool processWatchedPathChange(const QString &path, ChangeReason reason);
+
     bool reloadExcludes();
 
     void showSyncResultPopup();
@@ -442,11 +474,15 @@ private:
 
     SyncResult _syncResult;
     QScopedPointer<SyncEngine> _engine;
+    // Null unless the engine runs on a thread of its own, see startEngineThread()
+    QScopedPointer<QThread> _engineThread;
+    QScopedPointer<SyncEngineRelay> _engineRelay;
     QPointer<RequestEtagJob> _requestEtagJob;
     QString _lastEtag;
     QElapsedTimer _timeSinceLastSyncDone;
     QElapsedTimer _timeSinceLastSyncStart;
     QElapsedTimer _timeSinceLastFullLocalDiscovery;
+    QElapsedTimer _timeSinceLastLocalChange;
     std::chrono::milliseconds _lastSyncDuration;
 
     /// The number of syncs that failed in a row.
@@ -493,7 +529,7 @@ private:
     /**
      * Watches this folder's local directory for changes.
      *
-     * Created by registerFolderWatcher(), triggers slotWatchedPathChanged()
+     * Created by registerFolderWatcher(), triggers slotWatchedPathsChanged()
      */
     QScopedPointer<FolderWatcher> _folderWatcher;
 
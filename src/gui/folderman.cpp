@@ -63,6 +63,10 @@ FolderMan::FolderMan(QObject *parent)
     QObject::connect(&_etagPollTimer, &QTimer::timeout, this, &FolderMan::slotEtagPollTimerTimeout);
     _etagPollTimer.start();
 
+    int maxConcurrentSyncs = qEnvironmentVariableIntValue("OWNCLOUD_MAX_CONCURRENT_SYNCS");
+    _maxConcurrentSyncs = qMax(1, maxConcurrentSyncs ? maxConcurrentSyncs : cfg.maxConcurrentSyncs());
+    _jobBudget.reset(new SyncJobBudget);
+
     _startScheduledSyncTimer.setSingleShot(true);
     connect(&_startScheduledSyncTimer, &QTimer::timeout,
         this, &FolderMan::slotStartScheduledFolderSync);
@@ -80,6 +84,9 @@ FolderMan::FolderMan(QObject *parent)
         this, &FolderMan::slotWatchedFileUnlocked);
 
     connect(this, &FolderMan::folderListChanged, this, &FolderMan::slotSetupPushNotifications);
+
+    connect(ConfigFileNotifier::instance(), &ConfigFileNotifier::changed,
+        this, &FolderMan::slotConfigFileChanged);
 }
 
 FolderMan *FolderMan::instance()
@@ -120,6 +127,10 @@ void FolderMan::unloadFolder(Folder *f)
         _socketApi.data(), &SocketApi::broadcastStatusPushMessage);
     disconnect(f, &Folder::watchedFileChangedExternally,
         &f->syncEngine().syncFileStatusTracker(), &SyncFileStatusTracker::slotPathTouched);
+
+    // It won't report the end of its sync anymore
+    _currentSyncFolders.remove(f);
+    _prioritizedFolders.remove(f);
 }
 
 int FolderMan::unloadAndDeleteAllFolders()
@@ -138,8 +149,9 @@ int FolderMan::unloadAndDeleteAllFolders()
     ASSERT(_folderMap.isEmpty());
 
     _lastSyncFolder = nullptr;
-    _currentSyncFolder = nullptr;
+    _currentSyncFolders.clear();
     _scheduledFolders.clear();
+    _prioritizedFolders.clear();
     emit folderListChanged(_folderMap);
     emit scheduleQueueChanged();
 
@@ -639,6 +651,7 @@ void FolderMan::scheduleFolderNext(Folder *f)
     f->prepareToSync();
     emit folderSyncStateChange(f);
     _scheduledFolders.prepend(f);
+    _prioritizedFolders.insert(f);
     emit scheduleQueueChanged();
 
     startScheduledSyncSoon();
@@ -719,6 +732,7 @@ void FolderMan::slotAccountStateChanged()
             Folder *f = it.next();
             if (f->accountState() == accountState) {
                 it.remove();
+                _prioritizedFolders.remove(f);
             }
         }
         emit scheduleQueueChanged();
@@ -746,7 +760,7 @@ void FolderMan::startScheduledSyncSoon()
     if (_scheduledFolders.empty()) {
         return;
     }
-    if (isAnySyncRunning()) {
+    if (!hasFreeSyncSlot()) {
         return;
     }
 
@@ -784,11 +798,9 @@ void FolderMan::startScheduledSyncSoon()
   */
 void FolderMan::slotStartScheduledFolderSync()
 {
-    if (isAnySyncRunning()) {
-        for (auto f : _folderMap) {
-            if (f->isSyncRunning())
-                qCInfo(lcFolderMan) << "Currently folder " << f->remoteUrl().toString() << " is running, wait for finish!";
-        }
+    if (!hasFreeSyncSlot()) {
+        for (auto f : qAsConst(_currentSyncFolders))
+            qCInfo(lcFolderMan) << "Currently folder " << f->remoteUrl().toString() << " is running, wait for finish!";
         return;
     }
 
@@ -802,15 +814,7 @@ void FolderMan::slotStartScheduledFolderSync()
         return;
     }
 
-    // Find the first folder in the queue that can be synced.
-    Folder *folder = nullptr;
-    while (!_scheduledFolders.isEmpty()) {
-        Folder *g = _scheduledFolders.dequeue();
-        if (g->canSync()) {
-            folder = g;
-            break;
-        }
-    }
+    Folder *folder = takeNextScheduledFolder();
 
     emit scheduleQueueChanged();
 
@@ -821,9 +825,58 @@ void FolderMan::slotStartScheduledFolderSync()
         folder->registerFolderWatcher();
         registerFolderWithSocketApi(folder);
 
-        _currentSyncFolder = folder;
+        _currentSyncFolders.insert(folder);
         folder->startSync(QStringList());
+
+        // Fill the remaining slots right away, the pause between syncs is
+        // only needed once all slots are taken.
+        if (hasFreeSyncSlot() && !_scheduledFolders.isEmpty())
+            QTimer::singleShot(0, this, &FolderMan::slotStartScheduledFolderSync);
+    }
+}
+
+bool FolderMan::hasFreeSyncSlot() const
+{
+    int running = _currentSyncFolders.size();
+    for (auto f : _folderMap) {
+        // Externally managed syncs occupy a slot as well
+        if (f->isSyncRunning() && !_currentSyncFolders.contains(f))
+            running++;
+    }
+    return running < _maxConcurrentSyncs;
+}
+
+Folder *FolderMan::takeNextScheduledFolder()
+{
+    // Folders that can't sync anymore are dropped from the queue, folders
+    // that are already syncing stay in it for a later run.
+    Folder *best = nullptr;
+    int bestIndex = -1;
+    for (int i = 0; i < _scheduledFolders.size();) {
+        Folder *f = _scheduledFolders.at(i);
+        if (!f->canSync()) {
+            _scheduledFolders.removeAt(i);
+            _prioritizedFolders.remove(f);
+            continue;
+        }
+        if (!f->isSyncRunning() && !_currentSyncFolders.contains(f)) {
+            // Prefer explicitly prioritized folders, then the most recent
+            // local change. Ties keep the queue order.
+            if (!best
+                || (_prioritizedFolders.contains(f) && !_prioritizedFolders.contains(best))
+                || (_prioritizedFolders.contains(f) == _prioritizedFolders.contains(best)
+                       && f->msecSinceLastLocalChange() < best->msecSinceLastLocalChange())) {
+                best = f;
+                bestIndex = i;
+            }
+        }
+        ++i;
+    }
+    if (best) {
+        _scheduledFolders.removeAt(bestIndex);
+        _prioritizedFolders.remove(best);
     }
+    return best;
 }
 
 bool FolderMan::pushNotificationsFilesReady(Account *account)
@@ -834,6 +887,21 @@ bool FolderMan::pushNotificationsFilesReady(Account *account)
     return pushFilesAvailable && pushNotifications && pushNotifications->isReady();
 }
 
+void FolderMan::slotConfigFileChanged()
+{
+    ConfigFile cfg;
+    const auto polltime = cfg.remotePollInterval();
+    if (polltime.count() != _etagPollTimer.interval()) {
+        qCInfo(lcFolderMan) << "setting remote poll timer interval to" << polltime.count() << "msec";
+        _etagPollTimer.setInterval(polltime.count());
+    }
+
+    if (!qEnvironmentVariableIntValue("OWNCLOUD_MAX_CONCURRENT_SYNCS")) {
+        _maxConcurrentSyncs = qMax(1, cfg.maxConcurrentSyncs());
+        startScheduledSyncSoon();
+    }
+}
+
 void FolderMan::slotEtagPollTimerTimeout()
 {
     qCInfo(lcFolderMan) << "Etag poll timer timeout";
@@ -996,7 +1064,7 @@ void FolderMan::slotScheduleFolderByTime()
 
 bool FolderMan::isAnySyncRunning() const
 {
-    if (_currentSyncFolder)
+    if (!_currentSyncFolders.isEmpty())
         return true;
 
     for (auto f : _folderMap) {
@@ -1037,12 +1105,10 @@ void FolderMan::slotFolderSyncFinished(const SyncResult &)
         qPrintable(f->accountState()->account()->displayName()),
         qPrintable(f->remoteUrl().toString()));
 
-    if (f == _currentSyncFolder) {
-        _lastSyncFolder = _currentSyncFolder;
-        _currentSyncFolder = nullptr;
+    if (_currentSyncFolders.remove(f)) {
+        _lastSyncFolder = f;
     }
-    if (!isAnySyncRunning())
-        startScheduledSyncSoon();
+    startScheduledSyncSoon();
 }
 
 Folder *FolderMan::addFolder(AccountState *accountState, const FolderDefinition &folderDefinition)
@@ -1179,6 +1245,7 @@ void FolderMan::removeFolder(Folder *f)
         f->slotTerminateSync();
     }
 
+    _prioritizedFolders.remove(f);
     if (_scheduledFolders.removeAll(f) > 0) {
         emit scheduleQueueChanged();
     }
@@ -1298,12 +1365,13 @@ void FolderMan::slotWipeFolderForAccount(AccountState *accountState)
 
         qCInfo(lcFolderMan) << "Removing " << f->alias();
 
-        const bool currentlyRunning = (_currentSyncFolder == f);
+        const bool currentlyRunning = _currentSyncFolders.contains(f);
         if (currentlyRunning) {
             // abort the sync now
-            _currentSyncFolder->slotTerminateSync();
+            f->slotTerminateSync();
         }
 
+        _prioritizedFolders.remove(f);
         if (_scheduledFolders.removeAll(f) > 0) {
             emit scheduleQueueChanged();
         }
@@ -1662,11 +1730,6 @@ QQueue<Folder *> FolderMan::scheduleQueue() const
     return _scheduledFolders;
 }
 
-Folder *FolderMan::currentSyncFolder() const
-{
-    return _currentSyncFolder;
-}
-
 void FolderMan::restartApplication()
 {
     if (Utility::isLinux()) {
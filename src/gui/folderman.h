@@ -19,6 +19,7 @@
 #include <QObject>
 #include <QQueue>
 #include <QList>
+#include <QSet>
 
 #include "folder.h"
 #include "folderwatcher.h"
@@ -57,6 +58,12 @@ class LockWatcher;
  * - There was a sync error or a follow-up sync is requested
  *   (_timeScheduler and slotScheduleFolderByTime()
  *    and Folder::slotSyncFinished())
+ *
+ * Up to _maxConcurrentSyncs scheduled folders sync at the same time. Folders
+ * put in front with scheduleFolderNext() start first, otherwise the folder
+ * with the most recent local change is preferred so that a long sync of a
+ * large folder does not hold back small ones. All running folders share
+ * the network job budget (_jobBudget).
  */
 class FolderMan : public QObject
 {
@@ -163,14 +170,17 @@ public:
     QQueue<Folder *> scheduleQueue() const;
 
     /**
-     * Access to the currently syncing folder.
+     * Access to the currently syncing folders.
      *
-     * Note: This is only the folder that's currently syncing *as-scheduled*. There
-     * may be externally-managed syncs such as from placeholder hydrations.
+     * Note: These are only the folders that are currently syncing *as-scheduled*.
+     * There may be externally-managed syncs such as from placeholder hydrations.
      *
      * See also isAnySyncRunning()
      */
-    Folder *currentSyncFolder() const;
+    QSet<Folder *> currentSyncFolders() const { return _currentSyncFolders; }
+
+    /** Network job budget shared by all folders that sync at the same time */
+    QSharedPointer<SyncJobBudget> jobBudget() const { return _jobBudget; }
 
     /**
      * Returns true if any folder is currently syncing.
@@ -264,6 +274,9 @@ private slots:
     void slotStartScheduledFolderSync();
     void slotEtagPollTimerTimeout();
 
+    // Applies the config values FolderMan keeps around
+    void slotConfigFileChanged();
+
     void slotRemoveFoldersForAccount(AccountState *accountState);
 
     // Wraps the Folder::syncStateChange() signal into the
@@ -322,10 +335,18 @@ private:
 
     bool pushNotificationsFilesReady(Account *account);
 
+    /// Whether another scheduled folder may start syncing now
+    bool hasFreeSyncSlot() const;
+
+    /// Removes the folder that should sync next from _scheduledFolders
+    Folder *takeNextScheduledFolder();
+
     QSet<Folder *> _disabledFolders;
     Folder::Map _folderMap;
     QString _folderConfigPath;
-    Folder *_currentSyncFolder = nullptr;
+    QSet<Folder *> _currentSyncFolders;
+    int _maxConcurrentSyncs = 1;
+    QSharedPointer<SyncJobBudget> _jobBudget;
     QPointer<Folder> _lastSyncFolder;
     bool _syncEnabled = true;
 
@@ -345,6 +366,8 @@ private:
 
     /// Scheduled folders that should be synced as soon as possible
     QQueue<Folder *> _scheduledFolders;
+    /// Scheduled folders that were put in front with scheduleFolderNext()
+    QSet<Folder *> _prioritizedFolders;
 
     /// Picks the next scheduled folder and starts the sync
     QTimer _startScheduledSyncTimer;
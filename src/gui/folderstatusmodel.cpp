@@ -1130,8 +1130,8 @@ void FolderStatusModel::slotFolderSyncStateChange(Folder *f)
     } else if (state == SyncResult::NotYetStarted) {
         FolderMan *folderMan = FolderMan::instance();
         int pos = folderMan->scheduleQueue().indexOf(f);
-        for (auto other : folderMan->map()) {
-            if (other != f && other->isSyncRunning())
+        for (auto other : folderMan->currentSyncFolders()) {
+            if (other != f)
                 pos += 1;
         }
         QString message;
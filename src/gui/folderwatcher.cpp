@@ -15,11 +15,13 @@
 // event masks
 #include "folderwatcher.h"
 
+#include <algorithm>
 #include <cstdint>
 
 #include <QFileInfo>
 #include <QFlags>
 #include <QDir>
+#include <QDirIterator>
 #include <QMutexLocker>
 #include <QStringList>
 #include <QTimer>
@@ -39,13 +41,69 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcFolderWatcher, "nextcloud.gui.folderwatcher", QtInfoMsg)
 
+/**
+ * Lists everything below new directories for FolderWatcher, lives in
+ * FolderWatcher::_expanderThread.
+ */
+class FolderWatcherExpander : public QObject
+{
+    Q_OBJECT
+public:
+    /// Number of paths delivered per pathsFound() signal
+    static constexpr int batchSize = 1000;
+
+    /// Set from the GUI thread to abandon a running expand()
+    QAtomicInt _abort;
+
+    void expand(const QStringList &dirs)
+    {
+        QStringList batch;
+        for (const auto &dir : dirs) {
+            QDirIterator it(dir, QDir::NoDotAndDotDot | QDir::Dirs | QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                if (_abort.loadAcquire())
+                    return;
+                batch.append(it.next());
+                if (batch.size() >= batchSize) {
+                    emit pathsFound(batch);
+                    batch.clear();
+                }
+            }
+        }
+        if (!batch.isEmpty())
+            emit pathsFound(batch);
+        emit finished();
+    }
+
+signals:
+    void pathsFound(const QStringList &paths);
+    void finished();
+};
+
 FolderWatcher::FolderWatcher(Folder *folder)
     : QObject(folder)
     , _folder(folder)
+    , _expander(new FolderWatcherExpander)
 {
+    // Collect the notifications of one event loop iteration into one batch
+    _pendingChangesTimer.setSingleShot(true);
+    _pendingChangesTimer.setInterval(0);
+    connect(&_pendingChangesTimer, &QTimer::timeout, this, &FolderWatcher::flushPendingChanges);
+
+    _expanderThread.setObjectName(QStringLiteral("FolderWatcherExpander"));
+    _expander->moveToThread(&_expanderThread);
+    connect(_expander.data(), &FolderWatcherExpander::pathsFound,
+        this, [this](const QStringList &paths) { changeDetected(paths); });
+    connect(_expander.data(), &FolderWatcherExpander::finished,
+        this, &FolderWatcher::slotExpansionFinished);
 }
 
-FolderWatcher::~FolderWatcher() = default;
+FolderWatcher::~FolderWatcher()
+{
+    _expander->_abort.storeRelease(1);
+    _expanderThread.quit();
+    _expanderThread.wait();
+}
 
 void FolderWatcher::init(const QString &root)
 {
@@ -74,19 +132,6 @@ bool FolderWatcher::isReliable() const
     return _isReliable;
 }
 
-void FolderWatcher::appendSubPaths(QDir dir, QStringList& subPaths) {
-    QStringList newSubPaths = dir.entryList(QDir::NoDotAndDotDot | QDir::Dirs | QDir::Files);
-    for (int i = 0; i < newSubPaths.size(); i++) {
-        QString path = dir.path() + "/" + newSubPaths[i];
-        QFileInfo fileInfo(path);
-        subPaths.append(path);
-        if (fileInfo.isDir()) {
-            QDir dir(path);
-            appendSubPaths(dir, subPaths);
-        }
-    }
-}
-
 void FolderWatcher::startNotificatonTest(const QString &path)
 {
 #ifdef Q_OS_MAC
@@ -140,15 +185,61 @@ int FolderWatcher::testLinuxWatchCount() const
 
 void FolderWatcher::changeDetected(const QString &path)
 {
-    QFileInfo fileInfo(path);
-    QStringList paths(path);
-    if (fileInfo.isDir()) {
-        QDir dir(path);
-        appendSubPaths(dir, paths);
-    }
+    _pendingChanges.insert(path);
+    if (QFileInfo(path).isDir())
+        queueExpansion(path);
+    if (!_pendingChangesTimer.isActive())
+        _pendingChangesTimer.start();
+}
+
+void FolderWatcher::flushPendingChanges()
+{
+    if (_pendingChanges.isEmpty())
+        return;
+    const QStringList paths = _pendingChanges.toList();
+    _pendingChanges.clear();
     changeDetected(paths);
 }
 
+void FolderWatcher::queueExpansion(const QString &dir)
+{
+    const QString dirPrefix = dir + QLatin1Char('/');
+    const auto covers = [&dir](const QString &root) {
+        return dir == root || dir.startsWith(root + QLatin1Char('/'));
+    };
+    if (std::any_of(_runningExpansions.cbegin(), _runningExpansions.cend(), covers)
+        || std::any_of(_pendingExpansions.cbegin(), _pendingExpansions.cend(), covers)) {
+        return;
+    }
+    _pendingExpansions.erase(std::remove_if(_pendingExpansions.begin(), _pendingExpansions.end(),
+                                 [&dirPrefix](const QString &pending) { return pending.startsWith(dirPrefix); }),
+        _pendingExpansions.end());
+    _pendingExpansions.append(dir);
+    startExpansion();
+}
+
+void FolderWatcher::startExpansion()
+{
+    // Only one listing runs at a time, so that directories that show up
+    // meanwhile get coalesced in _pendingExpansions
+    if (!_runningExpansions.isEmpty() || _pendingExpansions.isEmpty())
+        return;
+    if (!_expanderThread.isRunning())
+        _expanderThread.start(QThread::LowPriority);
+
+    _runningExpansions = std::move(_pendingExpansions);
+    _pendingExpansions.clear();
+    const QStringList dirs = _runningExpansions;
+    auto expander = _expander.data();
+    QMetaObject::invokeMethod(expander, [expander, dirs] { expander->expand(dirs); });
+}
+
+void FolderWatcher::slotExpansionFinished()
+{
+    _runningExpansions.clear();
+    startExpansion();
+}
+
 void FolderWatcher::changeDetected(const QStringList &paths)
 {
     // TODO: this shortcut doesn't look very reliable:
@@ -184,10 +275,14 @@ void FolderWatcher::changeDetected(const QStringList &paths)
         return;
     }
 
-    qCInfo(lcFolderWatcher) << "Detected changes in paths:" << changedPaths;
-    foreach (const QString &path, changedPaths) {
-        emit pathChanged(path);
+    if (changedPaths.size() <= 100) {
+        qCInfo(lcFolderWatcher) << "Detected changes in paths:" << changedPaths;
+    } else {
+        qCInfo(lcFolderWatcher) << "Detected changes in" << changedPaths.size() << "paths";
     }
+    emit pathsChanged(changedPaths);
 }
 
 } // namespace OCC
+
+#include "folderwatcher.moc"
@@ -27,14 +27,15 @@
 #include <QScopedPointer>
 #include <QSet>
 #include <QDir>
-
-class QTimer;
+#include <QThread>
+#include <QTimer>
 
 namespace OCC {
 
 Q_DECLARE_LOGGING_CATEGORY(lcFolderWatcher)
 
 class FolderWatcherPrivate;
+class FolderWatcherExpander;
 class Folder;
 
 /**
@@ -42,7 +43,11 @@ class Folder;
  *
  * Folder Watcher monitors a directory and its sub directories
  * for changes in the local file system. Changes are signalled
- * through the pathChanged() signal.
+ * in batches through the pathsChanged() signal.
+ *
+ * When a directory appears, everything below it is listed on a
+ * background thread so that moving a large tree into the folder
+ * doesn't block the GUI thread.
  *
  * @ingroup gui
  */
@@ -84,9 +89,9 @@ public:
     int testLinuxWatchCount() const;
 
 signals:
-    /** Emitted when one of the watched directories or one
-     *  of the contained files is changed. */
-    void pathChanged(const QString &path);
+    /** Emitted when some of the watched directories or
+     *  of the contained files changed. */
+    void pathsChanged(const QSet<QString> &paths);
 
     /**
      * Emitted if some notifications were lost.
@@ -111,6 +116,8 @@ protected slots:
 
 private slots:
     void startNotificationTestWhenReady();
+    void flushPendingChanges();
+    void slotExpansionFinished();
 
 protected:
     QHash<QString, int> _pendingPathes;
@@ -122,7 +129,20 @@ private:
     Folder *_folder;
     bool _isReliable = true;
 
-    void appendSubPaths(QDir dir, QStringList& subPaths);
+    /** Queues listing the tree below \a dir, unless a running or pending listing covers it */
+    void queueExpansion(const QString &dir);
+    void startExpansion();
+
+    /** Paths reported by changeDetected(const QString &) since the last flush */
+    QSet<QString> _pendingChanges;
+    QTimer _pendingChangesTimer;
+
+    /** Directories waiting to be listed by _expander */
+    QStringList _pendingExpansions;
+    /** Directories _expander lists right now, empty while it is idle */
+    QStringList _runningExpansions;
+    QThread _expanderThread;
+    QScopedPointer<FolderWatcherExpander> _expander;
 
     /** Path of the expected test notification */
     QString _testNotificationPath;
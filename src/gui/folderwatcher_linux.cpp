@@ -14,24 +14,159 @@
 
 #include "config.h"
 
+#include <sys/fanotify.h>
 #include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "folder.h"
 #include "folderwatcher_linux.h"
 
 #include <cerrno>
+#include <climits>
+#include <QFile>
 #include <QStringList>
 #include <QObject>
 #include <QVarLengthArray>
 
 namespace OCC {
 
+/// Time spent registering watches before the event loop gets control back
+static const int registerSliceMsecs = 20;
+
+/// Number of registered watches between two progress messages
+static const int registerProgressInterval = 10000;
+
+// Filter out journal changes - redundant with filtering in
+// FolderWatcher::pathIsIgnored.
+static bool isSyncJournalName(const QByteArray &fileName)
+{
+    return fileName.startsWith("._sync_")
+        || fileName.startsWith(".csync_journal.db")
+        || fileName.startsWith(".sync_");
+}
+
+constexpr quint32 InotifyWatchTree::NoNode;
+
+quint32 InotifyWatchTree::setRoot(const QByteArray &path, int wd)
+{
+    _nodes.clear();
+    _freeNodes.clear();
+    _watchToNode.clear();
+    _children.clear();
+
+    Node root;
+    root.wd = wd;
+    root.name = path;
+    _nodes.push_back(root);
+    _watchToNode.insert(wd, 0);
+    return 0;
+}
+
+quint32 InotifyWatchTree::add(quint32 parent, const QByteArray &name, int wd)
+{
+    Q_ASSERT(contains(parent) && child(parent, name) == NoNode);
+
+    quint32 node;
+    if (!_freeNodes.empty()) {
+        node = _freeNodes.back();
+        _freeNodes.pop_back();
+    } else {
+        node = quint32(_nodes.size());
+        _nodes.emplace_back();
+    }
+
+    auto &entry = _nodes[node];
+    entry.parent = parent;
+    entry.wd = wd;
+    entry.name = name;
+    entry.nextSibling = _nodes[parent].firstChild;
+    if (entry.nextSibling != NoNode)
+        _nodes[entry.nextSibling].previousSibling = node;
+    _nodes[parent].firstChild = node;
+
+    _watchToNode.insert(wd, node);
+    _children.insert(qMakePair(parent, name), node);
+    return node;
+}
+
+quint32 InotifyWatchTree::child(quint32 parent, const QByteArray &name) const
+{
+    return _children.value(qMakePair(parent, name), NoNode);
+}
+
+QByteArray InotifyWatchTree::path(quint32 node) const
+{
+    QVarLengthArray<quint32, 32> chain;
+    int size = 0;
+    for (; node != NoNode; node = _nodes[node].parent) {
+        chain.append(node);
+        size += _nodes[node].name.size() + 1;
+    }
+
+    QByteArray result;
+    result.reserve(size);
+    for (int i = chain.size() - 1; i >= 0; --i) {
+        result += _nodes[chain[i]].name;
+        if (i > 0)
+            result += '/';
+    }
+    return result;
+}
+
+void InotifyWatchTree::remove(quint32 node, const std::function<void(int)> &removed)
+{
+    if (!contains(node))
+        return;
+
+    // Unlink the node from its siblings
+    const auto &entry = _nodes[node];
+    if (entry.previousSibling != NoNode) {
+        _nodes[entry.previousSibling].nextSibling = entry.nextSibling;
+    } else if (entry.parent != NoNode) {
+        _nodes[entry.parent].firstChild = entry.nextSibling;
+    }
+    if (entry.nextSibling != NoNode)
+        _nodes[entry.nextSibling].previousSibling = entry.previousSibling;
+
+    // and free it with everything below
+    std::vector<quint32> pending { node };
+    while (!pending.empty()) {
+        const quint32 current = pending.back();
+        pending.pop_back();
+        auto &currentEntry = _nodes[current];
+        for (auto child = currentEntry.firstChild; child != NoNode; child = _nodes[child].nextSibling)
+            pending.push_back(child);
+
+        removed(currentEntry.wd);
+        if (_watchToNode.value(currentEntry.wd, NoNode) == current)
+            _watchToNode.remove(currentEntry.wd);
+        if (currentEntry.parent != NoNode)
+            _children.remove(qMakePair(currentEntry.parent, currentEntry.name));
+        currentEntry = Node();
+        _freeNodes.push_back(current);
+    }
+}
+
 FolderWatcherPrivate::FolderWatcherPrivate(FolderWatcher *p, const QString &path)
     : QObject()
     , _parent(p)
     , _folder(path)
+    , _rootPath(QFile::encodeName(QDir(path).absolutePath()))
 {
-    _fd = inotify_init();
+    _registerTimer.setInterval(0);
+    connect(&_registerTimer, &QTimer::timeout, this, &FolderWatcherPrivate::slotRegisterQueuedFolders);
+
+    if (initFanotify()) {
+        qCInfo(lcFolderWatcher) << "Watching" << path << "with a fanotify file system mark";
+        _ready = true;
+        return;
+    }
+
+    _fd = inotify_init1(IN_CLOEXEC);
     if (_fd != -1) {
         _socket.reset(new QSocketNotifier(_fd, QSocketNotifier::Read));
         connect(_socket.data(), &QSocketNotifier::activated, this, &FolderWatcherPrivate::slotReceivedNotification);
@@ -42,44 +177,23 @@ FolderWatcherPrivate::FolderWatcherPrivate(FolderWatcher *p, const QString &path
     QMetaObject::invokeMethod(this, "slotAddFolderRecursive", Q_ARG(QString, path));
 }
 
-FolderWatcherPrivate::~FolderWatcherPrivate() = default;
-
-// attention: result list passed by reference!
-bool FolderWatcherPrivate::findFoldersBelow(const QDir &dir, QStringList &fullList)
+FolderWatcherPrivate::~FolderWatcherPrivate()
 {
-    bool ok = true;
-    if (!(dir.exists() && dir.isReadable())) {
-        qCDebug(lcFolderWatcher) << "Non existing path coming in: " << dir.absolutePath();
-        ok = false;
-    } else {
-        QStringList nameFilter;
-        nameFilter << QLatin1String("*");
-        QDir::Filters filter = QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks | QDir::Hidden;
-        const QStringList pathes = dir.entryList(nameFilter, filter);
-
-        QStringList::const_iterator constIterator;
-        for (constIterator = pathes.constBegin(); constIterator != pathes.constEnd();
-             ++constIterator) {
-            const QString fullPath(dir.path() + QLatin1String("/") + (*constIterator));
-            fullList.append(fullPath);
-            ok = findFoldersBelow(QDir(fullPath), fullList);
-        }
-    }
-
-    return ok;
+    _socket.reset();
+    if (_fd != -1)
+        close(_fd);
+    if (_mountFd != -1)
+        close(_mountFd);
 }
 
-void FolderWatcherPrivate::inotifyRegisterPath(const QString &path)
+int FolderWatcherPrivate::inotifyRegisterPath(const QByteArray &path)
 {
     if (path.isEmpty())
-        return;
+        return -1;
 
-    int wd = inotify_add_watch(_fd, path.toUtf8().constData(),
+    int wd = inotify_add_watch(_fd, path.constData(),
         IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT | IN_ONLYDIR);
-    if (wd > -1) {
-        _watchToPath.insert(wd, path);
-        _pathToWatch.insert(path, wd);
-    } else {
+    if (wd < 0) {
         // If we're running out of memory or inotify watches, become
         // unreliable.
         if (_parent->_isReliable && (errno == ENOMEM || errno == ENOSPC)) {
@@ -89,46 +203,115 @@ void FolderWatcherPrivate::inotifyRegisterPath(const QString &path)
                    "Check the FAQ for details."));
         }
     }
+    return wd;
 }
 
 void FolderWatcherPrivate::slotAddFolderRecursive(const QString &path)
 {
-    if (_pathToWatch.contains(path))
+    // Only the root is added by path, directories below are added by name
+    // relative to their watched parent
+    qCDebug(lcFolderWatcher) << "(+) Watcher:" << path;
+
+    const QByteArray rootPath = QFile::encodeName(QDir(path).absolutePath());
+    const int wd = inotifyRegisterPath(rootPath);
+    if (wd < 0) {
+        _ready = true;
         return;
+    }
+    _registerQueue.clear();
+    _registerQueue.enqueue(_watches.setRoot(rootPath, wd));
+    _registerDuration.start();
+    registerQueuedFolders(registerSliceMsecs);
+}
 
-    int subdirs = 0;
-    qCDebug(lcFolderWatcher) << "(+) Watcher:" << path;
+void FolderWatcherPrivate::slotRegisterQueuedFolders()
+{
+    registerQueuedFolders(registerSliceMsecs);
+}
+
+void FolderWatcherPrivate::addFolder(quint32 parent, const QByteArray &name)
+{
+    if (_watches.child(parent, name) != InotifyWatchTree::NoNode)
+        return;
+
+    const int wd = inotifyRegisterPath(_watches.path(parent) + '/' + name);
+    // The same directory can be reachable twice through bind mounts
+    if (wd < 0 || _watches.nodeForWatch(wd) != InotifyWatchTree::NoNode)
+        return;
+    _registerQueue.enqueue(_watches.add(parent, name, wd));
+    ++_registeredSinceProgress;
+}
+
+void FolderWatcherPrivate::registerQueuedFolders(int budgetMsecs)
+{
+    QElapsedTimer slice;
+    slice.start();
+    while (!_registerQueue.isEmpty() && slice.elapsed() < budgetMsecs) {
+        const quint32 node = _registerQueue.dequeue();
+        if (!_watches.contains(node))
+            continue;
 
-    QDir inPath(path);
-    inotifyRegisterPath(inPath.absolutePath());
-
-    QStringList allSubfolders;
-    if (!findFoldersBelow(QDir(path), allSubfolders)) {
-        qCWarning(lcFolderWatcher) << "Could not traverse all sub folders";
-    }
-    QStringListIterator subfoldersIt(allSubfolders);
-    while (subfoldersIt.hasNext()) {
-        QString subfolder = subfoldersIt.next();
-        QDir folder(subfolder);
-        if (folder.exists() && !_pathToWatch.contains(folder.absolutePath())) {
-            subdirs++;
-            if (_parent->pathIsIgnored(subfolder)) {
-                qCDebug(lcFolderWatcher) << "* Not adding" << folder.path();
+        const QByteArray path = _watches.path(node);
+        DIR *dir = opendir(path.constData());
+        if (!dir) {
+            qCDebug(lcFolderWatcher) << "Could not list" << path << strerror(errno);
+            continue;
+        }
+        while (auto entry = readdir(dir)) {
+            const char *name = entry->d_name;
+            if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
                 continue;
+            bool isDir = entry->d_type == DT_DIR;
+            if (entry->d_type == DT_UNKNOWN) {
+                struct stat st;
+                isDir = fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
             }
-            inotifyRegisterPath(folder.absolutePath());
-        } else {
-            qCDebug(lcFolderWatcher) << "    `-> discarded:" << folder.path();
+            if (!isDir)
+                continue;
+
+            const QByteArray fileName(name);
+            if (_watches.child(node, fileName) != InotifyWatchTree::NoNode)
+                continue;
+            const QString fullPath = QFile::decodeName(path + '/' + fileName);
+            if (_parent->pathIsIgnored(fullPath)) {
+                qCDebug(lcFolderWatcher) << "* Not adding" << fullPath;
+                continue;
+            }
+            addFolder(node, fileName);
         }
+        closedir(dir);
+
+        // Without watches left there is no point in listing further
+        if (!_parent->_isReliable)
+            _registerQueue.clear();
     }
 
-    if (subdirs > 0) {
-        qCDebug(lcFolderWatcher) << "    `-> and" << subdirs << "subdirectories";
+    if (_registeredSinceProgress >= registerProgressInterval) {
+        qCInfo(lcFolderWatcher) << "Watching" << _watches.size() << "directories of" << _folder
+                                << "so far," << _registerQueue.size() << "left to list";
+        _registeredSinceProgress = 0;
+    }
+
+    if (!_registerQueue.isEmpty()) {
+        if (!_registerTimer.isActive())
+            _registerTimer.start();
+        return;
+    }
+    _registerTimer.stop();
+    if (!_ready) {
+        _ready = true;
+        qCInfo(lcFolderWatcher) << "Watching" << _watches.size() << "directories of" << _folder
+                                << "after" << _registerDuration.elapsed() << "ms";
     }
 }
 
 void FolderWatcherPrivate::slotReceivedNotification(int fd)
 {
+    if (_fanotify) {
+        readFanotifyEvents(fd);
+        return;
+    }
+
     int len = 0;
     struct inotify_event *event = nullptr;
     size_t i = 0;
@@ -168,53 +351,158 @@ void FolderWatcherPrivate::slotReceivedNotification(int fd)
         // Fire event for the path that was changed.
         if (event->len == 0 || event->wd <= -1)
             continue;
+        const quint32 parentNode = _watches.nodeForWatch(event->wd);
+        if (parentNode == InotifyWatchTree::NoNode)
+            continue;
         QByteArray fileName(event->name);
-        // Filter out journal changes - redundant with filtering in
-        // FolderWatcher::pathIsIgnored.
-        if (fileName.startsWith("._sync_")
-            || fileName.startsWith(".csync_journal.db")
-            || fileName.startsWith(".sync_")) {
+        if (isSyncJournalName(fileName)) {
             continue;
         }
-        const QString p = _watchToPath[event->wd] + '/' + fileName;
+        const QString p = QFile::decodeName(_watches.path(parentNode) + '/' + fileName);
         _parent->changeDetected(p);
 
         if ((event->mask & (IN_MOVED_TO | IN_CREATE))
             && QFileInfo(p).isDir()
             && !_parent->pathIsIgnored(p)) {
-            slotAddFolderRecursive(p);
+            addFolder(parentNode, fileName);
         }
         if (event->mask & (IN_MOVED_FROM | IN_DELETE)) {
-            removeFoldersBelow(p);
+            removeFolder(parentNode, fileName);
         }
     }
+
+    // Watch what is below new directories, as far as the time budget allows
+    if (!_registerQueue.isEmpty())
+        registerQueuedFolders(registerSliceMsecs);
+}
+
+void FolderWatcherPrivate::removeFolder(quint32 parent, const QByteArray &name)
+{
+    const quint32 node = _watches.child(parent, name);
+    if (node == InotifyWatchTree::NoNode)
+        return;
+
+    qCDebug(lcFolderWatcher) << "Removing watches below" << _watches.path(node);
+    _watches.remove(node, [this](int wd) { inotify_rm_watch(_fd, wd); });
+}
+
+#ifdef FAN_REPORT_DFID_NAME
+// Returns the path of the directory a fanotify event refers to, or an
+// empty array if it is gone already
+static QByteArray resolveFileHandle(int mountFd, file_handle *handle)
+{
+    const int fd = open_by_handle_at(mountFd, handle, O_PATH | O_CLOEXEC);
+    if (fd == -1)
+        return QByteArray();
+    char path[PATH_MAX];
+    const QByteArray link = "/proc/self/fd/" + QByteArray::number(fd);
+    const auto len = readlink(link.constData(), path, sizeof(path));
+    close(fd);
+    if (len <= 0)
+        return QByteArray();
+    QByteArray result(path, int(len));
+    if (result.endsWith(" (deleted)"))
+        return QByteArray();
+    return result;
+}
+#endif
+
+bool FolderWatcherPrivate::initFanotify()
+{
+#ifdef FAN_REPORT_DFID_NAME
+    const QByteArray fanotifyEnv = qgetenv("OWNCLOUD_FANOTIFY");
+    if (!fanotifyEnv.isEmpty() && fanotifyEnv.toInt() == 0)
+        return false;
+
+    // Fails with EPERM without CAP_SYS_ADMIN and with EINVAL before Linux 5.9
+    const int fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK | FAN_REPORT_DFID_NAME, O_RDONLY | O_LARGEFILE);
+    if (fd == -1) {
+        qCDebug(lcFolderWatcher) << "fanotify is not available:" << strerror(errno);
+        return false;
+    }
+
+    const quint64 mask = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO
+        | FAN_ATTRIB | FAN_CLOSE_WRITE | FAN_ONDIR;
+    const int mountFd = open(_rootPath.constData(), O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+    bool ok = mountFd != -1
+        && fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, mask, AT_FDCWD, _rootPath.constData()) == 0;
+
+    // Events carry file handles, opening them needs CAP_DAC_READ_SEARCH
+    if (ok) {
+        alignas(file_handle) char buffer[sizeof(file_handle) + MAX_HANDLE_SZ];
+        auto handle = reinterpret_cast<file_handle *>(buffer);
+        handle->handle_bytes = MAX_HANDLE_SZ;
+        int mountId = 0;
+        ok = name_to_handle_at(mountFd, "", handle, &mountId, AT_EMPTY_PATH) == 0
+            && resolveFileHandle(mountFd, handle) == _rootPath;
+    }
+    if (!ok) {
+        qCDebug(lcFolderWatcher) << "Could not set up fanotify for" << _folder << strerror(errno);
+        if (mountFd != -1)
+            close(mountFd);
+        close(fd);
+        return false;
+    }
+
+    _fanotify = true;
+    _fd = fd;
+    _mountFd = mountFd;
+    _socket.reset(new QSocketNotifier(_fd, QSocketNotifier::Read));
+    connect(_socket.data(), &QSocketNotifier::activated, this, &FolderWatcherPrivate::slotReceivedNotification);
+    return true;
+#else
+    return false;
+#endif
 }
 
-void FolderWatcherPrivate::removeFoldersBelow(const QString &path)
+void FolderWatcherPrivate::readFanotifyEvents(int fd)
 {
-    auto it = _pathToWatch.find(path);
-    if (it == _pathToWatch.end())
+#ifdef FAN_REPORT_DFID_NAME
+    alignas(fanotify_event_metadata) char buffer[64 * 1024];
+    auto len = read(fd, buffer, sizeof(buffer));
+    if (len <= 0)
         return;
 
-    QString pathSlash = path + '/';
+    // The mark covers the whole file system: resolve every directory once
+    // per read and drop what is outside of the folder
+    QHash<QByteArray, QByteArray> directoryPaths;
+    const QByteArray rootSlash = _rootPath + '/';
 
-    // Remove the entry and all subentries
-    while (it != _pathToWatch.end()) {
-        auto itPath = it.key();
-        if (!itPath.startsWith(path))
+    auto event = reinterpret_cast<fanotify_event_metadata *>(buffer);
+    for (; FAN_EVENT_OK(event, len); event = FAN_EVENT_NEXT(event, len)) {
+        if (event->vers != FANOTIFY_METADATA_VERSION) {
+            qCWarning(lcFolderWatcher) << "Unexpected fanotify metadata version" << event->vers;
             break;
-        if (itPath != path && !itPath.startsWith(pathSlash)) {
-            // order is 'foo', 'foo bar', 'foo/bar'
-            ++it;
+        }
+        if (event->mask & FAN_Q_OVERFLOW) {
+            qCWarning(lcFolderWatcher) << "fanotify event queue overflowed";
+            emit _parent->lostChanges();
             continue;
         }
+        if (event->event_len < sizeof(fanotify_event_metadata) + sizeof(fanotify_event_info_fid))
+            continue;
+        auto info = reinterpret_cast<fanotify_event_info_fid *>(event + 1);
+        if (info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+            continue;
+
+        auto handle = reinterpret_cast<file_handle *>(info->handle);
+        const QByteArray fileName(reinterpret_cast<const char *>(handle->f_handle + handle->handle_bytes));
+        if (fileName.isEmpty() || fileName == "." || isSyncJournalName(fileName))
+            continue;
+
+        const QByteArray key(reinterpret_cast<const char *>(handle), int(sizeof(file_handle) + handle->handle_bytes));
+        auto it = directoryPaths.find(key);
+        if (it == directoryPaths.end())
+            it = directoryPaths.insert(key, resolveFileHandle(_mountFd, handle));
+        const QByteArray &directory = it.value();
+        if (directory != _rootPath && !directory.startsWith(rootSlash))
+            continue;
 
-        auto wid = it.value();
-        inotify_rm_watch(_fd, wid);
-        _watchToPath.remove(wid);
-        it = _pathToWatch.erase(it);
-        qCDebug(lcFolderWatcher) << "Removed watch for" << itPath;
+        _parent->changeDetected(QFile::decodeName(directory + '/' + fileName));
     }
+#else
+    Q_UNUSED(fd);
+#endif
 }
 
 } // ns mirall
@@ -19,17 +19,86 @@
 #include <QString>
 #include <QSocketNotifier>
 #include <QHash>
+#include <QPair>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QTimer>
 
-#include "folderwatcher.h"
+#include <functional>
+#include <vector>
 
-class QTimer;
+#include "folderwatcher.h"
 
 namespace OCC {
 
 /**
- * @brief Linux (inotify) API implementation of FolderWatcher
+ * @brief The directories watched with inotify
+ *
+ * Every directory is a node in an arena that only holds the index of its
+ * parent, its own name and its watch descriptor. A tree with hundreds of
+ * thousands of directories therefore costs one short name per directory
+ * instead of the full path twice, and full paths are only built for
+ * directories that see an event.
+ *
+ * Indices of removed nodes are reused.
+ */
+class InotifyWatchTree
+{
+public:
+    static constexpr quint32 NoNode = 0xffffffff;
+
+    /// Replaces the whole tree by the root directory \a path watched by \a wd
+    quint32 setRoot(const QByteArray &path, int wd);
+
+    /// Adds the subdirectory \a name of \a parent that is watched by \a wd
+    quint32 add(quint32 parent, const QByteArray &name, int wd);
+
+    /// The subdirectory \a name of \a parent or NoNode
+    quint32 child(quint32 parent, const QByteArray &name) const;
+
+    /// The node watched by \a wd or NoNode
+    quint32 nodeForWatch(int wd) const { return _watchToNode.value(wd, NoNode); }
+
+    bool contains(quint32 node) const { return node < _nodes.size() && _nodes[node].wd != -1; }
+
+    /// The full path of \a node, encoded like the file system does
+    QByteArray path(quint32 node) const;
+
+    /// Removes \a node with everything below it, \a removed sees every watch descriptor
+    void remove(quint32 node, const std::function<void(int)> &removed);
+
+    /// Number of watched directories
+    int size() const { return _watchToNode.size(); }
+
+private:
+    struct Node
+    {
+        quint32 parent = NoNode;
+        quint32 firstChild = NoNode;
+        quint32 previousSibling = NoNode;
+        quint32 nextSibling = NoNode;
+        int wd = -1;
+        QByteArray name;
+    };
+
+    std::vector<Node> _nodes;
+    std::vector<quint32> _freeNodes;
+    QHash<int, quint32> _watchToNode;
+    QHash<QPair<quint32, QByteArray>, quint32> _children;
+};
+
+/**
+ * @brief Linux (inotify or fanotify) API implementation of FolderWatcher
  * @ingroup gui
+ *
+ * When the process may place a fanotify mark on the whole file system
+ * (which needs CAP_SYS_ADMIN) and resolve file handles (CAP_DAC_READ_SEARCH),
+ * no per-directory watches are needed: events carry the handle of the
+ * parent directory plus the name of the changed entry.
+ *
+ * Otherwise every directory gets an inotify watch. They are registered a
+ * slice at a time from the event loop so a large tree doesn't block it.
  */
 class FolderWatcherPrivate : public QObject
 {
@@ -39,28 +108,47 @@ public:
     FolderWatcherPrivate(FolderWatcher *p, const QString &path);
     ~FolderWatcherPrivate();
 
-    int testWatchCount() const { return _pathToWatch.size(); }
+    int testWatchCount() const { return _watches.size(); }
 
-    /// On linux the watcher is ready when the ctor finished.
-    bool _ready = true;
+    /// On linux the watcher is ready when all existing directories are watched.
+    bool _ready = false;
 
 protected slots:
     void slotReceivedNotification(int fd);
     void slotAddFolderRecursive(const QString &path);
+    void slotRegisterQueuedFolders();
 
 protected:
-    bool findFoldersBelow(const QDir &dir, QStringList &fullList);
-    void inotifyRegisterPath(const QString &path);
-    void removeFoldersBelow(const QString &path);
+    int inotifyRegisterPath(const QByteArray &path);
+
+    /// Watches the subdirectory \a name of \a parent and queues it for registerQueuedFolders()
+    void addFolder(quint32 parent, const QByteArray &name);
+    void removeFolder(quint32 parent, const QByteArray &name);
+
+    /// Watches subdirectories of queued folders until the time budget is used up
+    void registerQueuedFolders(int budgetMsecs);
+
+    bool initFanotify();
+    void readFanotifyEvents(int fd);
 
 private:
-    FolderWatcher *_parent;
+    FolderWatcher *_parent = nullptr;
 
     QString _folder;
-    QHash<int, QString> _watchToPath;
-    QMap<QString, int> _pathToWatch;
+    /// _folder as absolute path in file system encoding
+    QByteArray _rootPath;
+    InotifyWatchTree _watches;
     QScopedPointer<QSocketNotifier> _socket;
-    int _fd;
+    int _fd = -1;
+
+    /// Watched directories whose subdirectories still need to be registered
+    QQueue<quint32> _registerQueue;
+    QTimer _registerTimer;
+    QElapsedTimer _registerDuration;
+    int _registeredSinceProgress = 0;
+
+    bool _fanotify = false;
+    int _mountFd = -1;
 };
 }
 
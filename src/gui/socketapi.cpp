@@ -75,7 +75,10 @@
 // This is the version that is returned when the client asks for the VERSION.
 // The first number should be changed if there is an incompatible change that breaks old clients.
 // The second number should be changed when there are new features.
-#define MIRALL_SOCKET_API_VERSION "1.1"
+#define MIRALL_SOCKET_API_VERSION "1.2"
+
+// Status pushes are collected for this long and then sent per directory
+static const int statusPushIntervalMsec = 100;
 
 namespace {
 #if GUI_TESTING
@@ -184,7 +187,11 @@ void SocketListener::sendMessage(const QString &message, bool doWait) const
         return;
     }
 
-    qCInfo(lcSocketApi) << "Sending SocketAPI message -->" << message << "to" << socket;
+    if (message.size() > 1000) {
+        qCInfo(lcSocketApi) << "Sending SocketAPI message -->" << message.left(1000) << "... of" << message.size() << "characters to" << socket;
+    } else {
+        qCInfo(lcSocketApi) << "Sending SocketAPI message -->" << message << "to" << socket;
+    }
     QString localMessage = message;
     if (!localMessage.endsWith(QLatin1Char('\n'))) {
         localMessage.append(QLatin1Char('\n'));
@@ -279,6 +286,10 @@ SocketApi::SocketApi(QObject *parent)
 
     connect(&_localServer, &SocketApiServer::newConnection, this, &SocketApi::slotNewConnection);
 
+    _statusPushTimer.setSingleShot(true);
+    _statusPushTimer.setInterval(statusPushIntervalMsec);
+    connect(&_statusPushTimer, &QTimer::timeout, this, &SocketApi::flushStatusPushMessages);
+
     // folder watcher
     connect(FolderMan::instance(), &FolderMan::folderSyncStateChange, this, &SocketApi::slotUpdateFolderView);
 }
@@ -357,7 +368,11 @@ void SocketApi::slotReadSocket()
         // make sure that the path will match, especially on OS X.
         QString line = QString::fromUtf8(socket->readLine()).normalized(QString::NormalizationForm_C);
         line.chop(1); // remove the '\n'
-        qCInfo(lcSocketApi) << "Received SocketAPI message <--" << line << "from" << socket;
+        if (line.size() > 1000) {
+            qCInfo(lcSocketApi) << "Received SocketAPI message <--" << line.left(1000) << "... of" << line.size() << "characters from" << socket;
+        } else {
+            qCInfo(lcSocketApi) << "Received SocketAPI message <--" << line << "from" << socket;
+        }
         QByteArray command = line.split(":").value(0).toLatin1();
 
         QByteArray functionWithArguments = "command_" + command;
@@ -452,6 +467,7 @@ void SocketApi::slotUpdateFolderView(Folder *f)
             || f->syncResult().status() == SyncResult::SetupError) {
             QString rootPath = removeTrailingSlash(f->path());
             broadcastStatusPushMessage(rootPath, f->syncEngine().syncFileStatusTracker().fileStatus(""));
+            flushStatusPushMessages();
 
             broadcastMessage(buildMessage(QLatin1String("UPDATE_VIEW"), rootPath));
         } else {
@@ -510,11 +526,50 @@ void SocketApi::processShareRequest(const QString &localFile, SocketListener *li
 
 void SocketApi::broadcastStatusPushMessage(const QString &systemPath, SyncFileStatus fileStatus)
 {
-    QString msg = buildMessage(QLatin1String("STATUS"), systemPath, fileStatus.toSocketAPIString());
+    if (_listeners.isEmpty())
+        return;
+
+    // Only the latest status of a path is sent and the pushes of a
+    // directory go out together, at most every statusPushIntervalMsec
     Q_ASSERT(!systemPath.endsWith('/'));
-    uint directoryHash = qHash(systemPath.left(systemPath.lastIndexOf('/')));
-    foreach (auto &listener, _listeners) {
-        listener.sendMessageIfDirectoryMonitored(msg, directoryHash);
+    const int lastSlash = systemPath.lastIndexOf('/');
+    _pendingStatusPushes[systemPath.left(lastSlash)].insert(systemPath.mid(lastSlash + 1), fileStatus);
+    if (!_statusPushTimer.isActive())
+        _statusPushTimer.start();
+}
+
+void SocketApi::flushStatusPushMessages()
+{
+    _statusPushTimer.stop();
+    QHash<QString, QHash<QString, SyncFileStatus>> pushes;
+    std::swap(pushes, _pendingStatusPushes);
+
+    for (auto directory = pushes.cbegin(); directory != pushes.cend(); ++directory) {
+        const uint directoryHash = qHash(directory.key());
+        QString directoryMessage;
+        QStringList statusMessages;
+        for (auto &listener : _listeners) {
+            if (!listener.isDirectoryMonitored(directoryHash))
+                continue;
+
+            if (listener.directoryStatusSupported) {
+                if (directoryMessage.isEmpty()) {
+                    directoryMessage = QLatin1String("DIRECTORY_STATUS:") + QDir::toNativeSeparators(directory.key());
+                    for (auto entry = directory->cbegin(); entry != directory->cend(); ++entry)
+                        directoryMessage += QLatin1Char('\x1e') + entry->toSocketAPIString() + QLatin1Char(':') + entry.key();
+                }
+                listener.sendMessage(directoryMessage);
+            } else {
+                if (statusMessages.isEmpty()) {
+                    for (auto entry = directory->cbegin(); entry != directory->cend(); ++entry) {
+                        const QString path = directory.key() + QLatin1Char('/') + entry.key();
+                        statusMessages.append(buildMessage(QLatin1String("STATUS"), path, entry->toSocketAPIString()));
+                    }
+                }
+                for (const auto &message : qAsConst(statusMessages))
+                    listener.sendMessage(message);
+            }
+        }
     }
 }
 
@@ -546,6 +601,31 @@ void SocketApi::command_RETRIEVE_FILE_STATUS(const QString &argument, SocketList
     listener->sendMessage(message);
 }
 
+void SocketApi::command_RETRIEVE_DIRECTORY_STATUS(const QString &argument, SocketListener *listener)
+{
+    QStringList names = argument.split(QLatin1Char('\x1e')); // Record Separator
+    const QString directory = names.takeFirst();
+    names.removeAll(QString());
+
+    QVector<SyncFileStatus> statuses;
+    auto fileData = FileData::get(directory);
+    if (fileData.folder) {
+        // Like RETRIEVE_FILE_STATUS for each name, but with a single query
+        // for the records of the directory and a single reply
+        listener->registerMonitoredDirectory(qHash(fileData.localPath));
+        listener->directoryStatusSupported = true;
+        statuses = fileData.folder->syncEngine().syncFileStatusTracker().fileStatuses(fileData.folderRelativePath, names);
+    }
+
+    QString message = QLatin1String("DIRECTORY_STATUS:") + QDir::toNativeSeparators(directory);
+    for (int i = 0; i < names.size(); ++i) {
+        // this can happen in offline mode e.g.: nothing to worry about
+        const QString statusString = fileData.folder ? statuses.at(i).toSocketAPIString() : QStringLiteral("NOP");
+        message += QLatin1Char('\x1e') + statusString + QLatin1Char(':') + names.at(i);
+    }
+    listener->sendMessage(message);
+}
+
 void SocketApi::command_SHARE(const QString &localFile, SocketListener *listener)
 {
     processShareRequest(localFile, listener, ShareDialogStartPage::UsersAndGroups);
@@ -22,6 +22,8 @@
 
 #include "config.h"
 
+#include <QTimer>
+
 #if defined(Q_OS_MAC)
 #include "socketapisocket_mac.h"
 #else
@@ -65,6 +67,8 @@ signals:
     void shareCommandReceived(const QString &sharePath, const QString &localPath, ShareDialogStartPage startPage);
 
 private slots:
+    /// Sends the status pushes collected by broadcastStatusPushMessage()
+    void flushStatusPushMessages();
     void slotNewConnection();
     void onLostConnection();
     void slotSocketDestroyed(QObject *obj);
@@ -105,6 +109,13 @@ private:
     Q_INVOKABLE void command_RETRIEVE_FOLDER_STATUS(const QString &argument, SocketListener *listener);
     Q_INVOKABLE void command_RETRIEVE_FILE_STATUS(const QString &argument, SocketListener *listener);
 
+    /** Statuses of many entries of one directory (added in version 1.2)
+     * argument is the directory followed by the names of its entries, separated by '\x1e'
+     * Reply with DIRECTORY_STATUS:[directory] followed by '\x1e'[status]:[name] for every name.
+     * Afterwards, status pushes for that directory are sent in the same format.
+     */
+    Q_INVOKABLE void command_RETRIEVE_DIRECTORY_STATUS(const QString &argument, SocketListener *listener);
+
     Q_INVOKABLE void command_VERSION(const QString &argument, SocketListener *listener);
 
     Q_INVOKABLE void command_SHARE_MENU_TITLE(const QString &argument, SocketListener *listener);
@@ -166,6 +177,10 @@ private:
     QSet<QString> _registeredAliases;
     QList<SocketListener> _listeners;
     SocketApiServer _localServer;
+
+    /// Latest status of changed entries, by directory and name, until the next flushStatusPushMessages()
+    QHash<QString, QHash<QString, SyncFileStatus>> _pendingStatusPushes;
+    QTimer _statusPushTimer;
 };
 }
 
@@ -69,10 +69,9 @@ public:
 
     void sendMessage(const QString &message, bool doWait = false) const;
 
-    void sendMessageIfDirectoryMonitored(const QString &message, uint systemDirectoryHash) const
+    bool isDirectoryMonitored(uint systemDirectoryHash) const
     {
-        if (_monitoredDirectoriesBloomFilter.isHashMaybeStored(systemDirectoryHash))
-            sendMessage(message, false);
+        return _monitoredDirectoriesBloomFilter.isHashMaybeStored(systemDirectoryHash);
     }
 
     void registerMonitoredDirectory(uint systemDirectoryHash)
@@ -80,6 +79,9 @@ public:
         _monitoredDirectoriesBloomFilter.storeHash(systemDirectoryHash);
     }
 
+    /// Set once the client used RETRIEVE_DIRECTORY_STATUS, it then gets DIRECTORY_STATUS pushes
+    bool directoryStatusSupported = false;
+
 private:
     BloomFilter _monitoredDirectoriesBloomFilter;
 };
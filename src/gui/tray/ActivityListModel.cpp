@@ -19,6 +19,8 @@
 #include <QJsonObject>
 #include <QJsonDocument>
 
+#include <algorithm>
+
 #include "account.h"
 #include "accountstate.h"
 #include "accountmanager.h"
@@ -65,10 +67,10 @@ QVariant ActivityListModel::data(const QModelIndex &index, int role) const
 {
     Activity a;
 
-    if (!index.isValid())
+    if (!index.isValid() || index.row() >= _rowCount)
         return QVariant();
 
-    a = _finalList.at(index.row());
+    a = activityAt(index.row());
     AccountStatePtr ast = AccountManager::instance()->account(a._accName);
     if (!ast && _accountState != ast.data())
         return QVariant();
@@ -227,11 +229,16 @@ QVariant ActivityListModel::data(const QModelIndex &index, int role) const
 
 int ActivityListModel::rowCount(const QModelIndex &) const
 {
-    return _finalList.count();
+    return _rowCount;
 }
 
 bool ActivityListModel::canFetchMore(const QModelIndex &) const
 {
+    // Older entries that are not exposed yet
+    if (_rowCount < totalCount()) {
+        return true;
+    }
+
     // We need to be connected to be able to fetch more
     if (_accountState && _accountState->isConnected()) {
         // If the fetching is reported to be done or we are currently fetching we can't fetch more
@@ -316,18 +323,23 @@ void ActivityListModel::slotActivitiesReceived(const QJsonDocument &json, int st
         }
     }
 
-    _activityLists.append(list);
+    for (const auto &activity : qAsConst(list)) {
+        addActivity(ActivitySection, activity);
+    }
+    capSection(ActivitySection, _maxActivities);
+    updateMoreActivitiesEntry();
 
     emit activityJobStatusCode(statusCode);
-
-    combineActivityLists();
 }
 
 void ActivityListModel::slotIconDownloaded(QByteArray iconData)
 {
-    for (auto i = 0; i < _activityLists.count(); i++) {
-        if (_activityLists[i]._id == sender()->property("activityId").toLongLong()) {
-            _activityLists[i]._iconData = iconData;
+    const auto activityId = sender()->property("activityId").toLongLong();
+    auto &activities = _sections[ActivitySection];
+    for (auto i = 0; i < activities.count(); i++) {
+        if (activities[i]._id == activityId) {
+            activities[i]._iconData = iconData;
+            updateActivity(ActivitySection, i);
         }
     }
 }
@@ -335,60 +347,64 @@ void ActivityListModel::slotIconDownloaded(QByteArray iconData)
 void ActivityListModel::addErrorToActivityList(Activity activity)
 {
     qCInfo(lcActivity) << "Error successfully added to the notification list: " << activity._subject;
-    _notificationErrorsLists.prepend(activity);
-    combineActivityLists();
+    addActivity(ErrorSection, activity);
+    capSection(ErrorSection, _maxErrors);
 }
 
 void ActivityListModel::addIgnoredFileToList(Activity newActivity)
 {
     qCInfo(lcActivity) << "First checking for duplicates then add file to the notification list of ignored files: " << newActivity._file;
 
-    bool duplicate = false;
-    if (_listOfIgnoredFiles.size() == 0) {
-        _notificationIgnoredFiles = newActivity;
-        _notificationIgnoredFiles._subject = tr("Files from the ignore list as well as symbolic links are not synced.");
-        _listOfIgnoredFiles.append(newActivity);
+    if (_ignoredFiles.contains(newActivity._file)) {
         return;
     }
+    _ignoredFiles.insert(newActivity._file);
 
-    foreach (Activity activity, _listOfIgnoredFiles) {
-        if (activity._file == newActivity._file) {
-            duplicate = true;
-            break;
-        }
+    if (_sections[IgnoredFilesSection].isEmpty()) {
+        auto summary = newActivity;
+        summary._subject = tr("Files from the ignore list as well as symbolic links are not synced.");
+        _listedIgnoredFiles = summary._message;
+        insertActivity(IgnoredFilesSection, 0, summary);
+        return;
     }
 
-    if (!duplicate) {
-        _notificationIgnoredFiles._message.append(", " + newActivity._file);
+    // Only the first files are named, the others are counted
+    auto &summary = _sections[IgnoredFilesSection][0];
+    if (_ignoredFiles.size() <= _maxIgnoredFilesListed) {
+        _listedIgnoredFiles.append(", " + newActivity._file);
+        summary._message = _listedIgnoredFiles;
+    } else {
+        summary._message = tr("%1 and %n other file(s)", "", _ignoredFiles.size() - _maxIgnoredFilesListed).arg(_listedIgnoredFiles);
     }
+    updateActivity(IgnoredFilesSection, 0);
 }
 
 void ActivityListModel::addNotificationToActivityList(Activity activity)
 {
     qCInfo(lcActivity) << "Notification successfully added to the notification list: " << activity._subject;
-    _notificationLists.prepend(activity);
-    combineActivityLists();
+    addActivity(NotificationSection, activity);
 }
 
 void ActivityListModel::clearNotifications()
 {
     qCInfo(lcActivity) << "Clear the notifications";
-    _notificationLists.clear();
-    combineActivityLists();
+    clearSection(NotificationSection);
 }
 
 void ActivityListModel::removeActivityFromActivityList(int row)
 {
-    Activity activity = _finalList.at(row);
-    removeActivityFromActivityList(activity);
-    combineActivityLists();
+    if (row < 0 || row >= _rowCount) {
+        qCWarning(lcActivity) << "Couldn't remove activity at index" << row << "/ list size:" << _rowCount;
+        return;
+    }
+    removeActivityFromActivityList(activityAt(row));
 }
 
 void ActivityListModel::addSyncFileItemToActivityList(Activity activity)
 {
     qCInfo(lcActivity) << "Successfully added to the activity list: " << activity._subject;
-    _syncFileItemLists.prepend(activity);
-    combineActivityLists();
+    addActivity(SyncFileItemSection, activity);
+    capSection(SyncFileItemSection, _maxSyncFileItems);
 }
 
 void ActivityListModel::removeActivityFromActivityList(Activity activity)
@@ -396,39 +412,59 @@ void ActivityListModel::removeActivityFromActivityList(Activity activity)
     qCInfo(lcActivity) << "Activity/Notification/Error successfully dismissed: " << activity._subject;
     qCInfo(lcActivity) << "Trying to remove Activity/Notification/Error from view... ";
 
-    int index = -1;
+    auto section = ErrorSection;
     if (activity._type == Activity::ActivityType) {
-        index = _activityLists.indexOf(activity);
-        if (index != -1)
-            _activityLists.removeAt(index);
+        section = ActivitySection;
     } else if (activity._type == Activity::NotificationType) {
-        index = _notificationLists.indexOf(activity);
-        if (index != -1)
-            _notificationLists.removeAt(index);
-    } else {
-        index = _notificationErrorsLists.indexOf(activity);
-        if (index != -1)
-            _notificationErrorsLists.removeAt(index);
+        section = NotificationSection;
     }
 
+    const auto index = findActivity(section, activity._dateTime, [&activity](const Activity &listed) {
+        return listed == activity;
+    });
     if (index != -1) {
         qCInfo(lcActivity) << "Activity/Notification/Error successfully removed from the list.";
         qCInfo(lcActivity) << "Updating Activity/Notification/Error view.";
-        combineActivityLists();
+        removeActivities(section, index, 1);
+        updateMoreActivitiesEntry();
+    }
+}
+
+void ActivityListModel::removeErrorsFromActivityList(const QString &folder, const std::function<bool(const Activity &)> &shouldRemove)
+{
+    // Adjacent entries are removed together and the window is refilled once
+    auto &errors = _sections[ErrorSection];
+    auto removed = 0;
+    for (auto end = errors.count(); end > 0;) {
+        auto begin = end;
+        while (begin > 0 && errors.at(begin - 1)._folder == folder && shouldRemove(errors.at(begin - 1))) {
+            --begin;
+        }
+        if (begin != end) {
+            eraseActivities(ErrorSection, begin, end - begin);
+            removed += end - begin;
+        }
+        // The entry before begin was already checked
+        end = begin - 1;
+    }
+
+    if (removed > 0) {
+        qCInfo(lcActivity) << "Removed" << removed << "errors of folder" << folder;
+        fillWindow();
     }
 }
 
 void ActivityListModel::triggerDefaultAction(int activityIndex)
 {
-    if (activityIndex < 0 || activityIndex >= _finalList.size()) {
-        qCWarning(lcActivity) << "Couldn't trigger default action at index" << activityIndex << "/ final list size:" << _finalList.size();
+    if (activityIndex < 0 || activityIndex >= _rowCount) {
+        qCWarning(lcActivity) << "Couldn't trigger default action at index" << activityIndex << "/ final list size:" << _rowCount;
         return;
     }
 
     const auto modelIndex = index(activityIndex);
     const auto path = data(modelIndex, PathRole).toUrl();
 
-    const auto activity = _finalList.at(activityIndex);
+    const auto activity = activityAt(activityIndex);
     if (activity._status == SyncFileItem::Conflict) {
         Q_ASSERT(!activity._file.isEmpty());
         Q_ASSERT(!activity._folder.isEmpty());
@@ -471,12 +507,12 @@ void ActivityListModel::triggerDefaultAction(int activityIndex)
 
 void ActivityListModel::triggerAction(int activityIndex, int actionIndex)
 {
-    if (activityIndex < 0 || activityIndex >= _finalList.size()) {
-        qCWarning(lcActivity) << "Couldn't trigger action on activity at index" << activityIndex << "/ final list size:" << _finalList.size();
+    if (activityIndex < 0 || activityIndex >= _rowCount) {
+        qCWarning(lcActivity) << "Couldn't trigger action on activity at index" << activityIndex << "/ final list size:" << _rowCount;
         return;
     }
 
-    const auto activity = _finalList[activityIndex];
+    const auto activity = activityAt(activityIndex);
 
     if (actionIndex < 0 || actionIndex >= activity._links.size()) {
         qCWarning(lcActivity) << "Couldn't trigger action at index" << actionIndex << "/ actions list size:" << activity._links.size();
@@ -493,94 +529,255 @@ void ActivityListModel::triggerAction(int activityIndex, int actionIndex)
     emit sendNotificationRequest(activity._accName, action._link, action._verb, activityIndex);
 }
 
-void ActivityListModel::combineActivityLists()
+ActivityList ActivityListModel::activityList() const
 {
-    ActivityList resultList;
-
-    if (_notificationErrorsLists.count() > 0) {
-        std::sort(_notificationErrorsLists.begin(), _notificationErrorsLists.end());
-        resultList.append(_notificationErrorsLists);
+    ActivityList list;
+    for (const auto &section : _sections) {
+        list.append(section);
     }
-    if (_listOfIgnoredFiles.size() > 0)
-        resultList.append(_notificationIgnoredFiles);
+    return list;
+}
 
-    if (_notificationLists.count() > 0) {
-        std::sort(_notificationLists.begin(), _notificationLists.end());
-        resultList.append(_notificationLists);
+int ActivityListModel::sectionStart(Section section) const
+{
+    int start = 0;
+    for (int i = 0; i < section; ++i) {
+        start += _sections[i].count();
     }
+    return start;
+}
 
-    if (_syncFileItemLists.count() > 0) {
-        std::sort(_syncFileItemLists.begin(), _syncFileItemLists.end());
-        resultList.append(_syncFileItemLists);
+int ActivityListModel::totalCount() const
+{
+    return sectionStart(SectionCount);
+}
+
+const Activity &ActivityListModel::activityAt(int row) const
+{
+    Q_ASSERT(row >= 0 && row < totalCount());
+    int section = 0;
+    while (row >= _sections[section].count()) {
+        row -= _sections[section].count();
+        ++section;
     }
+    return _sections[section].at(row);
+}
+
+bool ActivityListModel::coalescesPaths(Section section)
+{
+    return section == ErrorSection || section == SyncFileItemSection;
+}
 
-    if (_activityLists.count() > 0) {
-        std::sort(_activityLists.begin(), _activityLists.end());
-        resultList.append(_activityLists);
+QString ActivityListModel::pathKey(const Activity &activity)
+{
+    return activity._folder + QLatin1Char('/') + activity._file;
+}
 
-        if(_showMoreActivitiesAvailableEntry) {
-            Activity a;
-            a._type = Activity::ActivityType;
-            a._accName = _accountState->account()->displayName();
-            a._id = -1;
-            a._subject = tr("For more activities please open the Activity app.");
-            a._dateTime = QDateTime::currentDateTime();
+int ActivityListModel::findActivity(Section section, const QDateTime &dateTime, const std::function<bool(const Activity &)> &matches) const
+{
+    // Sorted youngest first, only the entries of the same time need a look
+    const auto &list = _sections[section];
+    auto it = std::lower_bound(list.cbegin(), list.cend(), dateTime, [](const Activity &activity, const QDateTime &value) {
+        return activity._dateTime > value;
+    });
+    for (; it != list.cend() && it->_dateTime == dateTime; ++it) {
+        if (matches(*it)) {
+            return static_cast<int>(it - list.cbegin());
+        }
+    }
+    return -1;
+}
 
-            AccountApp *app = _accountState->findApp(QLatin1String("activity"));
-            if(app) {
-                a._link = app->url();
+void ActivityListModel::addActivity(Section section, const Activity &activity)
+{
+    if (coalescesPaths(section) && !activity._file.isEmpty()) {
+        const auto key = pathKey(activity);
+        const auto listed = _pathIndex[section].constFind(key);
+        if (listed != _pathIndex[section].constEnd()) {
+            const auto index = findActivity(section, *listed, [&key](const Activity &other) {
+                return pathKey(other) == key;
+            });
+            if (index != -1) {
+                removeActivities(section, index, 1);
             }
+        }
+    }
+
+    const auto &list = _sections[section];
+    const auto index = static_cast<int>(std::upper_bound(list.cbegin(), list.cend(), activity) - list.cbegin());
+    insertActivity(section, index, activity);
+}
+
+void ActivityListModel::insertActivity(Section section, int index, const Activity &activity)
+{
+    if (coalescesPaths(section) && !activity._file.isEmpty()) {
+        _pathIndex[section].insert(pathKey(activity), activity._dateTime);
+    }
 
-            resultList.append(a);
+    const auto row = sectionStart(section) + index;
+    if (row > _rowCount || (row == _rowCount && _rowCount == _windowSize)) {
+        // Below the window
+        _sections[section].insert(index, activity);
+        return;
+    }
+
+    if (_rowCount == _windowSize) {
+        // The last row makes room
+        beginRemoveRows(QModelIndex(), _rowCount - 1, _rowCount - 1);
+        --_rowCount;
+        endRemoveRows();
+    }
+    beginInsertRows(QModelIndex(), row, row);
+    _sections[section].insert(index, activity);
+    ++_rowCount;
+    endInsertRows();
+}
+
+void ActivityListModel::removeActivities(Section section, int index, int count)
+{
+    if (count <= 0) {
+        return;
+    }
+    eraseActivities(section, index, count);
+    fillWindow();
+}
+
+void ActivityListModel::eraseActivities(Section section, int index, int count)
+{
+
+    auto &list = _sections[section];
+    if (coalescesPaths(section)) {
+        for (auto i = index; i < index + count; ++i) {
+            const auto &activity = list.at(i);
+            const auto key = pathKey(activity);
+            if (!activity._file.isEmpty() && _pathIndex[section].value(key) == activity._dateTime) {
+                _pathIndex[section].remove(key);
+            }
         }
     }
 
-    beginResetModel();
-    _finalList.clear();
-    endResetModel();
+    const auto first = sectionStart(section) + index;
+    const auto lastVisible = qMin(first + count, _rowCount) - 1;
+    if (first <= lastVisible) {
+        beginRemoveRows(QModelIndex(), first, lastVisible);
+        list.erase(list.begin() + index, list.begin() + index + count);
+        _rowCount -= lastVisible - first + 1;
+        endRemoveRows();
+    } else {
+        list.erase(list.begin() + index, list.begin() + index + count);
+    }
+}
+
+void ActivityListModel::capSection(Section section, int maxCount)
+{
+    // The oldest ones are dropped
+    const auto excess = _sections[section].count() - maxCount;
+    if (excess > 0) {
+        removeActivities(section, maxCount, excess);
+    }
+}
+
+void ActivityListModel::clearSection(Section section)
+{
+    removeActivities(section, 0, _sections[section].count());
+}
 
-    if (resultList.count() > 0) {
-        beginInsertRows(QModelIndex(), 0, resultList.count() - 1);
-        _finalList = resultList;
-        endInsertRows();
+void ActivityListModel::updateActivity(Section section, int index)
+{
+    const auto row = sectionStart(section) + index;
+    if (row < _rowCount) {
+        emit dataChanged(this->index(row), this->index(row));
+    }
+}
+
+void ActivityListModel::fillWindow()
+{
+    const auto count = qMin(totalCount(), _windowSize);
+    if (count <= _rowCount) {
+        return;
+    }
+    beginInsertRows(QModelIndex(), _rowCount, count - 1);
+    _rowCount = count;
+    endInsertRows();
+}
+
+void ActivityListModel::updateMoreActivitiesEntry()
+{
+    const auto shown = !_sections[MoreActivitiesSection].isEmpty();
+    const auto wanted = _showMoreActivitiesAvailableEntry && !_sections[ActivitySection].isEmpty();
+    if (shown == wanted) {
+        return;
+    }
+    if (!wanted) {
+        clearSection(MoreActivitiesSection);
+        return;
+    }
+
+    Activity a;
+    a._type = Activity::ActivityType;
+    a._accName = _accountState->account()->displayName();
+    a._id = -1;
+    a._subject = tr("For more activities please open the Activity app.");
+    a._dateTime = QDateTime::currentDateTime();
+
+    AccountApp *app = _accountState->findApp(QLatin1String("activity"));
+    if(app) {
+        a._link = app->url();
     }
+
+    insertActivity(MoreActivitiesSection, 0, a);
 }
 
 bool ActivityListModel::canFetchActivities() const
 {
-    return _accountState->isConnected() && _accountState->account()->capabilities().hasActivities();
+    return _accountState && _accountState->isConnected() && _accountState->account()->capabilities().hasActivities();
 }
 
 void ActivityListModel::fetchMore(const QModelIndex &)
 {
+    // Page in what is there before asking the server
+    if (_rowCount < totalCount()) {
+        _windowSize = _rowCount + _pageSize;
+        fillWindow();
+        return;
+    }
+
     if (canFetchActivities()) {
         startFetchJob();
     } else {
         _doneFetching = true;
-        combineActivityLists();
     }
 }
 
 void ActivityListModel::slotRefreshActivity()
 {
-    _activityLists.clear();
+    clearSection(ActivitySection);
     _doneFetching = false;
     _currentItem = 0;
     _totalActivitiesFetched = 0;
     _showMoreActivitiesAvailableEntry = false;
+    updateMoreActivitiesEntry();
 
     if (canFetchActivities()) {
         startFetchJob();
     } else {
         _doneFetching = true;
-        combineActivityLists();
     }
 }
 
 void ActivityListModel::slotRemoveAccount()
 {
-    _finalList.clear();
-    _activityLists.clear();
+    beginResetModel();
+    for (auto &section : _sections) {
+        section.clear();
+    }
+    for (auto &pathIndex : _pathIndex) {
+        pathIndex.clear();
+    }
+    _ignoredFiles.clear();
+    _listedIgnoredFiles.clear();
+    _rowCount = 0;
+    endResetModel();
     _currentlyFetching = false;
     _doneFetching = false;
     _currentItem = 0;
@@ -17,6 +17,9 @@
 
 #include <QtCore>
 
+#include <array>
+#include <functional>
+
 #include "ActivityData.h"
 
 class QJsonDocument;
@@ -33,6 +36,14 @@ class ConflictDialog;
  * @ingroup gui
  *
  * Simple list model to provide the list view with data.
+ *
+ * The rows are the errors, the summary of ignored files, the notifications,
+ * the sync file items and the server activities, each section youngest first.
+ * New entries are inserted at their place and entries for a path that is
+ * already listed replace the older one. The errors, sync file items and
+ * activities are capped, the oldest ones are dropped. Only a window of the first rows is
+ * exposed, fetchMore() pages in older entries before asking the server for
+ * more activities.
  */
 
 class ActivityListModel : public QAbstractListModel
@@ -65,8 +76,8 @@ public:
     bool canFetchMore(const QModelIndex &) const override;
     void fetchMore(const QModelIndex &) override;
 
-    ActivityList activityList() { return _finalList; }
-    ActivityList errorsList() { return _notificationErrorsLists; }
+    ActivityList activityList() const;
+    ActivityList errorsList() const { return _sections[ErrorSection]; }
     void addNotificationToActivityList(Activity activity);
     void clearNotifications();
     void addErrorToActivityList(Activity activity);
@@ -74,6 +85,8 @@ public:
     void addSyncFileItemToActivityList(Activity activity);
     void removeActivityFromActivityList(int row);
     void removeActivityFromActivityList(Activity activity);
+    /// Removes the errors of \a folder for which \a shouldRemove returns true
+    void removeErrorsFromActivityList(const QString &folder, const std::function<bool(const Activity &)> &shouldRemove);
 
     Q_INVOKABLE void triggerDefaultAction(int activityIndex);
     Q_INVOKABLE void triggerAction(int activityIndex, int actionIndex);
@@ -94,17 +107,56 @@ protected:
     QHash<int, QByteArray> roleNames() const override;
 
 private:
+    /// The sections of the list, in display order
+    enum Section {
+        ErrorSection,
+        IgnoredFilesSection,
+        NotificationSection,
+        SyncFileItemSection,
+        ActivitySection,
+        MoreActivitiesSection,
+        SectionCount
+    };
+
     void startFetchJob();
-    void combineActivityLists();
     bool canFetchActivities() const;
 
-    ActivityList _activityLists;
-    ActivityList _syncFileItemLists;
-    ActivityList _notificationLists;
-    ActivityList _listOfIgnoredFiles;
-    Activity _notificationIgnoredFiles;
-    ActivityList _notificationErrorsLists;
-    ActivityList _finalList;
+    /// The row of the first entry of \a section, counting hidden rows
+    int sectionStart(Section section) const;
+    int totalCount() const;
+    const Activity &activityAt(int row) const;
+
+    /// Inserts at the sorted position, replacing an older entry for the same path
+    void addActivity(Section section, const Activity &activity);
+    void insertActivity(Section section, int index, const Activity &activity);
+    void removeActivities(Section section, int index, int count);
+    /// Same as removeActivities() but leaves the window unfilled
+    void eraseActivities(Section section, int index, int count);
+    /// Drops the oldest entries of \a section beyond \a maxCount
+    void capSection(Section section, int maxCount);
+    void clearSection(Section section);
+    void updateActivity(Section section, int index);
+    /// Exposes hidden rows until the window is full
+    void fillWindow();
+    void updateMoreActivitiesEntry();
+
+    /// The index of the entry of \a section with \a dateTime that \a matches, or -1
+    int findActivity(Section section, const QDateTime &dateTime, const std::function<bool(const Activity &)> &matches) const;
+    static bool coalescesPaths(Section section);
+    static QString pathKey(const Activity &activity);
+
+    std::array<ActivityList, SectionCount> _sections;
+    /// The time of the entry listed for a path in the sections that coalesce paths
+    std::array<QHash<QString, QDateTime>, SectionCount> _pathIndex;
+    QSet<QString> _ignoredFiles;
+    QString _listedIgnoredFiles;
+    int _rowCount = 0;
+    int _windowSize = 100;
+    int _pageSize = 100;
+    int _maxSyncFileItems = 2000;
+    int _maxErrors = 2000;
+    int _maxIgnoredFilesListed = 50;
+
     AccountState *_accountState;
     bool _currentlyFetching = false;
     bool _doneFetching = false;
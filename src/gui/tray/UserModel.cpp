@@ -322,45 +322,22 @@ void User::slotProgressInfo(const QString &folder, const ProgressInfo &progress)
             return;
         const auto &engine = f->syncEngine();
         const auto style = engine.lastLocalDiscoveryStyle();
-        foreach (Activity activity, _activityModel->errorsList()) {
-            if (activity._folder != folder) {
-                continue;
-            }
-
+        _activityModel->removeErrorsFromActivityList(folder, [&](const Activity &activity) {
             if (style == LocalDiscoveryStyle::FilesystemOnly) {
-                _activityModel->removeActivityFromActivityList(activity);
-                continue;
+                return true;
             }
 
-            if (activity._status == SyncFileItem::Conflict && !QFileInfo(f->path() + activity._file).exists()) {
-                _activityModel->removeActivityFromActivityList(activity);
-                continue;
-            }
-
-            if (activity._status == SyncFileItem::FileLocked && !QFileInfo(f->path() + activity._file).exists()) {
-                _activityModel->removeActivityFromActivityList(activity);
-                continue;
-            }
-
-
-            if (activity._status == SyncFileItem::FileIgnored && !QFileInfo(f->path() + activity._file).exists()) {
-                _activityModel->removeActivityFromActivityList(activity);
-                continue;
-            }
-
-
+            // Conflicts, locked and ignored files and other errors for files that are gone
             if (!QFileInfo(f->path() + activity._file).exists()) {
-                _activityModel->removeActivityFromActivityList(activity);
-                continue;
+                return true;
             }
 
             auto path = QFileInfo(activity._file).dir().path().toUtf8();
             if (path == ".")
                 path.clear();
 
-            if (engine.shouldDiscoverLocally(path))
-                _activityModel->removeActivityFromActivityList(activity);
-        }
+            return engine.shouldDiscoverLocally(path);
+        });
     }
 
     if (progress.status() == ProgressInfo::Done) {
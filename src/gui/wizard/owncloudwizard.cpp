@@ -340,6 +340,26 @@ void OwncloudWizard::askExperimentalVirtualFilesFeature(QWidget *receiver, const
         acceptButton = msgBox->addButton(tr("Enable experimental placeholder mode"), QMessageBox::AcceptRole);
         msgBox->addButton(tr("Stay safe"), QMessageBox::RejectRole);
         break;
+    case Vfs::Fuse:
+        msgBox = new QMessageBox(
+            QMessageBox::Warning,
+            tr("Enable experimental feature?"),
+            tr("When the \"virtual files\" mode is enabled no files will be downloaded initially. "
+               "Instead, the files that exist on the server appear with their full size and "
+               "their contents are downloaded when they are read."
+               "\n\n"
+               "The virtual files mode is mutually exclusive with selective sync. "
+               "Currently unselected folders will be translated to online-only folders "
+               "and your selective sync settings will be reset."
+               "\n\n"
+               "Switching to this mode will abort any currently running synchronization."
+               "\n\n"
+               "This is a new, experimental mode. If you decide to use it, please report any "
+               "issues that come up."),
+            QMessageBox::NoButton, receiver);
+        acceptButton = msgBox->addButton(tr("Enable experimental placeholder mode"), QMessageBox::AcceptRole);
+        msgBox->addButton(tr("Stay safe"), QMessageBox::RejectRole);
+        break;
     case Vfs::Off:
         Q_UNREACHABLE();
     }
@@ -270,7 +270,8 @@ void AbstractNetworkJob::slotFinished()
 
     AbstractCredentials *creds = _account->credentials();
     if (!creds->stillValid(_reply) && !_ignoreCredentialFailure) {
-        _account->handleInvalidCredentials();
+        // Right away unless the job runs on a sync thread, see Account::addThreadNetworkAccessManager()
+        QMetaObject::invokeMethod(_account.data(), [account = _account] { account->handleInvalidCredentials(); });
     }
 
     bool discard = finished();
@@ -37,6 +37,7 @@
 #include <QSslKey>
 #include <QAuthenticator>
 #include <QStandardPaths>
+#include <QThread>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
@@ -286,6 +287,17 @@ void Account::resetNetworkAccessManager()
         SLOT(slotHandleSslErrors(QNetworkReply *, QList<QSslError>)));
     connect(_am.data(), &QNetworkAccessManager::proxyAuthenticationRequired,
         this, &Account::proxyAuthenticationRequired);
+
+    // The sync threads get new ones too, the old ones go once their thread is idle
+    QMutexLocker locker(&_threadAmsMutex);
+    for (auto it = _threadAms.begin(); it != _threadAms.end(); ++it) {
+        if (!_ownThreadAms.remove(it.value()))
+            continue;
+        it.value()->deleteLater();
+        it.value() = createThreadNetworkAccessManager();
+        it.value()->moveToThread(it.key());
+        _ownThreadAms.insert(it.value());
+    }
 }
 
 QNetworkAccessManager *Account::networkAccessManager()
@@ -298,22 +310,68 @@ QSharedPointer<QNetworkAccessManager> Account::sharedNetworkAccessManager()
     return _am;
 }
 
+QNetworkAccessManager *Account::createThreadNetworkAccessManager()
+{
+    auto am = _credentials->createQNAM();
+    // The credentials handle authentication requests of their QNAM in this thread
+    disconnect(am, nullptr, _credentials.data(), nullptr);
+    am->setProxy(_am->proxy());
+    // Emitted in the QNAM's thread, the errors must be ignored before returning
+    connect(am, &QNetworkAccessManager::sslErrors, this, &Account::handleThreadSslErrors, Qt::DirectConnection);
+    return am;
+}
+
+void Account::addThreadNetworkAccessManager(QThread *thread)
+{
+    auto am = createThreadNetworkAccessManager();
+    am->moveToThread(thread);
+    QMutexLocker locker(&_threadAmsMutex);
+    _ownThreadAms.insert(am);
+    _threadAms.insert(thread, am);
+}
+
+void Account::setThreadNetworkAccessManager(QThread *thread, QNetworkAccessManager *am)
+{
+    ASSERT(!am || am->thread() == thread);
+    QMutexLocker locker(&_threadAmsMutex);
+    auto previous = _threadAms.value(thread);
+    if (am) {
+        _threadAms.insert(thread, am);
+    } else {
+        _threadAms.remove(thread);
+    }
+    if (previous && previous != am && _ownThreadAms.remove(previous)) {
+        if (previous->thread() == QThread::currentThread()) {
+            delete previous;
+        } else {
+            previous->deleteLater();
+        }
+    }
+}
+
 QNetworkReply *Account::sendRawRequest(const QByteArray &verb, const QUrl &url, QNetworkRequest req, QIODevice *data)
 {
+    QNetworkAccessManager *am = _am.data();
+    if (QThread::currentThread() != thread()) {
+        QMutexLocker locker(&_threadAmsMutex);
+        if (auto threadAm = _threadAms.value(QThread::currentThread()))
+            am = threadAm;
+    }
+
     req.setUrl(url);
     req.setSslConfiguration(this->getOrCreateSslConfig());
     if (verb == "HEAD" && !data) {
-        return _am->head(req);
+        return am->head(req);
     } else if (verb == "GET" && !data) {
-        return _am->get(req);
+        return am->get(req);
     } else if (verb == "POST") {
-        return _am->post(req, data);
+        return am->post(req, data);
     } else if (verb == "PUT") {
-        return _am->put(req, data);
+        return am->put(req, data);
     } else if (verb == "DELETE" && !data) {
-        return _am->deleteResource(req);
+        return am->deleteResource(req);
     }
-    return _am->sendCustomRequest(req, verb, data);
+    return am->sendCustomRequest(req, verb, data);
 }
 
 SimpleNetworkJob *Account::sendRequest(const QByteArray &verb, const QUrl &url, QNetworkRequest req, QIODevice *data)
@@ -323,17 +381,26 @@ SimpleNetworkJob *Account::sendRequest(const QByteArray &verb, const QUrl &url,
     return job;
 }
 
+QSslConfiguration Account::sslConfiguration() const
+{
+    QMutexLocker locker(&_stateMutex);
+    return _sslConfiguration;
+}
+
 void Account::setSslConfiguration(const QSslConfiguration &config)
 {
+    QMutexLocker locker(&_stateMutex);
     _sslConfiguration = config;
 }
 
 QSslConfiguration Account::getOrCreateSslConfig()
 {
-    if (!_sslConfiguration.isNull()) {
+    // Requests of sync threads get a copy while the account thread may set it
+    auto sslConfiguration = this->sslConfiguration();
+    if (!sslConfiguration.isNull()) {
         // Will be set by CheckServerJob::finished()
         // We need to use a central shared config to get SSL session tickets
-        return _sslConfiguration;
+        return sslConfiguration;
     }
 
     // if setting the client certificate fails, you will probably get an error similar to this:
@@ -348,19 +415,30 @@ QSslConfiguration Account::getOrCreateSslConfig()
     return sslConfig;
 }
 
+QList<QSslCertificate> Account::approvedCerts() const
+{
+    QMutexLocker locker(&_stateMutex);
+    return _approvedCerts;
+}
+
 void Account::setApprovedCerts(const QList<QSslCertificate> certs)
 {
-    _approvedCerts = certs;
+    {
+        QMutexLocker locker(&_stateMutex);
+        _approvedCerts = certs;
+    }
     QSslSocket::addDefaultCaCertificates(certs);
 }
 
 void Account::addApprovedCerts(const QList<QSslCertificate> certs)
 {
+    QMutexLocker locker(&_stateMutex);
     _approvedCerts += certs;
 }
 
 void Account::resetRejectedCertificates()
 {
+    QMutexLocker locker(&_stateMutex);
     _rejectedCertificates.clear();
 }
 
@@ -413,9 +491,12 @@ void Account::slotHandleSslErrors(QNetworkReply *reply, QList<QSslError> errors)
     }
 
     bool allPreviouslyRejected = true;
-    foreach (const QSslError &error, errors) {
-        if (!_rejectedCertificates.contains(error.certificate())) {
-            allPreviouslyRejected = false;
+    {
+        QMutexLocker locker(&_stateMutex);
+        foreach (const QSslError &error, errors) {
+            if (!_rejectedCertificates.contains(error.certificate())) {
+                allPreviouslyRejected = false;
+            }
         }
     }
 
@@ -460,6 +541,7 @@ void Account::slotHandleSslErrors(QNetworkReply *reply, QList<QSslError> errors)
             return;
 
         // Mark all involved certificates as rejected, so we don't ask the user again.
+        QMutexLocker locker(&_stateMutex);
         foreach (const QSslError &error, errors) {
             if (!_rejectedCertificates.contains(error.certificate())) {
                 _rejectedCertificates.append(error.certificate());
@@ -471,6 +553,59 @@ void Account::slotHandleSslErrors(QNetworkReply *reply, QList<QSslError> errors)
     }
 }
 
+void Account::handleThreadSslErrors(QNetworkReply *reply, const QList<QSslError> &errors)
+{
+    // Runs in the sync thread, which can't wait for the account thread to ask the user
+    bool allApproved = true;
+    bool allPreviouslyRejected = true;
+    {
+        QMutexLocker locker(&_stateMutex);
+        for (const auto &error : errors) {
+            allApproved = allApproved && _approvedCerts.contains(error.certificate());
+            allPreviouslyRejected = allPreviouslyRejected && _rejectedCertificates.contains(error.certificate());
+        }
+    }
+    if (allApproved) {
+        reply->ignoreSslErrors(errors);
+        return;
+    }
+    if (allPreviouslyRejected) {
+        qCInfo(lcAccount) << "SSL errors for" << reply->url() << "of certificates rejected by the user";
+        return;
+    }
+
+    // This request fails, the next ones pass once the user approved the certificates
+    qCWarning(lcAccount) << "SSL errors for" << reply->url() << "in a sync thread, asking the user";
+    QMetaObject::invokeMethod(this, [this, errors, conf = reply->sslConfiguration()] {
+        askForThreadSslErrors(errors, conf);
+    });
+}
+
+void Account::askForThreadSslErrors(const QList<QSslError> &errors, const QSslConfiguration &conf)
+{
+    // Parallel requests hit the same errors
+    if (_askingForThreadSslErrors || _sslErrorHandler.isNull())
+        return;
+    _askingForThreadSslErrors = true;
+
+    QList<QSslCertificate> approvedCerts;
+    if (_sslErrorHandler->handleErrors(errors, conf, &approvedCerts, sharedFromThis())) {
+        if (!approvedCerts.isEmpty()) {
+            QSslSocket::addDefaultCaCertificates(approvedCerts);
+            addApprovedCerts(approvedCerts);
+            emit wantsAccountSaved(this);
+        }
+    } else {
+        QMutexLocker locker(&_stateMutex);
+        for (const auto &error : errors) {
+            if (!_rejectedCertificates.contains(error.certificate())) {
+                _rejectedCertificates.append(error.certificate());
+            }
+        }
+    }
+    _askingForThreadSslErrors = false;
+}
+
 void Account::slotCredentialsFetched()
 {
     emit credentialsFetched(_credentials.data());
@@ -494,14 +629,18 @@ void Account::clearQNAMCache()
     _am->clearAccessCache();
 }
 
-const Capabilities &Account::capabilities() const
+Capabilities Account::capabilities() const
 {
+    QMutexLocker locker(&_stateMutex);
     return _capabilities;
 }
 
 void Account::setCapabilities(const QVariantMap &caps)
 {
-    _capabilities = Capabilities(caps);
+    {
+        QMutexLocker locker(&_stateMutex);
+        _capabilities = Capabilities(caps);
+    }
 
     trySetupPushNotifications();
 }
@@ -682,6 +821,7 @@ void Account::slotDirectEditingRecieved(const QJsonDocument &json)
                 directEditor->addOptionalMimetype(optionalMimeType.toString().toLatin1());
             }
 
+            QMutexLocker locker(&_stateMutex);
             _capabilities.addDirectEditor(directEditor);
         }
     }
@@ -26,6 +26,9 @@
 #include <QSslCipher>
 #include <QSslError>
 #include <QSharedPointer>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
 
 #ifndef TOKEN_AUTH_ONLY
 #include <QPixmap>
@@ -40,6 +43,7 @@ class QSettings;
 class QNetworkReply;
 class QUrl;
 class QNetworkAccessManager;
+class QThread;
 
 namespace QKeychain {
 class Job;
@@ -163,7 +167,7 @@ public:
 
     /** The ssl configuration during the first connection */
     QSslConfiguration getOrCreateSslConfig();
-    QSslConfiguration sslConfiguration() const { return _sslConfiguration; }
+    QSslConfiguration sslConfiguration() const;
     void setSslConfiguration(const QSslConfiguration &config);
     // Because of bugs in Qt, we use this to store info needed for the SSL Button
     QSslCipher _sessionCipher;
@@ -172,7 +176,7 @@ public:
 
 
     /** The certificates of the account */
-    QList<QSslCertificate> approvedCerts() const { return _approvedCerts; }
+    QList<QSslCertificate> approvedCerts() const;
     void setApprovedCerts(const QList<QSslCertificate> certs);
     void addApprovedCerts(const QList<QSslCertificate> certs);
 
@@ -192,7 +196,7 @@ public:
     void setCertificate(const QByteArray certficate = QByteArray(), const QString privateKey = QString());
 
     /** Access the server capabilities */
-    const Capabilities &capabilities() const;
+    Capabilities capabilities() const;
     void setCapabilities(const QVariantMap &caps);
 
     /** Access the server version
@@ -237,6 +241,24 @@ public:
     QNetworkAccessManager *networkAccessManager();
     QSharedPointer<QNetworkAccessManager> sharedNetworkAccessManager();
 
+    /**
+     * Gives \a thread a QNAM of its own for the requests made from it.
+     *
+     * It has the credentials and proxy of networkAccessManager(), but none of
+     * its cookies. The account owns it and replaces it in
+     * resetNetworkAccessManager(); setThreadNetworkAccessManager() with
+     * nullptr removes it again.
+     */
+    void addThreadNetworkAccessManager(QThread *thread);
+
+    /**
+     * Makes sendRawRequest() use \a am for the requests made from \a thread.
+     *
+     * \a am must live in \a thread and is owned by the caller. nullptr goes
+     * back to networkAccessManager().
+     */
+    void setThreadNetworkAccessManager(QThread *thread, QNetworkAccessManager *am);
+
     /// Called by network jobs on credential errors, emits invalidCredentials()
     void handleInvalidCredentials();
 
@@ -294,6 +316,9 @@ private:
     Account(QObject *parent = nullptr);
     void setSharedThis(AccountPtr sharedThis);
     void trySetupPushNotifications();
+    QNetworkAccessManager *createThreadNetworkAccessManager();
+    void handleThreadSslErrors(QNetworkReply *reply, const QList<QSslError> &errors);
+    void askForThreadSslErrors(const QList<QSslError> &errors, const QSslConfiguration &conf);
 
     QWeakPointer<Account> _sharedThis;
     QString _id;
@@ -313,6 +338,8 @@ private:
      */
     QUrl _userVisibleUrl;
 
+    // Guards the state the requests of sync threads read
+    mutable QMutex _stateMutex;
     QList<QSslCertificate> _approvedCerts;
     QSslConfiguration _sslConfiguration;
     Capabilities _capabilities;
@@ -320,6 +347,12 @@ private:
     QScopedPointer<AbstractSslErrorHandler> _sslErrorHandler;
     QSharedPointer<QNetworkAccessManager> _am;
     QScopedPointer<AbstractCredentials> _credentials;
+
+    // The QNAMs of other threads, see setThreadNetworkAccessManager()
+    QMutex _threadAmsMutex;
+    QHash<QThread *, QNetworkAccessManager *> _threadAms;
+    QSet<QNetworkAccessManager *> _ownThreadAms; // from addThreadNetworkAccessManager()
+    bool _askingForThreadSslErrors = false;
     bool _http2Supported = false;
 
     /// Certificates that were explicitly rejected by the user
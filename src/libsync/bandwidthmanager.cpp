@@ -61,10 +61,9 @@ BandwidthManager::BandwidthManager(OwncloudPropagator *p)
     _switchingTimer.start();
     QMetaObject::invokeMethod(this, "switchingTimerExpired", Qt::QueuedConnection);
 
-    // absolute uploads/downloads
+    // absolute uploads/downloads, only runs while there are limited transfers
     QObject::connect(&_absoluteLimitTimer, &QTimer::timeout, this, &BandwidthManager::absoluteLimitTimerExpired);
-    _absoluteLimitTimer.setInterval(1000);
-    _absoluteLimitTimer.start();
+    _absoluteLimitTimer.setInterval(tokenIntervalMsec);
 
     // Relative uploads
     QObject::connect(&_relativeUploadMeasuringTimer, &QTimer::timeout,
@@ -89,6 +88,16 @@ BandwidthManager::BandwidthManager(OwncloudPropagator *p)
 
 BandwidthManager::~BandwidthManager() = default;
 
+void BandwidthManager::startAbsoluteLimitTimer()
+{
+    if (_absoluteLimitTimer.isActive())
+        return;
+    _uploadTokens = 0;
+    _downloadTokens = 0;
+    _lastRefill.start();
+    _absoluteLimitTimer.start();
+}
+
 void BandwidthManager::registerUploadDevice(UploadDevice *p)
 {
     _absoluteUploadDeviceList.push_back(p);
@@ -98,6 +107,7 @@ void BandwidthManager::registerUploadDevice(UploadDevice *p)
     if (usingAbsoluteUploadLimit()) {
         p->setBandwidthLimited(true);
         p->setChoked(false);
+        startAbsoluteLimitTimer();
     } else if (usingRelativeUploadLimit()) {
         p->setBandwidthLimited(true);
         p->setChoked(true);
@@ -126,6 +136,7 @@ void BandwidthManager::registerDownloadJob(GETFileJob *j)
     if (usingAbsoluteDownloadLimit()) {
         j->setBandwidthLimited(true);
         j->setChoked(false);
+        startAbsoluteLimitTimer();
     } else if (usingRelativeDownloadLimit()) {
         j->setBandwidthLimited(true);
         j->setChoked(true);
@@ -348,6 +359,7 @@ void BandwidthManager::switchingTimerExpired()
             } else if (newUploadLimit > 0) {
                 ud->setBandwidthLimited(true);
                 ud->setChoked(false);
+                startAbsoluteLimitTimer();
             } else if (newUploadLimit < 0) {
                 ud->setBandwidthLimited(true);
                 ud->setChoked(true);
@@ -362,6 +374,7 @@ void BandwidthManager::switchingTimerExpired()
             if (usingAbsoluteDownloadLimit()) {
                 j->setBandwidthLimited(true);
                 j->setChoked(false);
+                startAbsoluteLimitTimer();
             } else if (usingRelativeDownloadLimit()) {
                 j->setBandwidthLimited(true);
                 j->setChoked(true);
@@ -373,24 +386,39 @@ void BandwidthManager::switchingTimerExpired()
     }
 }
 
+/* Refills the bucket for \a elapsedMsec at \a limit bytes per second and splits
+ * it evenly between \a transfers. Quota they didn't use since the last tick is
+ * taken back first, that way it goes to the transfers that can use it. */
+template <typename Transfer>
+static void shareTokens(qint64 &tokens, qint64 limit, qint64 elapsedMsec, const std::list<Transfer *> &transfers)
+{
+    for (auto transfer : transfers)
+        tokens += transfer->bandwidthQuota();
+    tokens = qMin(tokens + limit * elapsedMsec / 1000,
+        qMax(limit * BandwidthManager::tokenBurstMsec / 1000, qint64(1)));
+    if (transfers.empty())
+        return;
+    const qint64 share = tokens / qint64(transfers.size());
+    for (auto transfer : transfers)
+        transfer->giveBandwidthQuota(share);
+    tokens -= share * qint64(transfers.size());
+}
+
 void BandwidthManager::absoluteLimitTimerExpired()
 {
-    if (usingAbsoluteUploadLimit() && !_absoluteUploadDeviceList.empty()) {
-        qint64 quotaPerDevice = _currentUploadLimit / qMax((std::list<UploadDevice *>::size_type)1, _absoluteUploadDeviceList.size());
-        qCDebug(lcBandwidthManager) << quotaPerDevice << _absoluteUploadDeviceList.size() << _currentUploadLimit;
-        Q_FOREACH (UploadDevice *device, _absoluteUploadDeviceList) {
-            device->giveBandwidthQuota(quotaPerDevice);
-            qCDebug(lcBandwidthManager) << "Gave " << quotaPerDevice / 1024.0 << " kB to" << device;
-        }
-    }
-    if (usingAbsoluteDownloadLimit() && !_downloadJobList.empty()) {
-        qint64 quotaPerJob = _currentDownloadLimit / qMax((std::list<GETFileJob *>::size_type)1, _downloadJobList.size());
-        qCDebug(lcBandwidthManager) << quotaPerJob << _downloadJobList.size() << _currentDownloadLimit;
-        Q_FOREACH (GETFileJob *j, _downloadJobList) {
-            j->giveBandwidthQuota(quotaPerJob);
-            qCDebug(lcBandwidthManager) << "Gave " << quotaPerJob / 1024.0 << " kB to" << j;
-        }
+    const bool uploads = usingAbsoluteUploadLimit() && !_absoluteUploadDeviceList.empty();
+    const bool downloads = usingAbsoluteDownloadLimit() && !_downloadJobList.empty();
+    if (!uploads && !downloads) {
+        // Restarted by the next limited transfer
+        _absoluteLimitTimer.stop();
+        return;
     }
+
+    const qint64 elapsedMsec = qBound(qint64(0), _lastRefill.restart(), qint64(tokenBurstMsec));
+    if (uploads)
+        shareTokens(_uploadTokens, _currentUploadLimit, elapsedMsec, _absoluteUploadDeviceList);
+    if (downloads)
+        shareTokens(_downloadTokens, _currentDownloadLimit, elapsedMsec, _downloadJobList);
 }
 
 } // namespace OCC
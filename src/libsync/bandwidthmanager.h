@@ -15,6 +15,7 @@
 #ifndef BANDWIDTHMANAGER_H
 #define BANDWIDTHMANAGER_H
 
+#include <QElapsedTimer>
 #include <QObject>
 #include <QTimer>
 #include <QIODevice>
@@ -29,6 +30,16 @@ class OwncloudPropagator;
 /**
  * @brief The BandwidthManager class
  * @ingroup libsync
+ *
+ * Absolute limits are enforced with a token bucket per direction: every
+ * tokenIntervalMsec the bucket is refilled at the configured rate and its
+ * tokens are split evenly between all registered transfers. Quota a transfer
+ * didn't use by the next tick goes back into the bucket and is shared anew,
+ * so any number of transfers can run in parallel and together stay at the
+ * limit. The bucket holds at most tokenBurstMsec worth of data.
+ *
+ * Relative limits measure the full speed of one transfer at a time and hand
+ * out a share of it in turns.
  */
 class BandwidthManager : public QObject
 {
@@ -42,6 +53,8 @@ public:
     bool usingAbsoluteDownloadLimit() { return _currentDownloadLimit > 0; }
     bool usingRelativeDownloadLimit() { return _currentDownloadLimit < 0; }
 
+    static constexpr int tokenIntervalMsec = 20;
+    static constexpr int tokenBurstMsec = 100;
 
 public slots:
     void registerUploadDevice(UploadDevice *);
@@ -69,6 +82,10 @@ private:
 
     // for absolute up/down bw limiting
     QTimer _absoluteLimitTimer;
+    QElapsedTimer _lastRefill;
+    qint64 _uploadTokens = 0;
+    qint64 _downloadTokens = 0;
+    void startAbsoluteLimitTimer();
 
     // FIXME merge these two lists
     std::list<UploadDevice *> _absoluteUploadDeviceList;
@@ -177,6 +177,16 @@ bool Capabilities::chunkingNg() const
     return _capabilities["dav"].toMap()["chunking"].toByteArray() >= "1.0";
 }
 
+bool Capabilities::bulkUpload() const
+{
+    static const auto bulkupload = qgetenv("OWNCLOUD_BULK_UPLOAD");
+    if (bulkupload == "0")
+        return false;
+    if (bulkupload == "1")
+        return true;
+    return _capabilities["dav"].toMap()["bulkupload"].toByteArray() >= "1.0";
+}
+
 PushNotificationTypes Capabilities::availablePushNotifications() const
 {
     if (!_capabilities.contains("notify_push")) {
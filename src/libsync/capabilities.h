@@ -57,6 +57,9 @@ public:
     bool shareResharing() const;
     bool chunkingNg() const;
 
+    /// Whether small files may be uploaded together in one multipart request
+    bool bulkUpload() const;
+
     /// Returns which kind of push notfications are available
     PushNotificationTypes availablePushNotifications() const;
 
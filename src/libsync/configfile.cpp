@@ -35,10 +35,13 @@
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QFileSystemWatcher>
 #include <QLoggingCategory>
+#include <QMutex>
 #include <QSettings>
 #include <QNetworkProxy>
 #include <QStandardPaths>
+#include <QVector>
 
 #define QTLEGACY (QT_VERSION < QT_VERSION_CHECK(5,9,0))
 
@@ -76,6 +79,15 @@ static const char chunkSizeC[] = "chunkSize";
 static const char minChunkSizeC[] = "minChunkSize";
 static const char maxChunkSizeC[] = "maxChunkSize";
 static const char targetChunkUploadDurationC[] = "targetChunkUploadDuration";
+static const char maxParallelChunksC[] = "maxParallelChunks";
+static const char journalWriteBehindBatchSizeC[] = "journalWriteBehindBatchSize";
+static const char journalWriteBehindIntervalC[] = "journalWriteBehindInterval";
+static const char downloadBufferSizeC[] = "downloadBufferSize";
+static const char remoteSubtreeListingC[] = "remoteSubtreeListing";
+static const char localDiscoveryThreadsC[] = "localDiscoveryThreads";
+static const char pipelinedPropagationC[] = "pipelinedPropagation";
+static const char maxConcurrentSyncsC[] = "maxConcurrentSyncs";
+static const char folderSyncThreadsC[] = "folderSyncThreads";
 static const char automaticLogDirC[] = "logToTemporaryLogDir";
 static const char logDirC[] = "logDir";
 static const char logDebugC[] = "logDebug";
@@ -107,7 +119,256 @@ const char certPasswd[] = "http_certificatePasswd";
 QString ConfigFile::_confDir = QString();
 bool ConfigFile::_askedUser = false;
 
-static chrono::milliseconds millisecondsValue(const QSettings &setting, const char *key,
+namespace {
+
+    /// A write of CachedSettings that is not in the file yet
+    struct ConfigChange
+    {
+        QString key;
+        QVariant value;
+        bool remove;
+    };
+
+    /**
+     * The parsed config file, shared by all ConfigFile instances and threads
+     */
+    class ConfigCache
+    {
+    public:
+        void ensureLoaded(const QString &fileName)
+        {
+            QMutexLocker lock(&_mutex);
+            if (fileName != _fileName)
+                load(fileName);
+        }
+
+        QVariant value(const QString &fileName, const QString &key, const QVariant &defaultValue)
+        {
+            QMutexLocker lock(&_mutex);
+            if (fileName != _fileName)
+                load(fileName);
+            return _values.value(key, defaultValue);
+        }
+
+        bool contains(const QString &fileName, const QString &key)
+        {
+            QMutexLocker lock(&_mutex);
+            if (fileName != _fileName)
+                load(fileName);
+            return _values.contains(key);
+        }
+
+        /// Writes \a changes to the file and takes over its new contents
+        void write(const QString &fileName, const QVector<ConfigChange> &changes)
+        {
+            QMutexLocker lock(&_mutex);
+            QSettings settings(fileName, QSettings::IniFormat);
+            for (const auto &change : changes) {
+                if (change.remove) {
+                    settings.remove(change.key);
+                } else {
+                    settings.setValue(change.key, change.value);
+                }
+            }
+            // QSettings replaces the file with a completely written new one
+            settings.sync();
+            if (settings.status() != QSettings::NoError)
+                qCWarning(lcConfigFile) << "Could not write" << fileName << settings.status();
+            load(fileName, settings);
+        }
+
+        /// Reloads the file if it was modified since it was read, returns whether a value changed
+        bool reloadIfModified(const QString &fileName)
+        {
+            QMutexLocker lock(&_mutex);
+            if (fileName != _fileName)
+                return false;
+            const QFileInfo info(fileName);
+            if (info.lastModified() == _lastModified && info.size() == _size)
+                return false;
+            return reloadLocked(fileName);
+        }
+
+        /// Reloads the file even if it looks unmodified, returns whether a value changed
+        bool reload(const QString &fileName)
+        {
+            QMutexLocker lock(&_mutex);
+            if (fileName != _fileName)
+                return false;
+            return reloadLocked(fileName);
+        }
+
+    private:
+        bool reloadLocked(const QString &fileName)
+        {
+            const auto oldValues = _values;
+            load(fileName);
+            return _values != oldValues;
+        }
+
+        void load(const QString &fileName)
+        {
+            QSettings settings(fileName, QSettings::IniFormat);
+            load(fileName, settings);
+        }
+
+        void load(const QString &fileName, const QSettings &settings)
+        {
+            ConfigFileNotifier::instance()->watch(fileName);
+
+            // Before reading, a modification in between causes another reload
+            const QFileInfo info(fileName);
+            _lastModified = info.lastModified();
+            _size = info.size();
+
+            _fileName = fileName;
+            _values.clear();
+            const auto keys = settings.allKeys();
+            for (const auto &key : keys)
+                _values.insert(key, settings.value(key));
+        }
+
+        QMutex _mutex;
+        QString _fileName;
+        QDateTime _lastModified;
+        qint64 _size = -1;
+        QHash<QString, QVariant> _values;
+    };
+
+    Q_GLOBAL_STATIC(ConfigCache, g_configCache)
+
+    /**
+     * The part of the QSettings interface that ConfigFile uses, served from
+     * the cache.
+     *
+     * Changes are written on sync() or when the object goes away.
+     */
+    class CachedSettings
+    {
+    public:
+        explicit CachedSettings(const QString &fileName)
+            : _fileName(fileName)
+        {
+        }
+
+        ~CachedSettings()
+        {
+            sync();
+        }
+
+        void beginGroup(const QString &group)
+        {
+            if (!group.isEmpty())
+                _prefix += group + QLatin1Char('/');
+        }
+
+        QVariant value(const QString &key, const QVariant &defaultValue = QVariant()) const
+        {
+            const auto fullKey = _prefix + key;
+            if (const auto change = pendingChange(fullKey))
+                return change->remove ? defaultValue : change->value;
+            return g_configCache->value(_fileName, fullKey, defaultValue);
+        }
+
+        bool contains(const QString &key) const
+        {
+            const auto fullKey = _prefix + key;
+            if (const auto change = pendingChange(fullKey))
+                return !change->remove;
+            return g_configCache->contains(_fileName, fullKey);
+        }
+
+        void setValue(const QString &key, const QVariant &value)
+        {
+            _changes.append({ _prefix + key, value, false });
+        }
+
+        /// Like QSettings, an empty \a key removes the current group
+        void remove(const QString &key)
+        {
+            auto fullKey = _prefix + key;
+            if (fullKey.endsWith(QLatin1Char('/')))
+                fullKey.chop(1);
+            _changes.append({ fullKey, QVariant(), true });
+        }
+
+        void sync()
+        {
+            if (_changes.isEmpty())
+                return;
+            g_configCache->write(_fileName, _changes);
+            _changes.clear();
+            emit ConfigFileNotifier::instance()->changed();
+        }
+
+    private:
+        Q_DISABLE_COPY(CachedSettings)
+
+        /// The last change of \a fullKey, the removal of a group counts too
+        const ConfigChange *pendingChange(const QString &fullKey) const
+        {
+            for (auto it = _changes.crbegin(); it != _changes.crend(); ++it) {
+                if (it->key == fullKey || (it->remove && fullKey.startsWith(it->key + QLatin1Char('/'))))
+                    return &*it;
+            }
+            return nullptr;
+        }
+
+        QString _fileName;
+        QString _prefix;
+        QVector<ConfigChange> _changes;
+    };
+
+} // anonymous namespace
+
+Q_GLOBAL_STATIC(ConfigFileNotifier, g_configFileNotifier)
+
+ConfigFileNotifier::ConfigFileNotifier(QObject *parent)
+    : QObject(parent)
+{
+    if (!parent && QCoreApplication::instance())
+        moveToThread(QCoreApplication::instance()->thread());
+}
+
+ConfigFileNotifier *ConfigFileNotifier::instance()
+{
+    return g_configFileNotifier();
+}
+
+void ConfigFileNotifier::watch(const QString &fileName)
+{
+    // The watcher needs the event loop of the main thread
+    QMetaObject::invokeMethod(this, [this, fileName] {
+        if (!_watcher) {
+            // Goes away with the application, before this global object
+            _watcher = new QFileSystemWatcher(QCoreApplication::instance());
+            connect(_watcher, &QFileSystemWatcher::fileChanged, this, &ConfigFileNotifier::slotFileModified);
+            // Writers replace the file, which ends the watch of the file itself
+            connect(_watcher, &QFileSystemWatcher::directoryChanged, this, &ConfigFileNotifier::slotFileModified);
+        }
+        if (fileName != _fileName) {
+            const auto paths = _watcher->files() + _watcher->directories();
+            if (!paths.isEmpty())
+                _watcher->removePaths(paths);
+            _fileName = fileName;
+        }
+        const auto dirPath = QFileInfo(fileName).absolutePath();
+        if (!_watcher->directories().contains(dirPath) && QFileInfo::exists(dirPath))
+            _watcher->addPath(dirPath);
+        if (!_watcher->files().contains(fileName) && QFileInfo::exists(fileName))
+            _watcher->addPath(fileName);
+    });
+}
+
+void ConfigFileNotifier::slotFileModified()
+{
+    if (g_configCache->reloadIfModified(_fileName)) {
+        qCInfo(lcConfigFile) << "Reloaded the modified config file" << _fileName;
+        emit changed();
+    }
+}
+
+static chrono::milliseconds millisecondsValue(const CachedSettings &setting, const char *key,
     chrono::milliseconds defaultValue)
 {
     return chrono::milliseconds(setting.value(QLatin1String(key), qlonglong(defaultValue.count())).toLongLong());
@@ -154,11 +415,7 @@ ConfigFile::ConfigFile()
 
     QSettings::setDefaultFormat(QSettings::IniFormat);
 
-    const QString config = configFile();
-
-
-    QSettings settings(config, QSettings::IniFormat);
-    settings.beginGroup(defaultConnection());
+    g_configCache->ensureLoaded(configFile());
 }
 
 bool ConfigFile::setConfDir(const QString &value)
@@ -183,7 +440,7 @@ bool ConfigFile::setConfDir(const QString &value)
 
 bool ConfigFile::optionalServerNotifications() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(optionalServerNotificationsC), true).toBool();
 }
 
@@ -200,50 +457,104 @@ bool ConfigFile::showInExplorerNavigationPane() const
         false
 #endif
         ;
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(showInExplorerNavigationPaneC), defaultValue).toBool();
 }
 
 void ConfigFile::setShowInExplorerNavigationPane(bool show)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.setValue(QLatin1String(showInExplorerNavigationPaneC), show);
     settings.sync();
 }
 
 int ConfigFile::timeout() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(timeoutC), 300).toInt(); // default to 5 min
 }
 
 qint64 ConfigFile::chunkSize() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(chunkSizeC), 10 * 1000 * 1000).toLongLong(); // default to 10 MB
 }
 
 qint64 ConfigFile::maxChunkSize() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(maxChunkSizeC), 100 * 1000 * 1000).toLongLong(); // default to 100 MB
 }
 
 qint64 ConfigFile::minChunkSize() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(minChunkSizeC), 1000 * 1000).toLongLong(); // default to 1 MB
 }
 
 chrono::milliseconds ConfigFile::targetChunkUploadDuration() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return millisecondsValue(settings, targetChunkUploadDurationC, chrono::minutes(1));
 }
 
+int ConfigFile::maxParallelChunks() const
+{
+    CachedSettings settings(configFile());
+    return settings.value(QLatin1String(maxParallelChunksC), 4).toInt();
+}
+
+int ConfigFile::journalWriteBehindBatchSize() const
+{
+    CachedSettings settings(configFile());
+    return settings.value(QLatin1String(journalWriteBehindBatchSizeC), 0).toInt();
+}
+
+chrono::milliseconds ConfigFile::journalWriteBehindInterval() const
+{
+    CachedSettings settings(configFile());
+    return millisecondsValue(settings, journalWriteBehindIntervalC, chrono::seconds(1));
+}
+
+qint64 ConfigFile::downloadBufferSize() const
+{
+    CachedSettings settings(configFile());
+    return settings.value(QLatin1String(downloadBufferSizeC), 1024 * 1024).toLongLong();
+}
+
+bool ConfigFile::remoteSubtreeListing() const
+{
+    CachedSettings settings(configFile());
+    return settings.value(QLatin1String(remoteSubtreeListingC), true).toBool();
+}
+
+int ConfigFile::localDiscoveryThreads() const
+{
+    CachedSettings settings(configFile());
+    return settings.value(QLatin1String(localDiscoveryThreadsC), 4).toInt();
+}
+
+bool ConfigFile::pipelinedPropagation() const
+{
+    CachedSettings settings(configFile());
+    return settings.value(QLatin1String(pipelinedPropagationC), false).toBool();
+}
+
+int ConfigFile::maxConcurrentSyncs() const
+{
+    CachedSettings settings(configFile());
+    return settings.value(QLatin1String(maxConcurrentSyncsC), 2).toInt();
+}
+
+bool ConfigFile::folderSyncThreads() const
+{
+    CachedSettings settings(configFile());
+    return settings.value(QLatin1String(folderSyncThreadsC), false).toBool();
+}
+
 void ConfigFile::setOptionalServerNotifications(bool show)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.setValue(QLatin1String(optionalServerNotificationsC), show);
     settings.sync();
 }
@@ -252,7 +563,7 @@ void ConfigFile::saveGeometry(QWidget *w)
 {
 #ifndef TOKEN_AUTH_ONLY
     ASSERT(!w->objectName().isNull());
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.beginGroup(w->objectName());
     settings.setValue(QLatin1String(geometryC), w->saveGeometry());
     settings.sync();
@@ -273,7 +584,7 @@ void ConfigFile::saveGeometryHeader(QHeaderView *header)
         return;
     ASSERT(!header->objectName().isEmpty());
 
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.beginGroup(header->objectName());
     settings.setValue(QLatin1String(geometryC), header->saveState());
     settings.sync();
@@ -287,7 +598,7 @@ void ConfigFile::restoreGeometryHeader(QHeaderView *header)
         return;
     ASSERT(!header->objectName().isNull());
 
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.beginGroup(header->objectName());
     header->restoreState(settings.value(geometryC).toByteArray());
 #endif
@@ -453,7 +764,7 @@ QString ConfigFile::defaultConnection() const
 void ConfigFile::storeData(const QString &group, const QString &key, const QVariant &value)
 {
     const QString con(group.isEmpty() ? defaultConnection() : group);
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
 
     settings.beginGroup(con);
     settings.setValue(key, value);
@@ -463,7 +774,7 @@ void ConfigFile::storeData(const QString &group, const QString &key, const QVari
 QVariant ConfigFile::retrieveData(const QString &group, const QString &key) const
 {
     const QString con(group.isEmpty() ? defaultConnection() : group);
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
 
     settings.beginGroup(con);
     return settings.value(key);
@@ -472,7 +783,7 @@ QVariant ConfigFile::retrieveData(const QString &group, const QString &key) cons
 void ConfigFile::removeData(const QString &group, const QString &key)
 {
     const QString con(group.isEmpty() ? defaultConnection() : group);
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
 
     settings.beginGroup(con);
     settings.remove(key);
@@ -481,7 +792,7 @@ void ConfigFile::removeData(const QString &group, const QString &key)
 bool ConfigFile::dataExists(const QString &group, const QString &key) const
 {
     const QString con(group.isEmpty() ? defaultConnection() : group);
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
 
     settings.beginGroup(con);
     return settings.contains(key);
@@ -493,7 +804,7 @@ chrono::milliseconds ConfigFile::remotePollInterval(const QString &connection) c
     if (connection.isEmpty())
         con = defaultConnection();
 
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.beginGroup(con);
 
     auto defaultPollInterval = chrono::milliseconds(DEFAULT_REMOTE_POLL_INTERVAL);
@@ -515,7 +826,7 @@ void ConfigFile::setRemotePollInterval(chrono::milliseconds interval, const QStr
         qCWarning(lcConfigFile) << "Remote Poll interval of " << interval.count() << " is below five seconds.";
         return;
     }
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.beginGroup(con);
     settings.setValue(QLatin1String(remotePollIntervalC), qlonglong(interval.count()));
     settings.sync();
@@ -528,7 +839,7 @@ chrono::milliseconds ConfigFile::forceSyncInterval(const QString &connection) co
     QString con(connection);
     if (connection.isEmpty())
         con = defaultConnection();
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.beginGroup(con);
 
     auto defaultInterval = chrono::hours(2);
@@ -542,7 +853,7 @@ chrono::milliseconds ConfigFile::forceSyncInterval(const QString &connection) co
 
 chrono::milliseconds OCC::ConfigFile::fullLocalDiscoveryInterval() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.beginGroup(defaultConnection());
     return millisecondsValue(settings, fullLocalDiscoveryIntervalC, chrono::hours(1));
 }
@@ -552,7 +863,7 @@ chrono::milliseconds ConfigFile::notificationRefreshInterval(const QString &conn
     QString con(connection);
     if (connection.isEmpty())
         con = defaultConnection();
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.beginGroup(con);
 
     auto defaultInterval = chrono::minutes(5);
@@ -569,7 +880,7 @@ chrono::milliseconds ConfigFile::updateCheckInterval(const QString &connection)
     QString con(connection);
     if (connection.isEmpty())
         con = defaultConnection();
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.beginGroup(con);
 
     auto defaultInterval = chrono::hours(10);
@@ -602,7 +913,7 @@ void ConfigFile::setSkipUpdateCheck(bool skip, const QString &connection)
     if (connection.isEmpty())
         con = defaultConnection();
 
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.beginGroup(con);
 
     settings.setValue(QLatin1String(skipUpdateCheckC), QVariant(skip));
@@ -628,7 +939,7 @@ void ConfigFile::setAutoUpdateCheck(bool autoCheck, const QString &connection)
     if (connection.isEmpty())
         con = defaultConnection();
 
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.beginGroup(con);
 
     settings.setValue(QLatin1String(autoUpdateCheckC), QVariant(autoCheck));
@@ -637,7 +948,7 @@ void ConfigFile::setAutoUpdateCheck(bool autoCheck, const QString &connection)
 
 int ConfigFile::updateSegment() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     int segment = settings.value(QLatin1String(updateSegmentC), -1).toInt();
 
     // Invalid? (Unset at the very first launch)
@@ -662,13 +973,13 @@ QString ConfigFile::updateChannel() const
         defaultUpdateChannel = QStringLiteral("beta");
     }
 
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(updateChannelC), defaultUpdateChannel).toString();
 }
 
 void ConfigFile::setUpdateChannel(const QString &channel)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.setValue(QLatin1String(updateChannelC), channel);
 }
 
@@ -678,7 +989,7 @@ void ConfigFile::setProxyType(int proxyType,
     const QString &user,
     const QString &pass)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
 
     settings.setValue(QLatin1String(proxyTypeC), proxyType);
 
@@ -733,7 +1044,7 @@ QVariant ConfigFile::getValue(const QString &param, const QString &group,
         systemSetting = systemSettings.value(param, defaultValue);
     }
 
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     if (!group.isEmpty())
         settings.beginGroup(group);
 
@@ -742,7 +1053,7 @@ QVariant ConfigFile::getValue(const QString &param, const QString &group,
 
 void ConfigFile::setValue(const QString &key, const QVariant &value)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
 
     settings.setValue(key, value);
 }
@@ -787,7 +1098,7 @@ QString ConfigFile::proxyPassword() const
         // Security: Migrate password from config file to keychain
         auto job = new KeychainChunk::WriteJob(key, pass.toUtf8());
         if (job->exec()) {
-            QSettings settings(configFile(), QSettings::IniFormat);
+            CachedSettings settings(configFile());
             settings.remove(QLatin1String(proxyPassC));
             qCInfo(lcConfigFile()) << "Migrated proxy password to keychain";
         }
@@ -883,19 +1194,19 @@ void ConfigFile::setMoveToTrash(bool isChecked)
 
 bool ConfigFile::promptDeleteFiles() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(promptDeleteC), false).toBool();
 }
 
 void ConfigFile::setPromptDeleteFiles(bool promptDeleteFiles)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.setValue(QLatin1String(promptDeleteC), promptDeleteFiles);
 }
 
 bool ConfigFile::monoIcons() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     bool monoDefault = false; // On Mac we want bw by default
 #ifdef Q_OS_MAC
     // OEM themes are not obliged to ship mono icons
@@ -906,86 +1217,86 @@ bool ConfigFile::monoIcons() const
 
 void ConfigFile::setMonoIcons(bool useMonoIcons)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.setValue(QLatin1String(monoIconsC), useMonoIcons);
 }
 
 bool ConfigFile::crashReporter() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(crashReporterC), true).toBool();
 }
 
 void ConfigFile::setCrashReporter(bool enabled)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.setValue(QLatin1String(crashReporterC), enabled);
 }
 
 bool ConfigFile::automaticLogDir() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(automaticLogDirC), false).toBool();
 }
 
 void ConfigFile::setAutomaticLogDir(bool enabled)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.setValue(QLatin1String(automaticLogDirC), enabled);
 }
 
 QString ConfigFile::logDir() const
 {
     const auto defaultLogDir = QString(configPath() + QStringLiteral("/logs"));
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(logDirC), defaultLogDir).toString();
 }
 
 void ConfigFile::setLogDir(const QString &dir)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.setValue(QLatin1String(logDirC), dir);
 }
 
 bool ConfigFile::logDebug() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(logDebugC), true).toBool();
 }
 
 void ConfigFile::setLogDebug(bool enabled)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.setValue(QLatin1String(logDebugC), enabled);
 }
 
 int ConfigFile::logExpire() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(logExpireC), 24).toBool();
 }
 
 void ConfigFile::setLogExpire(int hours)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.setValue(QLatin1String(logExpireC), hours);
 }
 
 bool ConfigFile::logFlush() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(logFlushC), false).toBool();
 }
 
 void ConfigFile::setLogFlush(bool enabled)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.setValue(QLatin1String(logFlushC), enabled);
 }
 
 bool ConfigFile::showExperimentalOptions() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(showExperimentalOptionsC), false).toBool();
 }
 
@@ -996,7 +1307,7 @@ QString ConfigFile::certificatePath() const
 
 void ConfigFile::setCertificatePath(const QString &cPath)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.setValue(QLatin1String(certPath), cPath);
     settings.sync();
 }
@@ -1008,20 +1319,20 @@ QString ConfigFile::certificatePasswd() const
 
 void ConfigFile::setCertificatePasswd(const QString &cPasswd)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.setValue(QLatin1String(certPasswd), cPasswd);
     settings.sync();
 }
 
 QString ConfigFile::clientVersionString() const
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     return settings.value(QLatin1String(clientVersionC), QString()).toString();
 }
 
 void ConfigFile::setClientVersionString(const QString &version)
 {
-    QSettings settings(configFile(), QSettings::IniFormat);
+    CachedSettings settings(configFile());
     settings.setValue(QLatin1String(clientVersionC), version);
 }
 
@@ -1034,8 +1345,15 @@ std::unique_ptr<QSettings> ConfigFile::settingsWithGroup(const QString &group, Q
         ConfigFile cfg;
         *g_configFileName() = cfg.configFile();
     }
-    std::unique_ptr<QSettings> settings(new QSettings(*g_configFileName(), QSettings::IniFormat, parent));
+    const QString fileName = *g_configFileName();
+    std::unique_ptr<QSettings> settings(new QSettings(fileName, QSettings::IniFormat, parent));
     settings->beginGroup(group);
+    // Pending changes are written when the settings go away. A write can keep
+    // the size and the modification time, so read the file again regardless.
+    QObject::connect(settings.get(), &QObject::destroyed, [fileName] {
+        if (g_configCache->reload(fileName))
+            emit ConfigFileNotifier::instance()->changed();
+    });
     return settings;
 }
 
@@ -17,6 +17,8 @@
 
 #include "owncloudlib.h"
 #include <memory>
+#include <QObject>
+#include <QPointer>
 #include <QSharedPointer>
 #include <QSettings>
 #include <QString>
@@ -25,12 +27,46 @@
 
 class QWidget;
 class QHeaderView;
+class QFileSystemWatcher;
 class ExcludedFiles;
 
 namespace OCC {
 
 class AbstractCredentials;
 
+/**
+ * @brief Announces changes of the config file
+ * @ingroup libsync
+ *
+ * ConfigFile serves the values from a copy of the config file that is shared
+ * by the whole process. The copy is updated by the setters and reloaded when
+ * the file is modified otherwise, by the QSettings of settingsWithGroup() or
+ * by another process. Consumers that keep values around connect to changed()
+ * instead of reading them again.
+ */
+class OWNCLOUDSYNC_EXPORT ConfigFileNotifier : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ConfigFileNotifier(QObject *parent = nullptr);
+
+    /// Lives in the main thread
+    static ConfigFileNotifier *instance();
+
+    /// Watches \a fileName for modifications, replacing the previous file
+    void watch(const QString &fileName);
+
+signals:
+    /// The values of the config file changed
+    void changed();
+
+private:
+    void slotFileModified();
+
+    QPointer<QFileSystemWatcher> _watcher;
+    QString _fileName;
+};
+
 /**
  * @brief The ConfigFile class
  * @ingroup libsync
@@ -157,6 +193,29 @@ public:
     qint64 maxChunkSize() const;
     qint64 minChunkSize() const;
     std::chrono::milliseconds targetChunkUploadDuration() const;
+    int maxParallelChunks() const;
+
+    /** Number of journal file records written per batch during propagation, 0 to disable */
+    int journalWriteBehindBatchSize() const;
+    std::chrono::milliseconds journalWriteBehindInterval() const;
+
+    /** Size of the buffer for unlimited downloads, see SyncOptions::_downloadBufferSize */
+    qint64 downloadBufferSize() const;
+
+    /** Whether new remote directories are listed with their subtree, see SyncOptions::_remoteSubtreeListing */
+    bool remoteSubtreeListing() const;
+
+    /** Number of threads that list the local tree, see SyncOptions::_localDiscoveryThreads */
+    int localDiscoveryThreads() const;
+
+    /** Whether transfers start during the discovery, see SyncOptions::_pipelinedPropagation */
+    bool pipelinedPropagation() const;
+
+    /** Number of folders that may sync at the same time */
+    int maxConcurrentSyncs() const;
+
+    /** Whether each folder syncs on a thread of its own instead of the main thread */
+    bool folderSyncThreads() const;
 
     void saveGeometry(QWidget *w);
     void restoreGeometry(QWidget *w);
@@ -16,6 +16,11 @@
 #define MIRALL_CREDS_ABSTRACT_CREDENTIALS_H
 
 #include <QObject>
+#include <QMutex>
+#include <QSslCertificate>
+#include <QSslKey>
+
+#include <memory>
 
 #include <csync.h>
 #include "owncloudlib.h"
@@ -27,6 +32,48 @@ namespace OCC {
 
 class AbstractNetworkJob;
 
+/**
+ * @brief What an access manager adds to its requests
+ *
+ * The access managers of sync threads read it while the credentials change
+ * on the account's thread, so it is never modified, only replaced.
+ */
+struct RequestCredentials
+{
+    QString user;
+    QString password; // or the OAuth access token
+    bool isOAuth = false;
+    bool isRenewingOAuthToken = false;
+    QSslKey clientSslKey;
+    QSslCertificate clientSslCertificate;
+    QList<QSslCertificate> clientSslCaCertificates;
+};
+
+/**
+ * @brief The current RequestCredentials, shared by the credentials and their access managers
+ *
+ * The access managers keep it alive, they may outlive the credentials.
+ */
+class SharedRequestCredentials
+{
+public:
+    std::shared_ptr<const RequestCredentials> get() const
+    {
+        QMutexLocker locker(&_mutex);
+        return _current;
+    }
+
+    void set(std::shared_ptr<const RequestCredentials> current)
+    {
+        QMutexLocker locker(&_mutex);
+        _current = std::move(current);
+    }
+
+private:
+    mutable QMutex _mutex;
+    std::shared_ptr<const RequestCredentials> _current = std::make_shared<RequestCredentials>();
+};
+
 class OWNCLOUDSYNC_EXPORT AbstractCredentials : public QObject
 {
     Q_OBJECT
@@ -90,7 +137,10 @@ public:
 
     static QString keychainKey(const QString &url, const QString &user, const QString &accountId);
 
-    /** If the job need to be restarted or queue, this does it and returns true. */
+    /** If the job need to be restarted or queue, this does it and returns true.
+     *
+     * Called from the thread of the job, which may not be the account's.
+     */
     virtual bool retryIfNeeded(AbstractNetworkJob *) { return false; }
 
 Q_SIGNALS:
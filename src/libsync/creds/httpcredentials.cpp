@@ -53,22 +53,25 @@ namespace {
 class HttpCredentialsAccessManager : public AccessManager
 {
 public:
-    HttpCredentialsAccessManager(const HttpCredentials *cred, QObject *parent = nullptr)
+    HttpCredentialsAccessManager(std::shared_ptr<SharedRequestCredentials> cred, QObject *parent = nullptr)
         : AccessManager(parent)
-        , _cred(cred)
+        , _cred(std::move(cred))
     {
     }
 
 protected:
     QNetworkReply *createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData) override
     {
+        // May run in a sync thread while the credentials change
+        const auto cred = _cred->get();
+
         QNetworkRequest req(request);
         if (!req.attribute(HttpCredentials::DontAddCredentialsAttribute).toBool()) {
-            if (_cred && !_cred->password().isEmpty()) {
-                if (_cred->isUsingOAuth()) {
-                    req.setRawHeader("Authorization", "Bearer " + _cred->password().toUtf8());
+            if (!cred->password.isEmpty()) {
+                if (cred->isOAuth) {
+                    req.setRawHeader("Authorization", "Bearer " + cred->password.toUtf8());
                 } else {
-                    QByteArray credHash = QByteArray(_cred->user().toUtf8() + ":" + _cred->password().toUtf8()).toBase64();
+                    QByteArray credHash = QByteArray(cred->user.toUtf8() + ":" + cred->password.toUtf8()).toBase64();
                     req.setRawHeader("Authorization", "Basic " + credHash);
                 }
             } else if (!request.url().password().isEmpty()) {
@@ -79,17 +82,17 @@ protected:
             }
         }
 
-        if (_cred && !_cred->_clientSslKey.isNull() && !_cred->_clientSslCertificate.isNull()) {
+        if (!cred->clientSslKey.isNull() && !cred->clientSslCertificate.isNull()) {
             // SSL configuration
             QSslConfiguration sslConfiguration = req.sslConfiguration();
-            sslConfiguration.setLocalCertificate(_cred->_clientSslCertificate);
-            sslConfiguration.setPrivateKey(_cred->_clientSslKey);
+            sslConfiguration.setLocalCertificate(cred->clientSslCertificate);
+            sslConfiguration.setPrivateKey(cred->clientSslKey);
             req.setSslConfiguration(sslConfiguration);
         }
 
         auto *reply = AccessManager::createRequest(op, req, outgoingData);
 
-        if (_cred->_isRenewingOAuthToken) {
+        if (cred->isRenewingOAuthToken) {
             // We know this is going to fail, but we have no way to queue it there, so we will
             // simply restart the job after the failure.
             reply->setProperty(needRetryC, true);
@@ -101,7 +104,7 @@ protected:
 private:
     // The credentials object dies along with the account, while the QNAM might
     // outlive both.
-    QPointer<const HttpCredentials> _cred;
+    std::shared_ptr<SharedRequestCredentials> _cred;
 };
 
 
@@ -127,6 +130,7 @@ HttpCredentials::HttpCredentials(const QString &user, const QString &password, c
     if (!unpackClientCertBundle()) {
         ASSERT(false, "pkcs12 client cert bundle passed to HttpCredentials must be valid");
     }
+    updateRequestCredentials();
 }
 
 QString HttpCredentials::authType() const
@@ -154,7 +158,7 @@ void HttpCredentials::setAccount(Account *account)
 
 QNetworkAccessManager *HttpCredentials::createQNAM() const
 {
-    AccessManager *qnam = new HttpCredentialsAccessManager(this);
+    AccessManager *qnam = new HttpCredentialsAccessManager(_requestCredentials);
 
     connect(qnam, &QNetworkAccessManager::authenticationRequired,
         this, &HttpCredentials::slotAuthentication);
@@ -170,6 +174,7 @@ bool HttpCredentials::ready() const
 QString HttpCredentials::fetchUser()
 {
     _user = _account->credentialSetting(QLatin1String(userC)).toString();
+    updateRequestCredentials();
     return _user;
 }
 
@@ -388,6 +393,7 @@ void HttpCredentials::slotReadJobDone(QKeychain::Job *incomingJob)
         // Still, the password can be empty which indicates a problem and
         // the password dialog has to be opened.
         _ready = true;
+        updateRequestCredentials();
         emit fetched();
     } else {
         // we come here if the password is empty or any other keychain
@@ -397,6 +403,7 @@ void HttpCredentials::slotReadJobDone(QKeychain::Job *incomingJob)
 
         _password = QString();
         _ready = false;
+        updateRequestCredentials();
         emit fetched();
     }
 
@@ -448,14 +455,12 @@ bool HttpCredentials::refreshAccessToken()
             persist();
         }
         _isRenewingOAuthToken = false;
-        for (const auto &job : _retryQueue) {
-            if (job)
-                job->retry();
-        }
-        _retryQueue.clear();
+        updateRequestCredentials();
+        emit refreshAccessTokenDone();
         emit fetched();
     });
     _isRenewingOAuthToken = true;
+    updateRequestCredentials();
     return true;
 }
 
@@ -468,7 +473,8 @@ void HttpCredentials::invalidateToken()
     _password = QString();
     _ready = false;
 
-    // User must be fetched from config file to generate a valid key
+    // User must be fetched from config file to generate a valid key, this
+    // also hands the cleared password to the access managers
     fetchUser();
 
     const QString kck = keychainKey(_account->url().toString(), _user, _account->id());
@@ -641,14 +647,41 @@ bool HttpCredentials::retryIfNeeded(AbstractNetworkJob *job)
     auto *reply = job->reply();
     if (!reply || !reply->property(needRetryC).toBool())
         return false;
-    if (_isRenewingOAuthToken) {
-        _retryQueue.append(job);
-    } else {
+
+    // This runs in the job's thread. Wait for the end of the refresh before
+    // checking whether it is still going on, so that it can't be missed, and
+    // make sure the job is only retried once.
+    auto retried = std::make_shared<bool>(false);
+    auto retry = [job, retried] {
+        if (*retried)
+            return;
+        *retried = true;
         job->retry();
+    };
+    auto connection = std::make_shared<QMetaObject::Connection>();
+    *connection = connect(this, &HttpCredentials::refreshAccessTokenDone, job, [retry, connection] {
+        QObject::disconnect(*connection);
+        retry();
+    }, Qt::QueuedConnection);
+    if (!_requestCredentials->get()->isRenewingOAuthToken) {
+        QObject::disconnect(*connection);
+        retry();
     }
     return true;
 }
 
+void HttpCredentials::updateRequestCredentials()
+{
+    auto cred = std::make_shared<RequestCredentials>();
+    cred->user = _user;
+    cred->password = _password;
+    cred->isOAuth = isUsingOAuth();
+    cred->isRenewingOAuthToken = _isRenewingOAuthToken;
+    cred->clientSslKey = _clientSslKey;
+    cred->clientSslCertificate = _clientSslCertificate;
+    _requestCredentials->set(std::move(cred));
+}
+
 bool HttpCredentials::unpackClientCertBundle()
 {
     if (_clientCertBundle.isEmpty())
@@ -73,7 +73,6 @@ namespace OCC {
 class OWNCLOUDSYNC_EXPORT HttpCredentials : public AbstractCredentials
 {
     Q_OBJECT
-    friend class HttpCredentialsAccessManager;
 
 public:
     /// Don't add credentials if this is set on a QNetworkRequest
@@ -110,6 +109,10 @@ public:
 
     bool retryIfNeeded(AbstractNetworkJob *) override;
 
+Q_SIGNALS:
+    /// Emitted when refreshAccessToken() is done, whether it succeeded or not
+    void refreshAccessTokenDone();
+
 private Q_SLOTS:
     void slotAuthentication(QNetworkReply *, QAuthenticator *);
 
@@ -156,6 +159,9 @@ protected:
      */
     bool unpackClientCertBundle();
 
+    /// Hands the current user, password and client certificate to the access managers
+    void updateRequestCredentials();
+
     QString _user;
     QString _password; // user's password, or access_token for OAuth
     QString _refreshToken; // OAuth _refreshToken, set if OAuth is used.
@@ -171,7 +177,7 @@ protected:
     bool _keychainMigration = false;
     bool _retryOnKeyChainError = true; // true if we haven't done yet any reading from keychain
 
-    QVector<QPointer<AbstractNetworkJob>> _retryQueue; // Jobs we need to retry once the auth token is fetched
+    std::shared_ptr<SharedRequestCredentials> _requestCredentials = std::make_shared<SharedRequestCredentials>();
 };
 
 
@@ -37,7 +37,7 @@ void ProcessDirectoryJob::start()
     qCInfo(lcDisco) << "STARTING" << _currentFolder._server << _queryServer << _currentFolder._local << _queryLocal;
 
     if (_queryServer == NormalQuery) {
-        _serverJob = startAsyncServerQuery();
+        startServerQuery();
     } else {
         _serverQueryDone = true;
     }
@@ -371,20 +371,28 @@ void ProcessDirectoryJob::processFile(PathTuple path,
     processFileAnalyzeLocalInfo(item, path, localEntry, serverEntry, dbEntry, _queryServer);
 }
 
-// Compute the checksum of the given file and assign the result in item->_checksumHeader
-// Returns true if the checksum was successfully computed
-static bool computeLocalChecksum(const QByteArray &header, const QString &path, const SyncFileItemPtr &item)
+void ProcessDirectoryJob::computeLocalChecksumAsync(const QByteArray &header, const QString &path,
+    const SyncFileItemPtr &item, const std::function<void(bool)> &continuation)
 {
     auto type = parseChecksumHeaderType(header);
-    if (!type.isEmpty()) {
-        // TODO: compute async?
-        QByteArray checksum = ComputeChecksum::computeNowOnFile(path, type);
-        if (!checksum.isEmpty()) {
-            item->_checksumHeader = makeChecksumHeader(type, checksum);
-            return true;
-        }
+    if (type.isEmpty()) {
+        continuation(false);
+        return;
     }
-    return false;
+
+    _pendingAsyncJobs++;
+    auto computeChecksum = new ComputeChecksum(this);
+    computeChecksum->setChecksumType(type);
+    connect(computeChecksum, &ComputeChecksum::done, this,
+        [=](const QByteArray &checksumType, const QByteArray &checksum) {
+            computeChecksum->deleteLater();
+            if (!checksum.isEmpty())
+                item->_checksumHeader = makeChecksumHeader(checksumType, checksum);
+            continuation(!checksum.isEmpty());
+            _pendingAsyncJobs--;
+            QTimer::singleShot(0, _discoveryData, &DiscoveryPhase::scheduleMoreJobs);
+        });
+    computeChecksum->start(path);
 }
 
 void ProcessDirectoryJob::processFileAnalyzeRemoteInfo(
@@ -454,7 +462,9 @@ void ProcessDirectoryJob::processFileAnalyzeRemoteInfo(
             item->_instruction = CSYNC_INSTRUCTION_UPDATE_METADATA;
             item->_direction = SyncFileItem::Down;
         } else {
-            processFileAnalyzeLocalInfo(item, path, localEntry, serverEntry, dbEntry, ParentNotChanged);
+            // A server may report changes below a directory without changing its etag
+            processFileAnalyzeLocalInfo(item, path, localEntry, serverEntry, dbEntry,
+                _discoveryData->hasRemoteChangesBelow(path._server) ? NormalQuery : ParentNotChanged);
             return;
         }
 
@@ -680,7 +690,8 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
 
     _childModified |= serverModified;
 
-    auto finalize = [&] {
+    // Captures by value so it can also be used from asynchronous continuations
+    auto finalizeWith = [this, item, localEntry, serverEntry](const PathTuple &path, QueryMode recurseQueryServer) {
         bool recurse = item->isDirectory() || localEntry.isDirectory || serverEntry.isDirectory;
         // Even if we have a local directory: If the remote is a file that's propagated as a
         // conflict we don't need to recurse into it. (local c1.owncloud, c1/ ; remote: c1)
@@ -692,6 +703,9 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
         auto recurseQueryLocal = _queryLocal == ParentNotChanged ? ParentNotChanged : localEntry.isDirectory || item->_instruction == CSYNC_INSTRUCTION_RENAME ? NormalQuery : ParentDontExist;
         processFileFinalize(item, path, recurse, recurseQueryLocal, recurseQueryServer);
     };
+    auto finalize = [&] {
+        finalizeWith(path, recurseQueryServer);
+    };
 
     if (!localEntry.isValid()) {
         if (_queryLocal == ParentNotChanged && dbEntry.isValid()) {
@@ -821,11 +835,17 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
             // check #4754 #4755
             bool isEmlFile = path._original.endsWith(QLatin1String(".eml"), Qt::CaseInsensitive);
             if (isEmlFile && dbEntry._fileSize == localEntry.size && !dbEntry._checksumHeader.isEmpty()) {
-                if (computeLocalChecksum(dbEntry._checksumHeader, _discoveryData->_localDir + path._local, item)
-                        && item->_checksumHeader == dbEntry._checksumHeader) {
-                    qCInfo(lcDisco) << "NOTE: Checksums are identical, file did not actually change: " << path._local;
-                    item->_instruction = CSYNC_INSTRUCTION_UPDATE_METADATA;
-                }
+                // The item is parked until the checksum is known
+                auto dbChecksumHeader = dbEntry._checksumHeader;
+                computeLocalChecksumAsync(dbChecksumHeader, _discoveryData->_localDir + path._local, item,
+                    [=](bool computed) {
+                        if (computed && item->_checksumHeader == dbChecksumHeader) {
+                            qCInfo(lcDisco) << "NOTE: Checksums are identical, file did not actually change: " << path._local;
+                            item->_instruction = CSYNC_INSTRUCTION_UPDATE_METADATA;
+                        }
+                        finalizeWith(path, recurseQueryServer);
+                    });
+                return;
             }
         }
 
@@ -916,132 +936,149 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
             return false;
         }
 
-        // Verify the checksum where possible
-        if (!base._checksumHeader.isEmpty() && item->_type == ItemTypeFile && base._type == ItemTypeFile) {
-            if (computeLocalChecksum(base._checksumHeader, _discoveryData->_localDir + path._original, item)) {
-                qCInfo(lcDisco) << "checking checksum of potential rename " << path._original << item->_checksumHeader << base._checksumHeader;
-                if (item->_checksumHeader != base._checksumHeader) {
-                    qCInfo(lcDisco) << "Not a move, checksums differ";
-                    return false;
-                }
-            }
-        }
+        return true;
+    };
 
-        if (_discoveryData->isRenamed(originalPath)) {
+    // Everything after the move checks. Captures by value since it may run after the
+    // checksum of the candidate was computed asynchronously.
+    auto processMoveCandidate = [=](bool isMove) mutable {
+        if (isMove && _discoveryData->isRenamed(originalPath)) {
             qCInfo(lcDisco) << "Not a move, base path already renamed";
-            return false;
+            isMove = false;
         }
 
-        return true;
-    };
-
-    // If it's not a move it's just a local-NEW
-    if (!moveCheck()) {
-        if (base._isE2eEncrypted) {
-            // renaming the encrypted folder is done via remove + re-upload hence we need to mark the newly created folder as encrypted
-            // base is a record in the SyncJournal database that contains the data about the being-renamed folder with it's old name and encryption information
-            item->_isEncrypted = true;
+        // If it's not a move it's just a local-NEW
+        if (!isMove) {
+            if (base._isE2eEncrypted) {
+                // renaming the encrypted folder is done via remove + re-upload hence we need to mark the newly created folder as encrypted
+                // base is a record in the SyncJournal database that contains the data about the being-renamed folder with it's old name and encryption information
+                item->_isEncrypted = true;
+            }
+            postProcessLocalNew();
+            finalizeWith(path, recurseQueryServer);
+            return;
         }
-        postProcessLocalNew();
-        finalize();
-        return;
-    }
 
-    // Check local permission if we are allowed to put move the file here
-    // Technically we should use the permissions from the server, but we'll assume it is the same
-    auto movePerms = checkMovePermissions(base._remotePerm, originalPath, item->isDirectory());
-    if (!movePerms.sourceOk || !movePerms.destinationOk) {
-        qCInfo(lcDisco) << "Move without permission to rename base file, "
-                        << "source:" << movePerms.sourceOk
-                        << ", target:" << movePerms.destinationOk
-                        << ", targetNew:" << movePerms.destinationNewOk;
-
-        // If we can create the destination, do that.
-        // Permission errors on the destination will be handled by checkPermissions later.
-        postProcessLocalNew();
-        finalize();
+        // Check local permission if we are allowed to put move the file here
+        // Technically we should use the permissions from the server, but we'll assume it is the same
+        auto movePerms = checkMovePermissions(base._remotePerm, originalPath, item->isDirectory());
+        if (!movePerms.sourceOk || !movePerms.destinationOk) {
+            qCInfo(lcDisco) << "Move without permission to rename base file, "
+                            << "source:" << movePerms.sourceOk
+                            << ", target:" << movePerms.destinationOk
+                            << ", targetNew:" << movePerms.destinationNewOk;
+
+            // If we can create the destination, do that.
+            // Permission errors on the destination will be handled by checkPermissions later.
+            postProcessLocalNew();
+            finalizeWith(path, recurseQueryServer);
+
+            // If the destination upload will work, we're fine with the source deletion.
+            // If the source deletion can't work, checkPermissions will error.
+            if (movePerms.destinationNewOk)
+                return;
 
-        // If the destination upload will work, we're fine with the source deletion.
-        // If the source deletion can't work, checkPermissions will error.
-        if (movePerms.destinationNewOk)
+            // Here we know the new location can't be uploaded: must prevent the source delete.
+            // Two cases: either the source item was already processed or not.
+            auto wasDeletedOnClient = _discoveryData->findAndCancelDeletedJob(originalPath);
+            if (wasDeletedOnClient.first) {
+                // More complicated. The REMOVE is canceled. Restore will happen next sync.
+                qCInfo(lcDisco) << "Undid remove instruction on source" << originalPath;
+                _discoveryData->_statedb->deleteFileRecord(originalPath, true);
+                _discoveryData->_statedb->schedulePathForRemoteDiscovery(originalPath);
+                _discoveryData->_anotherSyncNeeded = true;
+            } else {
+                // Signal to future checkPermissions() to forbid the REMOVE and set to restore instead
+                qCInfo(lcDisco) << "Preventing future remove on source" << originalPath;
+                _discoveryData->_forbiddenDeletes[originalPath + '/'] = true;
+            }
             return;
+        }
 
-        // Here we know the new location can't be uploaded: must prevent the source delete.
-        // Two cases: either the source item was already processed or not.
         auto wasDeletedOnClient = _discoveryData->findAndCancelDeletedJob(originalPath);
+
+        auto processRename = [item, originalPath, base, this](PathTuple &path) {
+            auto adjustedOriginalPath = _discoveryData->adjustRenamedPath(originalPath, SyncFileItem::Down);
+            _discoveryData->_renamedItemsLocal.insert(originalPath, path._target);
+            item->_renameTarget = path._target;
+            path._server = adjustedOriginalPath;
+            item->_file = path._server;
+            path._original = originalPath;
+            item->_originalFile = path._original;
+            item->_modtime = base._modtime;
+            item->_inode = base._inode;
+            item->_instruction = CSYNC_INSTRUCTION_RENAME;
+            item->_direction = SyncFileItem::Up;
+            item->_fileId = base._fileId;
+            item->_remotePerm = base._remotePerm;
+            item->_etag = base._etag;
+            item->_type = base._type;
+
+            // Discard any download/dehydrate tags on the base file.
+            // They could be preserved and honored in a follow-up sync,
+            // but it complicates handling a lot and will happen rarely.
+            if (item->_type == ItemTypeVirtualFileDownload)
+                item->_type = ItemTypeVirtualFile;
+            if (item->_type == ItemTypeVirtualFileDehydration)
+                item->_type = ItemTypeFile;
+
+            qCInfo(lcDisco) << "Rename detected (up) " << item->_file << " -> " << item->_renameTarget;
+        };
         if (wasDeletedOnClient.first) {
-            // More complicated. The REMOVE is canceled. Restore will happen next sync.
-            qCInfo(lcDisco) << "Undid remove instruction on source" << originalPath;
-            _discoveryData->_statedb->deleteFileRecord(originalPath, true);
-            _discoveryData->_statedb->schedulePathForRemoteDiscovery(originalPath);
-            _discoveryData->_anotherSyncNeeded = true;
+            recurseQueryServer = wasDeletedOnClient.second == base._etag ? ParentNotChanged : NormalQuery;
+            processRename(path);
         } else {
-            // Signal to future checkPermissions() to forbid the REMOVE and set to restore instead
-            qCInfo(lcDisco) << "Preventing future remove on source" << originalPath;
-            _discoveryData->_forbiddenDeletes[originalPath + '/'] = true;
+            // We must query the server to know if the etag has not changed
+            _pendingAsyncJobs++;
+            QString serverOriginalPath = _discoveryData->adjustRenamedPath(originalPath, SyncFileItem::Down);
+            if (base.isVirtualFile() && isVfsWithSuffix())
+                chopVirtualFileSuffix(serverOriginalPath);
+            auto job = new RequestEtagJob(_discoveryData->_account, serverOriginalPath, this);
+            connect(job, &RequestEtagJob::finishedWithResult, this, [=](const HttpResult<QString> &etag) mutable {
+                if (!etag || (*etag != base._etag && !item->isDirectory()) || _discoveryData->isRenamed(originalPath)) {
+                    qCInfo(lcDisco) << "Can't rename because the etag has changed or the directory is gone" << originalPath;
+                    // Can't be a rename, leave it as a new.
+                    postProcessLocalNew();
+                } else {
+                    // In case the deleted item was discovered in parallel
+                    _discoveryData->findAndCancelDeletedJob(originalPath);
+                    processRename(path);
+                    recurseQueryServer = *etag == base._etag ? ParentNotChanged : NormalQuery;
+                }
+                processFileFinalize(item, path, item->isDirectory(), NormalQuery, recurseQueryServer);
+                _pendingAsyncJobs--;
+                QTimer::singleShot(0, _discoveryData, &DiscoveryPhase::scheduleMoreJobs);
+            });
+            job->start();
+            return;
         }
-        return;
-    }
 
-    auto wasDeletedOnClient = _discoveryData->findAndCancelDeletedJob(originalPath);
+        finalizeWith(path, recurseQueryServer);
+    };
 
-    auto processRename = [item, originalPath, base, this](PathTuple &path) {
-        auto adjustedOriginalPath = _discoveryData->adjustRenamedPath(originalPath, SyncFileItem::Down);
-        _discoveryData->_renamedItemsLocal.insert(originalPath, path._target);
-        item->_renameTarget = path._target;
-        path._server = adjustedOriginalPath;
-        item->_file = path._server;
-        path._original = originalPath;
-        item->_originalFile = path._original;
-        item->_modtime = base._modtime;
-        item->_inode = base._inode;
-        item->_instruction = CSYNC_INSTRUCTION_RENAME;
-        item->_direction = SyncFileItem::Up;
-        item->_fileId = base._fileId;
-        item->_remotePerm = base._remotePerm;
-        item->_etag = base._etag;
-        item->_type = base._type;
-
-        // Discard any download/dehydrate tags on the base file.
-        // They could be preserved and honored in a follow-up sync,
-        // but it complicates handling a lot and will happen rarely.
-        if (item->_type == ItemTypeVirtualFileDownload)
-            item->_type = ItemTypeVirtualFile;
-        if (item->_type == ItemTypeVirtualFileDehydration)
-            item->_type = ItemTypeFile;
+    if (!moveCheck()) {
+        processMoveCandidate(false);
+        return;
+    }
 
-        qCInfo(lcDisco) << "Rename detected (up) " << item->_file << " -> " << item->_renameTarget;
-    };
-    if (wasDeletedOnClient.first) {
-        recurseQueryServer = wasDeletedOnClient.second == base._etag ? ParentNotChanged : NormalQuery;
-        processRename(path);
-    } else {
-        // We must query the server to know if the etag has not changed
-        _pendingAsyncJobs++;
-        QString serverOriginalPath = _discoveryData->adjustRenamedPath(originalPath, SyncFileItem::Down);
-        if (base.isVirtualFile() && isVfsWithSuffix())
-            chopVirtualFileSuffix(serverOriginalPath);
-        auto job = new RequestEtagJob(_discoveryData->_account, serverOriginalPath, this);
-        connect(job, &RequestEtagJob::finishedWithResult, this, [=](const HttpResult<QString> &etag) mutable {
-            if (!etag || (*etag != base._etag && !item->isDirectory()) || _discoveryData->isRenamed(originalPath)) {
-                qCInfo(lcDisco) << "Can't rename because the etag has changed or the directory is gone" << originalPath;
-                // Can't be a rename, leave it as a new.
-                postProcessLocalNew();
-            } else {
-                // In case the deleted item was discovered in parallel
-                _discoveryData->findAndCancelDeletedJob(originalPath);
-                processRename(path);
-                recurseQueryServer = *etag == base._etag ? ParentNotChanged : NormalQuery;
-            }
-            processFileFinalize(item, path, item->isDirectory(), NormalQuery, recurseQueryServer);
-            _pendingAsyncJobs--;
-            QTimer::singleShot(0, _discoveryData, &DiscoveryPhase::scheduleMoreJobs);
-        });
-        job->start();
+    // Verify the checksum where possible, the item is parked until it is known
+    if (!base._checksumHeader.isEmpty() && item->_type == ItemTypeFile && base._type == ItemTypeFile) {
+        computeLocalChecksumAsync(base._checksumHeader, _discoveryData->_localDir + path._original, item,
+            [=](bool computed) mutable {
+                bool isMove = true;
+                if (computed) {
+                    qCInfo(lcDisco) << "checking checksum of potential rename " << path._original << item->_checksumHeader << base._checksumHeader;
+                    if (item->_checksumHeader != base._checksumHeader) {
+                        qCInfo(lcDisco) << "Not a move, checksums differ";
+                        isMove = false;
+                    }
+                }
+                processMoveCandidate(isMove);
+            });
         return;
     }
 
-    finalize();
+    processMoveCandidate(true);
 }
 
 void ProcessDirectoryJob::processFileConflict(const SyncFileItemPtr &item, ProcessDirectoryJob::PathTuple path, const LocalInfo &localEntry, const RemoteInfo &serverEntry, const SyncJournalFileRecord &dbEntry)
@@ -1158,6 +1195,10 @@ void ProcessDirectoryJob::processFileFinalize(
         recurse = false;
     }
     if (recurse) {
+        if (!removed && path._original == path._target && !item->_isSelectiveSync
+            && (item->_instruction == CSYNC_INSTRUCTION_NONE || item->_instruction == CSYNC_INSTRUCTION_UPDATE_METADATA)) {
+            _discoveryData->_stableDirectories.insert(path._target);
+        }
         auto job = new ProcessDirectoryJob(path, item, recurseQueryLocal, recurseQueryServer, this);
         job->setInsideEncryptedTree(isInsideEncryptedTree() || item->_isEncrypted);
         if (removed) {
@@ -1414,6 +1455,53 @@ void ProcessDirectoryJob::chopVirtualFileSuffix(QString &str) const
         str.chop(_discoveryData->_syncOptions._vfs->fileSuffix().size());
 }
 
+void ProcessDirectoryJob::startServerQuery()
+{
+    if (serverEntriesFromRemoteChanges()) {
+        _serverQueryDone = true;
+        return;
+    }
+
+    // Directories the database knows nothing about are listed together with
+    // everything below them: on the first sync that's the whole tree.
+    auto subtree = _discoveryData->subtreeListingFor(_currentFolder._server);
+    if (!subtree && _discoveryData->shouldListSubtree(_currentFolder._server)) {
+        if (!_dirItem) {
+            // The root is still queried on its own for its properties
+            if (_discoveryData->_statedb->getFileRecordCount() == 0)
+                _discoveryData->startSubtreeListing(_currentFolder._server);
+        } else {
+            SyncJournalFileRecord dirRecord;
+            if (!_discoveryData->_statedb->getFileRecord(_currentFolder._original, &dirRecord)) {
+                dbError();
+                return;
+            }
+            if (!dirRecord.isValid()) {
+                _discoveryData->startSubtreeListing(_currentFolder._server);
+                subtree = _discoveryData->subtreeListingFor(_currentFolder._server);
+            }
+        }
+    }
+
+    if (subtree) {
+        if (!subtree->isFinished()) {
+            _pendingAsyncJobs++;
+            connect(subtree, &DiscoverySubtreeJob::finished, this, [this] {
+                _pendingAsyncJobs--;
+                startServerQuery();
+                if (_serverQueryDone && _localQueryDone)
+                    process();
+            });
+            return;
+        }
+        if (subtree->takeListing(_currentFolder._server, _serverNormalQueryEntries)) {
+            _serverQueryDone = true;
+            return;
+        }
+    }
+    _serverJob = startAsyncServerQuery();
+}
+
 DiscoverySingleDirectoryJob *ProcessDirectoryJob::startAsyncServerQuery()
 {
     auto serverJob = new DiscoverySingleDirectoryJob(_discoveryData->_account,
@@ -1431,6 +1519,8 @@ DiscoverySingleDirectoryJob *ProcessDirectoryJob::startAsyncServerQuery()
             _serverQueryDone = true;
             if (!serverJob->_dataFingerprint.isEmpty() && _discoveryData->_dataFingerprint.isEmpty())
                 _discoveryData->_dataFingerprint = serverJob->_dataFingerprint;
+            if (!serverJob->_syncToken.isEmpty() && _discoveryData->_syncToken.isEmpty())
+                _discoveryData->_syncToken = serverJob->_syncToken;
             if (_localQueryDone)
                 this->process();
         } else {
@@ -1447,6 +1537,7 @@ DiscoverySingleDirectoryJob *ProcessDirectoryJob::startAsyncServerQuery()
                 // Similarly, the server might also return 404 or 50x in case of bugs. #7199 #7586
                 _dirItem->_instruction = CSYNC_INSTRUCTION_IGNORE;
                 _dirItem->_errorString = results.error().message;
+                _discoveryData->_remoteDiscoveryIncomplete = true;
                 emit this->finished();
             } else {
                 // Fatal for the root job since it has no SyncFileItem, or for the network errors
@@ -1461,7 +1552,130 @@ DiscoverySingleDirectoryJob *ProcessDirectoryJob::startAsyncServerQuery()
     return serverJob;
 }
 
+bool ProcessDirectoryJob::serverEntriesFromRemoteChanges()
+{
+    // The root is always queried: it provides the root permissions and the etag.
+    // Renamed directories are listed under their new name and have no db entries there.
+    if (!_dirItem || !_discoveryData->_useRemoteChanges || _currentFolder._server != _currentFolder._original)
+        return false;
+
+    // Only directories that were fully synced before have their contents in the db
+    SyncJournalFileRecord dirRecord;
+    if (!_discoveryData->_statedb->getFileRecord(_currentFolder._original, &dirRecord)
+        || !dirRecord.isValid() || !dirRecord.isDirectory() || dirRecord._etag == "_invalid_")
+        return false;
+
+    std::map<QString, RemoteInfo> entries;
+    auto pathU8 = _currentFolder._original.toUtf8();
+    if (!_discoveryData->_statedb->listFilesInPath(pathU8, [&](const SyncJournalFileRecord &rec) {
+            auto name = QString::fromUtf8(rec._path.constData() + (pathU8.size() + 1));
+            if (rec.isVirtualFile() && isVfsWithSuffix())
+                chopVirtualFileSuffix(name);
+            RemoteInfo &info = entries[name];
+            info.name = name;
+            info.etag = rec._etag;
+            info.fileId = rec._fileId;
+            info.checksumHeader = rec._checksumHeader;
+            info.remotePerm = rec._remotePerm;
+            info.modtime = rec._modtime;
+            info.isDirectory = rec.isDirectory();
+            info.size = info.isDirectory ? 0 : rec._fileSize;
+        })) {
+        return false;
+    }
+
+    // Apply the changes to the direct children
+    const bool isExternalStorage = _dirItem->_remotePerm.hasPermission(RemotePermissions::IsMounted)
+        || _dirItem->_remotePerm.hasPermission(RemotePermissions::IsMountedSub);
+    const QString prefix = _currentFolder._server + QLatin1Char('/');
+    const auto &changes = _discoveryData->_remoteChanges;
+    for (auto it = changes.lowerBound(prefix); it != changes.end() && it.key().startsWith(prefix); ++it) {
+        const auto name = it.key().mid(prefix.size());
+        if (name.contains(QLatin1Char('/')))
+            continue;
+        if (!it->isValid()) {
+            entries.erase(name);
+            continue;
+        }
+        RemoteInfo info = *it;
+        if (isExternalStorage && info.remotePerm.hasPermission(RemotePermissions::IsMounted)) {
+            // Same as for DiscoverySingleDirectoryJob: only mount points keep the 'M'
+            info.remotePerm.unsetPermission(RemotePermissions::IsMounted);
+            info.remotePerm.setPermission(RemotePermissions::IsMountedSub);
+        }
+        entries[name] = std::move(info);
+    }
+
+    _serverNormalQueryEntries.reserve(static_cast<int>(entries.size()));
+    for (auto &e : entries)
+        _serverNormalQueryEntries.push_back(std::move(e.second));
+    qCDebug(lcDisco) << "Listed" << _currentFolder._server << "from the database and the remote changes";
+    return true;
+}
+
 void ProcessDirectoryJob::startAsyncLocalQuery()
+{
+    auto walker = _discoveryData->_localWalker.data();
+    if (!walker) {
+        startSingleLocalDirectoryJob();
+        return;
+    }
+
+    // Connect first, the walker may be done with the directory right after we asked for it
+    auto connection = std::make_shared<QMetaObject::Connection>();
+    *connection = connect(walker, &LocalDiscoveryWalker::listingDone, this, [this, walker, connection](const QString &path) {
+        if (path != _currentFolder._local)
+            return;
+        QObject::disconnect(*connection);
+        _discoveryData->_currentlyActiveJobs--;
+        _pendingAsyncJobs--;
+
+        LocalDiscoveryWalker::Listing listing;
+        if (walker->takeListing(path, listing) != LocalDiscoveryWalker::Ready) {
+            // Failed, list it again to get the error
+            startSingleLocalDirectoryJob();
+            return;
+        }
+        useLocalListing(listing);
+        if (_serverQueryDone)
+            this->process();
+    });
+
+    LocalDiscoveryWalker::Listing listing;
+    switch (walker->takeListing(_currentFolder._local, listing)) {
+    case LocalDiscoveryWalker::Ready:
+        QObject::disconnect(*connection);
+        useLocalListing(listing);
+        break;
+    case LocalDiscoveryWalker::Pending:
+        _discoveryData->_currentlyActiveJobs++;
+        _pendingAsyncJobs++;
+        break;
+    case LocalDiscoveryWalker::Unavailable:
+        QObject::disconnect(*connection);
+        startSingleLocalDirectoryJob();
+        break;
+    }
+}
+
+void ProcessDirectoryJob::useLocalListing(LocalDiscoveryWalker::Listing &listing)
+{
+    const QString localPath = _discoveryData->_localDir + _currentFolder._local;
+    for (const auto &name : qAsConst(listing.invalidNames)) {
+        _childIgnored = true;
+        auto item = SyncFileItemPtr::create();
+        // Like DiscoverySingleLocalDirectoryJob does
+        item->_file = localPath + name;
+        item->_instruction = CSYNC_INSTRUCTION_IGNORE;
+        item->_status = SyncFileItem::NormalError;
+        item->_errorString = DiscoverySingleLocalDirectoryJob::tr("Filename encoding is not valid");
+        emit _discoveryData->itemDiscovered(item);
+    }
+    _localNormalQueryEntries = std::move(listing.entries);
+    _localQueryDone = true;
+}
+
+void ProcessDirectoryJob::startSingleLocalDirectoryJob()
 {
     QString localPath = _discoveryData->_localDir + _currentFolder._local;
     auto localJob = new DiscoverySingleLocalDirectoryJob(_discoveryData->_account, localPath, _discoveryData->_syncOptions._vfs.data());
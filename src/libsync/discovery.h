@@ -15,6 +15,7 @@
 #pragma once
 
 #include <QObject>
+#include <functional>
 #include "discoveryphase.h"
 #include "syncfileitem.h"
 #include "common/asserts.h"
@@ -171,6 +172,16 @@ private:
     /// processFile helper for local/remote conflicts
     void processFileConflict(const SyncFileItemPtr &item, PathTuple, const LocalInfo &, const RemoteInfo &, const SyncJournalFileRecord &);
 
+    /** Compute the checksum of a local file on the checksum thread pool
+     *
+     * The checksum type is taken from \a header. On success item->_checksumHeader
+     * is set. The continuation is called with whether a checksum could be
+     * computed; it is called immediately if the type is unknown. While the
+     * computation is in flight the job is kept alive through _pendingAsyncJobs.
+     */
+    void computeLocalChecksumAsync(const QByteArray &header, const QString &path,
+        const SyncFileItemPtr &item, const std::function<void(bool)> &continuation);
+
     /// processFile helper for common final processing
     void processFileFinalize(const SyncFileItemPtr &item, PathTuple, bool recurse, QueryMode recurseQueryLocal, QueryMode recurseQueryServer);
 
@@ -210,18 +221,41 @@ private:
     /** Convenience to detect suffix-vfs modes */
     bool isVfsWithSuffix() const;
 
+    /** Get the remote entries of the directory
+     *
+     * From the remote changes, a subtree listing or a query for this directory
+     * alone, see the functions below. Fills _serverNormalQueryEntries and sets
+     * _serverQueryDone when done.
+     */
+    void startServerQuery();
+
     /** Start a remote discovery network job
      *
      * It fills _serverNormalQueryEntries and sets _serverQueryDone when done.
      */
     DiscoverySingleDirectoryJob *startAsyncServerQuery();
 
+    /** List the remote directory from the database and the remote changes
+     *
+     * Fills _serverNormalQueryEntries with the synced entries from the db,
+     * updated with DiscoveryPhase::_remoteChanges. Returns false without doing
+     * anything if the database may not know the directory's contents.
+     */
+    bool serverEntriesFromRemoteChanges();
+
     /** Discover the local directory
       *
-      * Fills _localNormalQueryEntries.
+      * From the listing of DiscoveryPhase::_localWalker if it has one, with
+      * startSingleLocalDirectoryJob() otherwise. Fills _localNormalQueryEntries.
       */
     void startAsyncLocalQuery();
 
+    /// List the local directory with a DiscoverySingleLocalDirectoryJob
+    void startSingleLocalDirectoryJob();
+
+    /// Fills _localNormalQueryEntries from a listing of the LocalDiscoveryWalker
+    void useLocalListing(LocalDiscoveryWalker::Listing &listing);
+
 
     /** Sets _pinState, the directory's pin state
      *
@@ -31,6 +31,9 @@
 #include <QTextCodec>
 #include <cstring>
 #include <QDateTime>
+#include <QThread>
+#include <QTimer>
+#include <QBuffer>
 
 
 namespace OCC {
@@ -87,7 +90,7 @@ void DiscoveryPhase::checkSelectiveSyncNewFolder(const QString &path, RemotePerm
         && remotePerm.hasPermission(RemotePermissions::IsMounted)) {
         // external storage.
 
-        /* Note: DiscoverySingleDirectoryJob::directoryListingIteratedSlot make sure that only the
+        /* Note: DiscoverySingleDirectoryJob::directoryListingIterated make sure that only the
          * root of a mounted storage has 'M', all sub entries have 'm' */
 
         // Only allow it if the white list contains exactly this path (not parents)
@@ -236,6 +239,115 @@ void DiscoveryPhase::setSelectiveSyncWhiteList(const QStringList &list)
     std::sort(_selectiveSyncWhiteList.begin(), _selectiveSyncWhiteList.end());
 }
 
+static QList<QByteArray> remoteInfoProperties(const AccountPtr &account);
+
+void DiscoveryPhase::queryRemoteChanges(const QByteArray &syncToken, std::function<void(bool)> done)
+{
+    auto job = new SyncCollectionJob(_account, _remoteFolder, syncToken, this);
+    job->setProperties(remoteInfoProperties(_account));
+    connect(job, &SyncCollectionJob::changed, this, [this](const QString &path, const RemoteInfo &info) {
+        _remoteChanges[path] = info;
+    });
+    connect(job, &SyncCollectionJob::removed, this, [this](const QString &path) {
+        _remoteChanges[path] = RemoteInfo();
+    });
+    connect(job, &SyncCollectionJob::finishedWithoutError, this, [this, done](const QByteArray &newSyncToken) {
+        qCInfo(lcDiscovery) << "Server reported" << _remoteChanges.size() << "changes since the last sync";
+        _useRemoteChanges = true;
+        _syncToken = newSyncToken;
+        done(true);
+    });
+    connect(job, &SyncCollectionJob::finishedWithError, this, [this, done](QNetworkReply *reply) {
+        qCInfo(lcDiscovery) << "Could not get the remote changes, falling back to a full remote discovery"
+                            << reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() << reply->errorString();
+        _remoteChanges.clear();
+        done(false);
+    });
+    job->start();
+}
+
+bool DiscoveryPhase::hasRemoteChangesBelow(const QString &path) const
+{
+    if (!_useRemoteChanges)
+        return false;
+    const QString prefix = path.isEmpty() ? path : path + QLatin1Char('/');
+    auto it = _remoteChanges.lowerBound(prefix);
+    return it != _remoteChanges.end() && it.key().startsWith(prefix);
+}
+
+DiscoverySubtreeJob *DiscoveryPhase::subtreeListingFor(const QString &path) const
+{
+    if (path.isEmpty())
+        return nullptr;
+    QString p = path;
+    forever {
+        if (auto job = _subtreeListings.value(p))
+            return job;
+        if (p.isEmpty())
+            return nullptr;
+        p = p.left(qMax(0, p.lastIndexOf(QLatin1Char('/'))));
+    }
+}
+
+bool DiscoveryPhase::shouldListSubtree(const QString &path) const
+{
+    // End-to-end encrypted directories need their metadata fetched one by one
+    if (!_syncOptions._remoteSubtreeListing || _subtreeListingRejected
+        || _account->capabilities().clientSideEncryptionAvailable())
+        return false;
+
+    // Don't list what the user chose not to sync
+    const QString prefix = path.isEmpty() ? path : path + QLatin1Char('/');
+    auto it = std::lower_bound(_selectiveSyncBlackList.begin(), _selectiveSyncBlackList.end(), prefix);
+    if (it != _selectiveSyncBlackList.end() && it->startsWith(prefix))
+        return false;
+
+    // New folders may still be excluded because of their size or because they are
+    // external storages. Only list the folders below the root once they were accepted.
+    if (path.isEmpty()
+        && ((_syncOptions._newBigFolderSizeLimit >= 0 && _syncOptions._vfs->mode() == Vfs::Off)
+            || _syncOptions._confirmExternalStorage)) {
+        return false;
+    }
+    return true;
+}
+
+void DiscoveryPhase::startSubtreeListing(const QString &path)
+{
+    auto job = new DiscoverySubtreeJob(_account, _remoteFolder, path, this);
+    _subtreeListings.insert(path, job);
+    _currentlyActiveJobs++;
+    connect(job, &DiscoverySubtreeJob::finished, this, [this, job] {
+        _currentlyActiveJobs--;
+        if (job->rejected())
+            _subtreeListingRejected = true;
+        QTimer::singleShot(0, this, &DiscoveryPhase::scheduleMoreJobs);
+    });
+    job->start();
+}
+
+DiscoveryPhase::~DiscoveryPhase()
+{
+    // Its threads use the members through the prefetch filter
+    delete _localWalker;
+}
+
+void DiscoveryPhase::startLocalWalker()
+{
+    if (_syncOptions._localDiscoveryThreads <= 0)
+        return;
+    _localWalker = new LocalDiscoveryWalker(_localDir, _syncOptions._vfs.data(), _syncOptions._localDiscoveryThreads, this);
+    // Discovery never takes the listings of these, they would only pin the buffer
+    _localWalker->setPrefetchFilter([this](const QString &path, const LocalInfo &info) {
+        if (_ignoreHiddenFiles && (info.isHidden || info.name.startsWith(QLatin1Char('.'))))
+            return false;
+        if (isInSelectiveSyncBlackList(path))
+            return false;
+        return _excludes->traversalPatternMatch(path, ItemTypeDirectory) == CSYNC_NOT_EXCLUDED;
+    });
+    _localWalker->start();
+}
+
 void DiscoveryPhase::scheduleMoreJobs()
 {
     auto limit = qMax(1, _syncOptions._parallelNetworkJobs);
@@ -284,11 +396,7 @@ void DiscoverySingleLocalDirectoryJob::run() {
         if (dirent->type == ItemTypeSkip)
             continue;
         LocalInfo i;
-        static QTextCodec *codec = QTextCodec::codecForName("UTF-8");
-        ASSERT(codec);
-        QTextCodec::ConverterState state;
-        i.name = codec->toUnicode(dirent->path, dirent->path.size(), &state);
-        if (state.invalidChars > 0 || state.remainingChars > 0) {
+        if (!fillLocalInfo(*dirent, i)) {
             emit childIgnored(true);
             auto item = SyncFileItemPtr::create();
             //item->_file = _currentFolder._target + i.name;
@@ -300,14 +408,6 @@ void DiscoverySingleLocalDirectoryJob::run() {
             emit itemDiscovered(item);
             continue;
         }
-        i.modtime = dirent->modtime;
-        i.size = dirent->size;
-        i.inode = dirent->inode;
-        i.isDirectory = dirent->type == ItemTypeDirectory;
-        i.isHidden = dirent->is_hidden;
-        i.isSymLink = dirent->type == ItemTypeSoftLink;
-        i.isVirtualFile = dirent->type == ItemTypeVirtualFile || dirent->type == ItemTypeVirtualFileDownload;
-        i.type = dirent->type;
         results.push_back(i);
     }
     if (errno != 0) {
@@ -328,6 +428,212 @@ void DiscoverySingleLocalDirectoryJob::run() {
     emit finished(results);
 }
 
+bool DiscoverySingleLocalDirectoryJob::fillLocalInfo(const csync_file_stat_t &dirent, LocalInfo &info)
+{
+    static QTextCodec *codec = QTextCodec::codecForName("UTF-8");
+    ASSERT(codec);
+    QTextCodec::ConverterState state;
+    info.name = codec->toUnicode(dirent.path, dirent.path.size(), &state);
+    if (state.invalidChars > 0 || state.remainingChars > 0)
+        return false;
+    info.modtime = dirent.modtime;
+    info.size = dirent.size;
+    info.inode = dirent.inode;
+    info.isDirectory = dirent.type == ItemTypeDirectory;
+    info.isHidden = dirent.is_hidden;
+    info.isSymLink = dirent.type == ItemTypeSoftLink;
+    info.isVirtualFile = dirent.type == ItemTypeVirtualFile || dirent.type == ItemTypeVirtualFileDownload;
+    info.type = dirent.type;
+    return true;
+}
+
+LocalDiscoveryWalker::LocalDiscoveryWalker(const QString &localDir, Vfs *vfs, int threadCount, QObject *parent)
+    : QObject(parent)
+    , _localDir(localDir)
+    , _vfs(vfs)
+    , _queues(qMax(1, threadCount))
+{
+}
+
+LocalDiscoveryWalker::~LocalDiscoveryWalker()
+{
+    {
+        QMutexLocker locker(&_mutex);
+        _aborted = true;
+        _workAvailable.wakeAll();
+    }
+    for (auto &thread : _threads)
+        thread->wait();
+}
+
+void LocalDiscoveryWalker::start()
+{
+    _directories.insert(QString(), Directory());
+    _queues[0].push_back(Task{ QString(), QString(), nullptr });
+    for (int worker = 0; worker < int(_queues.size()); ++worker) {
+        _threads.emplace_back(QThread::create([this, worker] {
+            Task task;
+            while (nextTask(worker, task))
+                list(worker, task);
+        }));
+        _threads.back()->start();
+    }
+}
+
+LocalDiscoveryWalker::Result LocalDiscoveryWalker::takeListing(const QString &path, Listing &listing)
+{
+    QMutexLocker locker(&_mutex);
+    auto it = _directories.find(path);
+    if (it == _directories.end())
+        return Unavailable;
+
+    switch (it->state) {
+    case Listed:
+        listing = std::move(it->listing);
+        _bufferedEntries -= listing.entries.size();
+        _directories.erase(it);
+        // There may be room for prefetching again
+        _workAvailable.wakeAll();
+        return Ready;
+    case Failed:
+        _directories.erase(it);
+        return Unavailable;
+    case Queued:
+        if (!it->demanded) {
+            it->demanded = true;
+            _demanded.push_back(path);
+            _workAvailable.wakeOne();
+        }
+        return Pending;
+    case InProgress:
+        it->demanded = true;
+        return Pending;
+    }
+    return Unavailable;
+}
+
+bool LocalDiscoveryWalker::nextTask(int worker, Task &task)
+{
+    QMutexLocker locker(&_mutex);
+    const int workerCount = int(_queues.size());
+    // Marks the directory of the task as being listed, unless that already happened
+    auto claim = [this](const QString &path) {
+        auto it = _directories.find(path);
+        if (it == _directories.end() || it->state != Queued)
+            return false;
+        it->state = InProgress;
+        ++_busyWorkers;
+        return true;
+    };
+
+    forever {
+        if (_aborted)
+            return false;
+
+        // Directories somebody waits for come first, opened through their full path
+        while (!_demanded.empty()) {
+            const QString path = std::move(_demanded.front());
+            _demanded.pop_front();
+            if (claim(path)) {
+                task = Task{ path, QString(), nullptr };
+                return true;
+            }
+        }
+
+        bool queued = false;
+        for (int i = 0; i < workerCount; ++i) {
+            auto &queue = _queues[(worker + i) % workerCount];
+            queued |= !queue.empty();
+            while (_bufferedEntries < _maxBufferedEntries && !queue.empty()) {
+                // The own queue newest first, the others oldest first
+                if (i == 0) {
+                    task = std::move(queue.back());
+                    queue.pop_back();
+                } else {
+                    task = std::move(queue.front());
+                    queue.pop_front();
+                }
+                if (claim(task.path))
+                    return true;
+            }
+        }
+
+        // Once nothing is queued or being listed no new work can appear
+        if (!queued && _busyWorkers == 0) {
+            _workAvailable.wakeAll();
+            return false;
+        }
+        _workAvailable.wait(&_mutex);
+    }
+}
+
+void LocalDiscoveryWalker::list(int worker, const Task &task)
+{
+    csync_vio_handle_t *dh = nullptr;
+    if (task.parent) {
+        dh = csync_vio_local_opendir_at(task.parent.get(), task.name);
+    } else {
+        QString localPath = _localDir + task.path;
+        if (localPath.endsWith('/')) // The root
+            localPath.chop(1);
+        dh = csync_vio_local_opendir(localPath);
+    }
+
+    Listing listing;
+    std::vector<Task> subdirectories;
+    bool ok = dh != nullptr;
+    if (dh) {
+        // Stays open while subdirectories are opened relative to it
+        std::shared_ptr<csync_vio_handle_t> handle(dh, csync_vio_local_closedir);
+        while (true) {
+            errno = 0;
+            auto dirent = csync_vio_local_readdir(dh, _vfs);
+            if (!dirent)
+                break;
+            if (dirent->type == ItemTypeSkip)
+                continue;
+            LocalInfo info;
+            if (!DiscoverySingleLocalDirectoryJob::fillLocalInfo(*dirent, info)) {
+                listing.invalidNames.append(info.name);
+                continue;
+            }
+            if (info.isDirectory) {
+                const QString path = task.path.isEmpty() ? info.name : QString(task.path + QLatin1Char('/') + info.name);
+                if (!_prefetchFilter || _prefetchFilter(path, info))
+                    subdirectories.push_back(Task{ path, info.name, handle });
+            }
+            listing.entries.push_back(std::move(info));
+        }
+        ok = errno == 0;
+        if (!ok)
+            subdirectories.clear();
+    }
+
+    bool demanded = false;
+    {
+        QMutexLocker locker(&_mutex);
+        auto &directory = _directories[task.path];
+        demanded = directory.demanded;
+        if (ok) {
+            directory.state = Listed;
+            _bufferedEntries += listing.entries.size();
+            directory.listing = std::move(listing);
+        } else {
+            directory.state = Failed;
+        }
+        auto &queue = _queues[worker];
+        for (auto &subdirectory : subdirectories) {
+            _directories.insert(subdirectory.path, Directory());
+            queue.push_back(std::move(subdirectory));
+        }
+        --_busyWorkers;
+        // Idle workers may steal the new directories, or exit when there are none
+        _workAvailable.wakeAll();
+    }
+    if (demanded)
+        emit listingDone(task.path);
+}
+
 DiscoverySingleDirectoryJob::DiscoverySingleDirectoryJob(const AccountPtr &account, const QString &path, QObject *parent)
     : QObject(parent)
     , _subPath(path)
@@ -342,8 +648,37 @@ DiscoverySingleDirectoryJob::DiscoverySingleDirectoryJob(const AccountPtr &accou
 void DiscoverySingleDirectoryJob::start()
 {
     // Start the actual HTTP job
-    auto *lsColJob = new LsColJob(_account, _subPath, this);
+    auto *lsColJob = new RemoteInfoLsColJob(_account, _subPath, [this](RemoteInfoParser::Entry &entry) {
+        directoryListingIterated(entry);
+    }, this);
+
+    QList<QByteArray> props = remoteInfoProperties(_account);
+    if (_isRootPath) {
+        props << "http://owncloud.org/ns:data-fingerprint";
+        // The remote changes can't be used for end-to-end encrypted folders
+        if (!_account->capabilities().clientSideEncryptionAvailable())
+            props << "sync-token";
+    }
+
+    lsColJob->setProperties(props);
+
+    QObject::connect(lsColJob, &LsColJob::finishedWithError, this, &DiscoverySingleDirectoryJob::lsJobFinishedWithErrorSlot);
+    QObject::connect(lsColJob, &LsColJob::finishedWithoutError, this, &DiscoverySingleDirectoryJob::lsJobFinishedWithoutErrorSlot);
+    lsColJob->start();
+
+    _lsColJob = lsColJob;
+}
+
+void DiscoverySingleDirectoryJob::abort()
+{
+    if (_lsColJob && _lsColJob->reply()) {
+        _lsColJob->reply()->abort();
+    }
+}
 
+// The properties decoded by RemoteInfoParser
+static QList<QByteArray> remoteInfoProperties(const AccountPtr &account)
+{
     QList<QByteArray> props;
     props << "resourcetype"
           << "getlastmodified"
@@ -354,117 +689,501 @@ void DiscoverySingleDirectoryJob::start()
           << "http://owncloud.org/ns:dDC"
           << "http://owncloud.org/ns:permissions"
           << "http://owncloud.org/ns:checksums";
-    if (_isRootPath)
-        props << "http://owncloud.org/ns:data-fingerprint";
-    if (_account->serverVersionInt() >= Account::makeServerVersion(10, 0, 0)) {
+    if (account->serverVersionInt() >= Account::makeServerVersion(10, 0, 0)) {
         // Server older than 10.0 have performances issue if we ask for the share-types on every PROPFIND
         props << "http://owncloud.org/ns:share-types";
     }
-    if (_account->capabilities().clientSideEncryptionAvailable()) {
+    if (account->capabilities().clientSideEncryptionAvailable()) {
         props << "http://nextcloud.org/ns:is-encrypted";
     }
+    return props;
+}
 
-    lsColJob->setProperties(props);
+// Names of RemoteInfoParser::Property, properties are matched by their local name
+static const QLatin1String propertyNames[] = {
+    QLatin1String("resourcetype"),
+    QLatin1String("getlastmodified"),
+    QLatin1String("getcontentlength"),
+    QLatin1String("getetag"),
+    QLatin1String("id"),
+    QLatin1String("downloadURL"),
+    QLatin1String("dDC"),
+    QLatin1String("permissions"),
+    QLatin1String("checksums"),
+    QLatin1String("share-types"),
+    QLatin1String("is-encrypted"),
+    QLatin1String("data-fingerprint"),
+    QLatin1String("sync-token"),
+};
+static_assert(sizeof(propertyNames) / sizeof(propertyNames[0]) == RemoteInfoParser::PropertyCount,
+    "a name for every property");
 
-    QObject::connect(lsColJob, &LsColJob::directoryListingIterated,
-        this, &DiscoverySingleDirectoryJob::directoryListingIteratedSlot);
-    QObject::connect(lsColJob, &LsColJob::finishedWithError, this, &DiscoverySingleDirectoryJob::lsJobFinishedWithErrorSlot);
-    QObject::connect(lsColJob, &LsColJob::finishedWithoutError, this, &DiscoverySingleDirectoryJob::lsJobFinishedWithoutErrorSlot);
-    lsColJob->start();
+static int propertyFor(const QStringRef &name)
+{
+    for (int i = 0; i < RemoteInfoParser::PropertyCount; ++i) {
+        if (name.size() == propertyNames[i].size() && name == propertyNames[i])
+            return i;
+    }
+    return -1;
+}
 
-    _lsColJob = lsColJob;
+// Whether the href is a plain path that QUrl wouldn't change
+static bool isPlainHref(const QString &href)
+{
+    if (!href.startsWith(QLatin1Char('/')))
+        return false;
+    for (const QChar c : href) {
+        const ushort u = c.unicode();
+        if (!((u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9')
+                || u == '/' || u == '-' || u == '_' || u == '.' || u == '~')) {
+            return false;
+        }
+    }
+    return !href.contains(QLatin1String("//")) && !href.contains(QLatin1String("/./"))
+        && !href.contains(QLatin1String("/../")) && !href.endsWith(QLatin1String("/."))
+        && !href.endsWith(QLatin1String("/.."));
 }
 
-void DiscoverySingleDirectoryJob::abort()
+static int daysInMonth(int year, int month)
 {
-    if (_lsColJob && _lsColJob->reply()) {
-        _lsColJob->reply()->abort();
+    static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    const bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return month == 2 && leap ? 29 : days[month - 1];
+}
+
+/* Parses the "Sun, 06 Nov 1994 08:49:37 GMT" form of HTTP dates that servers
+ * send, which is much faster than QDateTime. Returns false for anything else. */
+static bool parseHttpDate(const QStringRef &value, time_t &result)
+{
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    if (value.size() != 29 || value.at(3) != QLatin1Char(',') || !value.endsWith(QLatin1String(" GMT")))
+        return false;
+    char s[30];
+    for (int i = 0; i < 29; ++i) {
+        const ushort u = value.at(i).unicode();
+        if (u > 127)
+            return false;
+        s[i] = char(u);
     }
+    s[29] = 0;
+    auto number = [&s](int pos, int len) {
+        int n = 0;
+        for (int i = pos; i < pos + len; ++i) {
+            if (s[i] < '0' || s[i] > '9')
+                return -1;
+            n = n * 10 + (s[i] - '0');
+        }
+        return n;
+    };
+    int m = 0;
+    for (int i = 0; i < 12 && m == 0; ++i) {
+        if (std::strncmp(months + 3 * i, s + 8, 3) == 0)
+            m = i + 1;
+    }
+    const int d = number(5, 2), y = number(12, 4), h = number(17, 2), min = number(20, 2), sec = number(23, 2);
+    if (s[4] != ' ' || s[7] != ' ' || s[11] != ' ' || s[16] != ' ' || s[19] != ':' || s[22] != ':'
+        || m == 0 || y < 1970 || d < 1 || d > daysInMonth(y, m) || h < 0 || h > 23
+        || min < 0 || min > 59 || sec < 0 || sec > 59) {
+        return false;
+    }
+
+    // Days since the epoch, for the proleptic Gregorian calendar
+    const int yy = m <= 2 ? y - 1 : y;
+    const int era = yy / 400;
+    const int yearOfEra = yy - era * 400;
+    const int dayOfYear = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const qint64 days = qint64(era) * 146097 + yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear - 719468;
+    result = time_t(days * 86400 + h * 3600 + min * 60 + sec);
+    return true;
 }
 
-static void propertyMapToRemoteInfo(const QMap<QString, QString> &map, RemoteInfo &result)
-{
-    for (auto it = map.constBegin(); it != map.constEnd(); ++it) {
-        QString property = it.key();
-        QString value = it.value();
-        if (property == QLatin1String("resourcetype")) {
-            result.isDirectory = value.contains(QLatin1String("collection"));
-        } else if (property == QLatin1String("getlastmodified")) {
-            const auto date = QDateTime::fromString(value, Qt::RFC2822Date);
-            Q_ASSERT(date.isValid());
-            result.modtime = date.toTime_t();
-        } else if (property == QLatin1String("getcontentlength")) {
-            // See #4573, sometimes negative size values are returned
-            bool ok = false;
-            qlonglong ll = value.toLongLong(&ok);
-            if (ok && ll >= 0) {
-                result.size = ll;
-            } else {
-                result.size = 0;
+// The code of a status line like "HTTP/1.1 404 Not Found", 0 if there is none
+static int httpStatusCode(const QString &status)
+{
+    const QString line = status.trimmed();
+    const auto parts = line.splitRef(QLatin1Char(' '), QString::SkipEmptyParts);
+    return parts.size() >= 2 ? parts.at(1).toInt() : 0;
+}
+
+RemoteInfoParser::RemoteInfoParser(Callback callback)
+    : _callback(std::move(callback))
+{
+}
+
+bool RemoteInfoParser::parse(const QByteArray &xml, const QString &expectedPath)
+{
+    start(expectedPath);
+    return addData(xml) && finish();
+}
+
+void RemoteInfoParser::start(const QString &expectedPath)
+{
+    _reader.clear();
+    _reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
+    _expectedPath = expectedPath;
+    _capture = nullptr;
+    _captureDepth = 0;
+    _path.clear();
+    _responseStatus.clear();
+    _syncToken.clear();
+    _propstatFound = 0;
+    _found = 0;
+    _insideMultiStatus = false;
+    _insidePropstat = false;
+    _insideProp = false;
+    _failed = false;
+}
+
+bool RemoteInfoParser::addData(const QByteArray &data)
+{
+    if (_failed)
+        return false;
+    _reader.addData(data);
+    return parseAvailable();
+}
+
+bool RemoteInfoParser::finish()
+{
+    if (_failed)
+        return false;
+    if (_reader.hasError()) {
+        qCWarning(lcDiscovery) << "Invalid PROPFIND answer" << _reader.errorString();
+        _failed = true;
+        return false;
+    } else if (!_insideMultiStatus) {
+        qCWarning(lcDiscovery) << "PROPFIND answer without WebDAV response";
+        _failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool RemoteInfoParser::parseAvailable()
+{
+    while (!_reader.atEnd()) {
+        const QXmlStreamReader::TokenType type = _reader.readNext();
+        if (type == QXmlStreamReader::Invalid)
+            break;
+
+        if (_captureDepth > 0) {
+            // Inside a property, href or status: collect the text. The names of child
+            // elements are kept too, resourcetype and share-types only have those.
+            if (type == QXmlStreamReader::Characters) {
+                if (_capture)
+                    _capture->append(_reader.text());
+            } else if (type == QXmlStreamReader::StartElement) {
+                ++_captureDepth;
+                if (_capture) {
+                    _capture->append(QLatin1Char(' '));
+                    _capture->append(_reader.name());
+                    _capture->append(QLatin1Char(' '));
+                }
+            } else if (type == QXmlStreamReader::EndElement) {
+                if (--_captureDepth == 0 && !endCapture())
+                    return false;
+            }
+            continue;
+        }
+
+        if (type == QXmlStreamReader::StartElement) {
+            if (_insideProp) {
+                // All those elements are properties
+                const int property = propertyFor(_reader.name());
+                _capture = property >= 0 ? &_propstatValues[property] : nullptr;
+                if (_capture) {
+                    _capture->resize(0);
+                    _propstatFound |= 1u << property;
+                }
+                _captureDepth = 1;
+                continue;
             }
-        } else if (property == "getetag") {
-            result.etag = Utility::normalizeEtag(value.toUtf8());
-        } else if (property == "id") {
-            result.fileId = value.toUtf8();
-        } else if (property == "downloadURL") {
-            result.directDownloadUrl = value;
-        } else if (property == "dDC") {
-            result.directDownloadCookies = value;
-        } else if (property == "permissions") {
-            result.remotePerm = RemotePermissions::fromServerString(value);
-        } else if (property == "checksums") {
-            result.checksumHeader = findBestChecksum(value.toUtf8());
-        } else if (property == "share-types" && !value.isEmpty()) {
-            // Since QMap is sorted, "share-types" is always after "permissions".
-            if (result.remotePerm.isNull()) {
-                qWarning() << "Server returned a share type, but no permissions?";
+            if (_reader.namespaceUri() != QLatin1String("DAV:"))
+                continue;
+            const QStringRef name = _reader.name();
+            if (name == QLatin1String("href") && !_insidePropstat) {
+                _capture = &_href;
+            } else if (name == QLatin1String("status")) {
+                _capture = _insidePropstat ? &_status : &_responseStatus;
+            } else if (name == QLatin1String("sync-token")) {
+                // The new token of a sync-collection answer, properties were handled above
+                _capture = &_syncToken;
+            } else if (name == QLatin1String("prop") && _insidePropstat) {
+                _insideProp = true;
+                continue;
+            } else if (name == QLatin1String("propstat")) {
+                _insidePropstat = true;
+                _propstatFound = 0;
+                _status.resize(0);
+                continue;
+            } else if (name == QLatin1String("multistatus")) {
+                _insideMultiStatus = true;
+                continue;
             } else {
-                // S means shared with me.
-                // But for our purpose, we want to know if the file is shared. It does not matter
-                // if we are the owner or not.
-                // Piggy back on the persmission field
-                result.remotePerm.setPermission(RemotePermissions::IsShared);
+                continue;
+            }
+            _capture->resize(0);
+            _captureDepth = 1;
+        } else if (type == QXmlStreamReader::EndElement && _reader.namespaceUri() == QLatin1String("DAV:")) {
+            const QStringRef name = _reader.name();
+            if (name == QLatin1String("prop")) {
+                _insideProp = false;
+            } else if (name == QLatin1String("propstat")) {
+                endPropstat();
+            } else if (name == QLatin1String("response")) {
+                endResponse();
             }
-        } else if (property == "is-encrypted" && value == QStringLiteral("1")) {
-            result.isE2eEncrypted = true;
         }
     }
+
+    if (_reader.hasError() && _reader.error() != QXmlStreamReader::PrematureEndOfDocumentError) {
+        qCWarning(lcDiscovery) << "Invalid PROPFIND answer" << _reader.errorString();
+        _failed = true;
+        return false;
+    }
+    return true;
 }
 
-void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(const QString &file, const QMap<QString, QString> &map)
+bool RemoteInfoParser::endCapture()
+{
+    if (_capture == &_href) {
+        // We don't use URL encoding in our request URL (which is the expected path) (QNAM will do it for us)
+        // but the result will have URL encoding..
+        const QString href = _href.trimmed();
+        _path = isPlainHref(href)
+            ? href
+            : QUrl::fromLocalFile(QUrl::fromPercentEncoding(href.toUtf8())).adjusted(QUrl::NormalizePathSegments).path();
+        if (!_path.startsWith(_expectedPath)) {
+            qCWarning(lcDiscovery) << "Invalid href" << _path << "expected starting with" << _expectedPath;
+            _failed = true;
+            return false;
+        }
+    }
+    _capture = nullptr;
+    return true;
+}
+
+void RemoteInfoParser::endPropstat()
+{
+    _insidePropstat = false;
+    if (!QStringRef(&_status).trimmed().startsWith(QLatin1String("HTTP/1.1 200")))
+        return;
+    for (int i = 0; i < PropertyCount; ++i) {
+        if (_propstatFound & (1u << i))
+            std::swap(_values[i], _propstatValues[i]);
+    }
+    _found |= _propstatFound;
+}
+
+void RemoteInfoParser::endResponse()
+{
+    Entry entry;
+    entry.path = std::move(_path);
+    _path = QString();
+    if (entry.path.endsWith(QLatin1Char('/')))
+        entry.path.chop(1);
+    entry.found = _found;
+    _found = 0;
+    entry.status = httpStatusCode(_responseStatus);
+    _responseStatus.resize(0);
+
+    RemoteInfo &info = entry.info;
+    info.name = entry.path.mid(entry.path.lastIndexOf(QLatin1Char('/')) + 1);
+    info.size = -1;
+    if (entry.has(ResourceType))
+        info.isDirectory = value(ResourceType).contains(QLatin1String("collection"));
+    if (entry.has(GetLastModified) && !parseHttpDate(value(GetLastModified), info.modtime)) {
+        const auto date = QDateTime::fromString(value(GetLastModified).toString(), Qt::RFC2822Date);
+        Q_ASSERT(date.isValid());
+        info.modtime = date.toTime_t();
+    }
+    if (entry.has(GetContentLength)) {
+        // See #4573, sometimes negative size values are returned
+        bool ok = false;
+        const qlonglong ll = value(GetContentLength).toLongLong(&ok);
+        info.size = ok && ll >= 0 ? ll : 0;
+    }
+    if (entry.has(GetEtag)) {
+        entry.rawEtag = value(GetEtag).toUtf8();
+        info.etag = Utility::normalizeEtag(entry.rawEtag);
+    }
+    if (entry.has(Id))
+        info.fileId = value(Id).toUtf8();
+    if (entry.has(DownloadUrl))
+        info.directDownloadUrl = value(DownloadUrl).toString();
+    if (entry.has(DDC))
+        info.directDownloadCookies = value(DDC).toString();
+    if (entry.has(Permissions)) {
+        entry.permissions = RemotePermissions::fromServerString(_values[Permissions]);
+        info.remotePerm = entry.permissions;
+    }
+    if (entry.has(Checksums))
+        info.checksumHeader = findBestChecksum(value(Checksums).toUtf8());
+    if (entry.has(ShareTypes) && !value(ShareTypes).isEmpty()) {
+        if (info.remotePerm.isNull()) {
+            qWarning() << "Server returned a share type, but no permissions?";
+        } else {
+            // S means shared with me.
+            // But for our purpose, we want to know if the file is shared. It does not matter
+            // if we are the owner or not.
+            // Piggy back on the persmission field
+            info.remotePerm.setPermission(RemotePermissions::IsShared);
+        }
+    }
+    if (entry.has(IsEncrypted))
+        info.isE2eEncrypted = value(IsEncrypted) == QLatin1String("1");
+    if (entry.has(DataFingerprint))
+        entry.dataFingerprint = value(DataFingerprint).toUtf8();
+    if (entry.has(SyncToken))
+        entry.syncToken = value(SyncToken).toUtf8();
+    if (info.isDirectory)
+        info.size = 0;
+
+    _callback(entry);
+}
+
+RemoteInfoLsColJob::RemoteInfoLsColJob(AccountPtr account, const QString &path,
+    RemoteInfoParser::Callback callback, QObject *parent)
+    : LsColJob(account, path, parent)
+    , _parser(std::move(callback))
+{
+}
+
+void RemoteInfoLsColJob::startParsing(const QString &expectedPath)
+{
+    _parser.start(expectedPath);
+}
+
+bool RemoteInfoLsColJob::parseData(const QByteArray &data)
+{
+    return _parser.addData(data);
+}
+
+bool RemoteInfoLsColJob::finishParsing()
+{
+    return _parser.finish();
+}
+
+SyncCollectionJob::SyncCollectionJob(AccountPtr account, const QString &path, const QByteArray &syncToken, QObject *parent)
+    : AbstractNetworkJob(account, path, parent)
+    , _syncToken(syncToken)
+{
+}
+
+void SyncCollectionJob::setProperties(QList<QByteArray> properties)
+{
+    _properties = properties;
+}
+
+void SyncCollectionJob::start()
+{
+    QNetworkRequest req;
+    req.setRawHeader("Content-Type", "application/xml; charset=utf-8");
+    const QByteArray token = QString::fromUtf8(_syncToken).toHtmlEscaped().toUtf8();
+    QByteArray xml = "<?xml version=\"1.0\" ?>\n"
+                     "<d:sync-collection xmlns:d=\"DAV:\" xmlns:oc=\"http://owncloud.org/ns\">\n"
+                     "  <d:sync-token>" + token + "</d:sync-token>\n"
+                     "  <d:sync-level>infinite</d:sync-level>\n"
+                     "  <d:prop>\n"
+        + davPropertiesXml(_properties) + "  </d:prop>\n"
+                                          "</d:sync-collection>\n";
+    auto *buf = new QBuffer(this);
+    buf->setData(xml);
+    buf->open(QIODevice::ReadOnly);
+    sendRequest("REPORT", makeDavUrl(path()), req, buf);
+    AbstractNetworkJob::start();
+}
+
+bool SyncCollectionJob::finished()
+{
+    qCInfo(lcDiscovery) << "REPORT sync-collection of" << reply()->request().url() << "FINISHED WITH STATUS"
+                        << replyStatusString();
+
+    QString contentType = reply()->header(QNetworkRequest::ContentTypeHeader).toString();
+    int httpCode = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (httpCode == 207 && contentType.contains("application/xml; charset=utf-8")) {
+        QString collectionPath = reply()->request().url().path();
+        if (collectionPath.endsWith('/'))
+            collectionPath.chop(1);
+        if (!parse(reply()->readAll(), collectionPath)) {
+            emit finishedWithError(reply());
+        }
+    } else {
+        // 403/409 for a token the server doesn't know (anymore), or no support at all
+        emit finishedWithError(reply());
+    }
+    return true;
+}
+
+bool SyncCollectionJob::parse(const QByteArray &xml, const QString &collectionPath)
+{
+    QVector<QPair<QString, RemoteInfo>> changes;
+    QStringList removals;
+    const QString prefix = collectionPath + QLatin1Char('/');
+    bool truncated = false;
+    bool invalid = false;
+
+    RemoteInfoParser parser([&](RemoteInfoParser::Entry &entry) {
+        if (entry.status == 507) {
+            // The server didn't list all changes
+            truncated = true;
+        } else if (entry.path == collectionPath) {
+            // The collection itself
+        } else if (!entry.path.startsWith(prefix)) {
+            qCWarning(lcDiscovery) << "Invalid href" << entry.path << "expected starting with" << prefix;
+            invalid = true;
+        } else if (entry.status == 404) {
+            removals.append(entry.path.mid(prefix.size()));
+        } else {
+            changes.append(qMakePair(entry.path.mid(prefix.size()), std::move(entry.info)));
+        }
+    });
+    if (!parser.parse(xml, collectionPath) || invalid) {
+        return false;
+    } else if (parser.syncToken().isEmpty()) {
+        qCWarning(lcDiscovery) << "No sync-token in the sync-collection answer";
+        return false;
+    } else if (truncated) {
+        qCWarning(lcDiscovery) << "The server truncated the list of changes";
+        return false;
+    }
+
+    // Only report once the whole response is known to be usable
+    for (const auto &removal : qAsConst(removals))
+        emit removed(removal);
+    for (const auto &change : qAsConst(changes))
+        emit changed(change.first, change.second);
+    emit finishedWithoutError(parser.syncToken());
+    return true;
+}
+
+void DiscoverySingleDirectoryJob::directoryListingIterated(RemoteInfoParser::Entry &entry)
 {
     if (!_ignoredFirst) {
         // The first entry is for the folder itself, we should process it differently.
         _ignoredFirst = true;
-        if (map.contains("permissions")) {
-            auto perm = RemotePermissions::fromServerString(map.value("permissions"));
-            emit firstDirectoryPermissions(perm);
-            _isExternalStorage = perm.hasPermission(RemotePermissions::IsMounted);
+        if (entry.has(RemoteInfoParser::Permissions)) {
+            emit firstDirectoryPermissions(entry.permissions);
+            _isExternalStorage = entry.permissions.hasPermission(RemotePermissions::IsMounted);
         }
-        if (map.contains("data-fingerprint")) {
-            _dataFingerprint = map.value("data-fingerprint").toUtf8();
+        if (entry.has(RemoteInfoParser::DataFingerprint)) {
+            _dataFingerprint = entry.dataFingerprint;
             if (_dataFingerprint.isEmpty()) {
                 // Placeholder that means that the server supports the feature even if it did not set one.
                 _dataFingerprint = "[empty]";
             }
         }
-        if (map.contains("id")) {
-            _fileId = map.value("id").toUtf8();
+        if (entry.has(RemoteInfoParser::SyncToken)) {
+            _syncToken = entry.syncToken;
+        }
+        if (entry.has(RemoteInfoParser::Id)) {
+            _fileId = entry.info.fileId;
         }
-        if (map.contains("is-encrypted") && map.value("is-encrypted") == QStringLiteral("1")) {
+        if (entry.info.isE2eEncrypted) {
             _isE2eEncrypted = true;
             Q_ASSERT(!_fileId.isEmpty());
         }
     } else {
-
-        RemoteInfo result;
-        int slash = file.lastIndexOf('/');
-        result.name = file.mid(slash + 1);
-        result.size = -1;
-        propertyMapToRemoteInfo(map, result);
-        if (result.isDirectory)
-            result.size = 0;
-
+        RemoteInfo &result = entry.info;
         if (_isExternalStorage && result.remotePerm.hasPermission(RemotePermissions::IsMounted)) {
             /* All the entries in a external storage have 'M' in their permission. However, for all
                purposes in the desktop client, we only need to know about the mount points.
@@ -472,27 +1191,19 @@ void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(const QString &fi
             result.remotePerm.unsetPermission(RemotePermissions::IsMounted);
             result.remotePerm.setPermission(RemotePermissions::IsMountedSub);
         }
-
-        QStringRef fileRef(&file);
-        int slashPos = file.lastIndexOf(QLatin1Char('/'));
-        if (slashPos > -1) {
-            fileRef = file.midRef(slashPos + 1);
-        }
         _results.push_back(std::move(result));
     }
 
     //This works in concerto with the RequestEtagJob and the Folder object to check if the remote folder changed.
-    if (map.contains("getetag")) {
-        if (_firstEtag.isEmpty()) {
-            _firstEtag = parseEtag(map.value("getetag").toUtf8()); // for directory itself
-        }
+    if (entry.has(RemoteInfoParser::GetEtag) && _firstEtag.isEmpty()) {
+        _firstEtag = parseEtag(entry.rawEtag); // for directory itself
     }
 }
 
 void DiscoverySingleDirectoryJob::lsJobFinishedWithoutErrorSlot()
 {
     if (!_ignoredFirst) {
-        // This is a sanity check, if we haven't _ignoredFirst then it means we never received any directoryListingIteratedSlot
+        // This is a sanity check, if we haven't _ignoredFirst then it means we never received any directoryListingIterated
         // which means somehow the server XML was bogus
         emit finished(HttpError{ 0, tr("Server error: PROPFIND reply is not XML formatted!") });
         deleteLater();
@@ -575,4 +1286,117 @@ void DiscoverySingleDirectoryJob::metadataError(const QByteArray &fileId, int ht
     emit finished(_results);
     deleteLater();
 }
+
+DiscoverySubtreeJob::DiscoverySubtreeJob(const AccountPtr &account, const QString &remoteFolder, const QString &path, QObject *parent)
+    : QObject(parent)
+    , _account(account)
+    , _remoteFolder(remoteFolder)
+    , _path(path)
+{
+}
+
+void DiscoverySubtreeJob::start()
+{
+    auto *lsColJob = new RemoteInfoLsColJob(_account, _remoteFolder + _path, [this](RemoteInfoParser::Entry &entry) {
+        directoryListingIterated(entry);
+    }, this);
+    lsColJob->setDepth("infinity");
+    lsColJob->setProperties(remoteInfoProperties(_account));
+
+    QObject::connect(lsColJob, &LsColJob::finishedWithError, this, &DiscoverySubtreeJob::lsJobFinishedWithErrorSlot);
+    QObject::connect(lsColJob, &LsColJob::finishedWithoutError, this, &DiscoverySubtreeJob::lsJobFinishedWithoutErrorSlot);
+    lsColJob->start();
+}
+
+static QString joinPath(const QString &dir, const QString &name)
+{
+    if (dir.isEmpty() || name.isEmpty())
+        return dir + name;
+    return dir + QLatin1Char('/') + name;
+}
+
+void DiscoverySubtreeJob::directoryListingIterated(RemoteInfoParser::Entry &entry)
+{
+    const QString &file = entry.path;
+    if (_rootHref.isNull()) {
+        // The first entry is for the directory itself
+        _rootHref = file;
+        _listings[_path];
+        if (entry.permissions.hasPermission(RemotePermissions::IsMounted))
+            _mountedDirectories.insert(_path);
+        return;
+    }
+    if (!file.startsWith(_rootHref + QLatin1Char('/'))) {
+        qCWarning(lcDiscovery) << "Subtree listing of" << _path << "contains unexpected entry" << file;
+        return;
+    }
+
+    const QStringRef relative = file.midRef(_rootHref.size() + 1);
+    const int slash = relative.lastIndexOf(QLatin1Char('/'));
+    if (slash >= 0)
+        _sawNestedEntry = true;
+
+    RemoteInfo &result = entry.info;
+    if (result.isDirectory) {
+        const QString path = joinPath(_path, relative.toString());
+        _listings[path];
+        // Like DiscoverySingleDirectoryJob, decide on the 'M' of the entries
+        // by the permissions of the directory itself
+        if (result.remotePerm.hasPermission(RemotePermissions::IsMounted))
+            _mountedDirectories.insert(path);
+    }
+    _listings[joinPath(_path, relative.left(qMax(0, slash)).toString())].push_back(std::move(result));
+}
+
+void DiscoverySubtreeJob::lsJobFinishedWithoutErrorSlot()
+{
+    _finished = true;
+    if (_rootHref.isNull()) {
+        qCWarning(lcDiscovery) << "Subtree listing of" << _path << "is empty";
+    } else if (!_sawNestedEntry && _listings.size() > 1) {
+        // Subdirectories but nothing inside them: the server most likely treated the
+        // request as Depth: 1. Their contents are unknown, the listing of the
+        // directory itself is still right.
+        qCInfo(lcDiscovery) << "Subtree listing of" << _path << "contains only one level";
+        auto own = _listings.take(_path);
+        _listings.clear();
+        _listings.insert(_path, own);
+    } else {
+        qCInfo(lcDiscovery) << "Subtree listing of" << _path << "contains" << _listings.size() << "directories";
+    }
+    emit finished();
+}
+
+void DiscoverySubtreeJob::lsJobFinishedWithErrorSlot(QNetworkReply *r)
+{
+    int httpCode = r->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    qCWarning(lcDiscovery) << "Subtree listing of" << _path << "failed" << r->errorString() << httpCode << r->error();
+    // Servers that don't allow Depth: infinity answer with 403 (propfind-finite-depth,
+    // RFC 4918), or don't understand the request at all
+    _rejected = httpCode == 400 || httpCode == 403 || httpCode == 405 || httpCode == 501;
+    _finished = true;
+    _listings.clear();
+    _mountedDirectories.clear();
+    emit finished();
+}
+
+bool DiscoverySubtreeJob::takeListing(const QString &path, QVector<RemoteInfo> &result)
+{
+    auto it = _listings.find(path);
+    if (it == _listings.end())
+        return false;
+    result = std::move(*it);
+    _listings.erase(it);
+
+    if (_mountedDirectories.remove(path)) {
+        // All the entries in an external storage have 'M', see DiscoverySingleDirectoryJob
+        for (auto &entry : result) {
+            if (entry.remotePerm.hasPermission(RemotePermissions::IsMounted)) {
+                entry.remotePerm.unsetPermission(RemotePermissions::IsMounted);
+                entry.remotePerm.setPermission(RemotePermissions::IsMountedSub);
+            }
+        }
+    }
+    return true;
+}
 }
@@ -24,11 +24,17 @@
 #include <QMutex>
 #include <QWaitCondition>
 #include <QRunnable>
+#include <array>
 #include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
 #include "syncoptions.h"
 #include "syncfileitem.h"
 
 class ExcludedFiles;
+class QThread;
+struct csync_vio_handle_t;
 
 namespace OCC {
 
@@ -80,6 +86,174 @@ struct LocalInfo
     bool isValid() const { return !name.isNull(); }
 };
 
+/**
+ * @brief Streaming parser for PROPFIND and sync-collection REPORT answers
+ *
+ * Unlike LsColXMLParser no QMap of strings is built for every entry: the
+ * properties discovery asks for are recognized by their name and decoded
+ * straight into the fields of an Entry. The answer may be added in chunks
+ * of any size.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT RemoteInfoParser
+{
+public:
+    /// The properties that are decoded, other ones are skipped
+    enum Property {
+        ResourceType,
+        GetLastModified,
+        GetContentLength,
+        GetEtag,
+        Id,
+        DownloadUrl,
+        DDC,
+        Permissions,
+        Checksums,
+        ShareTypes,
+        IsEncrypted,
+        DataFingerprint,
+        SyncToken,
+        PropertyCount
+    };
+
+    /// One <response> of the answer
+    struct Entry
+    {
+        /// The decoded href, without trailing '/'
+        QString path;
+        /// name is the last segment of path; size is -1 if unknown and 0 for directories
+        RemoteInfo info;
+        /// The permissions as sent, IsShared is not added for share-types
+        RemotePermissions permissions;
+        QByteArray rawEtag;
+        QByteArray dataFingerprint;
+        QByteArray syncToken;
+        /// Bitmask of the properties that came with status 200
+        quint32 found = 0;
+        /// The HTTP status of a <response> without <propstat>, 0 if there is none
+        int status = 0;
+
+        bool has(Property p) const { return found & (1u << p); }
+    };
+
+    /// Called for every entry, which may be moved from
+    using Callback = std::function<void(Entry &)>;
+
+    explicit RemoteInfoParser(Callback callback);
+
+    /// Starts a new answer whose hrefs must all start with \a expectedPath
+    void start(const QString &expectedPath);
+    /// Returns false once the answer is known to be invalid
+    bool addData(const QByteArray &data);
+    /// Returns false if the answer was invalid or incomplete
+    bool finish();
+
+    /// start(), addData() and finish() at once
+    bool parse(const QByteArray &xml, const QString &expectedPath);
+
+    /// The DAV:sync-token of a sync-collection answer
+    QByteArray syncToken() const { return _syncToken.trimmed().toUtf8(); }
+
+private:
+    bool parseAvailable();
+    bool endCapture();
+    void endPropstat();
+    void endResponse();
+    QStringRef value(Property p) const { return QStringRef(&_values[p]).trimmed(); }
+
+    Callback _callback;
+    QXmlStreamReader _reader;
+    QString _expectedPath;
+
+    // The text of the element being read and how deep inside of it the reader is.
+    // Unknown properties are skipped with a null _capture.
+    QString *_capture = nullptr;
+    int _captureDepth = 0;
+
+    QString _href;
+    QString _status;
+    QString _responseStatus;
+    QString _syncToken;
+    QString _path;
+    // Values of the current <propstat> and the accepted ones of the current <response>.
+    // The buffers are reused for all entries.
+    std::array<QString, PropertyCount> _propstatValues;
+    std::array<QString, PropertyCount> _values;
+    quint32 _propstatFound = 0;
+    quint32 _found = 0;
+
+    bool _insideMultiStatus = false;
+    bool _insidePropstat = false;
+    bool _insideProp = false;
+    bool _failed = false;
+};
+
+/**
+ * @brief LsColJob that passes the answer through a RemoteInfoParser
+ *
+ * directoryListingIterated() and directoryListingSubfolders() are not emitted.
+ *
+ * @ingroup libsync
+ */
+class RemoteInfoLsColJob : public LsColJob
+{
+public:
+    explicit RemoteInfoLsColJob(AccountPtr account, const QString &path,
+        RemoteInfoParser::Callback callback, QObject *parent = nullptr);
+
+protected:
+    void startParsing(const QString &expectedPath) override;
+    bool parseData(const QByteArray &data) override;
+    bool finishParsing() override;
+
+private:
+    RemoteInfoParser _parser;
+};
+
+/**
+ * @brief Asks for the changes below a collection since a sync token
+ *
+ * Sends a DAV sync-collection REPORT (RFC 6578) with infinite depth. On
+ * success, removed() and changed() are emitted for every resource that was
+ * removed, added or modified since \a syncToken was handed out, followed by
+ * finishedWithoutError() with the token to ask for later changes.
+ *
+ * The paths are relative to the requested collection and don't end with a
+ * slash. The properties are requested like for LsColJob and decoded with
+ * RemoteInfoParser.
+ *
+ * Nothing is emitted but finishedWithError() if the server rejects the token
+ * or only reports part of the changes.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT SyncCollectionJob : public AbstractNetworkJob
+{
+    Q_OBJECT
+public:
+    explicit SyncCollectionJob(AccountPtr account, const QString &path, const QByteArray &syncToken, QObject *parent = nullptr);
+    void start() override;
+
+    /// See LsColJob::setProperties()
+    void setProperties(QList<QByteArray> properties);
+
+signals:
+    void changed(const QString &path, const OCC::RemoteInfo &info);
+    void removed(const QString &path);
+    void finishedWithoutError(const QByteArray &newSyncToken);
+    void finishedWithError(QNetworkReply *reply);
+
+private slots:
+    bool finished() override;
+
+private:
+    bool parse(const QByteArray &xml, const QString &collectionPath);
+
+    QByteArray _syncToken;
+    QList<QByteArray> _properties;
+};
+
 /**
  * @brief Run list on a local directory and process the results for Discovery
  *
@@ -92,6 +266,13 @@ public:
     explicit DiscoverySingleLocalDirectoryJob(const AccountPtr &account, const QString &localPath, OCC::Vfs *vfs, QObject *parent = nullptr);
 
     void run() Q_DECL_OVERRIDE;
+
+    /** Fills \a info from the directory entry \a dirent
+     *
+     * Returns false if the name isn't valid in the file name encoding, the
+     * name is still set, with replacement characters.
+     */
+    static bool fillLocalInfo(const csync_file_stat_t &dirent, LocalInfo &info);
 signals:
     void finished(QVector<LocalInfo> result);
     void finishedFatalError(QString errorString);
@@ -108,6 +289,110 @@ public:
 };
 
 
+/**
+ * @brief Lists the local tree ahead of the ProcessDirectoryJobs
+ *
+ * A few worker threads list directories in parallel, every directory is
+ * opened and its entries are stat'ed relative to the already open parent.
+ * A worker takes the directories it found itself newest first and steals the
+ * oldest ones of another worker when it has none left, so the workers stay
+ * in separate subtrees.
+ *
+ * Listings are kept until a ProcessDirectoryJob takes them. Directories the
+ * prefetch filter rejects, like excluded or deselected ones, aren't listed
+ * ahead at all. Prefetching pauses while too many entries wait to be taken,
+ * but directories that are asked for are always listed right away.
+ *
+ * Errors aren't reported: takeListing() answers Unavailable and the directory
+ * is listed again with a DiscoverySingleLocalDirectoryJob, which produces the
+ * appropriate error.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT LocalDiscoveryWalker : public QObject
+{
+    Q_OBJECT
+public:
+    struct Listing
+    {
+        QVector<LocalInfo> entries;
+        /// Names that aren't valid in the file name encoding, with replacement characters
+        QStringList invalidNames;
+    };
+
+    enum Result {
+        Ready,
+        Pending,
+        Unavailable
+    };
+
+    /// \a localDir ends with '/'
+    LocalDiscoveryWalker(const QString &localDir, Vfs *vfs, int threadCount, QObject *parent = nullptr);
+    ~LocalDiscoveryWalker() override;
+
+    void start();
+
+    /** Moves the listing of \a path, relative to the local directory, into \a listing
+     *
+     * If the result is Pending, listingDone() is emitted for \a path once it
+     * was listed or failed; connect to it before asking.
+     */
+    Result takeListing(const QString &path, Listing &listing);
+
+    /// Number of listed entries that may wait to be taken before prefetching pauses, set before start()
+    void setMaxBufferedEntries(int count) { _maxBufferedEntries = count; }
+
+    /** Whether the subdirectory \a path, with \a info, should be listed ahead
+     *
+     * Set before start(), it is called on the worker threads. Rejected
+     * directories and everything below them are answered with Unavailable.
+     */
+    using PrefetchFilter = std::function<bool(const QString &path, const LocalInfo &info)>;
+    void setPrefetchFilter(PrefetchFilter filter) { _prefetchFilter = std::move(filter); }
+
+signals:
+    void listingDone(const QString &path);
+
+private:
+    struct Task
+    {
+        QString path;
+        QString name;
+        // Null for directories that are opened through their full path
+        std::shared_ptr<csync_vio_handle_t> parent;
+    };
+    enum State {
+        Queued,
+        InProgress,
+        Listed,
+        Failed
+    };
+    struct Directory
+    {
+        State state = Queued;
+        bool demanded = false;
+        Listing listing;
+    };
+
+    bool nextTask(int worker, Task &task);
+    void list(int worker, const Task &task);
+
+    QString _localDir;
+    Vfs *_vfs;
+    PrefetchFilter _prefetchFilter;
+    std::vector<std::unique_ptr<QThread>> _threads;
+
+    QMutex _mutex;
+    QWaitCondition _workAvailable;
+    std::vector<std::deque<Task>> _queues; // one per worker
+    std::deque<QString> _demanded;
+    QHash<QString, Directory> _directories; // queued, running and untaken listings
+    int _busyWorkers = 0;
+    int _bufferedEntries = 0;
+    int _maxBufferedEntries = 500000;
+    bool _aborted = false;
+};
+
 /**
  * @brief Run a PROPFIND on a directory and process the results for Discovery
  *
@@ -130,7 +415,6 @@ signals:
     void finished(const HttpResult<QVector<RemoteInfo>> &result);
 
 private slots:
-    void directoryListingIteratedSlot(const QString &, const QMap<QString, QString> &);
     void lsJobFinishedWithoutErrorSlot();
     void lsJobFinishedWithErrorSlot(QNetworkReply *);
     void fetchE2eMetadata();
@@ -138,6 +422,8 @@ private slots:
     void metadataError(const QByteArray& fileId, int httpReturnCode);
 
 private:
+    void directoryListingIterated(RemoteInfoParser::Entry &entry);
+
     QVector<RemoteInfo> _results;
     QString _subPath;
     QString _firstEtag;
@@ -158,6 +444,65 @@ private:
 
 public:
     QByteArray _dataFingerprint;
+    QByteArray _syncToken;
+};
+
+/**
+ * @brief Lists a whole remote subtree with a single Depth: infinity PROPFIND
+ *
+ * Used for directories the database knows nothing about yet, most notably
+ * during the first sync, to avoid one request per directory. The answer is
+ * parsed while it arrives and the entries are grouped by their parent
+ * directory; the ProcessDirectoryJobs then take the listing of their
+ * directory with takeListing() once the job has finished.
+ *
+ * Servers may refuse Depth: infinity, then rejected() is set. Others silently
+ * answer as for Depth: 1; only the listing of the subtree root is kept then
+ * and the directories below it need to be queried individually.
+ *
+ * @ingroup libsync
+ */
+class DiscoverySubtreeJob : public QObject
+{
+    Q_OBJECT
+public:
+    /// \a path is relative to \a remoteFolder, which ends with '/'
+    explicit DiscoverySubtreeJob(const AccountPtr &account, const QString &remoteFolder, const QString &path, QObject *parent = nullptr);
+    void start();
+
+    bool isFinished() const { return _finished; }
+    /// Whether the server doesn't list subtrees, only meaningful once finished
+    bool rejected() const { return _rejected; }
+
+    /** Moves the entries of the directory \a path into \a result
+     *
+     * Returns false if the listing doesn't contain that directory, for
+     * example because the job failed.
+     */
+    bool takeListing(const QString &path, QVector<RemoteInfo> &result);
+
+signals:
+    void finished();
+
+private slots:
+    void lsJobFinishedWithoutErrorSlot();
+    void lsJobFinishedWithErrorSlot(QNetworkReply *);
+
+private:
+    void directoryListingIterated(RemoteInfoParser::Entry &entry);
+
+    AccountPtr _account;
+    QString _remoteFolder;
+    QString _path;
+    QString _rootHref; // href of _path as reported by the server
+    // Entries by the path of their parent directory, relative to _remoteFolder.
+    // Every listed directory has an entry, even if it is empty.
+    QHash<QString, QVector<RemoteInfo>> _listings;
+    // Directories whose own entry has 'M' in its permissions
+    QSet<QString> _mountedDirectories;
+    bool _sawNestedEntry = false;
+    bool _finished = false;
+    bool _rejected = false;
 };
 
 class DiscoveryPhase : public QObject
@@ -202,6 +547,9 @@ class DiscoveryPhase : public QObject
     // The value of this map doesn't matter.
     QMap<QString, bool> _forbiddenDeletes;
 
+    /// Directories that are neither new, removed nor moved, see isStableDirectory()
+    QSet<QString> _stableDirectories;
+
     /** Returns whether the db-path has been renamed locally or on the remote.
      *
      * Useful for avoiding processing of items that have already been claimed in
@@ -209,6 +557,32 @@ class DiscoveryPhase : public QObject
      */
     bool isRenamed(const QString &p) const { return _renamedItemsLocal.contains(p) || _renamedItemsRemote.contains(p); }
 
+    /** Remote changes since the last sync, see queryRemoteChanges()
+     *
+     * Maps paths relative to _remoteFolder to their current RemoteInfo, or
+     * to an invalid RemoteInfo if they were removed. Only meaningful if
+     * _useRemoteChanges is set.
+     */
+    QMap<QString, RemoteInfo> _remoteChanges;
+    bool _useRemoteChanges = false;
+
+    /// Whether the server reported changes for anything strictly below the path
+    bool hasRemoteChangesBelow(const QString &path) const;
+
+    /** Running and finished DiscoverySubtreeJobs by the path of their root
+     *
+     * The root job is never served from a subtree listing: it needs the
+     * properties of the sync root that are only asked for in its own query.
+     */
+    QMap<QString, QPointer<DiscoverySubtreeJob>> _subtreeListings;
+
+    /// The subtree listing that covers the directory \a path, if any
+    DiscoverySubtreeJob *subtreeListingFor(const QString &path) const;
+
+    /// Whether \a path should be listed with a new DiscoverySubtreeJob
+    bool shouldListSubtree(const QString &path) const;
+    void startSubtreeListing(const QString &path);
+
     int _currentlyActiveJobs = 0;
 
     // both must contain a sorted list
@@ -245,6 +619,8 @@ class DiscoveryPhase : public QObject
     QPair<bool, QByteArray> findAndCancelDeletedJob(const QString &originalPath);
 
 public:
+    ~DiscoveryPhase() override;
+
     // input
     QString _localDir; // absolute path to the local directory. ends with '/'
     QString _remoteFolder; // remote folder, ends with '/'
@@ -262,8 +638,46 @@ public:
     void setSelectiveSyncBlackList(const QStringList &list);
     void setSelectiveSyncWhiteList(const QStringList &list);
 
+    /** Set if the server refused a subtree listing
+     *
+     * Is not reset by the discovery, so remembering it across syncs avoids
+     * asking again.
+     */
+    bool _subtreeListingRejected = false;
+
+    /** Lists the local tree ahead of the ProcessDirectoryJobs, may be null
+     *
+     * Only worth it when the whole local tree is discovered, see startLocalWalker().
+     */
+    QPointer<LocalDiscoveryWalker> _localWalker;
+
+    /// Starts listing the local tree with SyncOptions::_localDiscoveryThreads threads, if there are any
+    void startLocalWalker();
+
+    /** Asks the server for all remote changes since \a syncToken in one request
+     *
+     * On success the changes are used to list directories whose etag changed
+     * from the database instead of querying the server for each of them, and
+     * _syncToken is set to the new token. Calls \a done with false if the
+     * server can't tell, the discovery then walks the etags as usual.
+     */
+    void queryRemoteChanges(const QByteArray &syncToken, std::function<void(bool)> done);
+
+    /** Whether the directory \a path exists on both sides and stays where it is
+     *
+     * True for the sync root and for directories whose instruction was NONE or
+     * UPDATE_METADATA when their content started to be discovered; that instruction
+     * doesn't change anymore. Only meaningful for directories whose entries have
+     * been discovered.
+     */
+    bool isStableDirectory(const QString &path) const { return path.isEmpty() || _stableDirectories.contains(path); }
+
     // output
     QByteArray _dataFingerprint;
+    /// Token for the next queryRemoteChanges(), empty if the server doesn't support it
+    QByteArray _syncToken;
+    /// Set if a remote directory couldn't be listed and was ignored
+    bool _remoteDiscoveryIncomplete = false;
     bool _anotherSyncNeeded = false;
 
 signals:
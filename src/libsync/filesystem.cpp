@@ -25,6 +25,12 @@
 #include "vio/csync_vio_local.h"
 #include "std/c_time.h"
 
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
 namespace OCC {
 
 bool FileSystem::fileEquals(const QString &fn1, const QString &fn2)
@@ -180,6 +186,28 @@ bool FileSystem::removeRecursively(const QString &path, const std::function<void
     return allRemoved;
 }
 
+bool FileSystem::preallocate(QFile &file, qint64 size)
+{
+#ifdef Q_OS_LINUX
+    const int fd = file.handle();
+    if (fd < 0 || size <= 0)
+        return false;
+    // Unlike posix_fallocate(), FALLOC_FL_KEEP_SIZE reserves the blocks without
+    // extending the file.
+    if (::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size) == 0)
+        return true;
+    if (errno != EOPNOTSUPP && errno != ENOSYS) {
+        qCWarning(lcFileSystem) << "Could not preallocate" << size << "bytes for" << file.fileName()
+                                << strerror(errno);
+    }
+    return false;
+#else
+    Q_UNUSED(file)
+    Q_UNUSED(size)
+    return false;
+#endif
+}
+
 bool FileSystem::getInode(const QString &filename, quint64 *inode)
 {
     csync_file_stat_t fs;
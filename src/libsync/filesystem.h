@@ -96,6 +96,15 @@ namespace FileSystem {
     bool OWNCLOUDSYNC_EXPORT removeRecursively(const QString &path,
         const std::function<void(const QString &path, bool isDir)> &onDeleted = nullptr,
         QStringList *errors = nullptr);
+
+    /**
+     * @brief Reserve disk space for an open file that will grow to \a size bytes
+     *
+     * The file size is not changed, so appending writes and size based download
+     * resumption keep working. Returns false if the platform or file system
+     * doesn't support it; that is not an error.
+     */
+    bool OWNCLOUDSYNC_EXPORT preallocate(QFile &file, qint64 size);
 }
 
 /** @} */
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "logbuffer.h"
+
+#include <QtGlobal>
+
+namespace OCC {
+
+LogBuffer::LogBuffer(int capacity)
+{
+    quint32 size = 2;
+    while (size < quint32(qMax(2, capacity)))
+        size *= 2;
+    _slots.reset(new Slot[size]);
+    _mask = size - 1;
+    // A slot is free for the push at position p when its sequence is p and
+    // holds a record for the pop at position p when its sequence is p + 1
+    for (quint32 i = 0; i < size; ++i)
+        _slots[i].sequence.storeRelease(i);
+}
+
+bool LogBuffer::push(QString &record)
+{
+    quint32 position = _pushPosition.loadAcquire();
+    forever {
+        Slot &slot = _slots[position & _mask];
+        const auto diff = qint32(slot.sequence.loadAcquire() - position);
+        if (diff == 0) {
+            // Claim the slot; if another producer was faster, retry at its position
+            if (_pushPosition.testAndSetRelaxed(position, position + 1, position)) {
+                slot.record = std::move(record);
+                slot.sequence.storeRelease(position + 1);
+                return true;
+            }
+        } else if (diff < 0) {
+            // The consumer didn't free this slot yet
+            return false;
+        } else {
+            position = _pushPosition.loadAcquire();
+        }
+    }
+}
+
+bool LogBuffer::pop(QString &record)
+{
+    const quint32 position = _popPosition.loadAcquire();
+    Slot &slot = _slots[position & _mask];
+    if (qint32(slot.sequence.loadAcquire() - (position + 1)) < 0)
+        return false;
+    record = std::move(slot.record);
+    slot.record = QString();
+    slot.sequence.storeRelease(position + _mask + 1);
+    _popPosition.storeRelease(position + 1);
+    return true;
+}
+
+int LogBuffer::size() const
+{
+    const auto size = qint32(_pushPosition.loadAcquire() - _popPosition.loadAcquire());
+    return qBound(0, size, capacity());
+}
+}
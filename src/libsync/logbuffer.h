@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef LOGBUFFER_H
+#define LOGBUFFER_H
+
+#include "owncloudlib.h"
+
+#include <QAtomicInteger>
+#include <QString>
+
+#include <memory>
+
+namespace OCC {
+
+/**
+ * @brief Bounded lock-free ring buffer of log records
+ * @ingroup libsync
+ *
+ * Any number of threads may push() at the same time, pop() must only be
+ * called by one thread at a time. Every slot carries a sequence number that
+ * tells producers and the consumer whose turn it is, so neither side ever
+ * blocks: push() fails when the buffer is full and pop() when it is empty.
+ */
+class OWNCLOUDSYNC_EXPORT LogBuffer
+{
+public:
+    /// \a capacity is rounded up to a power of two
+    explicit LogBuffer(int capacity);
+
+    /// Moves \a record into the buffer, returns false if it is full
+    bool push(QString &record);
+
+    /// Moves the oldest record into \a record, returns false if there is none
+    bool pop(QString &record);
+
+    int capacity() const { return int(_mask + 1); }
+
+    /// Number of records in the buffer, only a snapshot while producers run
+    int size() const;
+
+private:
+    struct Slot
+    {
+        QAtomicInteger<quint32> sequence;
+        QString record;
+    };
+
+    std::unique_ptr<Slot[]> _slots;
+    quint32 _mask;
+
+    // Position of the next push and pop, on separate cache lines
+    alignas(64) QAtomicInteger<quint32> _pushPosition;
+    alignas(64) QAtomicInteger<quint32> _popPosition;
+};
+}
+
+#endif
@@ -17,10 +17,13 @@
 #include "config.h"
 
 #include <QDir>
+#include <QElapsedTimer>
 #include <QStringList>
+#include <QThread>
 #include <QtGlobal>
 #include <qmetaobject.h>
 
+#include <climits>
 #include <iostream>
 
 #ifdef ZLIB_FOUND
@@ -43,7 +46,7 @@ static void mirallLogCatcher(QtMsgType type, const QMessageLogContext &ctx, cons
             s_originalMessageHandler(type, ctx, message);
         }
     } else if (!logger->isNoop()) {
-        logger->doLog(qFormatLogMessage(type, ctx, message));
+        logger->doLog(type, qFormatLogMessage(type, ctx, message));
     }
     if(type == QtCriticalMsg || type == QtFatalMsg) {
         std::cerr << qPrintable(qFormatLogMessage(type, ctx, message)) << std::endl;
@@ -69,6 +72,7 @@ Logger *Logger::instance()
 
 Logger::Logger(QObject *parent)
     : QObject(parent)
+    , _buffer(bufferCapacity)
 {
     qSetMessagePattern("%{time yyyy-MM-dd hh:mm:ss:zzz} [ %{type} %{category} ]%{if-debug}\t[ %{function} ]%{endif}:\t%{message}");
 #ifndef NO_MSG_HANDLER
@@ -83,6 +87,7 @@ Logger::~Logger()
 #ifndef NO_MSG_HANDLER
     qInstallMessageHandler(nullptr);
 #endif
+    close();
 }
 
 
@@ -120,37 +125,134 @@ void Logger::log(Log log)
  */
 bool Logger::isNoop() const
 {
-    QMutexLocker lock(&_mutex);
-    return !_logstream;
+    return !_logging.loadAcquire();
 }
 
 bool Logger::isLoggingToFile() const
 {
-    QMutexLocker lock(&_mutex);
-    return _logstream;
+    return _logging.loadAcquire();
 }
 
 void Logger::doLog(const QString &msg)
 {
-    {
-        QMutexLocker lock(&_mutex);
-        if (_logstream) {
-            (*_logstream) << msg << endl;
-            if (_doFileFlush)
-                _logstream->flush();
+    doLog(QtInfoMsg, msg);
+}
+
+void Logger::doLog(QtMsgType type, const QString &msg)
+{
+    if (type == QtFatalMsg) {
+        // The process is about to end, don't leave anything to the writer
+        {
+            QMutexLocker lock(&_mutex);
+            writePending();
+            if (_logFile.isOpen()) {
+                QByteArray line = msg.toUtf8();
+                line += '\n';
+                _logFile.write(line);
+                _logFile.flush();
+            }
+        }
+        emit logWindowLog(msg);
+        return;
+    }
+
+    if (_logging.loadAcquire()) {
+        QString record = msg;
+        bool pushed = _buffer.push(record);
+        // Buffer full: debug lines are dropped right away, other lines wait for the writer.
+        // The writer thread must never wait for itself.
+        if (!pushed && type != QtDebugMsg && QThread::currentThread() != _writer.data()) {
+            QElapsedTimer timer;
+            timer.start();
+            do {
+                wakeWriter();
+                QThread::yieldCurrentThread();
+                pushed = _buffer.push(record);
+            } while (!pushed && timer.elapsed() < backpressureMsec);
         }
+        if (!pushed)
+            _droppedLines.ref();
+        if (_doFileFlush.loadAcquire() || _buffer.size() >= _buffer.capacity() / 2)
+            wakeWriter();
     }
     emit logWindowLog(msg);
 }
 
-void Logger::close()
+void Logger::flush()
 {
     QMutexLocker lock(&_mutex);
-    if (_logstream)
+    writePending();
+}
+
+void Logger::writePending()
+{
+    QByteArray batch;
+    QString record;
+    if (!_logFile.isOpen()) {
+        // Nowhere to write to, the lines are lost
+        while (_buffer.pop(record)) {
+        }
+        _droppedLines.store(0);
+        return;
+    }
+    while (_buffer.pop(record)) {
+        batch += record.toUtf8();
+        batch += '\n';
+        if (batch.size() >= 1024 * 1024) {
+            _logFile.write(batch);
+            batch.clear();
+        }
+    }
+    if (const int dropped = _droppedLines.fetchAndStoreRelaxed(0)) {
+        batch += QByteArray::number(dropped) + " log lines were dropped because the log could not be written fast enough\n";
+    }
+    if (!batch.isEmpty()) {
+        _logFile.write(batch);
+        _logFile.flush();
+    }
+}
+
+void Logger::writerLoop()
+{
+    forever {
+        {
+            QMutexLocker lock(&_writerMutex);
+            if (_stopWriter)
+                return;
+            // Nothing can be logged without a log file, setLogFile() wakes the writer
+            _writerCondition.wait(&_writerMutex, _logging.loadAcquire() ? flushIntervalMsec : ULONG_MAX);
+        }
+        flush();
+    }
+}
+
+void Logger::wakeWriter()
+{
+    _writerCondition.wakeOne();
+}
+
+void Logger::stopWriter()
+{
+    if (!_writer)
+        return;
     {
-        _logstream->flush();
+        QMutexLocker lock(&_writerMutex);
+        _stopWriter = true;
+        _writerCondition.wakeOne();
+    }
+    _writer->wait();
+    _writer.reset();
+    _stopWriter = false;
+}
+
+void Logger::close()
+{
+    stopWriter();
+    QMutexLocker lock(&_mutex);
+    writePending();
+    if (_logFile.isOpen()) {
+        _logging.storeRelease(false);
         _logFile.close();
-        _logstream.reset();
     }
 }
 
@@ -171,8 +273,10 @@ QString Logger::logFile() const
 void Logger::setLogFile(const QString &name)
 {
     QMutexLocker locker(&_mutex);
-    if (_logstream) {
-        _logstream.reset(nullptr);
+    if (_logFile.isOpen()) {
+        // What was logged so far belongs to the previous file
+        writePending();
+        _logging.storeRelease(false);
         _logFile.close();
     }
 
@@ -197,7 +301,17 @@ void Logger::setLogFile(const QString &name)
         return;
     }
 
-    _logstream.reset(new QTextStream(&_logFile));
+    _logging.storeRelease(true);
+    locker.unlock();
+
+    if (!_writer) {
+        _writer.reset(QThread::create([this] { writerLoop(); }));
+        _writer->setObjectName(QStringLiteral("LogWriter"));
+        _writer->start(QThread::LowPriority);
+    } else {
+        QMutexLocker lock(&_writerMutex);
+        _writerCondition.wakeOne();
+    }
 }
 
 void Logger::setLogExpire(int expire)
@@ -217,7 +331,7 @@ void Logger::setLogDir(const QString &dir)
 
 void Logger::setLogFlush(bool flush)
 {
-    _doFileFlush = flush;
+    _doFileFlush.storeRelease(flush);
 }
 
 void Logger::setLogDebug(bool debug)
@@ -22,9 +22,14 @@
 #include <QTextStream>
 #include <qmutex.h>
 
+#include <QWaitCondition>
+
 #include "common/utility.h"
+#include "logbuffer.h"
 #include "owncloudlib.h"
 
+class QThread;
+
 namespace OCC {
 
 struct Log
@@ -36,6 +41,16 @@ struct Log
 /**
  * @brief The Logger class
  * @ingroup libsync
+ *
+ * Log lines are not written by the threads that log them: they are pushed
+ * into a lock-free LogBuffer and a writer thread writes them to the log file
+ * in batches, at the latest flushIntervalMsec after they were logged.
+ *
+ * When the buffer is full, debug lines are dropped and counted, the number
+ * is written to the log once there is room again. Other lines make the
+ * logging thread wait for the writer for up to backpressureMsec before they
+ * are dropped too. Fatal messages write everything that is pending and the
+ * message itself synchronously.
  */
 class OWNCLOUDSYNC_EXPORT Logger : public QObject
 {
@@ -46,6 +61,9 @@ public:
 
     void log(Log log);
     void doLog(const QString &log);
+    void doLog(QtMsgType type, const QString &log);
+    /// Writes all pending lines to the log file before returning
+    void flush();
     void close();
 
     static void mirallLog(const QString &message);
@@ -66,6 +84,7 @@ public:
     QString logDir() const;
     void setLogDir(const QString &dir);
 
+    /// Wake the writer for every line instead of batching them
     void setLogFlush(bool flush);
 
     bool logDebug() const { return _logDebug; }
@@ -87,6 +106,10 @@ public:
     /** For switching off via logwindow */
     void disableTemporaryFolderLogDir();
 
+    static constexpr int bufferCapacity = 16 * 1024;
+    static constexpr int flushIntervalMsec = 50;
+    static constexpr int backpressureMsec = 1000;
+
 signals:
     void logWindowLog(const QString &);
 
@@ -100,16 +123,32 @@ public slots:
 private:
     Logger(QObject *parent = nullptr);
     ~Logger();
+
+    void writerLoop();
+    void wakeWriter();
+    void stopWriter();
+    // Writes the pending lines, must hold _mutex
+    void writePending();
+
     QList<Log> _logs;
     bool _showTime = true;
     QFile _logFile;
-    bool _doFileFlush = false;
+    QAtomicInt _doFileFlush;
     int _logExpire = 0;
     bool _logDebug = false;
-    QScopedPointer<QTextStream> _logstream;
+    // Set while _logFile is open
+    QAtomicInt _logging;
+    // Protects _logFile and is held by whoever takes lines from _buffer
     mutable QMutex _mutex;
     QString _logDirectory;
     bool _temporaryFolderLogDir = false;
+
+    LogBuffer _buffer;
+    QAtomicInt _droppedLines;
+    QScopedPointer<QThread> _writer;
+    QMutex _writerMutex;
+    QWaitCondition _writerCondition;
+    bool _stopWriter = false;
 };
 
 } // namespace OCC
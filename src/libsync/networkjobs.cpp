@@ -215,105 +215,179 @@ LsColXMLParser::LsColXMLParser() = default;
 
 bool LsColXMLParser::parse(const QByteArray &xml, QHash<QString, ExtraFolderInfo> *fileInfo, const QString &expectedPath)
 {
-    // Parse DAV response
-    QXmlStreamReader reader(xml);
-    reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
-
-    QStringList folders;
-    QString currentHref;
-    QMap<QString, QString> currentTmpProperties;
-    QMap<QString, QString> currentHttp200Properties;
-    bool currentPropsHaveHttp200 = false;
-    bool insidePropstat = false;
-    bool insideProp = false;
-    bool insideMultiStatus = false;
-
-    while (!reader.atEnd()) {
-        QXmlStreamReader::TokenType type = reader.readNext();
-        QString name = reader.name().toString();
+    start(fileInfo, expectedPath);
+    return addData(xml) && finish();
+}
+
+void LsColXMLParser::start(QHash<QString, ExtraFolderInfo> *fileInfo, const QString &expectedPath)
+{
+    _reader.clear();
+    _reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
+    _pending.clear();
+    _fileInfo = fileInfo;
+    _expectedPath = expectedPath;
+    _folders.clear();
+    _currentHref.clear();
+    _currentTmpProperties.clear();
+    _currentHttp200Properties.clear();
+    _currentPropsHaveHttp200 = false;
+    _insidePropstat = false;
+    _insideProp = false;
+    _insideMultiStatus = false;
+    _failed = false;
+}
+
+// Position just after the last "</response>" end tag (with any namespace prefix) in data, or -1
+static int endOfLastResponse(const QByteArray &data)
+{
+    static const QByteArray tag("response>");
+    int idx = data.lastIndexOf(tag);
+    while (idx > 0) {
+        // Skip back over a namespace prefix
+        int start = idx;
+        if (data.at(start - 1) == ':') {
+            --start;
+            while (start > 0 && data.at(start - 1) != '/' && data.at(start - 1) != '<'
+                && !QChar::isSpace(static_cast<uchar>(data.at(start - 1)))) {
+                --start;
+            }
+        }
+        if (start >= 2 && data.at(start - 1) == '/' && data.at(start - 2) == '<')
+            return idx + tag.size();
+        idx = data.lastIndexOf(tag, idx - 1);
+    }
+    return -1;
+}
+
+bool LsColXMLParser::addData(const QByteArray &data)
+{
+    if (_failed)
+        return false;
+
+    // Only hand complete <response> elements to the reader: properties are read
+    // with readContentsAsString()/readElementText() which can't be resumed.
+    _pending += data;
+    const int end = endOfLastResponse(_pending);
+    if (end < 0)
+        return true;
+    _reader.addData(_pending.left(end));
+    _pending.remove(0, end);
+    return parseAvailable();
+}
+
+bool LsColXMLParser::finish()
+{
+    if (_failed)
+        return false;
+
+    _reader.addData(_pending);
+    _pending.clear();
+    if (!parseAvailable())
+        return false;
+
+    if (_reader.hasError()) {
+        // Truncated document. Whatever had been emitted before came as directoryListingIterated
+        qCWarning(lcLsColJob) << "ERROR" << _reader.errorString();
+        _failed = true;
+        return false;
+    } else if (!_insideMultiStatus) {
+        qCWarning(lcLsColJob) << "ERROR no WebDAV response?";
+        _failed = true;
+        return false;
+    }
+    emit directoryListingSubfolders(_folders);
+    emit finishedWithoutError();
+    return true;
+}
+
+bool LsColXMLParser::parseAvailable()
+{
+    while (!_reader.atEnd()) {
+        QXmlStreamReader::TokenType type = _reader.readNext();
+        if (type == QXmlStreamReader::Invalid)
+            break;
+        QString name = _reader.name().toString();
         // Start elements with DAV:
-        if (type == QXmlStreamReader::StartElement && reader.namespaceUri() == QLatin1String("DAV:")) {
+        if (type == QXmlStreamReader::StartElement && _reader.namespaceUri() == QLatin1String("DAV:")) {
             if (name == QLatin1String("href")) {
                 // We don't use URL encoding in our request URL (which is the expected path) (QNAM will do it for us)
                 // but the result will have URL encoding..
-                QString hrefString = QUrl::fromLocalFile(QUrl::fromPercentEncoding(reader.readElementText().toUtf8()))
+                QString hrefString = QUrl::fromLocalFile(QUrl::fromPercentEncoding(_reader.readElementText().toUtf8()))
                         .adjusted(QUrl::NormalizePathSegments)
                         .path();
-                if (!hrefString.startsWith(expectedPath)) {
-                    qCWarning(lcLsColJob) << "Invalid href" << hrefString << "expected starting with" << expectedPath;
+                if (!hrefString.startsWith(_expectedPath)) {
+                    qCWarning(lcLsColJob) << "Invalid href" << hrefString << "expected starting with" << _expectedPath;
+                    _failed = true;
                     return false;
                 }
-                currentHref = hrefString;
+                _currentHref = hrefString;
             } else if (name == QLatin1String("response")) {
             } else if (name == QLatin1String("propstat")) {
-                insidePropstat = true;
-            } else if (name == QLatin1String("status") && insidePropstat) {
-                QString httpStatus = reader.readElementText();
+                _insidePropstat = true;
+            } else if (name == QLatin1String("status") && _insidePropstat) {
+                QString httpStatus = _reader.readElementText();
                 if (httpStatus.startsWith("HTTP/1.1 200")) {
-                    currentPropsHaveHttp200 = true;
+                    _currentPropsHaveHttp200 = true;
                 } else {
-                    currentPropsHaveHttp200 = false;
+                    _currentPropsHaveHttp200 = false;
                 }
             } else if (name == QLatin1String("prop")) {
-                insideProp = true;
+                _insideProp = true;
                 continue;
             } else if (name == QLatin1String("multistatus")) {
-                insideMultiStatus = true;
+                _insideMultiStatus = true;
                 continue;
             }
         }
 
-        if (type == QXmlStreamReader::StartElement && insidePropstat && insideProp) {
+        if (type == QXmlStreamReader::StartElement && _insidePropstat && _insideProp) {
             // All those elements are properties
-            QString propertyContent = readContentsAsString(reader);
+            QString propertyContent = readContentsAsString(_reader);
             if (name == QLatin1String("resourcetype") && propertyContent.contains("collection")) {
-                folders.append(currentHref);
+                if (_fileInfo)
+                    _folders.append(_currentHref);
             } else if (name == QLatin1String("size")) {
                 bool ok = false;
                 auto s = propertyContent.toLongLong(&ok);
-                if (ok && fileInfo) {
-                    (*fileInfo)[currentHref].size = s;
+                if (ok && _fileInfo) {
+                    (*_fileInfo)[_currentHref].size = s;
                 }
             } else if (name == QLatin1String("fileid")) {
-                (*fileInfo)[currentHref].fileId = propertyContent.toUtf8();
+                if (_fileInfo)
+                    (*_fileInfo)[_currentHref].fileId = propertyContent.toUtf8();
             }
-            currentTmpProperties.insert(reader.name().toString(), propertyContent);
+            _currentTmpProperties.insert(_reader.name().toString(), propertyContent);
         }
 
         // End elements with DAV:
         if (type == QXmlStreamReader::EndElement) {
-            if (reader.namespaceUri() == QLatin1String("DAV:")) {
-                if (reader.name() == "response") {
-                    if (currentHref.endsWith('/')) {
-                        currentHref.chop(1);
+            if (_reader.namespaceUri() == QLatin1String("DAV:")) {
+                if (_reader.name() == "response") {
+                    if (_currentHref.endsWith('/')) {
+                        _currentHref.chop(1);
                     }
-                    emit directoryListingIterated(currentHref, currentHttp200Properties);
-                    currentHref.clear();
-                    currentHttp200Properties.clear();
-                } else if (reader.name() == "propstat") {
-                    insidePropstat = false;
-                    if (currentPropsHaveHttp200) {
-                        currentHttp200Properties = QMap<QString, QString>(currentTmpProperties);
+                    emit directoryListingIterated(_currentHref, _currentHttp200Properties);
+                    _currentHref.clear();
+                    _currentHttp200Properties.clear();
+                } else if (_reader.name() == "propstat") {
+                    _insidePropstat = false;
+                    if (_currentPropsHaveHttp200) {
+                        _currentHttp200Properties = QMap<QString, QString>(_currentTmpProperties);
                     }
-                    currentTmpProperties.clear();
-                    currentPropsHaveHttp200 = false;
-                } else if (reader.name() == "prop") {
-                    insideProp = false;
+                    _currentTmpProperties.clear();
+                    _currentPropsHaveHttp200 = false;
+                } else if (_reader.name() == "prop") {
+                    _insideProp = false;
                 }
             }
         }
     }
 
-    if (reader.hasError()) {
+    if (_reader.hasError() && _reader.error() != QXmlStreamReader::PrematureEndOfDocumentError) {
         // XML Parser error? Whatever had been emitted before will come as directoryListingIterated
-        qCWarning(lcLsColJob) << "ERROR" << reader.errorString() << xml;
+        qCWarning(lcLsColJob) << "ERROR" << _reader.errorString();
+        _failed = true;
         return false;
-    } else if (!insideMultiStatus) {
-        qCWarning(lcLsColJob) << "ERROR no WebDAV response?" << xml;
-        return false;
-    } else {
-        emit directoryListingSubfolders(folders);
-        emit finishedWithoutError();
     }
     return true;
 }
@@ -341,13 +415,8 @@ QList<QByteArray> LsColJob::properties() const
     return _properties;
 }
 
-void LsColJob::start()
+QByteArray davPropertiesXml(const QList<QByteArray> &properties)
 {
-    QList<QByteArray> properties = _properties;
-
-    if (properties.isEmpty()) {
-        qCWarning(lcLsColJob) << "Propfind with no properties!";
-    }
     QByteArray propStr;
     foreach (const QByteArray &prop, properties) {
         if (prop.contains(':')) {
@@ -362,9 +431,25 @@ void LsColJob::start()
             propStr += "    <d:" + prop + " />\n";
         }
     }
+    return propStr;
+}
+
+void LsColJob::start()
+{
+    QList<QByteArray> properties = _properties;
+
+    if (properties.isEmpty()) {
+        qCWarning(lcLsColJob) << "Propfind with no properties!";
+    }
+    QByteArray propStr = davPropertiesXml(properties);
+
+    connect(&_parser, &LsColXMLParser::directoryListingSubfolders,
+        this, &LsColJob::directoryListingSubfolders);
+    connect(&_parser, &LsColXMLParser::directoryListingIterated,
+        this, &LsColJob::directoryListingIterated);
 
     QNetworkRequest req;
-    req.setRawHeader("Depth", "1");
+    req.setRawHeader("Depth", _depth);
     QByteArray xml("<?xml version=\"1.0\" ?>\n"
                    "<d:propfind xmlns:d=\"DAV:\" xmlns:oc=\"http://owncloud.org/ns\">\n"
                    "  <d:prop>\n"
@@ -381,31 +466,58 @@ void LsColJob::start()
     AbstractNetworkJob::start();
 }
 
-// TODO: Instead of doing all in this slot, we should iteratively parse in readyRead(). This
-// would allow us to be more asynchronous in processing while data is coming from the network,
-// not all in one big blob at the end.
+void LsColJob::newReplyHook(QNetworkReply *reply)
+{
+    // Parse the answer while it is coming in, so a large listing is neither
+    // buffered completely nor processed in one big blob at the end
+    QString expectedPath = reply->request().url().path(); // something like "/owncloud/remote.php/webdav/folder"
+    startParsing(expectedPath);
+    _parseFailed = false;
+    connect(reply, &QIODevice::readyRead, this, &LsColJob::slotReadyRead);
+}
+
+void LsColJob::startParsing(const QString &expectedPath)
+{
+    _parser.start(_depth == "1" ? &_folderInfos : nullptr, expectedPath);
+}
+
+bool LsColJob::parseData(const QByteArray &data)
+{
+    return _parser.addData(data);
+}
+
+bool LsColJob::finishParsing()
+{
+    return _parser.finish();
+}
+
+bool LsColJob::isMultiStatusReply() const
+{
+    QString contentType = reply()->header(QNetworkRequest::ContentTypeHeader).toString();
+    int httpCode = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    return httpCode == 207 && contentType.contains("application/xml; charset=utf-8");
+}
+
+void LsColJob::slotReadyRead()
+{
+    // Error replies and redirects are dealt with in finished()
+    if (_parseFailed || !isMultiStatusReply())
+        return;
+    if (!parseData(reply()->readAll()))
+        _parseFailed = true;
+}
+
 bool LsColJob::finished()
 {
     qCInfo(lcLsColJob) << "LSCOL of" << reply()->request().url() << "FINISHED WITH STATUS"
                        << replyStatusString();
 
-    QString contentType = reply()->header(QNetworkRequest::ContentTypeHeader).toString();
-    int httpCode = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-    if (httpCode == 207 && contentType.contains("application/xml; charset=utf-8")) {
-        LsColXMLParser parser;
-        connect(&parser, &LsColXMLParser::directoryListingSubfolders,
-            this, &LsColJob::directoryListingSubfolders);
-        connect(&parser, &LsColXMLParser::directoryListingIterated,
-            this, &LsColJob::directoryListingIterated);
-        connect(&parser, &LsColXMLParser::finishedWithError,
-            this, &LsColJob::finishedWithError);
-        connect(&parser, &LsColXMLParser::finishedWithoutError,
-            this, &LsColJob::finishedWithoutError);
-
-        QString expectedPath = reply()->request().url().path(); // something like "/owncloud/remote.php/webdav/folder"
-        if (!parser.parse(reply()->readAll(), &_folderInfos, expectedPath)) {
+    if (isMultiStatusReply()) {
+        if (_parseFailed || !parseData(reply()->readAll()) || !finishParsing()) {
             // XML parse error
             emit finishedWithError(reply());
+        } else {
+            emit finishedWithoutError();
         }
     } else {
         // wrong content type, wrong HTTP code or any other network error
@@ -22,6 +22,7 @@
 
 #include <QBuffer>
 #include <QUrlQuery>
+#include <QXmlStreamReader>
 #include <functional>
 
 class QUrl;
@@ -86,8 +87,14 @@ struct ExtraFolderInfo {
 };
 
 /**
- * @brief The LsColJob class
+ * @brief Parses the multistatus answer of a PROPFIND
  * @ingroup libsync
+ *
+ * The document can be parsed in one go with parse(), or incrementally while
+ * it arrives from the network with start(), addData() and finish(). In the
+ * incremental case directoryListingIterated() is emitted as soon as a
+ * <d:response> element is complete, and only the unfinished tail of the data
+ * is buffered.
  */
 class OWNCLOUDSYNC_EXPORT LsColXMLParser : public QObject
 {
@@ -99,13 +106,53 @@ public:
                QHash<QString, ExtraFolderInfo> *sizes,
                const QString &expectedPath);
 
+    /** Prepares parsing a new document
+     *
+     * If \a sizes is null neither the sizes nor the subfolders are collected,
+     * so memory use does not depend on the size of the listing.
+     */
+    void start(QHash<QString, ExtraFolderInfo> *sizes, const QString &expectedPath);
+
+    /** Parses all complete responses contained in the data received so far
+     *
+     * Returns false once the document is known to be invalid.
+     */
+    bool addData(const QByteArray &data);
+
+    /** The whole document was passed to addData()
+     *
+     * Emits directoryListingSubfolders() and finishedWithoutError() if the
+     * document was valid and returns whether it was.
+     */
+    bool finish();
+
 signals:
     void directoryListingSubfolders(const QStringList &items);
     void directoryListingIterated(const QString &name, const QMap<QString, QString> &properties);
     void finishedWithError(QNetworkReply *reply);
     void finishedWithoutError();
+
+private:
+    bool parseAvailable();
+
+    QXmlStreamReader _reader;
+    QByteArray _pending; // received, but not yet passed to _reader
+    QHash<QString, ExtraFolderInfo> *_fileInfo = nullptr;
+    QString _expectedPath;
+    QStringList _folders;
+    QString _currentHref;
+    QMap<QString, QString> _currentTmpProperties;
+    QMap<QString, QString> _currentHttp200Properties;
+    bool _currentPropsHaveHttp200 = false;
+    bool _insidePropstat = false;
+    bool _insideProp = false;
+    bool _insideMultiStatus = false;
+    bool _failed = false;
 };
 
+/// The <d:prop> children of a request body for \a properties, see LsColJob::setProperties()
+OWNCLOUDSYNC_EXPORT QByteArray davPropertiesXml(const QList<QByteArray> &properties);
+
 class OWNCLOUDSYNC_EXPORT LsColJob : public AbstractNetworkJob
 {
     Q_OBJECT
@@ -126,18 +173,46 @@ public:
     void setProperties(QList<QByteArray> properties);
     QList<QByteArray> properties() const;
 
+    /**
+     * The Depth header of the request, "1" by default.
+     *
+     * With "infinity" the whole subtree is listed. In that case _folderInfos
+     * and the subfolder list are not collected, entries are only reported
+     * through directoryListingIterated() while the answer is streamed in.
+     */
+    void setDepth(const QByteArray &depth) { _depth = depth; }
+
 signals:
     void directoryListingSubfolders(const QStringList &items);
     void directoryListingIterated(const QString &name, const QMap<QString, QString> &properties);
     void finishedWithError(QNetworkReply *reply);
     void finishedWithoutError();
 
+protected:
+    void newReplyHook(QNetworkReply *reply) override;
+
+    /** The multistatus answer is fed through these while it arrives
+     *
+     * By default they use LsColXMLParser, which emits directoryListingIterated()
+     * and directoryListingSubfolders(). parseData() and finishParsing()
+     * return false if the answer is invalid.
+     */
+    virtual void startParsing(const QString &expectedPath);
+    virtual bool parseData(const QByteArray &data);
+    virtual bool finishParsing();
+
 private slots:
     bool finished() override;
+    void slotReadyRead();
 
 private:
+    bool isMultiStatusReply() const;
+
     QList<QByteArray> _properties;
     QUrl _url; // Used instead of path() if the url is specified in the constructor
+    QByteArray _depth = "1";
+    LsColXMLParser _parser;
+    bool _parseFailed = false;
 };
 
 /**
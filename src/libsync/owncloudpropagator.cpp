@@ -18,6 +18,7 @@
 #include "common/syncjournalfilerecord.h"
 #include "propagatedownload.h"
 #include "propagateupload.h"
+#include "propagateuploadbulk.h"
 #include "propagateremotedelete.h"
 #include "propagateremotemove.h"
 #include "propagateremotemkdir.h"
@@ -74,18 +75,49 @@ qint64 freeSpaceLimit()
     return value;
 }
 
-OwncloudPropagator::~OwncloudPropagator() = default;
+OwncloudPropagator::~OwncloudPropagator()
+{
+    if (_budgetJoined)
+        _syncOptions._jobBudget->leave();
+}
 
 
 int OwncloudPropagator::maximumActiveTransferJob()
 {
-    if (_downloadLimit != 0
-        || _uploadLimit != 0
+    if (_downloadLimit < 0
+        || _uploadLimit < 0
         || !_syncOptions._parallelNetworkJobs) {
-        // disable parallelism when there is a network limit.
+        // disable parallelism when there is a relative network limit: it is
+        // derived from the full speed of a single transfer.
+        // Absolute limits are shared between parallel transfers by the BandwidthManager.
         return 1;
     }
-    return qMin(3, qCeil(_syncOptions._parallelNetworkJobs / 2.));
+    return qMin(_transferConcurrency.limit(), hardMaximumActiveJob());
+}
+
+void OwncloudPropagator::reportJobFinished(const SyncFileItem &item, qint64 durationMsec)
+{
+    switch (item._httpErrorCode) {
+    case 429: // Too Many Requests
+    case 502: // Bad Gateway
+    case 503: // Service Unavailable
+    case 504: // Gateway Timeout
+        _transferConcurrency.congestionDetected();
+        return;
+    default:
+        break;
+    }
+
+    const bool isTransfer = item._type == ItemTypeFile
+        && (item._direction == SyncFileItem::Up || item._direction == SyncFileItem::Down)
+        && (item._instruction == CSYNC_INSTRUCTION_NEW
+            || item._instruction == CSYNC_INSTRUCTION_SYNC
+            || item._instruction == CSYNC_INSTRUCTION_TYPE_CHANGE);
+    if (!isTransfer || item._status != SyncFileItem::Success)
+        return;
+
+    // The finished job has usually already removed itself from the list
+    _transferConcurrency.transferFinished(item._size, durationMsec, _activeJobList.count() + 1);
 }
 
 /* The maximum number of active jobs in parallel  */
@@ -93,6 +125,9 @@ int OwncloudPropagator::hardMaximumActiveJob()
 {
     if (!_syncOptions._parallelNetworkJobs)
         return 1;
+    // Folders that propagate at the same time split the configured number of jobs
+    if (_budgetJoined)
+        return _syncOptions._jobBudget->share(_syncOptions._parallelNetworkJobs);
     return _syncOptions._parallelNetworkJobs;
 }
 
@@ -243,6 +278,9 @@ void PropagateItemJob::done(SyncFileItem::Status statusArg, const QString &error
         _item->_status = SyncFileItem::SoftError;
     }
 
+    if (_runTimer.isValid())
+        propagator()->reportJobFinished(*_item, _runTimer.elapsed());
+
     // Blacklist handling
     switch (_item->_status) {
     case SyncFileItem::SoftError:
@@ -383,20 +421,131 @@ PropagateItemJob *OwncloudPropagator::createJob(const SyncFileItemPtr &item)
 
 qint64 OwncloudPropagator::smallFileSize()
 {
-    const qint64 smallFileSize = 100 * 1024; //default to 1 MB. Not dynamic right now.
-    return smallFileSize;
+    return _transferConcurrency.quickTransferSize();
 }
 
 void OwncloudPropagator::start(const SyncFileItemVector &items)
 {
     Q_ASSERT(std::is_sorted(items.begin(), items.end()));
 
+    joinJobBudget();
+
+    if (_rootJob && _rootJob->_pipelinedJobs) {
+        // Wait for the pipelined jobs, see slotPipelinedJobsFinished()
+        _remainingItems = items;
+        _rootJob->_pipelinedJobs->_awaitingMoreJobs = false;
+        scheduleNextJob();
+        return;
+    }
+
+    _rootJob.reset(new PropagateRootDirectory(this));
+    appendToRootJob(items);
+
+    connect(_rootJob.data(), &PropagatorJob::finished, this, &OwncloudPropagator::emitFinished);
+
+    _jobScheduled = false;
+    scheduleNextJob();
+}
+
+void OwncloudPropagator::startPipelined()
+{
+    joinJobBudget();
+
+    _rootJob.reset(new PropagateRootDirectory(this));
+    _rootJob->_pipelinedJobs.reset(new PropagatorCompositeJob(this));
+    _rootJob->_pipelinedJobs->_awaitingMoreJobs = true;
+    connect(_rootJob->_pipelinedJobs.data(), &PropagatorJob::finished, this, &OwncloudPropagator::slotPipelinedJobsFinished);
+
+    connect(_rootJob.data(), &PropagatorJob::finished, this, &OwncloudPropagator::emitFinished);
+
+    _jobScheduled = false;
+}
+
+void OwncloudPropagator::appendPipelinedItems(const SyncFileItemVector &items)
+{
+    Q_ASSERT(std::is_sorted(items.begin(), items.end()));
+    ASSERT(_rootJob && _rootJob->_pipelinedJobs);
+
+    // Unlike in appendToRootJob(), nothing here is removed, renamed or in conflict
+    PropagatorCompositeJob *pipelinedJobs = _rootJob->_pipelinedJobs.data();
+    QStack<QPair<QString /* directory name */, PropagateDirectory * /* job */>> directories;
+    for (const auto &item : items) {
+        while (!directories.isEmpty() && !item->destination().startsWith(directories.top().first)) {
+            directories.pop();
+        }
+
+        if (item->isDirectory()) {
+            auto *dir = new PropagateDirectory(this, item);
+            if (directories.isEmpty()) {
+                pipelinedJobs->appendJob(dir);
+            } else {
+                directories.top().second->appendJob(dir);
+            }
+            directories.push(qMakePair(item->destination() + "/", dir));
+        } else if (directories.isEmpty()) {
+            pipelinedJobs->appendTask(item);
+        } else {
+            directories.top().second->appendTask(item);
+        }
+        _pipelinedItems.append(item);
+    }
+
+    scheduleNextJob();
+}
+
+void OwncloudPropagator::slotPipelinedJobsFinished(SyncFileItem::Status status)
+{
+    // Like for removed directories: the etag of a directory must not be updated
+    // while something below it failed, the next sync would not look at it again
+    QSet<QString> failedParents;
+    for (const auto &item : qAsConst(_pipelinedItems)) {
+        if (item->_status == SyncFileItem::Success
+            || item->_status == SyncFileItem::Restoration
+            || item->_status == SyncFileItem::Conflict) {
+            continue;
+        }
+        QString path = item->destination();
+        int slash;
+        while ((slash = path.lastIndexOf(QLatin1Char('/'))) > 0) {
+            path.truncate(slash);
+            if (failedParents.contains(path))
+                break;
+            failedParents.insert(path);
+        }
+    }
+    for (const auto &item : qAsConst(_remainingItems)) {
+        if (item->isDirectory() && item->_instruction == CSYNC_INSTRUCTION_UPDATE_METADATA
+            && failedParents.contains(item->destination())) {
+            item->_instruction = CSYNC_INSTRUCTION_NONE;
+        }
+    }
+    _pipelinedItems.clear();
+
+    // As if the pipelined jobs had been part of the other ones: an error
+    // keeps the directory deletions from running
+    if (status != SyncFileItem::Success)
+        _rootJob->_subJobs._hasError = status;
+
+    appendToRootJob(_remainingItems);
+    _remainingItems.clear();
+    scheduleNextJob();
+}
+
+void OwncloudPropagator::joinJobBudget()
+{
+    if (_syncOptions._jobBudget && !_budgetJoined) {
+        _syncOptions._jobBudget->join();
+        _budgetJoined = true;
+    }
+}
+
+void OwncloudPropagator::appendToRootJob(const SyncFileItemVector &items)
+{
     /* This builds all the jobs needed for the propagation.
      * Each directory is a PropagateDirectory job, which contains the files in it.
      * In order to do that we loop over the items. (which are sorted by destination)
      * When we enter a directory, we can create the directory job and push it on the stack. */
 
-    _rootJob.reset(new PropagateRootDirectory(this));
     QStack<QPair<QString /* directory name */, PropagateDirectory * /* job */>> directories;
     directories.push(qMakePair(QString(), _rootJob.data()));
     QVector<PropagatorJob *> directoriesToRemove;
@@ -507,11 +656,6 @@ void OwncloudPropagator::start(const SyncFileItemVector &items)
     foreach (PropagatorJob *it, directoriesToRemove) {
         _rootJob->_dirDeletionJobs.appendJob(it);
     }
-
-    connect(_rootJob.data(), &PropagatorJob::finished, this, &OwncloudPropagator::emitFinished);
-
-    _jobScheduled = false;
-    scheduleNextJob();
 }
 
 const SyncOptions &OwncloudPropagator::syncOptions() const
@@ -523,6 +667,8 @@ void OwncloudPropagator::setSyncOptions(const SyncOptions &syncOptions)
 {
     _syncOptions = syncOptions;
     _chunkSize = syncOptions._initialChunkSize;
+    // Start where the fixed limit used to be and let the measurements move it
+    _transferConcurrency.reset(qMin(3, qCeil(_syncOptions._parallelNetworkJobs / 2.)), hardMaximumActiveJob());
 }
 
 bool OwncloudPropagator::localFileNameClash(const QString &relFile)
@@ -623,9 +769,8 @@ void OwncloudPropagator::scheduleNextJob()
 
 void OwncloudPropagator::scheduleNextJobImpl()
 {
-    // TODO: If we see that the automatic up-scaling has a bad impact we
-    // need to check how to avoid this.
-    // Down-scaling on slow networks? https://github.com/owncloud/client/issues/3382
+    // The number of parallel transfers scales up and down with the measured
+    // throughput and latency, see TransferConcurrency.
     // Making sure we do up/down at same time? https://github.com/owncloud/client/issues/1633
 
     _jobScheduled = false;
@@ -635,13 +780,11 @@ void OwncloudPropagator::scheduleNextJobImpl()
             scheduleNextJob();
         }
     } else if (_activeJobList.count() < hardMaximumActiveJob()) {
+        // Jobs that are likely finished quickly don't use up the transfer budget:
+        // for each of them we can launch another one.
         int likelyFinishedQuicklyCount = 0;
-        // NOTE: Only counts the first 3 jobs! Then for each
-        // one that is likely finished quickly, we can launch another one.
-        // When a job finishes another one will "move up" to be one of the first 3 and then
-        // be counted too.
-        for (int i = 0; i < maximumActiveTransferJob() && i < _activeJobList.count(); i++) {
-            if (_activeJobList.at(i)->isLikelyFinishedQuickly()) {
+        for (auto job : qAsConst(_activeJobList)) {
+            if (job->isLikelyFinishedQuickly()) {
                 likelyFinishedQuicklyCount++;
             }
         }
@@ -845,6 +988,14 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
     // Now it's our turn, check if we have something left to do.
     // First, convert a task to a job if necessary
     while (_jobsToDo.isEmpty() && !_tasksToDo.isEmpty()) {
+        // Small uploads that follow each other are sent together
+        const int batchSize = PropagateBulkUpload::batchSize(propagator(), _tasksToDo);
+        if (batchSize > 0) {
+            appendJob(new PropagateBulkUpload(propagator(), _tasksToDo.mid(0, batchSize)));
+            _tasksToDo.remove(0, batchSize);
+            break;
+        }
+
         SyncFileItemPtr nextTask = _tasksToDo.first();
         _tasksToDo.remove(0);
         PropagatorJob *job = propagator()->createJob(nextTask);
@@ -865,7 +1016,7 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
 
     // If neither us or our children had stuff left to do we could hang. Make sure
     // we mark this job as finished so that the propagator can schedule a new one.
-    if (_jobsToDo.isEmpty() && _tasksToDo.isEmpty() && _runningJobs.isEmpty()) {
+    if (_jobsToDo.isEmpty() && _tasksToDo.isEmpty() && _runningJobs.isEmpty() && !_awaitingMoreJobs) {
         // Our parent jobs are already iterating over their running jobs, post to the event loop
         // to avoid removing ourself from that list while they iterate.
         QMetaObject::invokeMethod(this, "finalize", Qt::QueuedConnection);
@@ -894,7 +1045,7 @@ void PropagatorCompositeJob::slotSubJobFinished(SyncFileItem::Status status)
         _hasError = status;
     }
 
-    if (_jobsToDo.isEmpty() && _tasksToDo.isEmpty() && _runningJobs.isEmpty()) {
+    if (_jobsToDo.isEmpty() && _tasksToDo.isEmpty() && _runningJobs.isEmpty() && !_awaitingMoreJobs) {
         finalize();
     } else {
         propagator()->scheduleNextJob();
@@ -1047,27 +1198,42 @@ void PropagateRootDirectory::abort(PropagatorJob::AbortType abortType)
         struct AbortsFinished {
             bool subJobsFinished = false;
             bool dirDeletionFinished = false;
+            bool pipelinedJobsFinished = false;
+            bool all() const { return subJobsFinished && dirDeletionFinished && pipelinedJobsFinished; }
         };
         auto abortStatus = QSharedPointer<AbortsFinished>(new AbortsFinished);
+        abortStatus->pipelinedJobsFinished = !_pipelinedJobs;
 
         connect(&_subJobs, &PropagatorCompositeJob::abortFinished, this, [this, abortStatus]() {
             abortStatus->subJobsFinished = true;
-            if (abortStatus->subJobsFinished && abortStatus->dirDeletionFinished)
+            if (abortStatus->all())
                 emit abortFinished();
         });
         connect(&_dirDeletionJobs, &PropagatorCompositeJob::abortFinished, this, [this, abortStatus]() {
             abortStatus->dirDeletionFinished = true;
-            if (abortStatus->subJobsFinished && abortStatus->dirDeletionFinished)
+            if (abortStatus->all())
                 emit abortFinished();
         });
+        if (_pipelinedJobs) {
+            connect(_pipelinedJobs.data(), &PropagatorCompositeJob::abortFinished, this, [this, abortStatus]() {
+                abortStatus->pipelinedJobsFinished = true;
+                if (abortStatus->all())
+                    emit abortFinished();
+            });
+        }
     }
+    if (_pipelinedJobs)
+        _pipelinedJobs->abort(abortType);
     _subJobs.abort(abortType);
     _dirDeletionJobs.abort(abortType);
 }
 
 qint64 PropagateRootDirectory::committedDiskSpace() const
 {
-    return _subJobs.committedDiskSpace() + _dirDeletionJobs.committedDiskSpace();
+    qint64 needed = _subJobs.committedDiskSpace() + _dirDeletionJobs.committedDiskSpace();
+    if (_pipelinedJobs)
+        needed += _pipelinedJobs->committedDiskSpace();
+    return needed;
 }
 
 bool PropagateRootDirectory::scheduleSelfOrChild()
@@ -1075,6 +1241,13 @@ bool PropagateRootDirectory::scheduleSelfOrChild()
     if (_state == Finished)
         return false;
 
+    // The other jobs are only known once the pipelined ones are done
+    if (_pipelinedJobs && _pipelinedJobs->_state != Finished) {
+        if (_state == NotYetStarted)
+            _state = Running;
+        return _pipelinedJobs->scheduleSelfOrChild();
+    }
+
     if (PropagateDirectory::scheduleSelfOrChild())
         return true;
 
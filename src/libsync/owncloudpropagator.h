@@ -28,6 +28,7 @@
 #include "syncfileitem.h"
 #include "common/syncjournaldb.h"
 #include "bandwidthmanager.h"
+#include "transferconcurrency.h"
 #include "accountfwd.h"
 #include "syncoptions.h"
 
@@ -179,6 +180,7 @@ protected slots:
 private:
     QScopedPointer<PropagateItemJob> _restoreJob;
     JobParallelism _parallelism;
+    QElapsedTimer _runTimer; // started when the job is scheduled, feeds the transfer concurrency
 
 public:
     PropagateItemJob(OwncloudPropagator *propagator, const SyncFileItemPtr &item)
@@ -202,6 +204,7 @@ public:
         qCInfo(lcPropagator) << "Starting" << _item->_instruction << "propagation of" << _item->destination() << "by" << this;
 
         _state = Running;
+        _runTimer.start();
         QMetaObject::invokeMethod(this, "start"); // We could be in a different thread (neon jobs)
         return true;
     }
@@ -228,6 +231,12 @@ public:
     SyncFileItem::Status _hasError; // NoStatus,  or NormalError / SoftError if there was an error
     quint64 _abortsCount;
 
+    /** While set, more jobs may still be appended: running out of work doesn't finish the job.
+     *
+     * Clear it and schedule again to let the job finish.
+     */
+    bool _awaitingMoreJobs = false;
+
     explicit PropagatorCompositeJob(OwncloudPropagator *propagator)
         : PropagatorJob(propagator)
         , _hasError(SyncFileItem::NoStatus), _abortsCount(0)
@@ -350,12 +359,16 @@ private slots:
  *
  * Primary difference to PropagateDirectory is that it keeps track of directory
  * deletions that must happen at the very end.
+ *
+ * With pipelined propagation, the jobs that were handed over during the discovery
+ * run first, in _pipelinedJobs. The other jobs are only started after them.
  */
 class OWNCLOUDSYNC_EXPORT PropagateRootDirectory : public PropagateDirectory
 {
     Q_OBJECT
 public:
     PropagatorCompositeJob _dirDeletionJobs;
+    QScopedPointer<PropagatorCompositeJob> _pipelinedJobs; // null unless pipelining
 
     explicit PropagateRootDirectory(OwncloudPropagator *propagator);
 
@@ -421,8 +434,27 @@ public:
 
     ~OwncloudPropagator();
 
+    /** Propagates \a _syncedItems, sorted
+     *
+     * After startPipelined(), these are the items that weren't handed over during
+     * the discovery. They start once the pipelined jobs are done.
+     */
     void start(const SyncFileItemVector &_syncedItems);
 
+    /** Starts propagating while the discovery is still running
+     *
+     * Items are then handed over with appendPipelinedItems() until start()
+     * is called with the rest of them.
+     */
+    void startPipelined();
+
+    /** Propagates \a items right away, see SyncOptions::_pipelinedPropagation
+     *
+     * The items are sorted and either a single file or a new directory with all
+     * its content. Their parent directory must be neither new, removed nor moved.
+     */
+    void appendPipelinedItems(const SyncFileItemVector &items);
+
     const SyncOptions &syncOptions() const;
     void setSyncOptions(const SyncOptions &syncOptions);
 
@@ -443,6 +475,9 @@ public:
     /** We detected that another sync is required after this one */
     bool _anotherSyncNeeded;
 
+    /** A bulk upload request failed, upload the remaining files one by one */
+    bool _bulkUploadFailed = false;
+
     /** Per-folder quota guesses.
      *
      * This starts out empty. When an upload in a folder fails due to insufficent
@@ -456,9 +491,18 @@ public:
      */
     QHash<QString, qint64> _folderQuota;
 
-    /* the maximum number of jobs using bandwidth (uploads or downloads, in parallel) */
+    /** The maximum number of jobs using bandwidth (uploads or downloads, in parallel)
+     *
+     * Adapted at run time by _transferConcurrency.
+     */
     int maximumActiveTransferJob();
 
+    /** Measurements that drive maximumActiveTransferJob() and smallFileSize() */
+    TransferConcurrency _transferConcurrency;
+
+    /** Feeds the outcome of a finished item job into _transferConcurrency */
+    void reportJobFinished(const SyncFileItem &item, qint64 durationMsec);
+
     /** The size to use for upload chunks.
      *
      * Will be dynamically adjusted after each chunk upload finishes
@@ -466,6 +510,11 @@ public:
      * chunk-upload duration set.
      */
     qint64 _chunkSize;
+
+    /** Transfers of files smaller than this are expected to finish quickly
+     *
+     * Derived from the observed latency and per-transfer throughput.
+     */
     qint64 smallFileSize();
 
     /* The maximum number of active jobs in parallel  */
@@ -509,6 +558,12 @@ public:
         if (_abortRequested)
             return;
         if (_rootJob) {
+            // The items waiting for the pipelined jobs must not start anymore
+            if (_rootJob->_pipelinedJobs) {
+                disconnect(_rootJob->_pipelinedJobs.data(), &PropagatorJob::finished,
+                    this, &OwncloudPropagator::slotPipelinedJobsFinished);
+            }
+
             // Connect to abortFinished  which signals that abort has been asynchronously finished
             connect(_rootJob.data(), &PropagateDirectory::abortFinished, this, &OwncloudPropagator::emitFinished);
 
@@ -582,6 +637,9 @@ private slots:
 
     void scheduleNextJobImpl();
 
+    /** The jobs handed over during the discovery are done, start the others */
+    void slotPipelinedJobsFinished(SyncFileItem::Status status);
+
 signals:
     void newItem(const SyncFileItemPtr &);
     void itemCompleted(const SyncFileItemPtr &);
@@ -606,6 +664,14 @@ private:
     QScopedPointer<PropagateRootDirectory> _rootJob;
     SyncOptions _syncOptions;
     bool _jobScheduled = false;
+    bool _budgetJoined = false; // whether start() joined _syncOptions._jobBudget
+
+    SyncFileItemVector _pipelinedItems; // handed over with appendPipelinedItems()
+    SyncFileItemVector _remainingItems; // passed to start() after startPipelined()
+
+    void joinJobBudget();
+    /// Creates the jobs for \a items in _rootJob
+    void appendToRootJob(const SyncFileItemVector &items);
 
     const QString _localDir; // absolute path to the local directory. ends with '/'
     const QString _remoteFolder; // remote folder, ends with '/'
@@ -134,6 +134,7 @@ void ProgressDispatcher::setProgressInfo(const QString &folder, const ProgressIn
 
 ProgressInfo::ProgressInfo()
 {
+    _updateEstimatesTimer.setParent(this); // follows moveToThread()
     connect(&_updateEstimatesTimer, &QTimer::timeout, this, &ProgressInfo::updateEstimates);
     reset();
 }
@@ -155,9 +156,25 @@ void ProgressInfo::reset()
     _maxFilesPerSecond = 10.0;
 
     _updateEstimatesTimer.stop();
+    _copiedUpdatingEstimates = false;
     _lastCompletedItem = SyncFileItem();
 }
 
+void ProgressInfo::copyFrom(const ProgressInfo &other)
+{
+    _status = other._status;
+    _currentItems = other._currentItems;
+    _lastCompletedItem = other._lastCompletedItem;
+    _currentDiscoveredRemoteFolder = other._currentDiscoveredRemoteFolder;
+    _currentDiscoveredLocalFolder = other._currentDiscoveredLocalFolder;
+    _sizeProgress = other._sizeProgress;
+    _fileProgress = other._fileProgress;
+    _totalSizeOfCompletedJobs = other._totalSizeOfCompletedJobs;
+    _maxFilesPerSecond = other._maxFilesPerSecond;
+    _maxBytesPerSecond = other._maxBytesPerSecond;
+    _copiedUpdatingEstimates = other.isUpdatingEstimates();
+}
+
 ProgressInfo::Status ProgressInfo::status() const
 {
     return _status;
@@ -170,7 +187,7 @@ void ProgressInfo::startEstimateUpdates()
 
 bool ProgressInfo::isUpdatingEstimates() const
 {
-    return _updateEstimatesTimer.isActive();
+    return _updateEstimatesTimer.isActive() || _copiedUpdatingEstimates;
 }
 
 static bool shouldCountProgress(const SyncFileItem &item)
@@ -41,6 +41,14 @@ public:
      */
     void reset();
 
+    /**
+     * Takes over the state of \a other, a ProgressInfo of another thread.
+     *
+     * Doesn't update the estimates on its own: isUpdatingEstimates() returns
+     * what it returned for \a other.
+     */
+    void copyFrom(const ProgressInfo &other);
+
     /** Records the status of the sync run
      */
     enum Status {
@@ -232,6 +240,9 @@ private:
     // The fastest observed rate of files per second in this sync.
     double _maxFilesPerSecond;
     double _maxBytesPerSecond;
+
+    // Set by copyFrom(), the estimates are updated on the other thread
+    bool _copiedUpdatingEstimates = false;
 };
 
 namespace Progress {
@@ -143,9 +143,21 @@ void GETFileJob::start()
     AbstractNetworkJob::start();
 }
 
+bool GETFileJob::isUnlimited() const
+{
+    return !_bandwidthManager
+        || (!_bandwidthManager->usingAbsoluteDownloadLimit() && !_bandwidthManager->usingRelativeDownloadLimit());
+}
+
+qint64 GETFileJob::replyReadBufferSize() const
+{
+    // keep low so we can easier limit the bandwidth
+    return isUnlimited() ? _bufferSize : 16 * 1024;
+}
+
 void GETFileJob::newReplyHook(QNetworkReply *reply)
 {
-    reply->setReadBufferSize(16 * 1024); // keep low so we can easier limit the bandwidth
+    reply->setReadBufferSize(replyReadBufferSize());
 
     connect(reply, &QNetworkReply::metaDataChanged, this, &GETFileJob::slotMetaDataChanged);
     connect(reply, &QIODevice::readyRead, this, &GETFileJob::slotReadyRead);
@@ -157,7 +169,7 @@ void GETFileJob::slotMetaDataChanged()
 {
     // For some reason setting the read buffer in GETFileJob::start doesn't seem to go
     // through the HTTP layer thread(?)
-    reply()->setReadBufferSize(16 * 1024);
+    reply()->setReadBufferSize(replyReadBufferSize());
 
     int httpStatus = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
 
@@ -249,6 +261,12 @@ void GETFileJob::slotMetaDataChanged()
         _lastModified = Utility::qDateTimeToTime_t(lastModified.toDateTime());
     }
 
+    // Reserve the space for the whole file up front to avoid fragmentation
+    if (ok && _contentLength > 0 && isUnlimited()) {
+        if (auto file = qobject_cast<QFile *>(_device))
+            FileSystem::preallocate(*file, _resumeStart + _contentLength);
+    }
+
     _saveBodyToFile = true;
 }
 
@@ -266,13 +284,14 @@ void GETFileJob::setChoked(bool c)
 void GETFileJob::setBandwidthLimited(bool b)
 {
     _bandwidthLimited = b;
+    if (reply() && _saveBodyToFile)
+        reply()->setReadBufferSize(replyReadBufferSize());
     QMetaObject::invokeMethod(this, "slotReadyRead", Qt::QueuedConnection);
 }
 
 void GETFileJob::giveBandwidthQuota(qint64 q)
 {
     _bandwidthQuota = q;
-    qCDebug(lcGetJob) << "Got" << q << "bytes";
     QMetaObject::invokeMethod(this, "slotReadyRead", Qt::QueuedConnection);
 }
 
@@ -288,8 +307,9 @@ void GETFileJob::slotReadyRead()
 {
     if (!reply())
         return;
-    int bufferSize = qMin(1024 * 8ll, reply()->bytesAvailable());
-    QByteArray buffer(bufferSize, Qt::Uninitialized);
+    const qint64 bufferSize = qMin(isUnlimited() ? _bufferSize : 8 * 1024, reply()->bytesAvailable());
+    if (_buffer.size() < bufferSize)
+        _buffer.resize(static_cast<int>(bufferSize));
 
     while (reply()->bytesAvailable() > 0 && _saveBodyToFile) {
         if (_bandwidthChoked) {
@@ -300,13 +320,13 @@ void GETFileJob::slotReadyRead()
         if (_bandwidthLimited) {
             toRead = qMin(qint64(bufferSize), _bandwidthQuota);
             if (toRead == 0) {
-                qCWarning(lcGetJob) << "Out of quota";
+                qCDebug(lcGetJob) << "Out of quota";
                 break;
             }
             _bandwidthQuota -= toRead;
         }
 
-        qint64 r = reply()->read(buffer.data(), toRead);
+        qint64 r = reply()->read(_buffer.data(), toRead);
         if (r < 0) {
             _errorString = networkReplyErrorString(*reply());
             _errorStatus = SyncFileItem::NormalError;
@@ -315,7 +335,7 @@ void GETFileJob::slotReadyRead()
             return;
         }
 
-        qint64 w = _device->write(buffer.constData(), r);
+        qint64 w = _device->write(_buffer.constData(), r);
         if (w != r) {
             _errorString = _device->errorString();
             _errorStatus = SyncFileItem::NormalError;
@@ -598,6 +618,7 @@ void PropagateDownloadFile::startDownload()
             &_tmpFile, headers, expectedEtagForResume, _resumeStart, this);
     }
     _job->setBandwidthManager(&propagator()->_bandwidthManager);
+    _job->setBufferSize(propagator()->syncOptions()._downloadBufferSize);
     connect(_job.data(), &GETFileJob::finishedSignal, this, &PropagateDownloadFile::slotGetFinished);
     connect(_job.data(), &GETFileJob::downloadProgress, this, &PropagateDownloadFile::slotDownloadProgress);
     propagator()->_activeJobList.append(this);
@@ -50,6 +50,15 @@ class GETFileJob : public AbstractNetworkJob
     /// Will be set to true once we've seen a 2xx response header
     bool _saveBodyToFile = false;
 
+    /// Read buffer, reused across readyRead() calls
+    QByteArray _buffer;
+    qint64 _bufferSize = 8 * 1024;
+
+    /// Whether no bandwidth limit is active and large reads can be used
+    bool isUnlimited() const;
+    /// The read buffer size the reply should use in the current bandwidth mode
+    qint64 replyReadBufferSize() const;
+
 public:
     // DOES NOT take ownership of the device.
     explicit GETFileJob(AccountPtr account, const QString &path, QIODevice *device,
@@ -86,9 +95,18 @@ public:
     void newReplyHook(QNetworkReply *reply) override;
 
     void setBandwidthManager(BandwidthManager *bwm);
+
+    /** Size of the buffer that moves data from the reply to the device
+     *
+     * Only applies while no bandwidth limit is active: then the reply is allowed
+     * to buffer as much and the data is written to the device in large blocks.
+     * Bandwidth limited downloads always read in small slices.
+     */
+    void setBufferSize(qint64 size) { _bufferSize = qBound<qint64>(8 * 1024, size, 64 * 1024 * 1024); }
     void setChoked(bool c);
     void setBandwidthLimited(bool b);
     void giveBandwidthQuota(qint64 q);
+    qint64 bandwidthQuota() const { return _bandwidthQuota; }
     qint64 currentDownloadPosition();
 
     QString errorString() const;
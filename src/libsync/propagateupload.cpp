@@ -331,36 +331,57 @@ void PropagateUploadFileCommon::slotComputeContentChecksum()
         return;
     }
 
-    // Compute the content checksum.
+    // Compute the content checksum. If the transmission checksum needs a
+    // different algorithm, compute it in the same pass over the file.
     auto computeChecksum = new ComputeChecksum(this);
-    computeChecksum->setChecksumType(checksumType);
-
-    connect(computeChecksum, &ComputeChecksum::done,
-        this, &PropagateUploadFileCommon::slotComputeTransmissionChecksum);
-    connect(computeChecksum, &ComputeChecksum::done,
+    const QByteArray transmissionType = transmissionChecksumType(checksumType);
+    if (transmissionType.isEmpty() || transmissionType == checksumType) {
+        computeChecksum->setChecksumType(checksumType);
+        connect(computeChecksum, &ComputeChecksum::done,
+            this, &PropagateUploadFileCommon::slotComputeTransmissionChecksum);
+    } else {
+        computeChecksum->setChecksumTypes({ checksumType, transmissionType });
+        connect(computeChecksum, &ComputeChecksum::allDone,
+            this, &PropagateUploadFileCommon::slotChecksumsComputed);
+    }
+    connect(computeChecksum, &ComputeChecksum::allDone,
         computeChecksum, &QObject::deleteLater);
     computeChecksum->start(_fileToUpload._path);
 }
 
-void PropagateUploadFileCommon::slotComputeTransmissionChecksum(const QByteArray &contentChecksumType, const QByteArray &contentChecksum)
+QByteArray PropagateUploadFileCommon::transmissionChecksumType(const QByteArray &contentChecksumType) const
 {
-    _item->_checksumHeader = makeChecksumHeader(contentChecksumType, contentChecksum);
-
     // Reuse the content checksum as the transmission checksum if possible
     const auto supportedTransmissionChecksums =
         propagator()->account()->capabilities().supportedChecksumTypes();
     if (supportedTransmissionChecksums.contains(contentChecksumType)) {
+        return contentChecksumType;
+    }
+    if (uploadChecksumEnabled()) {
+        return propagator()->account()->capabilities().uploadChecksumType();
+    }
+    return QByteArray();
+}
+
+void PropagateUploadFileCommon::slotChecksumsComputed(const QByteArrayList &checksumTypes, const QByteArrayList &checksums)
+{
+    _item->_checksumHeader = makeChecksumHeader(checksumTypes.value(0), checksums.value(0));
+    slotStartUpload(checksumTypes.value(1), checksums.value(1));
+}
+
+void PropagateUploadFileCommon::slotComputeTransmissionChecksum(const QByteArray &contentChecksumType, const QByteArray &contentChecksum)
+{
+    _item->_checksumHeader = makeChecksumHeader(contentChecksumType, contentChecksum);
+
+    const QByteArray transmissionType = transmissionChecksumType(contentChecksumType);
+    if (transmissionType == contentChecksumType) {
         slotStartUpload(contentChecksumType, contentChecksum);
         return;
     }
 
     // Compute the transmission checksum.
     auto computeChecksum = new ComputeChecksum(this);
-    if (uploadChecksumEnabled()) {
-        computeChecksum->setChecksumType(propagator()->account()->capabilities().uploadChecksumType());
-    } else {
-        computeChecksum->setChecksumType(QByteArray());
-    }
+    computeChecksum->setChecksumType(transmissionType);
 
     connect(computeChecksum, &ComputeChecksum::done,
         this, &PropagateUploadFileCommon::slotStartUpload);
@@ -561,8 +582,8 @@ bool UploadDevice::seek(qint64 pos)
 
 void UploadDevice::giveBandwidthQuota(qint64 bwq)
 {
+    _bandwidthQuota = bwq;
     if (!atEnd()) {
-        _bandwidthQuota = bwq;
         QMetaObject::invokeMethod(this, "readyRead", Qt::QueuedConnection); // tell QNAM that we have quota
     }
 }
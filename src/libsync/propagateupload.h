@@ -57,6 +57,7 @@ public:
     void setChoked(bool);
     bool isChoked() { return _choked; }
     void giveBandwidthQuota(qint64 bwq);
+    qint64 bandwidthQuota() const { return _bandwidthQuota; }
 
 signals:
 
@@ -190,12 +191,16 @@ class PropagateUploadEncrypted;
  *   +---> start()  --> (delete job) -------+
  *   |                                      |
  *   +--> slotComputeContentChecksum()  <---+
- *                   |
- *                   v
- *    slotComputeTransmissionChecksum()
+ *                   |                  |
+ *                   v                  |
+ *    slotComputeTransmissionChecksum() |
+ *         |                            v
+ *         |                 slotChecksumsComputed() (both checksums in one pass)
+ *         v                            |
+ *    slotStartUpload()  <--------------+
  *         |
  *         v
- *    slotStartUpload()  -> doStartUpload()
+ *    doStartUpload()
  *                                  .
  *                                  .
  *                                  v
@@ -260,6 +265,8 @@ private slots:
     void slotComputeContentChecksum();
     // Content checksum computed, compute the transmission checksum
     void slotComputeTransmissionChecksum(const QByteArray &contentChecksumType, const QByteArray &contentChecksum);
+    // Content and transmission checksum computed together, prepare the upload
+    void slotChecksumsComputed(const QByteArrayList &checksumTypes, const QByteArrayList &checksums);
     // transmission checksum computed, prepare the upload
     void slotStartUpload(const QByteArray &transmissionChecksumType, const QByteArray &transmissionChecksum);
     // invoked when encrypted folder lock has been released
@@ -267,6 +274,10 @@ private slots:
     // invoked on internal error to unlock a folder and faile
     void slotOnErrorStartFolderUnlock(SyncFileItem::Status status, const QString &errorString);
 
+private:
+    /// The transmission checksum type to use for a file with the given content checksum type
+    QByteArray transmissionChecksumType(const QByteArray &contentChecksumType) const;
+
 public:
     virtual void doStartUpload() = 0;
 
@@ -374,6 +385,10 @@ private slots:
  *
  * Propagation job, impementing the new chunking agorithm
  *
+ * Several chunks of the file may be in flight at once. How many is decided by
+ * _chunkWindow from the throughput measured on the finished chunks, up to
+ * SyncOptions::_maxParallelChunks. Chunks can therefore finish out of order;
+ * when resuming only the chunks up to the first missing one are kept.
  */
 class PropagateUploadFileNG : public PropagateUploadFileCommon
 {
@@ -382,8 +397,9 @@ private:
     qint64 _sent = 0; /// amount of data (bytes) that was already sent
     uint _transferId = 0; /// transfer id (part of the url)
     int _currentChunk = 0; /// Id of the next chunk that will be sent
-    qint64 _currentChunkSize = 0; /// current chunk size
     bool _removeJobError = false; /// If not null, there was an error removing the job
+    TransferConcurrency _chunkWindow; /// how many chunks may be uploaded in parallel
+    QHash<PUTFileJob *, qint64> _chunkBytesWritten; /// what the chunk uploads in flight sent so far
 
     // Map chunk number with its size  from the PROPFIND on resume.
     // (Only used from slotPropfindIterate/slotPropfindFinished because the LsColJob use signals to report data.)
@@ -411,6 +427,8 @@ public:
 private:
     void startNewUpload();
     void startNextChunk();
+    /// Starts the upload of the chunk at _sent, false if the upload was aborted
+    bool startChunk();
 public slots:
     void abort(AbortType abortType) override;
 private slots:
@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "propagateuploadbulk.h"
+#include "account.h"
+#include "common/asserts.h"
+#include "common/checksums.h"
+#include "common/syncjournaldb.h"
+#include "filesystem.h"
+#include "networkjobs.h"
+#include "propagatorjobs.h"
+
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QUuid>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcPutMultiFileJob, "nextcloud.sync.networkjob.put.multi", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcPropagateUploadBulk, "nextcloud.sync.propagator.upload.bulk", QtInfoMsg)
+
+constexpr qint64 PropagateBulkUpload::maxFileSize;
+constexpr int PropagateBulkUpload::maxFilesPerRequest;
+constexpr qint64 PropagateBulkUpload::maxBytesPerRequest;
+
+PutMultiFileJob::PutMultiFileJob(AccountPtr account, const QVector<Part> &parts, QObject *parent)
+    : AbstractNetworkJob(account, QString(), parent)
+    , _parts(parts)
+{
+}
+
+void PutMultiFileJob::start()
+{
+    const QByteArray boundary = "nextcloud-bulk-" + QUuid::createUuid().toByteArray().mid(1, 36);
+
+    QByteArray body;
+    for (const auto &part : qAsConst(_parts)) {
+        body += "--" + boundary + "\r\n";
+        for (auto it = part.headers.cbegin(); it != part.headers.cend(); ++it) {
+            body += it.key() + ": " + it.value() + "\r\n";
+        }
+        body += "Content-Length: " + QByteArray::number(part.content.size()) + "\r\n\r\n";
+        body += part.content + "\r\n";
+    }
+    body += "--" + boundary + "--\r\n";
+    // The body holds the contents now
+    _parts.clear();
+
+    QNetworkRequest req;
+    req.setHeader(QNetworkRequest::ContentTypeHeader, QByteArray("multipart/related; boundary=" + boundary));
+    req.setPriority(QNetworkRequest::LowPriority); // Long uploads must not block non-propagation jobs.
+
+    auto *buf = new QBuffer(this);
+    buf->setData(body);
+    buf->open(QIODevice::ReadOnly);
+    // assumes ownership
+    sendRequest("POST", makeAccountUrl(QStringLiteral("remote.php/dav/bulk")), req, buf);
+
+    if (reply()->error() != QNetworkReply::NoError) {
+        qCWarning(lcPutMultiFileJob) << " Network error: " << reply()->errorString();
+    }
+
+    connect(this, &AbstractNetworkJob::networkActivity, account().data(), &Account::propagatorNetworkActivity);
+    AbstractNetworkJob::start();
+}
+
+bool PutMultiFileJob::finished()
+{
+    qCInfo(lcPutMultiFileJob) << "POST of" << reply()->request().url().toString() << "FINISHED WITH STATUS"
+                              << replyStatusString()
+                              << reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute)
+                              << reply()->attribute(QNetworkRequest::HttpReasonPhraseAttribute);
+
+    if (reply()->error() == QNetworkReply::NoError) {
+        QJsonParseError jsonParseError;
+        const auto json = QJsonDocument::fromJson(reply()->readAll(), &jsonParseError);
+        if (jsonParseError.error == QJsonParseError::NoError) {
+            _results = json.object();
+        } else {
+            qCWarning(lcPutMultiFileJob) << "Invalid JSON reply:" << jsonParseError.errorString();
+        }
+    }
+
+    emit finishedSignal();
+    return true;
+}
+
+PropagateBulkUpload::PropagateBulkUpload(OwncloudPropagator *propagator, const SyncFileItemVector &items)
+    : PropagatorJob(propagator)
+    , _subJobs(propagator)
+    , _pendingFiles(items.size())
+{
+    for (const auto &item : items) {
+        auto file = new PropagateBulkUploadFile(propagator, item, this);
+        connect(file, &PropagatorJob::finished, this, &PropagateBulkUpload::slotFileFinished);
+        _subJobs.appendJob(file);
+    }
+    connect(&_subJobs, &PropagatorJob::finished, this, &PropagateBulkUpload::slotSubJobsFinished);
+}
+
+int PropagateBulkUpload::batchSize(OwncloudPropagator *propagator, const SyncFileItemVector &items)
+{
+    // Encrypted uploads must run one at a time and the bandwidth manager
+    // only knows how to throttle single uploads.
+    const auto &capabilities = propagator->account()->capabilities();
+    if (!capabilities.bulkUpload() || capabilities.clientSideEncryptionAvailable()
+        || propagator->_bulkUploadFailed || propagator->_uploadLimit != 0) {
+        return 0;
+    }
+
+    int count = 0;
+    qint64 bytes = 0;
+    for (const auto &item : items) {
+        const bool isFileUpload = item->_direction == SyncFileItem::Up && !item->isDirectory()
+            && (item->_instruction == CSYNC_INSTRUCTION_NEW || item->_instruction == CSYNC_INSTRUCTION_SYNC);
+        if (!isFileUpload || item->_size > maxFileSize
+            || count == maxFilesPerRequest || bytes + item->_size > maxBytesPerRequest) {
+            break;
+        }
+        ++count;
+        bytes += item->_size;
+    }
+    return count > 1 ? count : 0;
+}
+
+bool PropagateBulkUpload::scheduleSelfOrChild()
+{
+    if (_state == Finished) {
+        return false;
+    }
+
+    if (_state == NotYetStarted) {
+        _state = Running;
+    }
+
+    return _subJobs.scheduleSelfOrChild();
+}
+
+PropagatorJob::JobParallelism PropagateBulkUpload::parallelism()
+{
+    return _subJobs.parallelism();
+}
+
+void PropagateBulkUpload::abort(PropagatorJob::AbortType abortType)
+{
+    if (_job && _job->reply() && _job->reply()->isRunning()) {
+        _job->reply()->abort();
+    }
+
+    if (abortType == AbortType::Asynchronous) {
+        connect(&_subJobs, &PropagatorCompositeJob::abortFinished, this, &PropagateBulkUpload::abortFinished);
+    }
+    _subJobs.abort(abortType);
+}
+
+void PropagateBulkUpload::addReadyFile(PropagateBulkUploadFile *file)
+{
+    _readyFiles.append(file);
+    --_pendingFiles;
+    startPutIfComplete();
+}
+
+void PropagateBulkUpload::slotFileFinished()
+{
+    auto *file = qobject_cast<PropagateBulkUploadFile *>(sender());
+    ASSERT(file);
+
+    // Files that failed before they were ready are no longer waited for
+    if (file->bulkState() == PropagateBulkUploadFile::Preparing) {
+        --_pendingFiles;
+        startPutIfComplete();
+    }
+}
+
+void PropagateBulkUpload::startPutIfComplete()
+{
+    if (_pendingFiles > 0 || _readyFiles.isEmpty() || propagator()->_abortRequested) {
+        return;
+    }
+
+    QVector<PutMultiFileJob::Part> parts;
+    for (auto *file : qAsConst(_readyFiles)) {
+        PutMultiFileJob::Part part;
+        QString error;
+        if (file->makePart(&part, &error)) {
+            parts.append(part);
+            _sentFiles.append(file);
+        } else {
+            qCWarning(lcPropagateUploadBulk) << "Could not read" << file->_item->_file << error;
+            file->uploadSeparately();
+        }
+    }
+    _readyFiles.clear();
+
+    // A request of its own is cheaper for a single file
+    if (_sentFiles.size() == 1) {
+        _sentFiles.takeFirst()->uploadSeparately();
+    }
+    if (_sentFiles.isEmpty()) {
+        return;
+    }
+
+    qCInfo(lcPropagateUploadBulk) << "Uploading" << _sentFiles.size() << "files with one request";
+    _job = new PutMultiFileJob(propagator()->account(), parts, this);
+    connect(_job.data(), &PutMultiFileJob::finishedSignal, this, &PropagateBulkUpload::slotPutFinished);
+    // The request is a single transfer, let its first file stand for it
+    propagator()->_activeJobList.append(_sentFiles.first());
+    _job->start();
+}
+
+void PropagateBulkUpload::slotPutFinished()
+{
+    auto *job = qobject_cast<PutMultiFileJob *>(sender());
+    ASSERT(job);
+
+    propagator()->_activeJobList.removeOne(_sentFiles.first());
+    const auto files = _sentFiles;
+    _sentFiles.clear();
+
+    if (propagator()->_abortRequested) {
+        return;
+    }
+
+    if (job->reply()->error() != QNetworkReply::NoError || job->results().isEmpty()) {
+        qCWarning(lcPropagateUploadBulk) << "Bulk upload failed, uploading the files separately:"
+                                         << job->reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt()
+                                         << job->errorString();
+        propagator()->_bulkUploadFailed = true;
+        for (auto *file : files) {
+            file->uploadSeparately();
+        }
+        return;
+    }
+
+    for (auto *file : files) {
+        const auto result = job->results().value(QString::fromUtf8(file->remotePath())).toObject();
+        file->bulkUploadFinished(result, job);
+    }
+}
+
+void PropagateBulkUpload::slotSubJobsFinished(SyncFileItem::Status status)
+{
+    _state = Finished;
+    emit finished(status);
+}
+
+void PropagateBulkUploadFile::doStartUpload()
+{
+    if (!_item->_checksumHeader.isEmpty()) {
+        // Like for a single PUT, write the checksum in the database, so if the request
+        // is sent to the server, but the connection drops before we get the etag, we can
+        // check the checksum in reconcile (issue #5106)
+        SyncJournalDb::UploadInfo pi;
+        pi._valid = true;
+        pi._chunk = 0;
+        pi._transferid = 0; // We set a null transfer id because it is not chunked.
+        pi._modtime = _item->_modtime;
+        pi._errorCount = 0;
+        pi._contentChecksum = _item->_checksumHeader;
+        pi._size = _item->_size;
+        propagator()->_journal->setUploadInfo(_item->_file, pi);
+        propagator()->_journal->commit("Upload info");
+    }
+
+    _bulkState = Waiting;
+    propagator()->reportProgress(*_item, 0);
+    _bulkUpload->addReadyFile(this);
+
+    // The other files of the batch may still need to be started
+    propagator()->scheduleNextJob();
+}
+
+QByteArray PropagateBulkUploadFile::remotePath() const
+{
+    return propagator()->fullRemotePath(_fileToUpload._file).toUtf8();
+}
+
+bool PropagateBulkUploadFile::makePart(PutMultiFileJob::Part *part, QString *error)
+{
+    QFile file(_fileToUpload._path);
+    if (!FileSystem::openAndSeekFileSharedRead(&file, error, 0)) {
+        return false;
+    }
+    part->content = file.read(_fileToUpload._size);
+    if (part->content.size() != _fileToUpload._size) {
+        *error = file.errorString();
+        return false;
+    }
+
+    part->headers = headers();
+    part->headers[QByteArrayLiteral("X-File-Path")] = remotePath();
+    part->headers[QByteArrayLiteral("X-File-Mtime")] = QByteArray::number(qint64(_item->_modtime));
+    if (!_transmissionChecksumHeader.isEmpty()) {
+        part->headers[checkSumHeaderC] = _transmissionChecksumHeader;
+    }
+    // The server rejects parts without it, whatever the transmission checksum type is
+    part->headers[QByteArrayLiteral("X-File-MD5")] = QCryptographicHash::hash(part->content, QCryptographicHash::Md5).toHex();
+    return true;
+}
+
+void PropagateBulkUploadFile::uploadSeparately()
+{
+    _bulkState = Separate;
+    PropagateUploadFileV1::doStartUpload();
+}
+
+void PropagateBulkUploadFile::bulkUploadFinished(const QJsonObject &result, PutMultiFileJob *job)
+{
+    _item->_responseTimeStamp = job->responseTimestamp();
+    _item->_requestId = job->requestId();
+
+    const QByteArray etag = parseEtag(result.value(QStringLiteral("etag")).toString().toUtf8());
+    if (result.value(QStringLiteral("error")).toBool() || etag.isEmpty()) {
+        // The upload on its own reports the error properly, if it fails again
+        qCInfo(lcPropagateUploadBulk) << "Bulk upload of" << _item->_file << "failed, uploading it separately:"
+                                      << result.value(QStringLiteral("message")).toString();
+        uploadSeparately();
+        return;
+    }
+
+    // The file was read when the request was made
+    if (!FileSystem::verifyFileUnchanged(propagator()->fullLocalPath(_item->_file), _item->_size, _item->_modtime)) {
+        propagator()->_anotherSyncNeeded = true;
+    }
+
+    const QByteArray fileId = result.value(QStringLiteral("fileid")).toString().toUtf8();
+    if (!fileId.isEmpty()) {
+        if (!_item->_fileId.isEmpty() && _item->_fileId != fileId) {
+            qCWarning(lcPropagateUploadBulk) << "File ID changed!" << _item->_fileId << fileId;
+        }
+        _item->_fileId = fileId;
+    }
+    _item->_etag = etag;
+
+    finalize();
+}
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+#pragma once
+
+#include "propagateupload.h"
+
+#include <QJsonObject>
+#include <QPointer>
+
+namespace OCC {
+
+Q_DECLARE_LOGGING_CATEGORY(lcPutMultiFileJob)
+Q_DECLARE_LOGGING_CATEGORY(lcPropagateUploadBulk)
+
+/**
+ * @brief Uploads several files with one multipart POST to the bulk endpoint
+ * @ingroup libsync
+ *
+ * Every part carries the headers of its file, X-File-Path being the path
+ * relative to the user's DAV root. The server answers with a JSON object
+ * that maps each X-File-Path to {"error", "message", "etag", "fileid"}.
+ */
+class PutMultiFileJob : public AbstractNetworkJob
+{
+    Q_OBJECT
+public:
+    struct Part
+    {
+        QMap<QByteArray, QByteArray> headers;
+        QByteArray content;
+    };
+
+    explicit PutMultiFileJob(AccountPtr account, const QVector<Part> &parts, QObject *parent = nullptr);
+
+    void start() override;
+    bool finished() override;
+
+    /// The per-file results, empty if the reply couldn't be parsed
+    const QJsonObject &results() const { return _results; }
+
+signals:
+    void finishedSignal();
+
+private:
+    QVector<Part> _parts;
+    QJsonObject _results;
+};
+
+class PropagateBulkUploadFile;
+
+/**
+ * @brief Propagates a batch of small uploads of one directory with a single request
+ * @ingroup libsync
+ *
+ * Each file gets a PropagateBulkUploadFile, which checks and checksums the
+ * file like any other upload and then waits. Once every file of the batch is
+ * either waiting or done, the waiting ones are sent in one PutMultiFileJob.
+ *
+ * Files the server rejects are uploaded again on their own, so they get the
+ * usual error handling. If the bulk request itself fails, all its files are
+ * uploaded on their own and bulk upload isn't used for the rest of the sync.
+ */
+class PropagateBulkUpload : public PropagatorJob
+{
+    Q_OBJECT
+public:
+    /// Files up to this size are uploaded in bulk
+    static constexpr qint64 maxFileSize = 1000 * 1000;
+    /// Limits of a single bulk request
+    static constexpr int maxFilesPerRequest = 100;
+    static constexpr qint64 maxBytesPerRequest = 10 * 1000 * 1000;
+
+    PropagateBulkUpload(OwncloudPropagator *propagator, const SyncFileItemVector &items);
+
+    /**
+     * How many of the leading \a items go into one bulk upload.
+     *
+     * Zero if the batch would be smaller than two files or bulk upload isn't
+     * available.
+     */
+    static int batchSize(OwncloudPropagator *propagator, const SyncFileItemVector &items);
+
+    bool scheduleSelfOrChild() override;
+    JobParallelism parallelism() override;
+    void abort(PropagatorJob::AbortType abortType) override;
+
+    /// Called by a file of the batch when it is ready to be sent
+    void addReadyFile(PropagateBulkUploadFile *file);
+
+private slots:
+    void slotFileFinished();
+    void slotPutFinished();
+    void slotSubJobsFinished(SyncFileItem::Status status);
+
+private:
+    void startPutIfComplete();
+
+    PropagatorCompositeJob _subJobs;
+    int _pendingFiles; /// files that are neither ready nor done
+    QVector<PropagateBulkUploadFile *> _readyFiles;
+    QVector<PropagateBulkUploadFile *> _sentFiles;
+    QPointer<PutMultiFileJob> _job;
+};
+
+/**
+ * @brief One file of a PropagateBulkUpload
+ * @ingroup libsync
+ *
+ * Behaves like PropagateUploadFileV1 until the upload itself starts, which
+ * it leaves to the batch unless uploadSeparately() was called.
+ */
+class PropagateBulkUploadFile : public PropagateUploadFileV1
+{
+    Q_OBJECT
+public:
+    PropagateBulkUploadFile(OwncloudPropagator *propagator, const SyncFileItemPtr &item, PropagateBulkUpload *bulkUpload)
+        : PropagateUploadFileV1(propagator, item)
+        , _bulkUpload(bulkUpload)
+    {
+    }
+
+    enum BulkState {
+        Preparing, /// checks and checksums, like any upload
+        Waiting, /// for the bulk request to be sent or to finish
+        Separate /// uploaded with its own request
+    };
+
+    void doStartUpload() override;
+
+    BulkState bulkState() const { return _bulkState; }
+
+    /// The part that uploads the file, false if the file couldn't be read
+    bool makePart(PutMultiFileJob::Part *part, QString *error);
+
+    /// The bulk request finished, \a result is the entry of this file
+    void bulkUploadFinished(const QJsonObject &result, PutMultiFileJob *job);
+
+    /// Uploads the file with its own request
+    void uploadSeparately();
+
+    QByteArray remotePath() const;
+
+private:
+    PropagateBulkUpload *_bulkUpload;
+    BulkState _bulkState = Preparing;
+};
+}
@@ -68,20 +68,45 @@ QUrl PropagateUploadFileNG::chunkUrl(int chunk)
     +-----+<------------------------------------------------------+<---  slotDeleteJobFinished()
     |
     +---->  startNextChunk()  ---finished?  --+
-                  ^               |          |
-                  +---------------+          |
+             |    ^               |          |
+             |    +---------------+          |
+             |                               |
+             +-- PUT of up to _chunkWindow   |
+                 chunks in parallel          |
                                              |
     +----------------------------------------+
     |
     +-> MOVE ------> moveJobFinished() ---> finalize()
 
+  The MOVE is only sent once all the chunks are uploaded. A chunk may finish
+  before an earlier one; if the upload is aborted in between, the PROPFIND on
+  resume finds a "hole" and the chunks after it are deleted.
 
  */
 
+static int maxParallelChunks(OwncloudPropagator *propagator)
+{
+    if (propagator->account()->capabilities().chunkingParallelUploadDisabled()) {
+        return 1;
+    }
+    QByteArray env = qgetenv("OWNCLOUD_PARALLEL_CHUNK");
+    if (env == "false" || env == "0") {
+        return 1;
+    }
+    if (propagator->_uploadLimit < 0) {
+        // A relative bandwidth limit is derived from the speed of a single transfer
+        return 1;
+    }
+    return qMax(1, propagator->syncOptions()._maxParallelChunks);
+}
+
 void PropagateUploadFileNG::doStartUpload()
 {
     propagator()->_activeJobList.append(this);
 
+    const int maxChunks = maxParallelChunks(propagator());
+    _chunkWindow.reset(qMin(2, maxChunks), maxChunks);
+
     const SyncJournalDb::UploadInfo progressInfo = propagator()->_journal->getUploadInfo(_item->_file);
     if (progressInfo._valid && progressInfo.isChunked() && progressInfo._modtime == _item->_modtime
             && progressInfo._size == _item->_size) {
@@ -281,11 +306,11 @@ void PropagateUploadFileNG::startNextChunk()
     qint64 fileSize = _fileToUpload._size;
     ENFORCE(fileSize >= _sent, "Sent data exceeds file size");
 
-    // prevent situation that chunk size is bigger then required one to send
-    _currentChunkSize = qMin(propagator()->_chunkSize, fileSize - _sent);
-
-    if (_currentChunkSize == 0) {
-        Q_ASSERT(_jobs.isEmpty()); // There should be no running job anymore
+    if (_sent == fileSize) {
+        if (!_jobs.isEmpty()) {
+            // Wait for the chunks that are still being uploaded
+            return;
+        }
         _finished = true;
 
         // Finish with a MOVE
@@ -316,9 +341,28 @@ void PropagateUploadFileNG::startNextChunk()
         return;
     }
 
+    // Fill the window. There is always at least one chunk in flight, the further
+    // ones also need room in the propagator's list of active jobs.
+    while (_sent < fileSize
+        && (_jobs.isEmpty()
+            || (_jobs.size() < _chunkWindow.limit()
+                && propagator()->_activeJobList.count() < propagator()->hardMaximumActiveJob()))) {
+        if (!startChunk())
+            return;
+    }
+
+    // If the window shrank, other jobs may use the freed slot
+    propagator()->scheduleNextJob();
+}
+
+bool PropagateUploadFileNG::startChunk()
+{
+    // prevent situation that chunk size is bigger then required one to send
+    const qint64 chunkSize = qMin(propagator()->_chunkSize, _fileToUpload._size - _sent);
+
     const QString fileName = _fileToUpload._path;
     auto device = std::make_unique<UploadDevice>(
-            fileName, _sent, _currentChunkSize, &propagator()->_bandwidthManager);
+            fileName, _sent, chunkSize, &propagator()->_bandwidthManager);
     if (!device->open(QIODevice::ReadOnly)) {
         qCWarning(lcPropagateUploadNG) << "Could not prepare upload device: " << device->errorString();
 
@@ -329,13 +373,13 @@ void PropagateUploadFileNG::startNextChunk()
         }
         // Soft error because this is likely caused by the user modifying his files while syncing
         abortWithError(SyncFileItem::SoftError, device->errorString());
-        return;
+        return false;
     }
 
     QMap<QByteArray, QByteArray> headers;
     headers["OC-Chunk-Offset"] = QByteArray::number(_sent);
 
-    _sent += _currentChunkSize;
+    _sent += chunkSize;
     QUrl url = chunkUrl(_currentChunk);
 
     // job takes ownership of device via a QScopedPointer. Job deletes itself when finishing
@@ -348,9 +392,12 @@ void PropagateUploadFileNG::startNextChunk()
     connect(job, &PUTFileJob::uploadProgress,
         devicePtr, &UploadDevice::slotJobUploadProgress);
     connect(job, &QObject::destroyed, this, &PropagateUploadFileCommon::slotJobDestroyed);
+    // Aborted jobs may go without finishing
+    connect(job, &QObject::destroyed, this, [this, job] { _chunkBytesWritten.remove(job); });
     job->start();
     propagator()->_activeJobList.append(this);
     _currentChunk++;
+    return true;
 }
 
 void PropagateUploadFileNG::slotPutFinished()
@@ -359,6 +406,7 @@ void PropagateUploadFileNG::slotPutFinished()
     ASSERT(job);
 
     slotJobDestroyed(job); // remove it from the _jobs list
+    _chunkBytesWritten.remove(job);
 
     propagator()->_activeJobList.removeOne(this);
 
@@ -378,14 +426,16 @@ void PropagateUploadFileNG::slotPutFinished()
 
     ENFORCE(_sent <= _fileToUpload._size, "can't send more than size");
 
+    const qint64 chunkSize = job->device()->size();
+    auto uploadTime = ++job->msSinceStart(); // add one to avoid div-by-zero
+
     // Adjust the chunk size for the time taken.
     //
     // Dynamic chunk sizing is enabled if the server configured a
     // target duration for each chunk upload.
     auto targetDuration = propagator()->syncOptions()._targetChunkUploadDuration;
     if (targetDuration.count() > 0) {
-        auto uploadTime = ++job->msSinceStart(); // add one to avoid div-by-zero
-        qint64 predictedGoodSize = (_currentChunkSize * targetDuration) / uploadTime;
+        qint64 predictedGoodSize = (chunkSize * targetDuration) / uploadTime;
 
         // The whole targeting is heuristic. The predictedGoodSize will fluctuate
         // quite a bit because of external factors (like available bandwidth)
@@ -401,13 +451,16 @@ void PropagateUploadFileNG::slotPutFinished()
             targetSize,
             propagator()->syncOptions()._maxChunkSize);
 
-        qCInfo(lcPropagateUploadNG) << "Chunked upload of" << _currentChunkSize << "bytes took" << uploadTime.count()
+        qCInfo(lcPropagateUploadNG) << "Chunked upload of" << chunkSize << "bytes took" << uploadTime.count()
                                   << "ms, desired is" << targetDuration.count() << "ms, expected good chunk size is"
                                   << predictedGoodSize << "bytes and nudged next chunk size to "
                                   << propagator()->_chunkSize << "bytes";
     }
 
-    _finished = _sent == _item->_size;
+    // The chunks still in flight ran alongside this one
+    _chunkWindow.transferFinished(chunkSize, uploadTime.count(), _jobs.size() + 1);
+
+    _finished = _sent == _item->_size && _jobs.isEmpty();
 
     // Check if the file still exists
     const QString fullFilePath(propagator()->fullLocalPath(_item->_file));
@@ -508,7 +561,19 @@ void PropagateUploadFileNG::slotUploadProgress(qint64 sent, qint64 total)
     if (sent == 0 && total == 0) {
         return;
     }
-    propagator()->reportProgress(*_item, _sent + sent - total);
+
+    // _sent counts every chunk that was started, subtract what the ones in
+    // flight still have to send.
+    auto *sendingJob = qobject_cast<PUTFileJob *>(sender());
+    ASSERT(sendingJob);
+    _chunkBytesWritten[sendingJob] = sent;
+    qint64 amount = _sent;
+    for (auto *job : qAsConst(_jobs)) {
+        if (auto *putJob = qobject_cast<PUTFileJob *>(job)) {
+            amount -= putJob->device()->size() - _chunkBytesWritten.value(putJob);
+        }
+    }
+    propagator()->reportProgress(*_item, amount);
 }
 
 void PropagateUploadFileNG::abort(PropagatorJob::AbortType abortType)
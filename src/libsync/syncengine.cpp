@@ -59,8 +59,6 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcEngine, "nextcloud.sync.engine", QtInfoMsg)
 
-bool SyncEngine::s_anySyncRunning = false;
-
 /** When the client touches a file, block change notifications for this duration (ms)
  *
  * On Linux and Windows the file watcher can't distinguish a change that originates
@@ -83,8 +81,9 @@ SyncEngine::SyncEngine(AccountPtr account, const QString &localPath,
     const QString &remotePath, OCC::SyncJournalDb *journal)
     : _account(account)
     , _needsUpdate(false)
-    , _syncRunning(false)
+    , _syncRunning(0)
     , _localPath(localPath)
+    , _localIoPath(localPath)
     , _remotePath(remotePath)
     , _journal(journal)
     , _progressInfo(new ProgressInfo)
@@ -108,6 +107,9 @@ SyncEngine::SyncEngine(AccountPtr account, const QString &localPath,
 
     _syncFileStatusTracker.reset(new SyncFileStatusTracker(this));
 
+    // Children follow the engine to its thread, the tracker stays
+    _progressInfo->setParent(this);
+    _clearTouchedFilesTimer.setParent(this);
     _clearTouchedFilesTimer.setSingleShot(true);
     _clearTouchedFilesTimer.setInterval(30 * 1000);
     connect(&_clearTouchedFilesTimer, &QTimer::timeout, this, &SyncEngine::slotClearTouchedFiles);
@@ -116,6 +118,8 @@ SyncEngine::SyncEngine(AccountPtr account, const QString &localPath,
 SyncEngine::~SyncEngine()
 {
     abort();
+    // The local walker's threads check the excludes
+    _discoveryPhase.reset();
     _excludedFiles.reset();
 }
 
@@ -254,7 +258,8 @@ void SyncEngine::deleteStaleErrorBlacklistEntries(const SyncFileItemVector &sync
     // Find all blacklisted paths that we want to preserve.
     QSet<QString> blacklist_file_paths;
     foreach (const SyncFileItemPtr &it, syncItems) {
-        if (it->_hasBlacklistEntry)
+        // Pipelined items may have failed already and got a new entry
+        if (it->_hasBlacklistEntry || _pipelinedItems.contains(it.data()))
             blacklist_file_paths.insert(it->_file);
     }
 
@@ -329,7 +334,7 @@ void OCC::SyncEngine::slotItemDiscovered(const OCC::SyncFileItemPtr &item)
         // mini-jobs later on, we just update metadata right now.
 
         if (item->_direction == SyncFileItem::Down) {
-            QString filePath = _localPath + item->_file;
+            QString filePath = _localIoPath + item->_file;
 
             // If the 'W' remote permission changed, update the local filesystem
             SyncJournalFileRecord prev;
@@ -415,14 +420,167 @@ void OCC::SyncEngine::slotItemDiscovered(const OCC::SyncFileItemPtr &item)
     }
 }
 
+static QString parentPath(const QString &path)
+{
+    const int slash = path.lastIndexOf(QLatin1Char('/'));
+    return slash < 0 ? QString() : path.left(slash);
+}
+
+// Whether nothing else in the sync can change what happens to the item,
+// provided its parent directory stays where it is
+static bool canBePipelined(const SyncFileItem &item)
+{
+    if (item._instruction != CSYNC_INSTRUCTION_NEW
+        && (item._instruction != CSYNC_INSTRUCTION_SYNC || item.isDirectory())) {
+        return false;
+    }
+    if (item._direction != SyncFileItem::Up && item._direction != SyncFileItem::Down)
+        return false;
+
+    // Inside a renamed directory, or becoming a rename later
+    if (item._file != item._originalFile || !item._renameTarget.isEmpty())
+        return false;
+
+    // Restored placeholders may still turn out to be the source of a rename,
+    // see DiscoveryPhase::findAndCancelDeletedJob()
+    return !item._isRestoration
+        && !(item._type == ItemTypeVirtualFile && item._instruction == CSYNC_INSTRUCTION_NEW);
+}
+
+// Whether the item doesn't keep anything in its directory from being pipelined
+static bool isPipelineNeutral(const SyncFileItem &item)
+{
+    switch (item._instruction) {
+    case CSYNC_INSTRUCTION_NONE:
+    case CSYNC_INSTRUCTION_UPDATE_METADATA:
+        return true;
+    case CSYNC_INSTRUCTION_IGNORE:
+        // Errors must keep the etag of a new parent directory from being stored
+        return item._status == SyncFileItem::NoStatus
+            || item._status == SyncFileItem::FileIgnored
+            || item._status == SyncFileItem::Conflict;
+    default:
+        return false;
+    }
+}
+
+void SyncEngine::slotPipelineItem(const SyncFileItemPtr &item)
+{
+    const QString parent = parentPath(item->_file);
+
+    if (item->isDirectory()) {
+        // The content of a directory is discovered before the directory itself
+        const bool blocked = _pipelineBlockedDirectories.remove(item->_file);
+        auto it = _pipelineCandidates.lowerBound(item->_file + QLatin1Char('/'));
+        const auto end = _pipelineCandidates.lowerBound(item->_file + QLatin1Char('0')); // '0' follows '/'
+
+        if (!blocked && canBePipelined(*item)) {
+            if (!isPipelineParent(parent)) {
+                _pipelineCandidates.insert(item->_file, item);
+                return;
+            }
+
+            SyncJournalFileRecord record;
+            if (_journal->getFileRecord(item->_file, &record) && !record.isValid()) {
+                SyncFileItemVector items{ item };
+                while (it != end) {
+                    items.append(it.value());
+                    it = _pipelineCandidates.erase(it);
+                }
+                pipelineItems(items);
+                return;
+            }
+            // A path the journal knows could still be the source of a move
+        }
+
+        while (it != end)
+            it = _pipelineCandidates.erase(it);
+    } else if (canBePipelined(*item)) {
+        if (!isPipelineParent(parent)) {
+            _pipelineCandidates.insert(item->_file, item);
+            return;
+        }
+
+        SyncJournalFileRecord record;
+        if (item->_instruction == CSYNC_INSTRUCTION_SYNC
+            || (_journal->getFileRecord(item->_file, &record) && !record.isValid())) {
+            pipelineItems({ item });
+            return;
+        }
+    }
+
+    if (!isPipelineNeutral(*item))
+        _pipelineBlockedDirectories.insert(parent);
+}
+
+bool SyncEngine::isPipelineParent(const QString &path)
+{
+    auto it = _pipelineParents.constFind(path);
+    if (it != _pipelineParents.constEnd())
+        return it.value();
+
+    // A blacklisted directory might be ignored, and its content with it
+    const bool result = _discoveryPhase->isStableDirectory(path)
+        && (path.isEmpty() || !_journal->errorBlacklistEntry(path).isValid());
+    _pipelineParents.insert(path, result);
+    return result;
+}
+
+void SyncEngine::pipelineItems(SyncFileItemVector items)
+{
+    // restoreOldFiles() could still change the instructions
+    if (!_pipelineDataFingerprint.isEmpty() && _discoveryPhase->_dataFingerprint != _pipelineDataFingerprint)
+        return;
+
+    std::sort(items.begin(), items.end());
+
+    if (!_propagator) {
+        qCInfo(lcEngine) << "#### Pipelined propagation start ####################################################" << _stopWatch.addLapTime(QStringLiteral("Pipelined propagation start")) << "ms";
+        createPropagator();
+        _propagator->startPipelined();
+        emit started();
+    }
+
+    emit aboutToPropagatePipelined(items);
+    for (const auto &item : qAsConst(items))
+        _pipelinedItems.insert(item.data());
+    _propagator->appendPipelinedItems(items);
+}
+
+void SyncEngine::createPropagator()
+{
+    _propagator = QSharedPointer<OwncloudPropagator>(
+        new OwncloudPropagator(_account, _localIoPath, _remotePath, _journal));
+    _propagator->setSyncOptions(_syncOptions);
+    connect(_propagator.data(), &OwncloudPropagator::itemCompleted,
+        this, &SyncEngine::slotItemCompleted);
+    connect(_propagator.data(), &OwncloudPropagator::progress,
+        this, &SyncEngine::slotProgress);
+    connect(_propagator.data(), &OwncloudPropagator::finished, this, &SyncEngine::slotPropagationFinished, Qt::QueuedConnection);
+    connect(_propagator.data(), &OwncloudPropagator::seenLockedFile, this, &SyncEngine::seenLockedFile);
+    connect(_propagator.data(), &OwncloudPropagator::touchedFile, this, &SyncEngine::slotAddTouchedFile);
+    connect(_propagator.data(), &OwncloudPropagator::insufficientLocalStorage, this, &SyncEngine::slotInsufficientLocalStorage);
+    connect(_propagator.data(), &OwncloudPropagator::insufficientRemoteStorage, this, &SyncEngine::slotInsufficientRemoteStorage);
+    connect(_propagator.data(), &OwncloudPropagator::newItem, this, &SyncEngine::slotNewItem);
+
+    // apply the network limits to the propagator
+    setNetworkLimits(_uploadLimit, _downloadLimit);
+
+    _journal->setFileRecordWriteBehind(_syncOptions._journalWriteBehindBatchSize,
+        _syncOptions._journalWriteBehindInterval);
+}
+
 void SyncEngine::startSync()
 {
+    // Around a mount over the folder, whose handlers may wait for the sync
+    _localIoPath = _syncOptions._vfs->underlyingPath(_localPath);
+
     if (_journal->exists()) {
         QVector<SyncJournalDb::PollInfo> pollInfos = _journal->getPollInfos();
         if (!pollInfos.isEmpty()) {
             qCInfo(lcEngine) << "Finish Poll jobs before starting a sync";
             auto *job = new CleanupPollsJob(pollInfos, _account,
-                _journal, _localPath, _syncOptions._vfs, this);
+                _journal, _localIoPath, _syncOptions._vfs, this);
             connect(job, &CleanupPollsJob::finished, this, &SyncEngine::startSync);
             connect(job, &CleanupPollsJob::aborted, this, &SyncEngine::slotCleanPollsJobAborted);
             job->start();
@@ -430,23 +588,24 @@ void SyncEngine::startSync()
         }
     }
 
-    if (s_anySyncRunning || _syncRunning) {
+    if (_syncRunning) {
         ASSERT(false);
         return;
     }
 
-    s_anySyncRunning = true;
-    _syncRunning = true;
+    _syncRunning.storeRelease(1);
     _anotherSyncNeeded = NoFollowUpSync;
     _clearTouchedFilesTimer.stop();
 
     _hasNoneFiles = false;
     _hasRemoveFile = false;
     _seenConflictFiles.clear();
+    _syncTokenInvalidations = _journal->syncTokenInvalidations();
+    _syncTokenUsable = true;
 
     _progressInfo->reset();
 
-    if (!QDir(_localPath).exists()) {
+    if (!QDir(_localIoPath).exists()) {
         _anotherSyncNeeded = DelayedFollowUp;
         // No _tr, it should only occur in non-mirall
         syncError("Unable to find local sync folder.");
@@ -456,7 +615,7 @@ void SyncEngine::startSync()
 
     // Check free size on disk first.
     const qint64 minFree = criticalFreeSpaceLimit();
-    const qint64 freeBytes = Utility::freeDiskSpace(_localPath);
+    const qint64 freeBytes = Utility::freeDiskSpace(_localIoPath);
     if (freeBytes >= 0) {
         if (freeBytes < minFree) {
             qCWarning(lcEngine()) << "Too little space available at" << _localPath << ". Have"
@@ -542,7 +701,7 @@ void SyncEngine::startSync()
     _discoveryPhase->_account = _account;
     _discoveryPhase->_excludes = _excludedFiles.data();
     _discoveryPhase->_statedb = _journal;
-    _discoveryPhase->_localDir = _localPath;
+    _discoveryPhase->_localDir = _localIoPath;
     if (!_discoveryPhase->_localDir.endsWith('/'))
         _discoveryPhase->_localDir+='/';
     _discoveryPhase->_remoteFolder = _remotePath;
@@ -574,21 +733,56 @@ void SyncEngine::startSync()
         _discoveryPhase->_invalidFilenameRx = QRegExp(invalidFilenamePattern);
     _discoveryPhase->_serverBlacklistedFiles = _account->capabilities().blacklistedFiles();
     _discoveryPhase->_ignoreHiddenFiles = ignoreHiddenFiles();
+    _discoveryPhase->_subtreeListingRejected = _remoteSubtreeListingRejected;
+
+    // Encrypted folders need their metadata, which is only handled at the end of the discovery
+    const bool pipelining = _syncOptions._pipelinedPropagation && !_account->capabilities().clientSideEncryptionAvailable();
+    _pipelineDataFingerprint = pipelining ? _journal->dataFingerprint() : QByteArray();
+    _pipelinedItems.clear();
+    _pipelineCandidates.clear();
+    _pipelineBlockedDirectories.clear();
+    _pipelineParents.clear();
 
     connect(_discoveryPhase.data(), &DiscoveryPhase::itemDiscovered, this, &SyncEngine::slotItemDiscovered);
+    if (pipelining)
+        connect(_discoveryPhase.data(), &DiscoveryPhase::itemDiscovered, this, &SyncEngine::slotPipelineItem);
     connect(_discoveryPhase.data(), &DiscoveryPhase::newBigFolder, this, &SyncEngine::newBigFolder);
     connect(_discoveryPhase.data(), &DiscoveryPhase::fatalError, this, [this](const QString &errorString) {
         syncError(errorString);
-        finalize(false);
+        // Pipelined jobs finish the sync once they are aborted
+        if (_propagator)
+            abort();
+        else
+            finalize(false);
     });
     connect(_discoveryPhase.data(), &DiscoveryPhase::finished, this, &SyncEngine::slotDiscoveryFinished);
     connect(_discoveryPhase.data(), &DiscoveryPhase::silentlyExcluded,
         _syncFileStatusTracker.data(), &SyncFileStatusTracker::slotAddSilentlyExcluded);
 
-    auto discoveryJob = new ProcessDirectoryJob(
-        _discoveryPhase.data(), PinState::AlwaysLocal, _discoveryPhase.data());
-    _discoveryPhase->startJob(discoveryJob);
-    connect(discoveryJob, &ProcessDirectoryJob::etag, this, &SyncEngine::slotRootEtagReceived);
+    // When all of the local tree gets discovered, list it ahead of the jobs,
+    // also while the remote changes are being asked for
+    if (_localDiscoveryStyle == LocalDiscoveryStyle::FilesystemOnly)
+        _discoveryPhase->startLocalWalker();
+
+    auto startDiscovery = [this] {
+        auto discoveryJob = new ProcessDirectoryJob(
+            _discoveryPhase.data(), PinState::AlwaysLocal, _discoveryPhase.data());
+        _discoveryPhase->startJob(discoveryJob);
+        connect(discoveryJob, &ProcessDirectoryJob::etag, this, &SyncEngine::slotRootEtagReceived);
+    };
+
+    // If the server told us its state at the end of the last sync, only ask
+    // for what changed since then instead of walking all changed directories.
+    const auto syncToken = _journal->syncToken();
+    if (!syncToken.isEmpty() && !_account->capabilities().clientSideEncryptionAvailable()) {
+        _discoveryPhase->queryRemoteChanges(syncToken, [this, startDiscovery](bool ok) {
+            if (!ok)
+                _journal->setSyncToken(QByteArray());
+            startDiscovery();
+        });
+    } else {
+        startDiscovery();
+    }
 }
 
 void SyncEngine::slotFolderDiscovered(bool local, const QString &folder)
@@ -633,11 +827,16 @@ void SyncEngine::slotDiscoveryFinished()
 
     qCInfo(lcEngine) << "#### Discovery end #################################################### " << _stopWatch.addLapTime(QLatin1String("Discovery Finished")) << "ms";
 
+    _remoteSubtreeListingRejected = _discoveryPhase->_subtreeListingRejected;
+
     // Sanity check
     if (!_journal->open()) {
         qCWarning(lcEngine) << "Bailing out, DB failure";
         syncError(tr("Cannot open the sync journal"));
-        finalize(false);
+        if (_propagator)
+            abort();
+        else
+            finalize(false);
         return;
     } else {
         // Commits a possibly existing (should not though) transaction and starts a new one for the propagate phase
@@ -670,8 +869,18 @@ void SyncEngine::slotDiscoveryFinished()
 
         _localDiscoveryPaths.clear();
 
+        // Pipelined items were announced and started during the discovery already
+        SyncFileItemVector items = _syncItems;
+        if (!_pipelinedItems.isEmpty()) {
+            items.erase(std::remove_if(items.begin(), items.end(), [this](const SyncFileItemPtr &item) {
+                return _pipelinedItems.contains(item.data());
+            }),
+                items.end());
+        }
+        _pipelineCandidates.clear();
+
         // To announce the beginning of the sync
-        emit aboutToPropagate(_syncItems);
+        emit aboutToPropagate(items);
 
         qCInfo(lcEngine) << "#### Reconcile (aboutToPropagate OK) #################################################### "<< _stopWatch.addLapTime(QStringLiteral("Reconcile (aboutToPropagate OK)")) << "ms";
 
@@ -695,22 +904,10 @@ void SyncEngine::slotDiscoveryFinished()
         // do a database commit
         _journal->commit(QStringLiteral("post treewalk"));
 
-        _propagator = QSharedPointer<OwncloudPropagator>(
-            new OwncloudPropagator(_account, _localPath, _remotePath, _journal));
-        _propagator->setSyncOptions(_syncOptions);
-        connect(_propagator.data(), &OwncloudPropagator::itemCompleted,
-            this, &SyncEngine::slotItemCompleted);
-        connect(_propagator.data(), &OwncloudPropagator::progress,
-            this, &SyncEngine::slotProgress);
-        connect(_propagator.data(), &OwncloudPropagator::finished, this, &SyncEngine::slotPropagationFinished, Qt::QueuedConnection);
-        connect(_propagator.data(), &OwncloudPropagator::seenLockedFile, this, &SyncEngine::seenLockedFile);
-        connect(_propagator.data(), &OwncloudPropagator::touchedFile, this, &SyncEngine::slotAddTouchedFile);
-        connect(_propagator.data(), &OwncloudPropagator::insufficientLocalStorage, this, &SyncEngine::slotInsufficientLocalStorage);
-        connect(_propagator.data(), &OwncloudPropagator::insufficientRemoteStorage, this, &SyncEngine::slotInsufficientRemoteStorage);
-        connect(_propagator.data(), &OwncloudPropagator::newItem, this, &SyncEngine::slotNewItem);
-
-        // apply the network limits to the propagator
-        setNetworkLimits(_uploadLimit, _downloadLimit);
+        // Created already if items were pipelined
+        const bool propagatorStarted = !_propagator.isNull();
+        if (!propagatorStarted)
+            createPropagator();
 
         deleteStaleDownloadInfos(_syncItems);
         deleteStaleUploadInfos(_syncItems);
@@ -718,11 +915,12 @@ void SyncEngine::slotDiscoveryFinished()
         _journal->commit(QStringLiteral("post stale entry removal"));
 
         // Emit the started signal only after the propagator has been set up.
-        if (_needsUpdate)
+        if (_needsUpdate && !propagatorStarted)
             emit(started());
 
-        _propagator->start(_syncItems);
+        _propagator->start(items);
         _syncItems.clear();
+        _pipelinedItems.clear();
 
         qCInfo(lcEngine) << "#### Post-Reconcile end #################################################### " << _stopWatch.addLapTime(QStringLiteral("Post-Reconcile Finished")) << "ms";
     };
@@ -747,7 +945,10 @@ void SyncEngine::slotDiscoveryFinished()
             guard->deleteLater();
             if (cancel) {
                 qCInfo(lcEngine) << "User aborted sync";
-                finalize(false);
+                if (_propagator)
+                    abort();
+                else
+                    finalize(false);
                 return;
             } else {
                 finish();
@@ -783,6 +984,19 @@ void SyncEngine::setNetworkLimits(int upload, int download)
 
 void SyncEngine::slotItemCompleted(const SyncFileItemPtr &item)
 {
+    switch (item->_status) {
+    case SyncFileItem::FatalError:
+    case SyncFileItem::NormalError:
+    case SyncFileItem::SoftError:
+    case SyncFileItem::DetailError:
+    case SyncFileItem::BlacklistedError:
+    case SyncFileItem::FileLocked:
+        _syncTokenUsable = false;
+        break;
+    default:
+        break;
+    }
+
     _progressInfo->setProgressComplete(*item);
 
     emit transmissionProgress(*_progressInfo);
@@ -797,6 +1011,14 @@ void SyncEngine::slotPropagationFinished(bool success)
 
     if (success && _discoveryPhase) {
         _journal->setDataFingerprint(_discoveryPhase->_dataFingerprint);
+
+        // Only a sync that saw and applied all remote changes may move the token
+        // forward. Otherwise the previous token is kept: the changes since then
+        // include everything that is still missing.
+        if (_syncTokenUsable && !_discoveryPhase->_remoteDiscoveryIncomplete
+            && _journal->syncTokenInvalidations() == _syncTokenInvalidations) {
+            _journal->setSyncToken(_discoveryPhase->_syncToken);
+        }
     }
 
     conflictRecordMaintenance();
@@ -819,11 +1041,14 @@ void SyncEngine::finalize(bool success)
     qCInfo(lcEngine) << "Sync run took " << _stopWatch.addLapTime(QLatin1String("Sync Finished")) << "ms";
     _stopWatch.stop();
 
+    // Also writes out any file records still queued
+    _journal->setFileRecordWriteBehind(0);
+
     if (_discoveryPhase) {
+        delete _discoveryPhase->_localWalker;
         _discoveryPhase.take()->deleteLater();
     }
-    s_anySyncRunning = false;
-    _syncRunning = false;
+    _syncRunning.storeRelease(0);
     emit finished(success);
 
     // Delete the propagator only after emitting the signal.
@@ -880,7 +1105,14 @@ void SyncEngine::slotAddTouchedFile(const QString &fn)
     QElapsedTimer now;
     now.start();
     QString file = QDir::cleanPath(fn);
+    // Like the folder watcher reports it
+    if (_localIoPath != _localPath) {
+        const QString ioRoot = QDir::cleanPath(_localIoPath);
+        if (file.startsWith(ioRoot))
+            file = QDir::cleanPath(_localPath) + file.mid(ioRoot.size());
+    }
 
+    QMutexLocker locker(&_touchedFilesMutex);
     // Iterate from the oldest and remove anything older than 15 seconds.
     while (true) {
         auto first = _touchedFiles.begin();
@@ -903,12 +1135,14 @@ void SyncEngine::slotAddTouchedFile(const QString &fn)
 
 void SyncEngine::slotClearTouchedFiles()
 {
+    QMutexLocker locker(&_touchedFilesMutex);
     _touchedFiles.clear();
 }
 
 bool SyncEngine::wasFileTouched(const QString &fn) const
 {
     // Start from the end (most recent) and look for our path. Check the time just in case.
+    QMutexLocker locker(&_touchedFilesMutex);
     auto begin = _touchedFiles.constBegin();
     for (auto it = _touchedFiles.constEnd(); it != begin; --it) {
         if ((it-1).value() == fn)
@@ -1013,12 +1247,18 @@ void SyncEngine::abort()
         qCInfo(lcEngine) << "Aborting sync";
 
     if (_propagator) {
-        // If we're already in the propagation phase, aborting that is sufficient
+        // If we're already in the propagation phase, aborting that is sufficient.
+        // With pipelined propagation the discovery may still be running, it
+        // must not hand over any more items.
+        if (_discoveryPhase)
+            disconnect(_discoveryPhase.data(), nullptr, this, nullptr);
         _propagator->abort();
     } else if (_discoveryPhase) {
         // Delete the discovery and all child jobs after ensuring
         // it can't finish and start the propagator
         disconnect(_discoveryPhase.data(), nullptr, this, nullptr);
+        // Stop the local walker's threads now, not when the deletion comes around
+        delete _discoveryPhase->_localWalker;
         _discoveryPhase.take()->deleteLater();
 
         syncError(tr("Aborted"));
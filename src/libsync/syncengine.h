@@ -17,6 +17,7 @@
 
 #include <cstdint>
 
+#include <QAtomicInt>
 #include <QMutex>
 #include <QThread>
 #include <QString>
@@ -52,6 +53,12 @@ enum AnotherSyncNeeded {
 /**
  * @brief The SyncEngine class
  * @ingroup libsync
+ *
+ * The engine may be moved to a thread of its own, see SyncEngineRelay. Its
+ * syncFileStatusTracker() stays behind. Other threads may call
+ * isSyncRunning() and wasFileTouched(), and use the journal and the
+ * excluded files. Everything else happens in the engine's thread, or while
+ * no sync is running.
  */
 class OWNCLOUDSYNC_EXPORT SyncEngine : public QObject
 {
@@ -64,10 +71,10 @@ public:
     Q_INVOKABLE void startSync();
     void setNetworkLimits(int upload, int download);
 
-    /* Abort the sync.  Called from the main thread */
+    /* Abort the sync.  Called from the engine's thread */
     void abort();
 
-    bool isSyncRunning() const { return _syncRunning; }
+    bool isSyncRunning() const { return _syncRunning.loadAcquire(); }
 
     SyncOptions syncOptions() const { return _syncOptions; }
     void setSyncOptions(const SyncOptions &options) { _syncOptions = options; }
@@ -143,6 +150,13 @@ signals:
     // after the above signals. with the items that actually need propagating
     void aboutToPropagate(SyncFileItemVector &);
 
+    /** Before \a items are propagated while the discovery is still running
+     *
+     * See SyncOptions::_pipelinedPropagation. aboutToPropagate() follows at the
+     * end of the discovery, without these items.
+     */
+    void aboutToPropagatePipelined(SyncFileItemVector &items);
+
     // after each item completed by a job (successful or not)
     void itemCompleted(const SyncFileItemPtr &);
 
@@ -177,6 +191,9 @@ private slots:
     /** When the discovery phase discovers an item */
     void slotItemDiscovered(const SyncFileItemPtr &item);
 
+    /** Hands the item over to the propagator right away if nothing in this sync can affect it */
+    void slotPipelineItem(const SyncFileItemPtr &item);
+
     /** Called when a SyncFileItem gets accepted for a sync.
      *
      * Mostly done in initial creation inside treewalkFile but
@@ -206,6 +223,15 @@ private slots:
 private:
     bool checkErrorBlacklisting(SyncFileItem &item);
 
+    /// Creates _propagator, which is started by the caller
+    void createPropagator();
+
+    /// Whether items in the directory \a path may be propagated during the discovery
+    bool isPipelineParent(const QString &path);
+
+    /// Starts propagating \a items, a single file or a new directory with its content
+    void pipelineItems(SyncFileItemVector items);
+
     // Cleans up unnecessary downloadinfo entries in the journal as well
     // as their temporary files.
     void deleteStaleDownloadInfos(const SyncFileItemVector &syncItems);
@@ -222,15 +248,14 @@ private:
     // cleanup and emit the finished signal
     void finalize(bool success);
 
-    static bool s_anySyncRunning; //true when one sync is running somewhere (for debugging)
-
     // Must only be acessed during update and reconcile
     QVector<SyncFileItemPtr> _syncItems;
 
     AccountPtr _account;
     bool _needsUpdate;
-    bool _syncRunning;
+    QAtomicInt _syncRunning;
     QString _localPath;
+    QString _localIoPath; // where the sync does its file operations, see Vfs::underlyingPath()
     QString _remotePath;
     QString _remoteRootEtag;
     SyncJournalDb *_journal;
@@ -264,6 +289,26 @@ private:
     // true if there is at leasr one file with instruction REMOVE
     bool _hasRemoveFile;
 
+    // SyncJournalDb::syncTokenInvalidations() when the sync started
+    int _syncTokenInvalidations = 0;
+
+    // false once an item failed: the sync token must not move past its change
+    bool _syncTokenUsable = true;
+
+    // Set once the server refused a subtree listing, see DiscoveryPhase::_subtreeListingRejected
+    bool _remoteSubtreeListingRejected = false;
+
+    // SyncJournalDb::dataFingerprint() when the sync started, see pipelineItems()
+    QByteArray _pipelineDataFingerprint;
+    // The items already handed over to the propagator, see SyncOptions::_pipelinedPropagation
+    QSet<SyncFileItem *> _pipelinedItems;
+    // Can be handed over once their new parent directory is completely discovered, by path
+    QMap<QString, SyncFileItemPtr> _pipelineCandidates;
+    // Directories with content that has to wait for the end of the discovery
+    QSet<QString> _pipelineBlockedDirectories;
+    // Cache for isPipelineParent()
+    QHash<QString, bool> _pipelineParents;
+
     // If ignored files should be ignored
     bool _ignore_hidden_files = false;
 
@@ -276,6 +321,7 @@ private:
 
     /** Stores the time since a job touched a file. */
     QMultiMap<QElapsedTimer, QString> _touchedFiles;
+    mutable QMutex _touchedFilesMutex; // wasFileTouched() is called from other threads
 
     QElapsedTimer _lastUpdateProgressCallbackCall;
 
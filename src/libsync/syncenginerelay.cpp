@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "syncenginerelay.h"
+#include "syncengine.h"
+
+namespace OCC {
+
+static SyncFileItemPtr copyItem(const SyncFileItemPtr &item)
+{
+    return SyncFileItemPtr::create(*item);
+}
+
+static SyncFileItemVector copyItems(const SyncFileItemVector &items)
+{
+    SyncFileItemVector copies;
+    copies.reserve(items.size());
+    for (const auto &item : items)
+        copies.append(copyItem(item));
+    return copies;
+}
+
+SyncEngineRelay::SyncEngineRelay(SyncEngine *engine, QObject *parent)
+    : QObject(parent)
+    , _engine(engine)
+{
+    _batchTimer.setSingleShot(true);
+    _batchTimer.setInterval(batchIntervalMsec);
+    connect(&_batchTimer, &QTimer::timeout, this, &SyncEngineRelay::flush);
+
+    // The lambdas run in the engine's thread
+    connect(engine, &SyncEngine::started, this, [this] {
+        post([this] { emit started(); }, true);
+    }, Qt::DirectConnection);
+    connect(engine, &SyncEngine::finished, this, [this](bool success) {
+        post([this, success] { emit finished(success); }, true);
+    }, Qt::DirectConnection);
+    connect(engine, &SyncEngine::rootEtag, this, [this](const QString &etag, const QDateTime &time) {
+        post([this, etag, time] { emit rootEtag(etag, time); });
+    }, Qt::DirectConnection);
+    connect(engine, &SyncEngine::aboutToPropagate, this, [this](SyncFileItemVector &items) {
+        post([this, copies = copyItems(items)]() mutable { emit aboutToPropagate(copies); });
+    }, Qt::DirectConnection);
+    connect(engine, &SyncEngine::aboutToPropagatePipelined, this, [this](SyncFileItemVector &items) {
+        post([this, copies = copyItems(items)]() mutable { emit aboutToPropagatePipelined(copies); });
+    }, Qt::DirectConnection);
+    connect(engine, &SyncEngine::itemCompleted, this, [this](const SyncFileItemPtr &item) {
+        post([this, copy = copyItem(item)] { emit itemCompleted(copy); });
+    }, Qt::DirectConnection);
+    connect(engine, &SyncEngine::transmissionProgress, this, &SyncEngineRelay::postProgress, Qt::DirectConnection);
+    connect(engine, &SyncEngine::syncError, this, [this](const QString &message, ErrorCategory category) {
+        post([this, message, category] { emit syncError(message, category); });
+    }, Qt::DirectConnection);
+    connect(engine, &SyncEngine::aboutToRemoveAllFiles, this, [this](SyncFileItem::Direction direction, std::function<void(bool)> f) {
+        post([this, direction, f] {
+            emit aboutToRemoveAllFiles(direction, [engine = _engine, f](bool cancel) {
+                if (engine)
+                    QMetaObject::invokeMethod(engine.data(), [f, cancel] { f(cancel); });
+            });
+        }, true);
+    }, Qt::DirectConnection);
+    connect(engine, &SyncEngine::newBigFolder, this, [this](const QString &folder, bool isExternal) {
+        post([this, folder, isExternal] { emit newBigFolder(folder, isExternal); });
+    }, Qt::DirectConnection);
+    connect(engine, &SyncEngine::seenLockedFile, this, [this](const QString &fileName) {
+        post([this, fileName] { emit seenLockedFile(fileName); });
+    }, Qt::DirectConnection);
+}
+
+void SyncEngineRelay::post(Event event, bool urgent)
+{
+    QMutexLocker locker(&_mutex);
+    _events.push_back(std::move(event));
+    if (urgent) {
+        if (!_flushRequested) {
+            _flushRequested = true;
+            QMetaObject::invokeMethod(this, &SyncEngineRelay::flush, Qt::QueuedConnection);
+        }
+    } else if (!_timerRequested) {
+        _timerRequested = true;
+        QMetaObject::invokeMethod(this, [this] {
+            if (!_batchTimer.isActive())
+                _batchTimer.start();
+        }, Qt::QueuedConnection);
+    }
+}
+
+void SyncEngineRelay::postProgress(const ProgressInfo &progress)
+{
+    {
+        QMutexLocker locker(&_mutex);
+        _pendingProgress.copyFrom(progress);
+        if (_progressQueued)
+            return;
+        _progressQueued = true;
+    }
+    // The latest progress at the time the event is emitted
+    post([this] {
+        {
+            QMutexLocker locker(&_mutex);
+            _progress.copyFrom(_pendingProgress);
+            _progressQueued = false;
+        }
+        emit transmissionProgress(_progress);
+    });
+}
+
+void SyncEngineRelay::flush()
+{
+    std::vector<Event> events;
+    {
+        QMutexLocker locker(&_mutex);
+        events.swap(_events);
+        _flushRequested = false;
+        _timerRequested = false;
+    }
+    _batchTimer.stop();
+    for (const auto &event : events)
+        event();
+}
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef SYNCENGINERELAY_H
+#define SYNCENGINERELAY_H
+
+#include "owncloudlib.h"
+#include "progressdispatcher.h"
+#include "syncfileitem.h"
+
+#include <QDateTime>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+
+#include <functional>
+#include <vector>
+
+namespace OCC {
+
+class SyncEngine;
+
+/**
+ * @brief Hands the signals of a SyncEngine on another thread over in batches
+ * @ingroup libsync
+ *
+ * The relay lives in the receiving thread and has the signals of the engine,
+ * emitted there in their original order. Completed items and progress are
+ * collected for up to batchIntervalMsec and delivered with one event, the
+ * progress only in its latest state. started(), finished() and the questions
+ * for the user are delivered right away, after what was collected before them.
+ *
+ * The items are copies taken when the engine emitted them, so the engine can
+ * go on changing its own. Changes to the items of aboutToPropagate() don't
+ * reach the engine.
+ *
+ * The engine's SyncFileStatusTracker stays in the receiving thread and follows
+ * the relay, see SyncFileStatusTracker::setRelay().
+ */
+class OWNCLOUDSYNC_EXPORT SyncEngineRelay : public QObject
+{
+    Q_OBJECT
+public:
+    /// How long collected signals wait at most
+    static constexpr int batchIntervalMsec = 100;
+
+    /// Emits the signals of \a engine in the thread the relay is created in
+    explicit SyncEngineRelay(SyncEngine *engine, QObject *parent = nullptr);
+
+signals:
+    void rootEtag(const QString &, const QDateTime &);
+    void aboutToPropagate(SyncFileItemVector &);
+    void aboutToPropagatePipelined(SyncFileItemVector &items);
+    void itemCompleted(const SyncFileItemPtr &);
+    void transmissionProgress(const ProgressInfo &progress);
+    void syncError(const QString &message, ErrorCategory category = ErrorCategory::Normal);
+    void finished(bool success);
+    void started();
+
+    /// \a f is called in the engine's thread
+    void aboutToRemoveAllFiles(SyncFileItem::Direction direction, std::function<void(bool)> f);
+    void newBigFolder(const QString &folder, bool isExternal);
+    void seenLockedFile(const QString &fileName);
+
+private:
+    using Event = std::function<void()>;
+
+    /// Queues \a event, called in the engine's thread
+    void post(Event event, bool urgent = false);
+    void postProgress(const ProgressInfo &progress);
+
+    /// Emits the queued events
+    void flush();
+
+    QPointer<SyncEngine> _engine;
+    QTimer _batchTimer;
+
+    QMutex _mutex; // Protects the members below
+    std::vector<Event> _events;
+    bool _flushRequested = false;
+    bool _timerRequested = false;
+    ProgressInfo _pendingProgress;
+    bool _progressQueued = false;
+
+    // What transmissionProgress() hands out
+    ProgressInfo _progress;
+};
+}
+
+#endif
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "syncfilestatusindex.h"
+
+namespace OCC {
+
+constexpr quint32 SyncFileStatusIndex::NoNode;
+
+static inline QString nameKey(const QString &name)
+{
+    // Should match Utility::fsCasePreserving, we don't want to pay for the runtime check on every lookup.
+#if defined(Q_OS_WIN) || defined(Q_OS_MAC)
+    return name.toCaseFolded();
+#else
+    return name;
+#endif
+}
+
+SyncFileStatusIndex::SyncFileStatusIndex()
+{
+    // The root, it is never freed
+    _nodes.emplace_back();
+}
+
+quint32 SyncFileStatusIndex::find(const QString &path) const
+{
+    quint32 node = 0;
+    int start = 0;
+    while (start < path.size()) {
+        int end = path.indexOf(QLatin1Char('/'), start);
+        if (end == -1)
+            end = path.size();
+        if (end > start) {
+            node = _children.value(qMakePair(node, nameKey(path.mid(start, end - start))), NoNode);
+            if (node == NoNode)
+                return NoNode;
+        }
+        start = end + 1;
+    }
+    return node;
+}
+
+quint32 SyncFileStatusIndex::findOrCreate(const QString &path)
+{
+    quint32 node = 0;
+    int start = 0;
+    while (start < path.size()) {
+        int end = path.indexOf(QLatin1Char('/'), start);
+        if (end == -1)
+            end = path.size();
+        if (end > start) {
+            const QString name = path.mid(start, end - start);
+            quint32 &child = _children[qMakePair(node, nameKey(name))];
+            if (child == 0) {
+                // Not a valid child index since that is the root, so the entry is new
+                quint32 index;
+                if (!_freeNodes.empty()) {
+                    index = _freeNodes.back();
+                    _freeNodes.pop_back();
+                } else {
+                    index = quint32(_nodes.size());
+                    _nodes.emplace_back();
+                }
+                Node &created = _nodes[index];
+                created.parent = node;
+                created.name = name;
+                created.nextSibling = _nodes[node].firstChild;
+                if (created.nextSibling != NoNode)
+                    _nodes[created.nextSibling].previousSibling = index;
+                _nodes[node].firstChild = index;
+                child = index;
+            }
+            node = child;
+        }
+        start = end + 1;
+    }
+    return node;
+}
+
+void SyncFileStatusIndex::prune(quint32 node)
+{
+    // A free node has no parent, only the root is allowed that
+    while (node != 0 && _nodes[node].parent != NoNode && _nodes[node].isEmpty()) {
+        Node &n = _nodes[node];
+        const quint32 parent = n.parent;
+        if (n.previousSibling != NoNode)
+            _nodes[n.previousSibling].nextSibling = n.nextSibling;
+        else
+            _nodes[parent].firstChild = n.nextSibling;
+        if (n.nextSibling != NoNode)
+            _nodes[n.nextSibling].previousSibling = n.previousSibling;
+        _children.remove(qMakePair(parent, nameKey(n.name)));
+
+        n = Node();
+        _freeNodes.push_back(node);
+        node = parent;
+    }
+}
+
+QString SyncFileStatusIndex::path(quint32 node) const
+{
+    QStringList names;
+    for (; node != 0; node = _nodes[node].parent)
+        names.prepend(_nodes[node].name);
+    return names.join(QLatin1Char('/'));
+}
+
+template <typename Visitor>
+void SyncFileStatusIndex::forEachNode(Visitor visit)
+{
+    for (quint32 i = 0; i < _nodes.size(); ++i) {
+        if (i == 0 || _nodes[i].parent != NoNode)
+            visit(i, _nodes[i]);
+    }
+}
+
+int SyncFileStatusIndex::syncCount(const QString &path) const
+{
+    const quint32 node = find(path);
+    return node == NoNode ? 0 : _nodes[node].syncCount;
+}
+
+int SyncFileStatusIndex::addSyncCount(const QString &path, int delta)
+{
+    const quint32 node = findOrCreate(path);
+    int &count = _nodes[node].syncCount;
+    const bool hadCount = count != 0;
+    count += delta;
+    if (hadCount && count == 0) {
+        --_syncCountNodes;
+        const int result = count;
+        prune(node);
+        return result;
+    }
+    if (!hadCount && count != 0)
+        ++_syncCountNodes;
+    return count;
+}
+
+QStringList SyncFileStatusIndex::takeSyncCounts()
+{
+    QStringList paths;
+    std::vector<quint32> nodes;
+    forEachNode([&](quint32 index, Node &node) {
+        if (node.syncCount != 0) {
+            paths.append(path(index));
+            nodes.push_back(index);
+            node.syncCount = 0;
+        }
+    });
+    for (auto node : nodes)
+        prune(node);
+    _syncCountNodes = 0;
+    return paths;
+}
+
+SyncFileStatus::SyncFileStatusTag SyncFileStatusIndex::problem(const QString &path) const
+{
+    const quint32 node = find(path);
+    return node == NoNode ? SyncFileStatus::StatusNone : _nodes[node].problem;
+}
+
+SyncFileStatus::SyncFileStatusTag SyncFileStatusIndex::effectiveProblem(const QString &path) const
+{
+    const quint32 node = find(path);
+    if (node == NoNode)
+        return SyncFileStatus::StatusNone;
+    const Node &n = _nodes[node];
+    if (n.problem != SyncFileStatus::StatusNone)
+        return n.problem;
+    return n.errorsBelow > 0 ? SyncFileStatus::StatusWarning : SyncFileStatus::StatusNone;
+}
+
+int SyncFileStatusIndex::setProblem(const QString &path, SyncFileStatus::SyncFileStatusTag problem)
+{
+    const quint32 node = problem == SyncFileStatus::StatusNone ? find(path) : findOrCreate(path);
+    if (node == NoNode)
+        return 0;
+
+    const bool wasError = _nodes[node].problem == SyncFileStatus::StatusError;
+    const bool isError = problem == SyncFileStatus::StatusError;
+    _nodes[node].problem = problem;
+
+    // Since an ancestor counts at least the errors of its descendants, the
+    // ancestors that start or stop having errors below them are the nearest ones
+    int flipped = 0;
+    if (wasError != isError) {
+        const int delta = isError ? 1 : -1;
+        for (quint32 ancestor = _nodes[node].parent; ancestor != NoNode; ancestor = _nodes[ancestor].parent) {
+            int &errorsBelow = _nodes[ancestor].errorsBelow;
+            if (errorsBelow == (isError ? 0 : 1))
+                ++flipped;
+            errorsBelow += delta;
+        }
+    }
+    if (problem == SyncFileStatus::StatusNone)
+        prune(node);
+    return flipped;
+}
+
+QVector<SyncFileStatusIndex::Problem> SyncFileStatusIndex::takeProblems()
+{
+    QVector<Problem> problems;
+    std::vector<quint32> nodes;
+    forEachNode([&](quint32 index, Node &node) {
+        if (node.problem != SyncFileStatus::StatusNone) {
+            problems.append(qMakePair(path(index), node.problem));
+            nodes.push_back(index);
+            node.problem = SyncFileStatus::StatusNone;
+        }
+        node.errorsBelow = 0;
+    });
+    for (auto node : nodes)
+        prune(node);
+    return problems;
+}
+
+SyncFileStatusIndex::RecordState SyncFileStatusIndex::recordState(const QString &path) const
+{
+    const quint32 node = find(path);
+    return node == NoNode ? RecordUnknown : _nodes[node].record;
+}
+
+void SyncFileStatusIndex::setRecordState(const QString &path, RecordState state)
+{
+    const quint32 node = state == RecordUnknown ? find(path) : findOrCreate(path);
+    if (node == NoNode)
+        return;
+    _nodes[node].record = state;
+    if (state == RecordUnknown)
+        prune(node);
+}
+
+void SyncFileStatusIndex::clearRecordStates()
+{
+    std::vector<quint32> nodes;
+    forEachNode([&](quint32 index, Node &node) {
+        if (node.record != RecordUnknown) {
+            node.record = RecordUnknown;
+            nodes.push_back(index);
+        }
+    });
+    for (auto node : nodes)
+        prune(node);
+}
+}
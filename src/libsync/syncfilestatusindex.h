@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef SYNCFILESTATUSINDEX_H
+#define SYNCFILESTATUSINDEX_H
+
+#include "owncloudlib.h"
+#include "common/syncfilestatus.h"
+
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <vector>
+
+namespace OCC {
+
+/**
+ * @brief Per-path state of SyncFileStatusTracker, stored as a path trie
+ * @ingroup libsync
+ *
+ * Every path with some state is a node that is reached from the root (the
+ * empty path) one name component at a time, so all updates and lookups cost
+ * O(depth). A node aggregates the number of errors below it, which is what
+ * turns a directory into a warning. Nodes without state are pruned.
+ *
+ * Names are compared case-insensitively on Windows and macOS, like
+ * Utility::fsCasePreserving().
+ */
+class OWNCLOUDSYNC_EXPORT SyncFileStatusIndex
+{
+public:
+    /// What the database knows about a path, RecordUnknown if it wasn't asked yet
+    enum RecordState {
+        RecordUnknown,
+        RecordMissing,
+        RecordNotShared,
+        RecordShared
+    };
+
+    using Problem = QPair<QString, SyncFileStatus::SyncFileStatusTag>;
+
+    SyncFileStatusIndex();
+
+    int syncCount(const QString &path) const;
+    /// Adds \a delta to the sync count of \a path and returns the new count
+    int addSyncCount(const QString &path, int delta);
+    bool hasSyncCounts() const { return _syncCountNodes > 0; }
+    /// Resets all sync counts, returns the paths that had one
+    QStringList takeSyncCounts();
+
+    /// The problem recorded for exactly \a path
+    SyncFileStatus::SyncFileStatusTag problem(const QString &path) const;
+    /// The problem of \a path, or StatusWarning if there is an error below it
+    SyncFileStatus::SyncFileStatusTag effectiveProblem(const QString &path) const;
+    /**
+     * Records \a problem for \a path, StatusNone removes it.
+     *
+     * Returns how many of the nearest ancestors of \a path started or stopped
+     * having an error below them, those are the ones whose warning changed.
+     */
+    int setProblem(const QString &path, SyncFileStatus::SyncFileStatusTag problem);
+    /// Removes all problems and returns them
+    QVector<Problem> takeProblems();
+
+    RecordState recordState(const QString &path) const;
+    void setRecordState(const QString &path, RecordState state);
+    void clearRecordStates();
+
+    /// Number of nodes, for tests
+    int nodeCount() const { return int(_nodes.size() - _freeNodes.size()); }
+
+private:
+    static constexpr quint32 NoNode = 0xffffffff;
+
+    struct Node
+    {
+        quint32 parent = NoNode;
+        quint32 firstChild = NoNode;
+        quint32 previousSibling = NoNode;
+        quint32 nextSibling = NoNode;
+        QString name;
+        int syncCount = 0;
+        int errorsBelow = 0;
+        SyncFileStatus::SyncFileStatusTag problem = SyncFileStatus::StatusNone;
+        RecordState record = RecordUnknown;
+
+        bool isEmpty() const
+        {
+            return firstChild == NoNode && syncCount == 0 && errorsBelow == 0
+                && problem == SyncFileStatus::StatusNone && record == RecordUnknown;
+        }
+    };
+
+    quint32 find(const QString &path) const;
+    quint32 findOrCreate(const QString &path);
+    /// Removes \a node and then its ancestors as long as they are empty
+    void prune(quint32 node);
+    QString path(quint32 node) const;
+    /// Calls \a visit with every node that isn't free
+    template <typename Visitor>
+    void forEachNode(Visitor visit);
+
+    std::vector<Node> _nodes;
+    std::vector<quint32> _freeNodes;
+    QHash<QPair<quint32, QString>, quint32> _children;
+    int _syncCountNodes = 0;
+};
+}
+
+#endif
@@ -15,6 +15,7 @@
 
 #include "syncfilestatustracker.h"
 #include "syncengine.h"
+#include "syncenginerelay.h"
 #include "common/syncjournaldb.h"
 #include "common/syncjournalfilerecord.h"
 #include "common/asserts.h"
@@ -26,61 +27,6 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcStatusTracker, "nextcloud.sync.statustracker", QtInfoMsg)
 
-static int pathCompare( const QString& lhs, const QString& rhs )
-{
-    // Should match Utility::fsCasePreserving, we want don't want to pay for the runtime check on every comparison.
-    return lhs.compare(rhs,
-#if defined(Q_OS_WIN) || defined(Q_OS_MAC)
-        Qt::CaseInsensitive
-#else
-        Qt::CaseSensitive
-#endif
-        );
-}
-
-static bool pathStartsWith( const QString& lhs, const QString& rhs )
-{
-    return lhs.startsWith(rhs,
-#if defined(Q_OS_WIN) || defined(Q_OS_MAC)
-        Qt::CaseInsensitive
-#else
-        Qt::CaseSensitive
-#endif
-        );
-}
-
-bool SyncFileStatusTracker::PathComparator::operator()( const QString& lhs, const QString& rhs ) const
-{
-    // This will make sure that the std::map is ordered and queried case-insensitively on macOS and Windows.
-    return pathCompare(lhs, rhs) < 0;
-}
-
-SyncFileStatus::SyncFileStatusTag SyncFileStatusTracker::lookupProblem(const QString &pathToMatch, const SyncFileStatusTracker::ProblemsMap &problemMap)
-{
-    auto lower = problemMap.lower_bound(pathToMatch);
-    for (auto it = lower; it != problemMap.cend(); ++it) {
-        const QString &problemPath = it->first;
-        SyncFileStatus::SyncFileStatusTag severity = it->second;
-
-        if (pathCompare(problemPath, pathToMatch) == 0) {
-            return severity;
-        } else if (severity == SyncFileStatus::StatusError
-            && pathStartsWith(problemPath, pathToMatch)
-            && (pathToMatch.isEmpty() || problemPath.at(pathToMatch.size()) == '/')) {
-            return SyncFileStatus::StatusWarning;
-        } else if (!pathStartsWith(problemPath, pathToMatch)) {
-            // Starting at lower_bound we get the first path that is not smaller,
-            // since: "a/" < "a/aa" < "a/aa/aaa" < "a/ab/aba"
-            // If problemMap keys are ["a/aa/aaa", "a/ab/aba"] and pathToMatch == "a/aa",
-            // lower_bound(pathToMatch) will point to "a/aa/aaa", and the moment that
-            // problemPath.startsWith(pathToMatch) == false, we know that we've looked
-            // at everything that interest us.
-            break;
-        }
-    }
-    return SyncFileStatus::StatusNone;
-}
-
 /**
  * Whether this item should get an ERROR icon through the Socket API.
  *
@@ -110,16 +56,30 @@ static inline bool hasExcludedStatus(const SyncFileItem &item)
         || status == SyncFileItem::FileLocked;
 }
 
-SyncFileStatusTracker::SyncFileStatusTracker(SyncEngine *syncEngine)
-    : _syncEngine(syncEngine)
+template <typename Source>
+void SyncFileStatusTracker::connectTo(Source *source)
 {
-    connect(syncEngine, &SyncEngine::aboutToPropagate,
+    connect(source, &Source::aboutToPropagate,
         this, &SyncFileStatusTracker::slotAboutToPropagate);
-    connect(syncEngine, &SyncEngine::itemCompleted,
+    connect(source, &Source::aboutToPropagatePipelined,
+        this, &SyncFileStatusTracker::slotAboutToPropagatePipelined);
+    connect(source, &Source::itemCompleted,
         this, &SyncFileStatusTracker::slotItemCompleted);
-    connect(syncEngine, &SyncEngine::finished, this, &SyncFileStatusTracker::slotSyncFinished);
-    connect(syncEngine, &SyncEngine::started, this, &SyncFileStatusTracker::slotSyncEngineRunningChanged);
-    connect(syncEngine, &SyncEngine::finished, this, &SyncFileStatusTracker::slotSyncEngineRunningChanged);
+    connect(source, &Source::finished, this, &SyncFileStatusTracker::slotSyncFinished);
+    connect(source, &Source::started, this, &SyncFileStatusTracker::slotSyncEngineRunningChanged);
+    connect(source, &Source::finished, this, &SyncFileStatusTracker::slotSyncEngineRunningChanged);
+}
+
+SyncFileStatusTracker::SyncFileStatusTracker(SyncEngine *syncEngine)
+    : _syncEngine(syncEngine)
+{
+    connectTo(syncEngine);
+}
+
+void SyncFileStatusTracker::setRelay(SyncEngineRelay *relay)
+{
+    disconnect(_syncEngine, nullptr, this, nullptr);
+    connectTo(relay);
 }
 
 SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
@@ -131,6 +91,81 @@ SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
         return resolveSyncAndErrorStatus(QString(), NotShared);
     }
 
+    const auto tag = statusBeforeLookup(relativePath);
+    if (tag != SyncFileStatus::StatusNone)
+        return tag;
+
+    // First look it up in the database to know if it's shared, unless we already did
+    auto recordState = _index.recordState(relativePath);
+    if (recordState == SyncFileStatusIndex::RecordUnknown) {
+        SyncJournalFileRecord rec;
+        if (!_syncEngine->journal()->getFileRecord(relativePath, &rec))
+            return resolveSyncAndErrorStatus(relativePath, NotShared, PathUnknown);
+        if (!rec.isValid()) {
+            recordState = SyncFileStatusIndex::RecordMissing;
+        } else if (rec._remotePerm.hasPermission(RemotePermissions::IsShared)) {
+            recordState = SyncFileStatusIndex::RecordShared;
+        } else {
+            recordState = SyncFileStatusIndex::RecordNotShared;
+        }
+        _index.setRecordState(relativePath, recordState);
+    }
+    return resolveRecordState(relativePath, recordState);
+}
+
+QVector<SyncFileStatus> SyncFileStatusTracker::fileStatuses(const QString &relativeDirectory, const QStringList &names)
+{
+    ASSERT(!relativeDirectory.endsWith(QLatin1Char('/')));
+
+    QVector<SyncFileStatus> statuses;
+    statuses.reserve(names.size());
+    // The names that still need their database record, by index
+    QHash<QString, int> lookups;
+    QString relativePath;
+    for (int i = 0; i < names.size(); ++i) {
+        relativePath = relativeDirectory;
+        if (!relativePath.isEmpty())
+            relativePath += QLatin1Char('/');
+        relativePath += names[i];
+
+        const auto tag = statusBeforeLookup(relativePath);
+        if (tag != SyncFileStatus::StatusNone) {
+            statuses.append(tag);
+            continue;
+        }
+        const auto recordState = _index.recordState(relativePath);
+        if (recordState == SyncFileStatusIndex::RecordUnknown)
+            lookups.insert(names[i], i);
+        statuses.append(resolveRecordState(relativePath, recordState));
+    }
+    if (lookups.isEmpty())
+        return statuses;
+
+    // Whether each name known to the database is shared, from one query
+    // instead of one getFileRecord() per name
+    QHash<QString, SyncFileStatusIndex::RecordState> knownNames;
+    const bool ok = _syncEngine->journal()->listFilesInPath(relativeDirectory.toUtf8(), [&knownNames](const SyncJournalFileRecord &rec) {
+        const auto name = QString::fromUtf8(rec._path.mid(rec._path.lastIndexOf('/') + 1));
+        knownNames.insert(name, rec._remotePerm.hasPermission(RemotePermissions::IsShared) ? SyncFileStatusIndex::RecordShared : SyncFileStatusIndex::RecordNotShared);
+    });
+
+    for (auto it = lookups.constBegin(); it != lookups.constEnd(); ++it) {
+        relativePath = relativeDirectory;
+        if (!relativePath.isEmpty())
+            relativePath += QLatin1Char('/');
+        relativePath += it.key();
+
+        const auto recordState = knownNames.value(it.key(), SyncFileStatusIndex::RecordMissing);
+        // Like fileStatus(), don't remember anything the database couldn't tell
+        if (ok)
+            _index.setRecordState(relativePath, recordState);
+        statuses[it.value()] = resolveRecordState(relativePath, recordState);
+    }
+    return statuses;
+}
+
+SyncFileStatus::SyncFileStatusTag SyncFileStatusTracker::statusBeforeLookup(const QString &relativePath)
+{
     // The SyncEngine won't notify us at all for CSYNC_FILE_SILENTLY_EXCLUDED
     // and CSYNC_FILE_EXCLUDE_AND_REMOVE excludes. Even though it's possible
     // that the status of CSYNC_FILE_EXCLUDE_LIST excludes will change if the user
@@ -148,14 +183,7 @@ SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
     if (_dirtyPaths.contains(relativePath))
         return SyncFileStatus::StatusSync;
 
-    // First look it up in the database to know if it's shared
-    SyncJournalFileRecord rec;
-    if (_syncEngine->journal()->getFileRecord(relativePath, &rec) && rec.isValid()) {
-        return resolveSyncAndErrorStatus(relativePath, rec._remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared);
-    }
-
-    // Must be a new file not yet in the database, check if it's syncing or has an error.
-    return resolveSyncAndErrorStatus(relativePath, NotShared, PathUnknown);
+    return SyncFileStatus::StatusNone;
 }
 
 void SyncFileStatusTracker::slotPathTouched(const QString &fileName)
@@ -171,15 +199,14 @@ void SyncFileStatusTracker::slotPathTouched(const QString &fileName)
 
 void SyncFileStatusTracker::slotAddSilentlyExcluded(const QString &folderPath)
 {
-    _syncProblems[folderPath] = SyncFileStatus::StatusExcluded;
+    _index.setProblem(folderPath, SyncFileStatus::StatusExcluded);
     emit fileStatusChanged(getSystemDestination(folderPath), resolveSyncAndErrorStatus(folderPath, NotShared));
 }
 
 void SyncFileStatusTracker::incSyncCountAndEmitStatusChanged(const QString &relativePath, SharedFlag sharedFlag)
 {
-    // Will return 0 (and increase to 1) if the path wasn't in the map yet
-    int count = _syncCount[relativePath]++;
-    if (!count) {
+    // Will return 1 if the path wasn't syncing yet
+    if (_index.addSyncCount(relativePath, 1) == 1) {
         SyncFileStatus status = sharedFlag == UnknownShared
             ? fileStatus(relativePath)
             : resolveSyncAndErrorStatus(relativePath, sharedFlag);
@@ -198,11 +225,7 @@ void SyncFileStatusTracker::incSyncCountAndEmitStatusChanged(const QString &rela
 
 void SyncFileStatusTracker::decSyncCountAndEmitStatusChanged(const QString &relativePath, SharedFlag sharedFlag)
 {
-    int count = --_syncCount[relativePath];
-    if (!count) {
-        // Remove from the map, same as 0
-        _syncCount.remove(relativePath);
-
+    if (_index.addSyncCount(relativePath, -1) == 0) {
         SyncFileStatus status = sharedFlag == UnknownShared
             ? fileStatus(relativePath)
             : resolveSyncAndErrorStatus(relativePath, sharedFlag);
@@ -218,22 +241,28 @@ void SyncFileStatusTracker::decSyncCountAndEmitStatusChanged(const QString &rela
     }
 }
 
-void SyncFileStatusTracker::slotAboutToPropagate(SyncFileItemVector &items)
+void SyncFileStatusTracker::startPropagation()
 {
-    ASSERT(_syncCount.isEmpty());
+    if (_propagationStarted)
+        return;
+    ASSERT(!_index.hasSyncCounts());
 
-    ProblemsMap oldProblems;
-    std::swap(_syncProblems, oldProblems);
+    _oldProblems = _index.takeProblems();
+    _propagationStarted = true;
+}
 
+void SyncFileStatusTracker::announceItems(const SyncFileItemVector &items)
+{
     foreach (const SyncFileItemPtr &item, items) {
         qCDebug(lcStatusTracker) << "Investigating" << item->destination() << item->_status << item->_instruction;
         _dirtyPaths.remove(item->destination());
+        forgetRecordState(*item);
 
         if (hasErrorStatus(*item)) {
-            _syncProblems[item->destination()] = SyncFileStatus::StatusError;
+            _index.setProblem(item->destination(), SyncFileStatus::StatusError);
             invalidateParentPaths(item->destination());
         } else if (hasExcludedStatus(*item)) {
-            _syncProblems[item->destination()] = SyncFileStatus::StatusExcluded;
+            _index.setProblem(item->destination(), SyncFileStatus::StatusExcluded);
         }
 
         SharedFlag sharedFlag = item->_remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared;
@@ -247,6 +276,37 @@ void SyncFileStatusTracker::slotAboutToPropagate(SyncFileItemVector &items)
             emit fileStatusChanged(getSystemDestination(item->destination()), resolveSyncAndErrorStatus(item->destination(), sharedFlag));
         }
     }
+}
+
+void SyncFileStatusTracker::announceParentPaths()
+{
+    _collectParentPaths = false;
+    QStringList parentPaths = _invalidatedParentPaths.toList();
+    _invalidatedParentPaths.clear();
+    std::sort(parentPaths.begin(), parentPaths.end());
+    for (const auto &parentPath : qAsConst(parentPaths))
+        emit fileStatusChanged(getSystemDestination(parentPath), fileStatus(parentPath));
+}
+
+void SyncFileStatusTracker::slotAboutToPropagatePipelined(SyncFileItemVector &items)
+{
+    startPropagation();
+
+    _collectParentPaths = true;
+    announceItems(items);
+    announceParentPaths();
+}
+
+void SyncFileStatusTracker::slotAboutToPropagate(SyncFileItemVector &items)
+{
+    startPropagation();
+    const auto oldProblems = std::move(_oldProblems);
+    _oldProblems.clear();
+    _propagationStarted = false;
+
+    // A parent shared by many items is announced once, after all of them
+    _collectParentPaths = true;
+    announceItems(items);
 
     // Some metadata status won't trigger files to be synced, make sure that we
     // push the OK status for dirty files that don't need to be propagated.
@@ -258,29 +318,35 @@ void SyncFileStatusTracker::slotAboutToPropagate(SyncFileItemVector &items)
 
     // Make sure to push any status that might have been resolved indirectly since the last sync
     // (like an error file being deleted from disk)
-    for (const auto &syncProblem : _syncProblems)
-        oldProblems.erase(syncProblem.first);
     for (const auto &oldProblem : oldProblems) {
         const QString &path = oldProblem.first;
-        SyncFileStatus::SyncFileStatusTag severity = oldProblem.second;
-        if (severity == SyncFileStatus::StatusError)
+        if (_index.problem(path) != SyncFileStatus::StatusNone)
+            continue;
+        if (oldProblem.second == SyncFileStatus::StatusError)
             invalidateParentPaths(path);
         emit fileStatusChanged(getSystemDestination(path), fileStatus(path));
     }
+
+    announceParentPaths();
 }
 
 void SyncFileStatusTracker::slotItemCompleted(const SyncFileItemPtr &item)
 {
     qCDebug(lcStatusTracker) << "Item completed" << item->destination() << item->_status << item->_instruction;
 
+    forgetRecordState(*item);
+
+    // Only the parents that start or stop having an error below them change
+    int changedParents = 0;
     if (hasErrorStatus(*item)) {
-        _syncProblems[item->destination()] = SyncFileStatus::StatusError;
-        invalidateParentPaths(item->destination());
+        changedParents = _index.setProblem(item->destination(), SyncFileStatus::StatusError);
     } else if (hasExcludedStatus(*item)) {
-        _syncProblems[item->destination()] = SyncFileStatus::StatusExcluded;
+        changedParents = _index.setProblem(item->destination(), SyncFileStatus::StatusExcluded);
     } else {
-        _syncProblems.erase(item->destination());
+        changedParents = _index.setProblem(item->destination(), SyncFileStatus::StatusNone);
     }
+    if (changedParents > 0)
+        invalidateParentPaths(item->destination(), changedParents);
 
     SharedFlag sharedFlag = item->_remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared;
     if (item->_instruction != CSYNC_INSTRUCTION_NONE
@@ -297,20 +363,21 @@ void SyncFileStatusTracker::slotItemCompleted(const SyncFileItemPtr &item)
 void SyncFileStatusTracker::slotSyncFinished()
 {
     // Clear the sync counts to reduce the impact of unsymetrical inc/dec calls (e.g. when directory job abort)
-    QHash<QString, int> oldSyncCount;
-    std::swap(_syncCount, oldSyncCount);
-    for (auto it = oldSyncCount.begin(); it != oldSyncCount.end(); ++it) {
-        // Don't announce folders, fileStatus expect only paths without '/', otherwise it asserts
-        if (it.key().endsWith('/')) {
-            continue;
-        }
+    const auto oldSyncCountPaths = _index.takeSyncCounts();
+    for (const auto &path : oldSyncCountPaths)
+        emit fileStatusChanged(getSystemDestination(path), fileStatus(path));
 
-        emit fileStatusChanged(getSystemDestination(it.key()), fileStatus(it.key()));
+    // Aborted while pipelined items were propagated during the discovery
+    if (_propagationStarted) {
+        SyncFileItemVector noItems;
+        slotAboutToPropagate(noItems);
     }
 }
 
 void SyncFileStatusTracker::slotSyncEngineRunningChanged()
 {
+    // The database records change during a sync, look them up again
+    _index.clearRecordStates();
     emit fileStatusChanged(getSystemDestination(QString()), resolveSyncAndErrorStatus(QString(), NotShared));
 }
 
@@ -319,12 +386,12 @@ SyncFileStatus SyncFileStatusTracker::resolveSyncAndErrorStatus(const QString &r
     // If it's a new file and that we're not syncing it yet,
     // don't show any icon and wait for the filesystem watcher to trigger a sync.
     SyncFileStatus status(isPathKnown ? SyncFileStatus::StatusUpToDate : SyncFileStatus::StatusNone);
-    if (_syncCount.value(relativePath)) {
+    if (_index.syncCount(relativePath)) {
         status.set(SyncFileStatus::StatusSync);
     } else {
         // After a sync finished, we need to show the users issues from that last sync like the activity list does.
         // Also used for parent directories showing a warning for an error child.
-        SyncFileStatus::SyncFileStatusTag problemStatus = lookupProblem(relativePath, _syncProblems);
+        SyncFileStatus::SyncFileStatusTag problemStatus = _index.effectiveProblem(relativePath);
         if (problemStatus != SyncFileStatus::StatusNone)
             status.set(problemStatus);
     }
@@ -337,12 +404,41 @@ SyncFileStatus SyncFileStatusTracker::resolveSyncAndErrorStatus(const QString &r
     return status;
 }
 
-void SyncFileStatusTracker::invalidateParentPaths(const QString &path)
+SyncFileStatus SyncFileStatusTracker::resolveRecordState(const QString &relativePath, SyncFileStatusIndex::RecordState recordState)
 {
-    QStringList splitPath = path.split('/', QString::SkipEmptyParts);
-    for (int i = 0; i < splitPath.size(); ++i) {
-        QString parentPath = QStringList(splitPath.mid(0, i)).join(QLatin1String("/"));
-        emit fileStatusChanged(getSystemDestination(parentPath), fileStatus(parentPath));
+    switch (recordState) {
+    case SyncFileStatusIndex::RecordShared:
+        return resolveSyncAndErrorStatus(relativePath, Shared);
+    case SyncFileStatusIndex::RecordNotShared:
+        return resolveSyncAndErrorStatus(relativePath, NotShared);
+    case SyncFileStatusIndex::RecordUnknown:
+    case SyncFileStatusIndex::RecordMissing:
+        break;
+    }
+    // Must be a new file not yet in the database, check if it's syncing or has an error.
+    return resolveSyncAndErrorStatus(relativePath, NotShared, PathUnknown);
+}
+
+void SyncFileStatusTracker::forgetRecordState(const SyncFileItem &item)
+{
+    _index.setRecordState(item.destination(), SyncFileStatusIndex::RecordUnknown);
+    if (item._file != item.destination())
+        _index.setRecordState(item._file, SyncFileStatusIndex::RecordUnknown);
+}
+
+void SyncFileStatusTracker::invalidateParentPaths(const QString &path, int levels)
+{
+    // Nearest parent first
+    int slash = path.size();
+    while (levels != 0 && slash > 0) {
+        slash = qMax(0, path.lastIndexOf(QLatin1Char('/'), slash - 1));
+        const QString parentPath = path.left(slash);
+        if (_collectParentPaths) {
+            _invalidatedParentPaths.insert(parentPath);
+        } else {
+            emit fileStatusChanged(getSystemDestination(parentPath), fileStatus(parentPath));
+        }
+        --levels;
     }
 }
 
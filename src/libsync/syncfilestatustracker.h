@@ -18,13 +18,14 @@
 
 // #include "ownsql.h"
 #include "syncfileitem.h"
+#include "syncfilestatusindex.h"
 #include "common/syncfilestatus.h"
-#include <map>
 #include <QSet>
 
 namespace OCC {
 
 class SyncEngine;
+class SyncEngineRelay;
 
 /**
  * @brief Takes care of tracking the status of individual files as they
@@ -38,6 +39,23 @@ public:
     explicit SyncFileStatusTracker(SyncEngine *syncEngine);
     SyncFileStatus fileStatus(const QString &relativePath);
 
+    /**
+     * The statuses of the entries \a names of the directory \a relativeDirectory,
+     * in the same order.
+     *
+     * Same as calling fileStatus() for each of them, but the database records
+     * of the whole directory are read with a single query.
+     */
+    QVector<SyncFileStatus> fileStatuses(const QString &relativeDirectory, const QStringList &names);
+
+    /**
+     * Follows the engine through \a relay instead of its own signals.
+     *
+     * For an engine on another thread: the tracker stays in the thread of
+     * \a relay, where its statuses are asked for.
+     */
+    void setRelay(SyncEngineRelay *relay);
+
 public slots:
     void slotPathTouched(const QString &fileName);
     // path relative to folder
@@ -48,37 +66,58 @@ signals:
 
 private slots:
     void slotAboutToPropagate(SyncFileItemVector &items);
+    void slotAboutToPropagatePipelined(SyncFileItemVector &items);
     void slotItemCompleted(const SyncFileItemPtr &item);
     void slotSyncFinished();
     void slotSyncEngineRunningChanged();
 
 private:
-    struct PathComparator {
-        bool operator()( const QString& lhs, const QString& rhs ) const;
-    };
-    using ProblemsMap = std::map<QString, SyncFileStatus::SyncFileStatusTag, PathComparator>;
-    SyncFileStatus::SyncFileStatusTag lookupProblem(const QString &pathToMatch, const ProblemsMap &problemMap);
-
     enum SharedFlag { UnknownShared,
         NotShared,
         Shared };
     enum PathKnownFlag { PathUnknown = 0,
         PathKnown };
+    /// Connects to the signals of the SyncEngine or SyncEngineRelay \a source
+    template <typename Source>
+    void connectTo(Source *source);
+
+    /// The status of \a relativePath if it doesn't depend on its database record, StatusNone otherwise
+    SyncFileStatus::SyncFileStatusTag statusBeforeLookup(const QString &relativePath);
     SyncFileStatus resolveSyncAndErrorStatus(const QString &relativePath, SharedFlag sharedState, PathKnownFlag isPathKnown = PathKnown);
+    SyncFileStatus resolveRecordState(const QString &relativePath, SyncFileStatusIndex::RecordState recordState);
+    void forgetRecordState(const SyncFileItem &item);
 
-    void invalidateParentPaths(const QString &path);
+    /// Announces the status of the \a levels nearest parents of \a path, all of them by default
+    void invalidateParentPaths(const QString &path, int levels = -1);
     QString getSystemDestination(const QString &relativePath);
     void incSyncCountAndEmitStatusChanged(const QString &relativePath, SharedFlag sharedState);
+
+    /// Takes over the problems of the last sync, once per sync
+    void startPropagation();
+    /// Marks \a items as syncing, or shows their status
+    void announceItems(const SyncFileItemVector &items);
+    /// Announces the parent paths collected since _collectParentPaths was set
+    void announceParentPaths();
     void decSyncCountAndEmitStatusChanged(const QString &relativePath, SharedFlag sharedState);
 
     SyncEngine *_syncEngine;
 
-    ProblemsMap _syncProblems;
     QSet<QString> _dirtyPaths;
-    // Counts the number direct children currently being synced (has unfinished propagation jobs).
+    // Holds the problems of the last sync and, per path, the number of direct children currently
+    // being synced (has unfinished propagation jobs).
     // We'll show a file/directory as SYNC as long as its sync count is > 0.
     // A directory that starts/ends propagation will in turn increase/decrease its own parent by 1.
-    QHash<QString, int> _syncCount;
+    // Also caches what the database knows about the paths that were asked for.
+    SyncFileStatusIndex _index;
+
+    // While slotAboutToPropagate() runs, parent paths are collected here and announced once
+    bool _collectParentPaths = false;
+    QSet<QString> _invalidatedParentPaths;
+
+    // Set by startPropagation() until slotAboutToPropagate(), which announces the
+    // old problems that weren't found again.
+    bool _propagationStarted = false;
+    QVector<SyncFileStatusIndex::Problem> _oldProblems;
 };
 }
 
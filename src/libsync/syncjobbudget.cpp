@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "syncjobbudget.h"
+#include "common/asserts.h"
+
+#include <QtGlobal>
+
+namespace OCC {
+
+void SyncJobBudget::join()
+{
+    _participants.ref();
+}
+
+void SyncJobBudget::leave()
+{
+    _participants.deref();
+    ASSERT(_participants.loadAcquire() >= 0);
+}
+
+int SyncJobBudget::share(int total) const
+{
+    return qMax(1, total / qMax(1, participants()));
+}
+}
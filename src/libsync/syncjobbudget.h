@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef SYNCJOBBUDGET_H
+#define SYNCJOBBUDGET_H
+
+#include "owncloudlib.h"
+
+#include <QAtomicInt>
+
+namespace OCC {
+
+/**
+ * @brief Network job budget shared by all folders that propagate at the same time
+ * @ingroup libsync
+ *
+ * When several folders sync concurrently, each propagator joins the budget
+ * while it runs. The configured number of parallel network jobs then becomes
+ * a global limit that is split evenly between the participants instead of
+ * being available to each folder in full.
+ *
+ * Disk I/O heavy work (checksums, local discovery) already runs on process
+ * wide thread pools and is shared implicitly.
+ */
+class OWNCLOUDSYNC_EXPORT SyncJobBudget
+{
+public:
+    /// A propagator started running
+    void join();
+    /// A propagator that joined is done
+    void leave();
+
+    /// Number of propagators currently sharing the budget
+    int participants() const { return _participants.loadAcquire(); }
+
+    /// The part of \a total a single participant may use, at least 1
+    int share(int total) const;
+
+private:
+    QAtomicInt _participants;
+};
+}
+
+#endif
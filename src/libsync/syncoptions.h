@@ -19,6 +19,7 @@
 #include <QSharedPointer>
 #include <chrono>
 #include "common/vfs.h"
+#include "syncjobbudget.h"
 
 namespace OCC {
 
@@ -65,8 +66,63 @@ struct OWNCLOUDSYNC_EXPORT SyncOptions
      */
     std::chrono::milliseconds _targetChunkUploadDuration = std::chrono::minutes(1);
 
+    /** The maximum number of chunks of one file that chunkingNG uploads in parallel.
+     *
+     * The number actually in flight adapts to the measured throughput.
+     * Set to 1 to upload the chunks one after another.
+     */
+    int _maxParallelChunks = 4;
+
     /** The maximum number of active jobs in parallel  */
     int _parallelNetworkJobs = 6;
+
+    /** Number of file records the journal queues before writing them in one batch
+     * during propagation.
+     *
+     * Values of 0 or 1 write every record immediately.
+     * See SyncJournalDb::setFileRecordWriteBehind().
+     */
+    int _journalWriteBehindBatchSize = 0;
+
+    /** The longest time a queued file record may wait before its batch is written */
+    std::chrono::milliseconds _journalWriteBehindInterval = std::chrono::seconds(1);
+
+    /** Size of the buffer downloads are read into before they are written to disk.
+     *
+     * Only used when no download bandwidth limit is active, limited downloads
+     * keep reading in small slices.
+     */
+    qint64 _downloadBufferSize = 1024 * 1024; // 1 MiB
+
+    /** Whether directories unknown to the database are listed with their whole
+     * subtree in one request (PROPFIND with Depth: infinity) during discovery.
+     *
+     * Speeds up the first sync of large trees a lot, if the server allows it.
+     */
+    bool _remoteSubtreeListing = true;
+
+    /** Number of threads that list the local tree in parallel ahead of the discovery.
+     *
+     * Only used when the whole local tree is discovered. 0 lists every local
+     * directory on demand with one job each.
+     */
+    int _localDiscoveryThreads = 4;
+
+    /** Whether transfers may start while the discovery is still running.
+     *
+     * New and changed files whose directory is unchanged, and new directories
+     * with all their content, are propagated as soon as they are discovered.
+     * Everything else, including moves and deletions, waits for the end of the
+     * discovery and runs after them.
+     */
+    bool _pipelinedPropagation = false;
+
+    /** Budget shared with the other folders syncing at the same time
+     *
+     * If set, _parallelNetworkJobs is split between all propagators that use
+     * the same budget. May be null.
+     */
+    QSharedPointer<SyncJobBudget> _jobBudget;
 };
 
 
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "transferconcurrency.h"
+
+#include <QLoggingCategory>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcTransferConcurrency, "nextcloud.sync.propagator.concurrency", QtInfoMsg)
+
+constexpr qint64 TransferConcurrency::quickTransferMsec;
+constexpr qint64 TransferConcurrency::defaultQuickTransferSize;
+constexpr qint64 TransferConcurrency::defaultLatencyMsec;
+constexpr qint64 TransferConcurrency::latencyProbeSize;
+
+// Relative change of the aggregate throughput that counts as an improvement / a drop
+static const double increaseThreshold = 1.05;
+static const double decreaseThreshold = 0.8;
+// Multiplicative decrease factor
+static const double backoffFactor = 0.7;
+// After this many epochs without a change, probe with one more transfer anyway
+static const int probeAfterHoldEpochs = 4;
+
+void TransferConcurrency::reset(int initialLimit, int maximumLimit)
+{
+    *this = TransferConcurrency();
+    _maximumLimit = qMax(1, maximumLimit);
+    _limit = qBound(1, initialLimit, _maximumLimit);
+}
+
+void TransferConcurrency::transferFinished(qint64 bytes, qint64 durationMsec, int concurrency)
+{
+    durationMsec = qMax<qint64>(1, durationMsec);
+    concurrency = qMax(1, concurrency);
+
+    if (bytes < latencyProbeSize) {
+        // Small transfers are dominated by the request round trip
+        if (_minLatencyMsec < 0 || durationMsec < _minLatencyMsec)
+            _minLatencyMsec = durationMsec;
+        _smoothedLatencyMsec = _smoothedLatencyMsec < 0
+            ? durationMsec
+            : (7 * _smoothedLatencyMsec + durationMsec) / 8;
+    } else {
+        const qint64 throughput = bytes * 1000 / durationMsec;
+        _throughputPerTransfer = _throughputPerTransfer == 0
+            ? throughput
+            : (3 * _throughputPerTransfer + throughput) / 4;
+    }
+
+    _epochTransfers++;
+    _epochBytes += bytes;
+    _epochMsec += durationMsec;
+    _epochConcurrency += concurrency;
+
+    if (_epochTransfers >= _limit)
+        endEpoch();
+}
+
+void TransferConcurrency::congestionDetected()
+{
+    _epochCongested = true;
+}
+
+void TransferConcurrency::endEpoch()
+{
+    // Mean throughput of a single transfer times the mean number of transfers
+    // that were running at the same time.
+    const qint64 throughput = _epochBytes * 1000 / qMax<qint64>(1, _epochMsec)
+        * _epochConcurrency / _epochTransfers;
+    const bool queueing = _minLatencyMsec > 0 && _smoothedLatencyMsec > 4 * _minLatencyMsec + 50;
+    const bool dropped = _previousThroughput > 0 && throughput < _previousThroughput * decreaseThreshold;
+
+    const int oldLimit = _limit;
+    if (_epochCongested || queueing || dropped) {
+        _limit = qMax(1, static_cast<int>(_limit * backoffFactor));
+        _holdEpochs = 0;
+        // Measure the latency anew at the lower concurrency
+        _smoothedLatencyMsec = -1;
+    } else if (_previousThroughput == 0 || throughput > _previousThroughput * increaseThreshold
+        || ++_holdEpochs >= probeAfterHoldEpochs) {
+        _limit = qMin(_maximumLimit, _limit + 1);
+        _holdEpochs = 0;
+    }
+
+    if (_limit != oldLimit) {
+        qCInfo(lcTransferConcurrency) << "Parallel transfers" << oldLimit << "->" << _limit
+                                      << "throughput:" << throughput << "previous:" << _previousThroughput
+                                      << "congested:" << _epochCongested << "queueing:" << queueing;
+    }
+
+    _previousThroughput = throughput;
+    _epochTransfers = 0;
+    _epochBytes = 0;
+    _epochMsec = 0;
+    _epochConcurrency = 0;
+    _epochCongested = false;
+}
+
+qint64 TransferConcurrency::estimatedDurationMsec(qint64 bytes) const
+{
+    if (_throughputPerTransfer <= 0)
+        return latencyMsec() + bytes * quickTransferMsec / defaultQuickTransferSize;
+    return latencyMsec() + bytes * 1000 / _throughputPerTransfer;
+}
+
+qint64 TransferConcurrency::quickTransferSize() const
+{
+    if (_throughputPerTransfer <= 0)
+        return defaultQuickTransferSize;
+    const qint64 budgetMsec = qMax<qint64>(0, quickTransferMsec - latencyMsec());
+    return qBound<qint64>(16 * 1024, budgetMsec * _throughputPerTransfer / 1000, 1024 * 1024 * 1024);
+}
+}
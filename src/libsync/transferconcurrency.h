@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef TRANSFERCONCURRENCY_H
+#define TRANSFERCONCURRENCY_H
+
+#include "owncloudlib.h"
+
+#include <QtGlobal>
+
+namespace OCC {
+
+/**
+ * @brief Adapts the number of parallel transfers to the observed network
+ * @ingroup libsync
+ *
+ * The controller is fed with every finished transfer (bytes, duration and
+ * the number of jobs that were running alongside it) and with congestion
+ * signals from the server (503, 429, timeouts).
+ *
+ * The transfer limit follows an AIMD scheme that is evaluated once per epoch,
+ * an epoch being as many finished transfers as the current limit:
+ *  - If the aggregate throughput went up noticeably compared to the previous
+ *    epoch, one more parallel transfer is allowed (additive increase).
+ *  - If the server signaled congestion, the aggregate throughput dropped
+ *    noticeably, or the latency of cheap requests grew far beyond the best one
+ *    seen (queueing), the limit is reduced multiplicatively.
+ *  - Otherwise the limit is kept.
+ *
+ * The same measurements are used to estimate how long a transfer of a given
+ * size will take, which replaces a fixed size threshold for deciding whether
+ * a job is likely to finish quickly.
+ */
+class OWNCLOUDSYNC_EXPORT TransferConcurrency
+{
+public:
+    /** Resets all measurements and sets the bounds of the transfer limit
+     *
+     * The limit starts out at \a initialLimit and stays within [1, maximumLimit].
+     */
+    void reset(int initialLimit, int maximumLimit);
+
+    /// The number of transfers that may currently run in parallel
+    int limit() const { return _limit; }
+    int maximumLimit() const { return _maximumLimit; }
+
+    /** A transfer finished successfully
+     *
+     * \a concurrency is the number of jobs that were active while it ran,
+     * including itself.
+     */
+    void transferFinished(qint64 bytes, qint64 durationMsec, int concurrency);
+
+    /// The server signaled overload, the limit will be reduced at the end of the epoch
+    void congestionDetected();
+
+    /// Best guess for the latency of a request, in milliseconds
+    qint64 latencyMsec() const { return _minLatencyMsec < 0 ? defaultLatencyMsec : _minLatencyMsec; }
+
+    /// Best guess for the throughput of a single transfer, in bytes per second
+    qint64 throughputPerTransfer() const { return _throughputPerTransfer; }
+
+    /// Estimated duration of a transfer of \a bytes, in milliseconds
+    qint64 estimatedDurationMsec(qint64 bytes) const;
+
+    /** Size below which a transfer is expected to finish quickly
+     *
+     * Before any measurement this is the historic 100 KiB.
+     */
+    qint64 quickTransferSize() const;
+
+    /// Transfers that are estimated to finish within this time are considered quick
+    static constexpr qint64 quickTransferMsec = 1000;
+    static constexpr qint64 defaultQuickTransferSize = 100 * 1024;
+    static constexpr qint64 defaultLatencyMsec = 100;
+    /// Transfers smaller than this are dominated by latency and used to measure it
+    static constexpr qint64 latencyProbeSize = 64 * 1024;
+
+private:
+    void endEpoch();
+
+    int _limit = 1;
+    int _maximumLimit = 1;
+
+    // Measurements of the current epoch
+    int _epochTransfers = 0;
+    qint64 _epochBytes = 0;
+    qint64 _epochMsec = 0;
+    qint64 _epochConcurrency = 0;
+    bool _epochCongested = false;
+    int _holdEpochs = 0;
+
+    // Aggregate throughput of the previous epoch, bytes per second
+    qint64 _previousThroughput = 0;
+
+    qint64 _throughputPerTransfer = 0;
+    qint64 _minLatencyMsec = -1;
+    qint64 _smoothedLatencyMsec = -1;
+};
+}
+
+#endif
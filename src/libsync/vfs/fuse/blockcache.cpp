@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "blockcache.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <vector>
+
+Q_LOGGING_CATEGORY(lcBlockCache, "nextcloud.sync.vfs.fuse.blockcache", QtInfoMsg)
+
+namespace OCC {
+
+BlockCache::BlockCache(const QString &directory, qint64 blockSize, qint64 maxSize)
+    : _directory(directory)
+    , _blockSize(blockSize)
+    , _maxSize(maxSize)
+{
+    load();
+}
+
+QByteArray BlockCache::key(const QByteArray &fileId, const QByteArray &etag)
+{
+    return QCryptographicHash::hash(fileId + '\n' + etag, QCryptographicHash::Sha1).toHex();
+}
+
+QString BlockCache::entryName(const QByteArray &key, qint64 index)
+{
+    return QString::fromLatin1(key) + QLatin1Char('/') + QString::number(index);
+}
+
+qint64 BlockCache::size() const
+{
+    QMutexLocker locker(&_mutex);
+    return _size;
+}
+
+bool BlockCache::contains(const QByteArray &key, qint64 index) const
+{
+    QMutexLocker locker(&_mutex);
+    return _entries.contains(entryName(key, index));
+}
+
+Optional<QByteArray> BlockCache::block(const QByteArray &key, qint64 index)
+{
+    const auto name = entryName(key, index);
+    {
+        QMutexLocker locker(&_mutex);
+        auto it = _entries.find(name);
+        if (it == _entries.end())
+            return {};
+        it->lastUse = ++_useCounter;
+    }
+
+    // Read without the lock, the block may get evicted meanwhile
+    QFile file(_directory + QLatin1Char('/') + name);
+    if (!file.open(QIODevice::ReadOnly))
+        return {};
+    return file.readAll();
+}
+
+bool BlockCache::insert(const QByteArray &key, qint64 index, const QByteArray &data)
+{
+    const auto name = entryName(key, index);
+    const auto path = _directory + QLatin1Char('/') + name;
+    if (!QDir().mkpath(QFileInfo(path).path())) {
+        qCWarning(lcBlockCache) << "Could not create the cache directory for" << path;
+        return false;
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        qCWarning(lcBlockCache) << "Could not store block" << path << file.errorString();
+        return false;
+    }
+
+    QMutexLocker locker(&_mutex);
+    auto &entry = _entries[name];
+    _size += data.size() - entry.size;
+    entry.size = data.size();
+    entry.lastUse = ++_useCounter;
+    evict();
+    return true;
+}
+
+void BlockCache::remove(const QByteArray &key)
+{
+    const auto prefix = QString::fromLatin1(key) + QLatin1Char('/');
+    QMutexLocker locker(&_mutex);
+    for (auto it = _entries.begin(); it != _entries.end();) {
+        if (it.key().startsWith(prefix)) {
+            _size -= it->size;
+            it = _entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    QDir(_directory + QLatin1Char('/') + prefix).removeRecursively();
+}
+
+void BlockCache::load()
+{
+    QDir dir(_directory);
+    if (!dir.exists())
+        return;
+
+    std::vector<std::pair<QDateTime, QString>> files;
+    QDirIterator it(_directory, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        const auto info = it.fileInfo();
+        files.emplace_back(info.lastModified(), dir.relativeFilePath(info.filePath()));
+        _entries.insert(files.back().second, Entry { info.size(), 0 });
+        _size += info.size();
+    }
+
+    std::sort(files.begin(), files.end());
+    for (const auto &file : files)
+        _entries[file.second].lastUse = ++_useCounter;
+
+    evict();
+}
+
+void BlockCache::evict()
+{
+    if (_size <= _maxSize)
+        return;
+
+    std::vector<std::pair<quint64, QString>> byUse;
+    byUse.reserve(_entries.size());
+    for (auto it = _entries.cbegin(); it != _entries.cend(); ++it)
+        byUse.emplace_back(it->lastUse, it.key());
+    std::sort(byUse.begin(), byUse.end());
+
+    for (const auto &use : byUse) {
+        if (_size <= _maxSize)
+            break;
+        _size -= _entries.take(use.second).size;
+        QFile::remove(_directory + QLatin1Char('/') + use.second);
+    }
+    qCDebug(lcBlockCache) << "Cache size after eviction" << _size;
+}
+
+} // namespace OCC
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+#include "owncloudlib.h"
+#include "common/result.h"
+
+namespace OCC {
+
+/**
+ * @brief On-disk cache for blocks of remote file contents
+ * @ingroup libsync
+ *
+ * The contents of a file version (see key()) are split into blocks of
+ * blockSize() bytes, only the last one can be shorter. Every block is
+ * stored in a file of its own below the cache directory.
+ *
+ * When the blocks take more than the maximum size, the least recently
+ * used ones are removed. The usage order survives restarts only roughly,
+ * through the modification times of the block files.
+ *
+ * All functions are thread safe.
+ */
+class OWNCLOUDSYNC_EXPORT BlockCache
+{
+public:
+    BlockCache(const QString &directory, qint64 blockSize, qint64 maxSize);
+
+    /// Identifies a version of a file
+    static QByteArray key(const QByteArray &fileId, const QByteArray &etag);
+
+    QString directory() const { return _directory; }
+    qint64 blockSize() const { return _blockSize; }
+
+    /// The number of bytes all blocks take
+    qint64 size() const;
+
+    bool contains(const QByteArray &key, qint64 index) const;
+
+    /// The block, if it is cached
+    Optional<QByteArray> block(const QByteArray &key, qint64 index);
+
+    /// Stores a block, possibly removing older ones
+    bool insert(const QByteArray &key, qint64 index, const QByteArray &data);
+
+    /// Removes all blocks of a file version
+    void remove(const QByteArray &key);
+
+private:
+    struct Entry
+    {
+        qint64 size = 0;
+        quint64 lastUse = 0;
+    };
+
+    static QString entryName(const QByteArray &key, qint64 index);
+    void load();
+    void evict();
+
+    QString _directory;
+    qint64 _blockSize;
+    qint64 _maxSize;
+
+    mutable QMutex _mutex; // Protects the members below
+    QHash<QString, Entry> _entries; // by entryName()
+    qint64 _size = 0;
+    quint64 _useCounter = 0;
+};
+
+} // namespace OCC
@@ -0,0 +1,592 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "fusefilesystem.h"
+#include "blockcache.h"
+#include "rangegetjob.h"
+
+#include "common/syncjournaldb.h"
+#include "common/syncjournalfilerecord.h"
+
+#include <QElapsedTimer>
+#include <QLoggingCategory>
+#include <QSharedPointer>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+Q_LOGGING_CATEGORY(lcFuseFs, "nextcloud.sync.vfs.fuse.filesystem", QtInfoMsg)
+
+namespace OCC {
+
+QString createDownloadTmpFileName(const QString &previous);
+
+constexpr qint64 FuseFileSystem::blockSize;
+constexpr qint64 FuseFileSystem::maxBlocksPerRequest;
+constexpr uint64_t FuseFileSystem::placeholderHandle;
+const char FuseFileSystem::placeholderAttribute[] = "user.nextcloud.fuse.size";
+
+static QString blockId(const QByteArray &key, qint64 index)
+{
+    return QString::fromLatin1(key) + QLatin1Char('/') + QString::number(index);
+}
+
+// The event loop that runs the downloads may be stuck, a handler waits no
+// longer than a request may take
+static qint64 waitTimeoutMs()
+{
+    return AbstractNetworkJob::httpTimeout * 1000LL;
+}
+
+static bool isPlaceholderAttribute(const char *name)
+{
+    return std::strcmp(name, FuseFileSystem::placeholderAttribute) == 0;
+}
+
+FuseFileSystem::FuseFileSystem(const QByteArray &backingRoot, const VfsSetupParams &params, BlockCache *cache, QObject *parent)
+    : QObject(parent)
+    , _backingRoot(backingRoot)
+    , _params(params)
+    , _cache(cache)
+    // Created in the thread that runs the network requests
+    , _networkThreadId(static_cast<pid_t>(syscall(SYS_gettid)))
+{
+    if (_backingRoot.endsWith('/'))
+        _backingRoot.chop(1);
+}
+
+FuseFileSystem::~FuseFileSystem()
+{
+    abortRequests();
+}
+
+QByteArray FuseFileSystem::backingPath(const QByteArray &path) const
+{
+    if (path.isEmpty())
+        return _backingRoot;
+    return _backingRoot + '/' + path;
+}
+
+Optional<qint64> FuseFileSystem::placeholderSize(const QByteArray &path) const
+{
+    char value[32];
+    const auto length = ::getxattr(backingPath(path).constData(), placeholderAttribute, value, sizeof(value) - 1);
+    if (length < 0)
+        return {};
+    value[length] = '\0';
+    return QByteArray(value).toLongLong();
+}
+
+bool FuseFileSystem::isPlaceholder(const QByteArray &path) const
+{
+    return static_cast<bool>(placeholderSize(path));
+}
+
+Result<void, QString> FuseFileSystem::makePlaceholder(const QByteArray &path, qint64 size, time_t modtime)
+{
+    const auto backing = backingPath(path);
+    const int fd = ::open(backing.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0)
+        return QString::fromLocal8Bit(strerror(errno));
+
+    const auto value = QByteArray::number(size);
+    const auto attributeResult = ::fsetxattr(fd, placeholderAttribute, value.constData(), value.size(), 0);
+    const auto attributeErrno = errno;
+    ::close(fd);
+    if (attributeResult != 0) {
+        ::unlink(backing.constData());
+        return QStringLiteral("Failed to set the extended attribute: %1").arg(QString::fromLocal8Bit(strerror(attributeErrno)));
+    }
+
+    const struct timespec times[2] = { { 0, UTIME_OMIT }, { modtime, 0 } };
+    ::utimensat(AT_FDCWD, backing.constData(), times, 0);
+    return {};
+}
+
+Result<void, QString> FuseFileSystem::hydrate(const QByteArray &path, pid_t caller)
+{
+    const auto size = placeholderSize(path);
+    if (!size)
+        return {};
+
+    SyncJournalFileRecord record;
+    if (!_params.journal->getFileRecord(path, &record) || !record.isValid())
+        return QStringLiteral("No database entry for %1").arg(QString::fromUtf8(path));
+
+    const auto backing = backingPath(path);
+    struct stat st;
+    if (::stat(backing.constData(), &st) != 0)
+        return QString::fromLocal8Bit(strerror(errno));
+
+    _hydrations.ref();
+    emit hydrationStarted();
+    qCInfo(lcFuseFs) << "Hydrating" << path;
+
+    // Write next to the placeholder and replace it once complete
+    const auto tmpPath = createDownloadTmpFileName(QString::fromUtf8(backing)).toUtf8();
+    auto result = [&]() -> Result<void, QString> {
+        const int fd = ::open(tmpPath.constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777);
+        if (fd < 0)
+            return QString::fromLocal8Bit(strerror(errno));
+
+        const auto blockCount = (*size + blockSize - 1) / blockSize;
+        for (qint64 first = 0; first < blockCount; first += maxBlocksPerRequest) {
+            const auto last = qMin(first + maxBlocksPerRequest, blockCount) - 1;
+            QVector<QByteArray> blocks;
+            if (const auto error = fetchBlocks(path, record, *size, first, last, &blocks, caller)) {
+                ::close(fd);
+                return QString::fromLocal8Bit(strerror(-error));
+            }
+            for (const auto &block : qAsConst(blocks)) {
+                if (::write(fd, block.constData(), block.size()) != block.size()) {
+                    const auto error = errno;
+                    ::close(fd);
+                    return QString::fromLocal8Bit(strerror(error));
+                }
+            }
+        }
+
+        const struct timespec times[2] = { { 0, UTIME_OMIT }, st.st_mtim };
+        ::futimens(fd, times);
+        struct stat tmpSt;
+        ::fstat(fd, &tmpSt);
+        if (::close(fd) != 0 || ::rename(tmpPath.constData(), backing.constData()) != 0)
+            return QString::fromLocal8Bit(strerror(errno));
+
+        // Like a download by the sync, the database must not consider it virtual anymore
+        record._type = ItemTypeFile;
+        record._inode = tmpSt.st_ino;
+        _params.journal->setFileRecord(record);
+        _cache->remove(BlockCache::key(record._fileId, record._etag));
+        return {};
+    }();
+
+    if (!result) {
+        qCWarning(lcFuseFs) << "Hydration of" << path << "failed:" << result.error();
+        ::unlink(tmpPath.constData());
+    }
+    _hydrations.deref();
+    emit hydrationDone();
+    return result;
+}
+
+void FuseFileSystem::abortRequests()
+{
+    QMutexLocker locker(&_mutex);
+    _aborted = true;
+    _changed.wakeAll();
+}
+
+int FuseFileSystem::fetchBlocks(const QByteArray &path, const SyncJournalFileRecord &record, qint64 fileSize,
+    qint64 first, qint64 last, QVector<QByteArray> *blocks, pid_t caller)
+{
+    const auto key = BlockCache::key(record._fileId, record._etag);
+    const auto blockCount = (fileSize + blockSize - 1) / blockSize;
+
+    // Sequential reads get the next block with the same request
+    auto fetchLast = last;
+    if (first > 0 && last + 1 < blockCount && _cache->contains(key, first - 1))
+        fetchLast = last + 1;
+
+    blocks->resize(last - first + 1);
+    QElapsedTimer waited;
+    waited.start();
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        // Claim the missing blocks nobody else fetches, wait for the others
+        QVector<qint64> claimed;
+        {
+            QMutexLocker locker(&_mutex);
+            while (true) {
+                if (_aborted)
+                    return -EIO;
+                bool waitForOthers = false;
+                claimed.clear();
+                for (auto index = first; index <= fetchLast; ++index) {
+                    if (_cache->contains(key, index))
+                        continue;
+                    if (_blocksInFlight.contains(blockId(key, index))) {
+                        waitForOthers = waitForOthers || index <= last;
+                        continue;
+                    }
+                    claimed.append(index);
+                }
+                // Both the downloads and the wait need the network thread's event loop
+                if ((waitForOthers || !claimed.isEmpty()) && caller == _networkThreadId) {
+                    qCWarning(lcFuseFs) << "Placeholder read from the network thread, refusing to wait for it:" << path;
+                    return -EDEADLK;
+                }
+                if (!waitForOthers)
+                    break;
+                const auto remaining = waitTimeoutMs() - waited.elapsed();
+                if (remaining <= 0) {
+                    qCWarning(lcFuseFs) << "Timed out waiting for the blocks of" << path;
+                    return -ETIMEDOUT;
+                }
+                _changed.wait(&_mutex, static_cast<unsigned long>(remaining));
+            }
+            for (auto index : qAsConst(claimed))
+                _blocksInFlight.insert(blockId(key, index));
+        }
+
+        // One request per run of consecutive blocks
+        int error = 0;
+        for (int i = 0; i < claimed.size();) {
+            int j = i + 1;
+            while (j < claimed.size() && claimed[j] == claimed[j - 1] + 1 && j - i < maxBlocksPerRequest)
+                ++j;
+            const auto start = claimed[i] * blockSize;
+            const auto end = qMin((claimed[j - 1] + 1) * blockSize, fileSize) - 1;
+            const auto data = error ? Result<QByteArray, QString>(QString()) : download(path, start, end, record._etag);
+            if (!data) {
+                error = -EIO;
+            } else {
+                for (auto k = i; k < j; ++k) {
+                    const auto block = data->mid((claimed[k] - claimed[i]) * blockSize, blockSize);
+                    if (claimed[k] <= last && claimed[k] >= first)
+                        (*blocks)[claimed[k] - first] = block;
+                    _cache->insert(key, claimed[k], block);
+                }
+            }
+            QMutexLocker locker(&_mutex);
+            for (auto k = i; k < j; ++k)
+                _blocksInFlight.remove(blockId(key, claimed[k]));
+            _changed.wakeAll();
+            i = j;
+        }
+        if (error)
+            return error;
+
+        // The blocks of others, unless evicted meanwhile
+        bool complete = true;
+        for (auto index = first; index <= last; ++index) {
+            auto &block = (*blocks)[index - first];
+            if (!block.isNull())
+                continue;
+            if (auto cached = _cache->block(key, index)) {
+                block = *cached;
+            } else {
+                complete = false;
+            }
+        }
+        if (complete)
+            return 0;
+    }
+    return -EIO;
+}
+
+Result<QByteArray, QString> FuseFileSystem::download(const QByteArray &path, qint64 start, qint64 end, const QByteArray &etag)
+{
+    struct Download
+    {
+        QByteArray data;
+        QString error;
+        bool done = false;
+    };
+    auto download = QSharedPointer<Download>::create();
+
+    const auto remotePath = _params.remotePath + QString::fromUtf8(path);
+    QMetaObject::invokeMethod(this, [this, download, remotePath, start, end, etag] {
+        auto job = new RangeGetJob(_params.account, remotePath, start, end, etag, this);
+        connect(job, &RangeGetJob::finishedSignal, this, [this, job, download, start, end] {
+            QMutexLocker locker(&_mutex);
+            download->error = job->errorMessage();
+            if (download->error.isEmpty()) {
+                download->data = job->data().mid(start - job->dataStart(), end - start + 1);
+                if (download->data.size() != end - start + 1)
+                    download->error = tr("The server sent less data than requested");
+            }
+            download->done = true;
+            _changed.wakeAll();
+        });
+        job->start();
+    }, Qt::QueuedConnection);
+
+    QElapsedTimer waited;
+    waited.start();
+    QMutexLocker locker(&_mutex);
+    while (!download->done && !_aborted) {
+        const auto remaining = waitTimeoutMs() - waited.elapsed();
+        if (remaining <= 0)
+            break;
+        _changed.wait(&_mutex, static_cast<unsigned long>(remaining));
+    }
+    if (_aborted && !download->done)
+        return tr("Aborted");
+    if (!download->done)
+        return tr("Timed out waiting for the download");
+    if (!download->error.isEmpty())
+        return download->error;
+    return download->data;
+}
+
+int FuseFileSystem::readPlaceholder(const QByteArray &path, char *buffer, size_t size, off_t offset, pid_t caller)
+{
+    const auto fileSize = placeholderSize(path);
+    if (!fileSize) {
+        // Hydrated while it was open
+        const int fd = ::open(backingPath(path).constData(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return -errno;
+        const auto result = ::pread(fd, buffer, size, offset);
+        const auto error = errno;
+        ::close(fd);
+        return result < 0 ? -error : static_cast<int>(result);
+    }
+    if (size == 0 || offset >= *fileSize)
+        return 0;
+    const auto count = qMin<qint64>(size, *fileSize - offset);
+
+    SyncJournalFileRecord record;
+    if (!_params.journal->getFileRecord(path, &record) || !record.isValid()) {
+        qCWarning(lcFuseFs) << "No database entry for placeholder" << path;
+        return -EIO;
+    }
+
+    const auto first = offset / blockSize;
+    const auto last = (offset + count - 1) / blockSize;
+    QVector<QByteArray> blocks;
+    if (const auto error = fetchBlocks(path, record, *fileSize, first, last, &blocks, caller))
+        return error;
+
+    qint64 copied = 0;
+    for (auto index = first; index <= last; ++index) {
+        const auto &block = blocks[index - first];
+        const auto blockOffset = index == first ? offset - first * blockSize : 0;
+        const auto length = qMin<qint64>(block.size() - blockOffset, count - copied);
+        if (length <= 0)
+            break;
+        std::memcpy(buffer + copied, block.constData() + blockOffset, length);
+        copied += length;
+    }
+    return static_cast<int>(copied);
+}
+
+int FuseFileSystem::getattr(const QByteArray &path, struct stat *st)
+{
+    if (::lstat(backingPath(path).constData(), st) != 0)
+        return -errno;
+    if (S_ISREG(st->st_mode)) {
+        if (const auto size = placeholderSize(path)) {
+            st->st_size = *size;
+            st->st_blocks = 0;
+        }
+    }
+    return 0;
+}
+
+int FuseFileSystem::readdir(const QByteArray &path, const std::function<bool(const char *name)> &filler)
+{
+    auto dir = ::opendir(backingPath(path).constData());
+    if (!dir)
+        return -errno;
+    while (auto entry = ::readdir(dir)) {
+        if (!filler(entry->d_name))
+            break;
+    }
+    ::closedir(dir);
+    return 0;
+}
+
+int FuseFileSystem::readlink(const QByteArray &path, char *buffer, size_t size)
+{
+    if (size == 0)
+        return -EINVAL;
+    const auto length = ::readlink(backingPath(path).constData(), buffer, size - 1);
+    if (length < 0)
+        return -errno;
+    buffer[length] = '\0';
+    return 0;
+}
+
+int FuseFileSystem::mkdir(const QByteArray &path, mode_t mode)
+{
+    return ::mkdir(backingPath(path).constData(), mode) == 0 ? 0 : -errno;
+}
+
+int FuseFileSystem::unlink(const QByteArray &path)
+{
+    return ::unlink(backingPath(path).constData()) == 0 ? 0 : -errno;
+}
+
+int FuseFileSystem::rmdir(const QByteArray &path)
+{
+    return ::rmdir(backingPath(path).constData()) == 0 ? 0 : -errno;
+}
+
+int FuseFileSystem::symlink(const QByteArray &target, const QByteArray &path)
+{
+    return ::symlink(target.constData(), backingPath(path).constData()) == 0 ? 0 : -errno;
+}
+
+int FuseFileSystem::rename(const QByteArray &from, const QByteArray &to, unsigned int flags)
+{
+    if (flags) {
+        // RENAME_NOREPLACE and RENAME_EXCHANGE map onto the backing directory
+        const auto result = syscall(SYS_renameat2, AT_FDCWD, backingPath(from).constData(),
+            AT_FDCWD, backingPath(to).constData(), flags);
+        return result == 0 ? 0 : -errno;
+    }
+    return ::rename(backingPath(from).constData(), backingPath(to).constData()) == 0 ? 0 : -errno;
+}
+
+int FuseFileSystem::chmod(const QByteArray &path, mode_t mode)
+{
+    return ::chmod(backingPath(path).constData(), mode) == 0 ? 0 : -errno;
+}
+
+int FuseFileSystem::chown(const QByteArray &path, uid_t uid, gid_t gid)
+{
+    return ::lchown(backingPath(path).constData(), uid, gid) == 0 ? 0 : -errno;
+}
+
+int FuseFileSystem::truncate(const QByteArray &path, off_t size, pid_t caller)
+{
+    if (isPlaceholder(path)) {
+        if (size == 0) {
+            // Nothing of the contents survives
+            ::removexattr(backingPath(path).constData(), placeholderAttribute);
+        } else if (!hydrate(path, caller)) {
+            return -EIO;
+        }
+    }
+    return ::truncate(backingPath(path).constData(), size) == 0 ? 0 : -errno;
+}
+
+int FuseFileSystem::utimens(const QByteArray &path, const struct timespec times[2])
+{
+    return ::utimensat(AT_FDCWD, backingPath(path).constData(), times, AT_SYMLINK_NOFOLLOW) == 0 ? 0 : -errno;
+}
+
+int FuseFileSystem::statfs(struct statvfs *st)
+{
+    return ::statvfs(_backingRoot.constData(), st) == 0 ? 0 : -errno;
+}
+
+int FuseFileSystem::open(const QByteArray &path, int flags, uint64_t *handle, pid_t caller)
+{
+    if (isPlaceholder(path)) {
+        if ((flags & O_ACCMODE) == O_RDONLY) {
+            *handle = placeholderHandle;
+            return 0;
+        }
+        if (flags & O_TRUNC) {
+            ::removexattr(backingPath(path).constData(), placeholderAttribute);
+        } else if (!hydrate(path, caller)) {
+            return -EIO;
+        }
+    }
+
+    const int fd = ::open(backingPath(path).constData(), flags | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+    *handle = static_cast<uint64_t>(fd);
+    return 0;
+}
+
+int FuseFileSystem::create(const QByteArray &path, mode_t mode, int flags, uint64_t *handle)
+{
+    const int fd = ::open(backingPath(path).constData(), flags | O_CREAT | O_CLOEXEC, mode);
+    if (fd < 0)
+        return -errno;
+    *handle = static_cast<uint64_t>(fd);
+    return 0;
+}
+
+int FuseFileSystem::read(const QByteArray &path, uint64_t handle, char *buffer, size_t size, off_t offset, pid_t caller)
+{
+    if (handle == placeholderHandle)
+        return readPlaceholder(path, buffer, size, offset, caller);
+    const auto result = ::pread(static_cast<int>(handle), buffer, size, offset);
+    return result < 0 ? -errno : static_cast<int>(result);
+}
+
+int FuseFileSystem::write(uint64_t handle, const char *buffer, size_t size, off_t offset)
+{
+    if (handle == placeholderHandle)
+        return -EBADF;
+    const auto result = ::pwrite(static_cast<int>(handle), buffer, size, offset);
+    return result < 0 ? -errno : static_cast<int>(result);
+}
+
+int FuseFileSystem::fsync(uint64_t handle, bool dataOnly)
+{
+    if (handle == placeholderHandle)
+        return 0;
+    const auto fd = static_cast<int>(handle);
+    return (dataOnly ? ::fdatasync(fd) : ::fsync(fd)) == 0 ? 0 : -errno;
+}
+
+int FuseFileSystem::release(uint64_t handle)
+{
+    if (handle != placeholderHandle)
+        ::close(static_cast<int>(handle));
+    return 0;
+}
+
+// The placeholder attribute is not visible through the mount
+
+int FuseFileSystem::getxattr(const QByteArray &path, const char *name, char *value, size_t size)
+{
+    if (isPlaceholderAttribute(name))
+        return -ENODATA;
+    const auto result = ::lgetxattr(backingPath(path).constData(), name, value, size);
+    return result < 0 ? -errno : static_cast<int>(result);
+}
+
+int FuseFileSystem::setxattr(const QByteArray &path, const char *name, const char *value, size_t size, int flags)
+{
+    if (isPlaceholderAttribute(name))
+        return -EPERM;
+    return ::lsetxattr(backingPath(path).constData(), name, value, size, flags) == 0 ? 0 : -errno;
+}
+
+int FuseFileSystem::listxattr(const QByteArray &path, char *list, size_t size)
+{
+    const auto backing = backingPath(path);
+    const auto length = ::llistxattr(backing.constData(), nullptr, 0);
+    if (length < 0)
+        return -errno;
+    QByteArray names(static_cast<int>(length), '\0');
+    const auto actualLength = ::llistxattr(backing.constData(), names.data(), names.size());
+    if (actualLength < 0)
+        return -errno;
+    names.truncate(static_cast<int>(actualLength));
+
+    QByteArray visible;
+    for (const auto &name : names.split('\0')) {
+        if (!name.isEmpty() && !isPlaceholderAttribute(name.constData()))
+            visible += name + '\0';
+    }
+    if (size == 0)
+        return visible.size();
+    if (static_cast<size_t>(visible.size()) > size)
+        return -ERANGE;
+    std::memcpy(list, visible.constData(), visible.size());
+    return visible.size();
+}
+
+int FuseFileSystem::removexattr(const QByteArray &path, const char *name)
+{
+    if (isPlaceholderAttribute(name))
+        return -EPERM;
+    return ::lremovexattr(backingPath(path).constData(), name) == 0 ? 0 : -errno;
+}
+
+} // namespace OCC
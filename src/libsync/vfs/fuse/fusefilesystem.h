@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+#pragma once
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <functional>
+
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
+
+#include "owncloudlib.h"
+#include "common/result.h"
+#include "common/vfs.h"
+
+namespace OCC {
+
+class BlockCache;
+class SyncJournalFileRecord;
+
+/**
+ * @brief The file operations behind the FUSE mount of a sync folder
+ * @ingroup libsync
+ *
+ * The mount covers the sync folder. The real files stay in the directory
+ * below it, the backing directory, which is reached through a descriptor
+ * opened before mounting. Directories and hydrated files are passed through.
+ *
+ * Placeholders are empty files in the backing directory with the remote size
+ * in the placeholderAttribute extended attribute. They are presented with
+ * that size. Reading them fetches the needed blocks with range requests into
+ * the BlockCache, keyed by the file id and etag in the SyncJournalDb. Opening
+ * them for writing downloads them completely first, they become regular files.
+ *
+ * Paths are relative to the sync folder, without leading slash. The operations
+ * return 0 or a byte count on success and a negative errno on failure, like
+ * the FUSE callbacks, and may be called from any thread. The network requests
+ * run in the thread the instance lives in, which must be the account's thread.
+ * A caller in that thread would wait for itself, it gets EDEADLK. Other callers
+ * wait at most AbstractNetworkJob::httpTimeout for them, then get ETIMEDOUT or
+ * EIO.
+ *
+ * The client's own file operations don't go through the mount, see
+ * VfsFuse::underlyingPath(), so the handlers never wait for a thread that in
+ * turn waits for them.
+ */
+class OWNCLOUDSYNC_EXPORT FuseFileSystem : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr qint64 blockSize = 1024 * 1024;
+    /// Upper bound for the blocks fetched with one request
+    static constexpr qint64 maxBlocksPerRequest = 16;
+    /// The handle of placeholders that are open for reading
+    static constexpr uint64_t placeholderHandle = ~uint64_t(0);
+
+    /// Holds the remote size of a placeholder
+    static const char placeholderAttribute[];
+
+    FuseFileSystem(const QByteArray &backingRoot, const VfsSetupParams &params, BlockCache *cache, QObject *parent = nullptr);
+    ~FuseFileSystem();
+
+    QByteArray backingRoot() const { return _backingRoot; }
+    QByteArray backingPath(const QByteArray &path) const;
+
+    // Placeholder handling for the sync, bypassing the mount
+
+    bool isPlaceholder(const QByteArray &path) const;
+    /// The remote size if \a path is a placeholder
+    Optional<qint64> placeholderSize(const QByteArray &path) const;
+    /// Creates a placeholder or turns a file into one
+    Result<void, QString> makePlaceholder(const QByteArray &path, qint64 size, time_t modtime);
+    /// Downloads the contents of a placeholder into place
+    Result<void, QString> hydrate(const QByteArray &path, pid_t caller = 0);
+
+    /// Whether a placeholder is being hydrated
+    bool isHydrating() const { return _hydrations.loadAcquire() > 0; }
+
+    /// Lets all waiting and later reads of placeholders fail
+    void abortRequests();
+
+    // The operations of the mount
+
+    int getattr(const QByteArray &path, struct stat *st);
+    int readdir(const QByteArray &path, const std::function<bool(const char *name)> &filler);
+    int readlink(const QByteArray &path, char *buffer, size_t size);
+    int mkdir(const QByteArray &path, mode_t mode);
+    int unlink(const QByteArray &path);
+    int rmdir(const QByteArray &path);
+    int symlink(const QByteArray &target, const QByteArray &path);
+    int rename(const QByteArray &from, const QByteArray &to, unsigned int flags);
+    int chmod(const QByteArray &path, mode_t mode);
+    int chown(const QByteArray &path, uid_t uid, gid_t gid);
+    int truncate(const QByteArray &path, off_t size, pid_t caller = 0);
+    int utimens(const QByteArray &path, const struct timespec times[2]);
+    int statfs(struct statvfs *st);
+
+    int open(const QByteArray &path, int flags, uint64_t *handle, pid_t caller = 0);
+    int create(const QByteArray &path, mode_t mode, int flags, uint64_t *handle);
+    int read(const QByteArray &path, uint64_t handle, char *buffer, size_t size, off_t offset, pid_t caller = 0);
+    int write(uint64_t handle, const char *buffer, size_t size, off_t offset);
+    int fsync(uint64_t handle, bool dataOnly);
+    int release(uint64_t handle);
+
+    int getxattr(const QByteArray &path, const char *name, char *value, size_t size);
+    int setxattr(const QByteArray &path, const char *name, const char *value, size_t size, int flags);
+    int listxattr(const QByteArray &path, char *list, size_t size);
+    int removexattr(const QByteArray &path, const char *name);
+
+signals:
+    void hydrationStarted();
+    void hydrationDone();
+
+private:
+    /// Fills \a blocks with the blocks \a first to \a last of a placeholder
+    int fetchBlocks(const QByteArray &path, const SyncJournalFileRecord &record, qint64 fileSize,
+        qint64 first, qint64 last, QVector<QByteArray> *blocks, pid_t caller);
+    /// Downloads the bytes \a start to \a end, blocking
+    Result<QByteArray, QString> download(const QByteArray &path, qint64 start, qint64 end, const QByteArray &etag);
+    int readPlaceholder(const QByteArray &path, char *buffer, size_t size, off_t offset, pid_t caller);
+
+    QByteArray _backingRoot;
+    VfsSetupParams _params;
+    BlockCache *_cache;
+    pid_t _networkThreadId;
+    QAtomicInt _hydrations;
+
+    QMutex _mutex; // Protects the members below
+    QWaitCondition _changed; // Wakes up waiting reads
+    QSet<QString> _blocksInFlight;
+    bool _aborted = false;
+};
+
+} // namespace OCC
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#define FUSE_USE_VERSION 31
+
+#include "fusemount.h"
+#include "fusefilesystem.h"
+
+#include "config.h"
+
+#include <QDir>
+#include <QFile>
+#include <QLoggingCategory>
+
+#include <fuse.h>
+
+Q_LOGGING_CATEGORY(lcFuseMount, "nextcloud.sync.vfs.fuse.mount", QtInfoMsg)
+
+namespace {
+
+using OCC::FuseFileSystem;
+
+FuseFileSystem *fileSystem()
+{
+    return static_cast<FuseFileSystem *>(fuse_get_context()->private_data);
+}
+
+/// The thread that made the request, to detect requests that would deadlock
+pid_t caller()
+{
+    return fuse_get_context()->pid;
+}
+
+/// The paths of libfuse start with a slash
+QByteArray relative(const char *path)
+{
+    return QByteArray(path[0] == '/' ? path + 1 : path);
+}
+
+void *fsInit(struct fuse_conn_info *, struct fuse_config *config)
+{
+    // The sync uses the inodes to detect moves
+    config->use_ino = 1;
+    // The sync changes the backing directory behind the kernel's back
+    config->entry_timeout = 0;
+    config->attr_timeout = 0;
+    config->negative_timeout = 0;
+    // No .fuse_hidden files the sync would pick up
+    config->hard_remove = 1;
+    return fuse_get_context()->private_data;
+}
+
+int fsGetattr(const char *path, struct stat *st, struct fuse_file_info *)
+{
+    return fileSystem()->getattr(relative(path), st);
+}
+
+int fsReaddir(const char *path, void *buffer, fuse_fill_dir_t filler, off_t, struct fuse_file_info *, enum fuse_readdir_flags)
+{
+    return fileSystem()->readdir(relative(path), [buffer, filler](const char *name) {
+        return filler(buffer, name, nullptr, 0, static_cast<enum fuse_fill_dir_flags>(0)) == 0;
+    });
+}
+
+int fsReadlink(const char *path, char *buffer, size_t size)
+{
+    return fileSystem()->readlink(relative(path), buffer, size);
+}
+
+int fsMkdir(const char *path, mode_t mode)
+{
+    return fileSystem()->mkdir(relative(path), mode);
+}
+
+int fsUnlink(const char *path)
+{
+    return fileSystem()->unlink(relative(path));
+}
+
+int fsRmdir(const char *path)
+{
+    return fileSystem()->rmdir(relative(path));
+}
+
+int fsSymlink(const char *target, const char *path)
+{
+    return fileSystem()->symlink(QByteArray(target), relative(path));
+}
+
+int fsRename(const char *from, const char *to, unsigned int flags)
+{
+    return fileSystem()->rename(relative(from), relative(to), flags);
+}
+
+int fsChmod(const char *path, mode_t mode, struct fuse_file_info *)
+{
+    return fileSystem()->chmod(relative(path), mode);
+}
+
+int fsChown(const char *path, uid_t uid, gid_t gid, struct fuse_file_info *)
+{
+    return fileSystem()->chown(relative(path), uid, gid);
+}
+
+int fsTruncate(const char *path, off_t size, struct fuse_file_info *)
+{
+    return fileSystem()->truncate(relative(path), size, caller());
+}
+
+int fsUtimens(const char *path, const struct timespec times[2], struct fuse_file_info *)
+{
+    return fileSystem()->utimens(relative(path), times);
+}
+
+int fsStatfs(const char *, struct statvfs *st)
+{
+    return fileSystem()->statfs(st);
+}
+
+int fsOpen(const char *path, struct fuse_file_info *info)
+{
+    uint64_t handle = 0;
+    const auto result = fileSystem()->open(relative(path), info->flags, &handle, caller());
+    if (result == 0)
+        info->fh = handle;
+    return result;
+}
+
+int fsCreate(const char *path, mode_t mode, struct fuse_file_info *info)
+{
+    uint64_t handle = 0;
+    const auto result = fileSystem()->create(relative(path), mode, info->flags, &handle);
+    if (result == 0)
+        info->fh = handle;
+    return result;
+}
+
+int fsRead(const char *path, char *buffer, size_t size, off_t offset, struct fuse_file_info *info)
+{
+    return fileSystem()->read(relative(path), info->fh, buffer, size, offset, caller());
+}
+
+int fsWrite(const char *, const char *buffer, size_t size, off_t offset, struct fuse_file_info *info)
+{
+    return fileSystem()->write(info->fh, buffer, size, offset);
+}
+
+int fsFsync(const char *, int dataOnly, struct fuse_file_info *info)
+{
+    return fileSystem()->fsync(info->fh, dataOnly != 0);
+}
+
+int fsRelease(const char *, struct fuse_file_info *info)
+{
+    return fileSystem()->release(info->fh);
+}
+
+int fsGetxattr(const char *path, const char *name, char *value, size_t size)
+{
+    return fileSystem()->getxattr(relative(path), name, value, size);
+}
+
+int fsSetxattr(const char *path, const char *name, const char *value, size_t size, int flags)
+{
+    return fileSystem()->setxattr(relative(path), name, value, size, flags);
+}
+
+int fsListxattr(const char *path, char *list, size_t size)
+{
+    return fileSystem()->listxattr(relative(path), list, size);
+}
+
+int fsRemovexattr(const char *path, const char *name)
+{
+    return fileSystem()->removexattr(relative(path), name);
+}
+
+/// The device of the mount at \a mountPoint as named in /sys/fs/fuse/connections, found
+/// in /proc/self/mountinfo since a stat() of the mount point would be a FUSE request
+QByteArray connectionName(const QByteArray &mountPoint)
+{
+    QFile mountInfo(QStringLiteral("/proc/self/mountinfo"));
+    if (!mountInfo.open(QIODevice::ReadOnly))
+        return QByteArray();
+    QByteArray connection;
+    // The last matching mount is the one on top
+    for (const auto &line : mountInfo.readAll().split('\n')) {
+        const auto fields = line.split(' ');
+        if (fields.size() < 5)
+            continue;
+        auto path = fields.at(4);
+        path.replace("\\040", " ").replace("\\011", "\t").replace("\\012", "\n").replace("\\134", "\\");
+        if (path != mountPoint)
+            continue;
+        const auto device = fields.at(2).split(':');
+        if (device.size() == 2)
+            connection = QByteArray::number((device.at(0).toUInt() << 20) | device.at(1).toUInt());
+    }
+    return connection;
+}
+
+struct fuse_operations makeOperations()
+{
+    struct fuse_operations operations = {};
+    operations.init = fsInit;
+    operations.getattr = fsGetattr;
+    operations.readdir = fsReaddir;
+    operations.readlink = fsReadlink;
+    operations.mkdir = fsMkdir;
+    operations.unlink = fsUnlink;
+    operations.rmdir = fsRmdir;
+    operations.symlink = fsSymlink;
+    operations.rename = fsRename;
+    operations.chmod = fsChmod;
+    operations.chown = fsChown;
+    operations.truncate = fsTruncate;
+    operations.utimens = fsUtimens;
+    operations.statfs = fsStatfs;
+    operations.open = fsOpen;
+    operations.create = fsCreate;
+    operations.read = fsRead;
+    operations.write = fsWrite;
+    operations.fsync = fsFsync;
+    operations.release = fsRelease;
+    operations.getxattr = fsGetxattr;
+    operations.setxattr = fsSetxattr;
+    operations.listxattr = fsListxattr;
+    operations.removexattr = fsRemovexattr;
+    return operations;
+}
+
+}
+
+namespace OCC {
+
+FuseMount::~FuseMount()
+{
+    unmount();
+}
+
+Result<void, QString> FuseMount::mount(const QByteArray &mountPoint, FuseFileSystem *fileSystem)
+{
+    static const auto operations = makeOperations();
+
+    struct fuse_args args = FUSE_ARGS_INIT(0, nullptr);
+    fuse_opt_add_arg(&args, APPLICATION_EXECUTABLE);
+    fuse_opt_add_arg(&args, "-o");
+    fuse_opt_add_arg(&args, "default_permissions,fsname=" APPLICATION_EXECUTABLE ",subtype=" APPLICATION_EXECUTABLE);
+    _fuse = fuse_new(&args, &operations, sizeof(operations), fileSystem);
+    fuse_opt_free_args(&args);
+    if (!_fuse)
+        return QStringLiteral("Could not create the FUSE session");
+
+    // mountinfo lists the resolved path
+    const auto canonicalMountPoint = QFile::encodeName(QDir(QFile::decodeName(mountPoint)).canonicalPath());
+    if (fuse_mount(_fuse, mountPoint.constData()) != 0) {
+        fuse_destroy(_fuse);
+        _fuse = nullptr;
+        return QStringLiteral("Could not mount %1").arg(QString::fromUtf8(mountPoint));
+    }
+    _connection = connectionName(canonicalMountPoint);
+
+    _loop = std::thread([fuse = _fuse] {
+        fuse_loop_mt(fuse, 0);
+    });
+    qCInfo(lcFuseMount) << "Mounted" << mountPoint;
+    return {};
+}
+
+void FuseMount::unmount()
+{
+    if (!_fuse)
+        return;
+
+    // The loop ends once the kernel connection is gone. A lazy unmount keeps it
+    // while processes have files open in the mount or use it as their working
+    // directory, and the workers would wait for their requests forever.
+    fuse_exit(_fuse);
+    abortConnection();
+    fuse_unmount(_fuse);
+    _loop.join();
+    fuse_destroy(_fuse);
+    _fuse = nullptr;
+    _connection.clear();
+    qCInfo(lcFuseMount) << "Unmounted";
+}
+
+void FuseMount::abortConnection()
+{
+    if (_connection.isEmpty()) {
+        qCWarning(lcFuseMount) << "Unknown FUSE connection, unmounting may wait for the users of the mount";
+        return;
+    }
+    QFile abort(QStringLiteral("/sys/fs/fuse/connections/%1/abort").arg(QString::fromLatin1(_connection)));
+    if (!abort.open(QIODevice::WriteOnly) || abort.write("1") != 1) {
+        qCWarning(lcFuseMount) << "Could not abort the FUSE connection" << _connection << abort.errorString();
+    }
+}
+
+} // namespace OCC
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+#include <thread>
+
+#include "common/result.h"
+
+struct fuse;
+
+namespace OCC {
+
+class FuseFileSystem;
+
+/**
+ * @brief A libfuse mount serving the operations of a FuseFileSystem
+ * @ingroup libsync
+ *
+ * The requests are handled by libfuse's worker threads. The kernel caches
+ * neither attributes nor directory entries, the sync changes the backing
+ * directory directly.
+ */
+class FuseMount
+{
+public:
+    FuseMount() = default;
+    ~FuseMount();
+
+    Result<void, QString> mount(const QByteArray &mountPoint, FuseFileSystem *fileSystem);
+    void unmount();
+
+    bool isMounted() const { return _fuse != nullptr; }
+
+private:
+    Q_DISABLE_COPY(FuseMount)
+
+    /// Makes the kernel fail all requests of the mount, which wakes the workers
+    void abortConnection();
+
+    struct fuse *_fuse = nullptr;
+    std::thread _loop;
+    QByteArray _connection; // the name of the mount's directory in /sys/fs/fuse/connections
+};
+
+} // namespace OCC
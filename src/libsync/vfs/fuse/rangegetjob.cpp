@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "rangegetjob.h"
+
+#include "owncloudpropagator_p.h"
+
+#include <QLoggingCategory>
+#include <QNetworkReply>
+#include <QRegularExpression>
+
+Q_LOGGING_CATEGORY(lcRangeGetJob, "nextcloud.sync.networkjob.rangeget", QtInfoMsg)
+
+namespace OCC {
+
+RangeGetJob::RangeGetJob(AccountPtr account, const QString &path, qint64 start, qint64 end,
+    const QByteArray &expectedEtag, QObject *parent)
+    : AbstractNetworkJob(account, path, parent)
+    , _start(start)
+    , _end(end)
+    , _expectedEtag(expectedEtag)
+{
+}
+
+void RangeGetJob::start()
+{
+    QNetworkRequest req;
+    req.setRawHeader("Range", "bytes=" + QByteArray::number(_start) + '-' + QByteArray::number(_end));
+    sendRequest("GET", makeDavUrl(path()), req);
+    AbstractNetworkJob::start();
+}
+
+bool RangeGetJob::finished()
+{
+    const auto httpStatus = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (reply()->error() != QNetworkReply::NoError) {
+        _errorMessage = errorString();
+    } else if (httpStatus != 200 && httpStatus != 206) {
+        _errorMessage = tr("Unexpected HTTP status %1").arg(httpStatus);
+    } else {
+        const auto etag = getEtagFromReply(reply());
+        if (!_expectedEtag.isEmpty() && !etag.isEmpty() && etag != _expectedEtag) {
+            qCInfo(lcRangeGetJob) << "ETag of" << path() << "changed from" << _expectedEtag << "to" << etag;
+            _errorMessage = tr("The file changed on the server");
+        } else if (httpStatus == 206) {
+            static const QRegularExpression rangeRx(QStringLiteral("^bytes (\\d+)-"));
+            const auto match = rangeRx.match(QString::fromLatin1(reply()->rawHeader("Content-Range")));
+            _dataStart = match.hasMatch() ? match.captured(1).toLongLong() : -1;
+            if (_dataStart < 0 || _dataStart > _start) {
+                _errorMessage = tr("Server returned wrong content-range");
+            }
+        }
+    }
+
+    if (_errorMessage.isEmpty()) {
+        _data = reply()->readAll();
+    } else {
+        qCWarning(lcRangeGetJob) << "Range download of" << path() << "failed:" << _errorMessage;
+    }
+    emit finishedSignal();
+    return true;
+}
+
+} // namespace OCC
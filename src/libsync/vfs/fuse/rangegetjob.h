@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+#pragma once
+
+#include "abstractnetworkjob.h"
+
+namespace OCC {
+
+/**
+ * @brief Downloads a byte range of a file into memory
+ * @ingroup libsync
+ *
+ * Sends a GET with a "Range: bytes=start-end" header. Servers that ignore
+ * the header answer with the whole file, data() then starts at 0 instead
+ * of at the requested start, see dataStart().
+ *
+ * The download fails if the server's ETag differs from the expected one,
+ * the cached blocks of the file would no longer match.
+ */
+class OWNCLOUDSYNC_EXPORT RangeGetJob : public AbstractNetworkJob
+{
+    Q_OBJECT
+public:
+    /// \a end is inclusive, like in the Range header
+    explicit RangeGetJob(AccountPtr account, const QString &path, qint64 start, qint64 end,
+        const QByteArray &expectedEtag, QObject *parent = nullptr);
+
+    void start() override;
+
+    /// Empty on success
+    QString errorMessage() const { return _errorMessage; }
+
+    QByteArray data() const { return _data; }
+    qint64 dataStart() const { return _dataStart; }
+
+signals:
+    void finishedSignal();
+
+private slots:
+    bool finished() override;
+
+private:
+    qint64 _start;
+    qint64 _end;
+    QByteArray _expectedEtag;
+
+    QByteArray _data;
+    qint64 _dataStart = 0;
+    QString _errorMessage;
+};
+
+} // namespace OCC
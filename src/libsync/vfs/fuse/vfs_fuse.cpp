@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "vfs_fuse.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QProcess>
+#include <QStandardPaths>
+
+#include "syncfileitem.h"
+#include "filesystem.h"
+#include "common/syncjournaldb.h"
+
+#include "blockcache.h"
+#include "fusefilesystem.h"
+#include "fusemount.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+Q_LOGGING_CATEGORY(lcVfsFuse, "nextcloud.sync.vfs.fuse", QtInfoMsg)
+
+namespace OCC {
+
+constexpr qint64 VfsFuse::defaultCacheSize;
+
+VfsFuse::VfsFuse(QObject *parent)
+    : Vfs(parent)
+{
+}
+
+VfsFuse::~VfsFuse()
+{
+    stop();
+}
+
+Vfs::Mode VfsFuse::mode() const
+{
+    return Fuse;
+}
+
+QString VfsFuse::fileSuffix() const
+{
+    return QString();
+}
+
+void VfsFuse::startImpl(const VfsSetupParams &params)
+{
+    auto folderPath = QFile::encodeName(params.filesystemPath);
+    if (folderPath.endsWith('/'))
+        folderPath.chop(1);
+
+    // A mount left behind by a crashed client
+    struct stat st;
+    if (::stat(folderPath.constData(), &st) != 0 && errno == ENOTCONN) {
+        qCInfo(lcVfsFuse) << "Removing the stale mount at" << folderPath;
+        // Don't block the caller on fusermount, the folder is set up once it is done
+        _staleMountCleanup = new QProcess(this);
+        auto done = [this, folderPath] {
+            _staleMountCleanup->deleteLater();
+            _staleMountCleanup = nullptr;
+            startMount(folderPath);
+            // The journal was opened on the stale mount until now
+            if (!_backingRoot.isEmpty()) {
+                auto journal = _setupParams.journal;
+                journal->setDatabaseOpenPath(underlyingPath(journal->databaseFilePath()));
+            }
+        };
+        connect(_staleMountCleanup, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished), this, done);
+        connect(_staleMountCleanup, &QProcess::errorOccurred, this, [this, done](QProcess::ProcessError error) {
+            if (error != QProcess::FailedToStart)
+                return;
+            qCWarning(lcVfsFuse) << "Could not run fusermount3:" << _staleMountCleanup->errorString();
+            done();
+        });
+        _staleMountCleanup->start(QStringLiteral("fusermount3"), { QStringLiteral("-u"), QStringLiteral("-z"), QFile::decodeName(folderPath) });
+        return;
+    }
+
+    startMount(folderPath);
+}
+
+void VfsFuse::startMount(const QByteArray &folderPath)
+{
+    const auto &params = _setupParams;
+
+    // The descriptor keeps the directory reachable below the mount
+    _backingFd = ::open(folderPath.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (_backingFd < 0) {
+        qCWarning(lcVfsFuse) << "Could not open" << folderPath << strerror(errno);
+        return;
+    }
+
+    _backingRoot = QStringLiteral("/proc/self/fd/%1/").arg(_backingFd);
+
+    _cache.reset(new BlockCache(cacheDirectory(), FuseFileSystem::blockSize, defaultCacheSize));
+    _fileSystem.reset(new FuseFileSystem(QFile::encodeName(_backingRoot), params, _cache.data()));
+    connect(_fileSystem.data(), &FuseFileSystem::hydrationStarted, this, &Vfs::beginHydrating);
+    connect(_fileSystem.data(), &FuseFileSystem::hydrationDone, this, &Vfs::doneHydrating);
+
+    if (qgetenv("OWNCLOUD_VFS_FUSE_MOUNT") == "0")
+        return;
+
+    _mount.reset(new FuseMount);
+    const auto result = _mount->mount(folderPath, _fileSystem.data());
+    if (!result) {
+        // The placeholders stay empty files, like with the xattr backend
+        qCWarning(lcVfsFuse) << "Continuing without the mount:" << result.error();
+        _mount.reset();
+    }
+}
+
+void VfsFuse::stop()
+{
+    // Killed if it still runs, and the folder isn't set up anymore
+    delete _staleMountCleanup;
+    _staleMountCleanup = nullptr;
+
+    if (_fileSystem)
+        _fileSystem->abortRequests();
+    _mount.reset();
+    _fileSystem.reset();
+    _cache.reset();
+    if (_backingFd >= 0) {
+        ::close(_backingFd);
+        _backingFd = -1;
+        _backingRoot.clear();
+    }
+}
+
+void VfsFuse::unregisterFolder()
+{
+    QDir(cacheDirectory()).removeRecursively();
+}
+
+QString VfsFuse::underlyingPath(const QString &path) const
+{
+    // The handlers wait for the journal and the network thread, which must
+    // therefore never wait for them
+    if (_backingRoot.isEmpty())
+        return path;
+    const auto &folderPath = _setupParams.filesystemPath;
+    if (path.startsWith(folderPath))
+        return _backingRoot + path.mid(folderPath.size());
+    if (path + QLatin1Char('/') == folderPath)
+        return _backingRoot;
+    return path;
+}
+
+bool VfsFuse::socketApiPinStateActionsShown() const
+{
+    return true;
+}
+
+bool VfsFuse::isHydrating() const
+{
+    return _fileSystem && _fileSystem->isHydrating();
+}
+
+Result<void, QString> VfsFuse::updateMetadata(const QString &filePath, time_t modtime, qint64 size, const QByteArray &)
+{
+    if (_fileSystem) {
+        const auto path = relativePath(filePath);
+        if (_fileSystem->isPlaceholder(path))
+            return _fileSystem->makePlaceholder(path, size, modtime);
+    }
+    FileSystem::setModTime(filePath, modtime);
+    return {};
+}
+
+Result<void, QString> VfsFuse::createPlaceholder(const SyncFileItem &item)
+{
+    if (!_fileSystem)
+        return QStringLiteral("The sync folder could not be opened");
+
+    const auto path = underlyingPath(_setupParams.filesystemPath + item._file);
+    const auto relative = item._file.toUtf8();
+    if (QFileInfo::exists(path) && !_fileSystem->isPlaceholder(relative)
+        && !FileSystem::verifyFileUnchanged(path, item._size, item._modtime)) {
+        return QStringLiteral("Cannot create a placeholder because a file with the placeholder name already exist");
+    }
+    return _fileSystem->makePlaceholder(relative, item._size, item._modtime);
+}
+
+Result<void, QString> VfsFuse::dehydratePlaceholder(const SyncFileItem &item)
+{
+    if (!_fileSystem)
+        return QStringLiteral("The sync folder could not be opened");
+
+    // Truncated in place, the inode stays the same
+    auto r = _fileSystem->makePlaceholder(item._file.toUtf8(), item._size, item._modtime);
+    if (!r) {
+        return r;
+    }
+
+    // Ensure the pin state isn't contradictory
+    const auto pin = pinState(item._file);
+    if (pin && *pin == PinState::AlwaysLocal) {
+        setPinState(item._renameTarget, PinState::Unspecified);
+    }
+    return {};
+}
+
+Result<void, QString> VfsFuse::convertToPlaceholder(const QString &, const SyncFileItem &, const QString &)
+{
+    // Nothing necessary
+    return {};
+}
+
+bool VfsFuse::needsMetadataUpdate(const SyncFileItem &)
+{
+    return false;
+}
+
+bool VfsFuse::isDehydratedPlaceholder(const QString &filePath)
+{
+    return _fileSystem && _fileSystem->isPlaceholder(relativePath(filePath));
+}
+
+bool VfsFuse::statTypeVirtualFile(csync_file_stat_t *stat, void *statData)
+{
+    if (stat->type == ItemTypeDirectory || !_fileSystem) {
+        return false;
+    }
+
+    const auto parentPath = static_cast<QByteArray *>(statData);
+    Q_ASSERT(!parentPath->endsWith('/'));
+    Q_ASSERT(!stat->path.startsWith('/'));
+
+    const auto path = relativePath(QString::fromUtf8(*parentPath + '/' + stat->path));
+    const auto pin = pinState(QString::fromUtf8(path));
+
+    if (_fileSystem->isPlaceholder(path)) {
+        const auto shouldDownload = pin && (*pin == PinState::AlwaysLocal);
+        stat->type = shouldDownload ? ItemTypeVirtualFileDownload : ItemTypeVirtualFile;
+        return true;
+    } else {
+        const auto shouldDehydrate = pin && (*pin == PinState::OnlineOnly);
+        if (shouldDehydrate) {
+            stat->type = ItemTypeVirtualFileDehydration;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool VfsFuse::setPinState(const QString &folderPath, PinState state)
+{
+    return setPinStateInDb(folderPath, state);
+}
+
+Optional<PinState> VfsFuse::pinState(const QString &folderPath)
+{
+    return pinStateInDb(folderPath);
+}
+
+Vfs::AvailabilityResult VfsFuse::availability(const QString &folderPath)
+{
+    return availabilityInDb(folderPath);
+}
+
+void VfsFuse::fileStatusChanged(const QString &, SyncFileStatus)
+{
+}
+
+QByteArray VfsFuse::relativePath(const QString &filePath) const
+{
+    // The sync passes paths below underlyingPath()
+    if (!_backingRoot.isEmpty() && filePath.startsWith(_backingRoot))
+        return filePath.mid(_backingRoot.size()).toUtf8();
+    if (filePath.startsWith(_setupParams.filesystemPath))
+        return filePath.mid(_setupParams.filesystemPath.size()).toUtf8();
+    return filePath.toUtf8();
+}
+
+QString VfsFuse::cacheDirectory() const
+{
+    const auto folderHash = QCryptographicHash::hash(_setupParams.filesystemPath.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+        + QStringLiteral("/vfs-fuse/") + QString::fromLatin1(folderHash);
+}
+
+} // namespace OCC
+
+OCC_DEFINE_VFS_FACTORY("fuse", OCC::VfsFuse)
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+#pragma once
+
+#include <QObject>
+#include <QPointer>
+#include <QProcess>
+#include <QScopedPointer>
+
+#include "common/vfs.h"
+
+namespace OCC {
+
+class BlockCache;
+class FuseFileSystem;
+class FuseMount;
+
+/**
+ * @brief Virtual files presented through a FUSE mount over the sync folder
+ *
+ * Placeholders look like the complete remote files and their contents are
+ * fetched on demand, see FuseFileSystem. Without the mount, for instance
+ * when /dev/fuse is not available, they are empty files.
+ */
+class VfsFuse : public Vfs
+{
+    Q_OBJECT
+
+public:
+    /// The default upper bound for the block cache of a folder
+    static constexpr qint64 defaultCacheSize = 1024LL * 1024 * 1024;
+
+    explicit VfsFuse(QObject *parent = nullptr);
+    ~VfsFuse();
+
+    Mode mode() const override;
+    QString fileSuffix() const override;
+
+    void stop() override;
+    void unregisterFolder() override;
+    QString underlyingPath(const QString &path) const override;
+
+    bool socketApiPinStateActionsShown() const override;
+    bool isHydrating() const override;
+
+    Result<void, QString> updateMetadata(const QString &filePath, time_t modtime, qint64 size, const QByteArray &fileId) override;
+
+    Result<void, QString> createPlaceholder(const SyncFileItem &item) override;
+    Result<void, QString> dehydratePlaceholder(const SyncFileItem &item) override;
+    Result<void, QString> convertToPlaceholder(const QString &filename, const SyncFileItem &item, const QString &replacesFile) override;
+
+    bool needsMetadataUpdate(const SyncFileItem &item) override;
+    bool isDehydratedPlaceholder(const QString &filePath) override;
+    bool statTypeVirtualFile(csync_file_stat_t *stat, void *statData) override;
+
+    bool setPinState(const QString &folderPath, PinState state) override;
+    Optional<PinState> pinState(const QString &folderPath) override;
+    AvailabilityResult availability(const QString &folderPath) override;
+
+public slots:
+    void fileStatusChanged(const QString &systemFileName, SyncFileStatus fileStatus) override;
+
+protected:
+    void startImpl(const VfsSetupParams &params) override;
+
+private:
+    /// Opens the backing directory and mounts over it
+    void startMount(const QByteArray &folderPath);
+    /// The path relative to the sync folder
+    QByteArray relativePath(const QString &filePath) const;
+    QString cacheDirectory() const;
+
+    int _backingFd = -1;
+    QString _backingRoot; // the backing directory through _backingFd, ends with '/'
+    QScopedPointer<BlockCache> _cache;
+    QScopedPointer<FuseFileSystem> _fileSystem;
+    QScopedPointer<FuseMount> _mount;
+    QPointer<QProcess> _staleMountCleanup; // removes a mount left behind before startMount()
+};
+
+} // namespace OCC
@@ -0,0 +1,101 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTemporaryDir>
+#include <QDebug>
+
+#include "common/checksums.h"
+#include "common/utility.h"
+
+using namespace OCC;
+
+static void report(const char *what, qint64 bytes, qint64 msecs)
+{
+    msecs = qMax<qint64>(1, msecs);
+    qDebug() << what << bytes / 1000000 << "MB in" << msecs << "ms,"
+             << QByteArray::number(double(bytes) / msecs / 1e6, 'f', 3).constData() << "GB/s";
+}
+
+template <typename F>
+static void benchFile(const char *what, const QString &path, F &&compute)
+{
+    QFile file(path);
+    file.open(QIODevice::ReadOnly);
+    QElapsedTimer timer;
+    timer.start();
+    const auto result = compute(&file);
+    report(what, file.size(), timer.elapsed());
+    Q_UNUSED(result)
+}
+
+// Usage: ChecksumsBench [fileSizeMB] [concurrentFiles]
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const qint64 fileSize = (argc > 1 ? QByteArray(argv[1]).toLongLong() : 512) * 1000 * 1000;
+    const int concurrentFiles = argc > 2 ? QByteArray(argv[2]).toInt() : 8;
+
+    QTemporaryDir dir;
+    const QString path = dir.path() + "/big";
+    {
+        QFile file(path);
+        file.open(QIODevice::WriteOnly);
+        QByteArray block(1024 * 1024, Qt::Uninitialized);
+        for (int i = 0; i < block.size(); ++i)
+            block[i] = static_cast<char>(qrand());
+        for (qint64 written = 0; written < fileSize; written += block.size())
+            file.write(block);
+    }
+    // Warm the page cache so disk speed doesn't dominate
+    benchFile("WARMUP", path, [](QIODevice *d) { return d->readAll().size(); });
+
+    benchFile("OLD MD5", path, [](QIODevice *d) { return calcMd5(d); });
+    benchFile("OLD SHA1", path, [](QIODevice *d) { return calcSha1(d); });
+#ifdef ZLIB_FOUND
+    benchFile("OLD ADLER32", path, [](QIODevice *d) { return calcAdler32(d); });
+#endif
+    benchFile("NEW MD5", path, [](QIODevice *d) { return ComputeChecksum::computeNow(d, QByteArray(checkSumMD5C)); });
+    benchFile("NEW SHA1", path, [](QIODevice *d) { return ComputeChecksum::computeNow(d, QByteArray(checkSumSHA1C)); });
+    benchFile("NEW SHA256", path, [](QIODevice *d) { return ComputeChecksum::computeNow(d, QByteArray(checkSumSHA2C)); });
+#ifdef ZLIB_FOUND
+    benchFile("NEW ADLER32", path, [](QIODevice *d) { return ComputeChecksum::computeNow(d, QByteArray(checkSumAdlerC)); });
+    benchFile("OLD SHA1 + ADLER32 (two passes)", path, [](QIODevice *d) {
+        auto sha1 = calcSha1(d);
+        d->seek(0);
+        return sha1 + calcAdler32(d);
+    });
+    benchFile("NEW SHA1 + ADLER32 (one pass)", path, [](QIODevice *d) {
+        return ComputeChecksum::computeNow(d, QByteArrayList{ checkSumSHA1C, checkSumAdlerC });
+    });
+#endif
+
+    // Many files at once through the bounded pool
+    QVector<QString> paths;
+    for (int i = 0; i < concurrentFiles; ++i) {
+        paths.append(dir.path() + "/copy" + QString::number(i));
+        QFile::copy(path, paths.last());
+    }
+    QElapsedTimer timer;
+    timer.start();
+    int pending = paths.size();
+    QEventLoop loop;
+    for (const auto &p : paths) {
+        auto compute = new ComputeChecksum(&app);
+        compute->setChecksumType(checkSumSHA1C);
+        QObject::connect(compute, &ComputeChecksum::done, &loop, [&]() {
+            if (--pending == 0)
+                loop.quit();
+        });
+        compute->start(p);
+    }
+    loop.exec();
+    report("CONCURRENT SHA1", fileSize * paths.size(), timer.elapsed());
+    return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+#include <ctime>
+
+using namespace OCC;
+
+// Downloads a few large files from the fake server with different read buffer
+// sizes and reports the throughput and the CPU time spent per GB.
+//
+// Usage: DownloadBench [MiB per file] [number of files]
+static bool runDownload(qint64 bufferSize, qint64 fileSize, int files)
+{
+    FakeFolder fakeFolder{ FileInfo{} };
+    for (int i = 0; i < files; ++i)
+        fakeFolder.remoteModifier().insert(QStringLiteral("big%1").arg(i), fileSize, 'X');
+
+    auto opts = fakeFolder.syncEngine().syncOptions();
+    opts._downloadBufferSize = bufferSize;
+    fakeFolder.syncEngine().setSyncOptions(opts);
+
+    QElapsedTimer timer;
+    timer.start();
+    const std::clock_t cpuStart = std::clock();
+    const bool ok = fakeFolder.syncOnce();
+    const double cpuSeconds = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    const double wallSeconds = qMax<qint64>(1, timer.elapsed()) / 1000.;
+
+    const double megabytes = double(fileSize) * files / (1000 * 1000);
+    qDebug().nospace() << "buffer " << bufferSize / 1024 << " KiB: "
+                       << megabytes / wallSeconds << " MB/s, "
+                       << cpuSeconds / (megabytes / 1000) << " CPU s/GB"
+                       << (ok ? "" : " (sync failed)");
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const qint64 fileSize = (argc > 1 ? QByteArray(argv[1]).toLongLong() : 256) * 1024 * 1024;
+    const int files = argc > 2 ? QByteArray(argv[2]).toInt() : 4;
+
+    bool ok = true;
+    for (qint64 bufferSize : { 8 * 1024, 64 * 1024, 1024 * 1024, 4 * 1024 * 1024 })
+        ok &= runDownload(bufferSize, fileSize, files);
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,59 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include "csync_exclude.h"
+
+using namespace OCC;
+
+#define EXCLUDE_LIST_FILE SOURCEDIR "/../../sync-exclude.lst"
+
+// Matches generated file paths against the default exclude list extended to
+// about 300 patterns and reports how many paths per second are checked.
+//
+// Usage: ExcludesBench [number of paths]
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int pathCount = argc > 1 ? QByteArray(argv[1]).toInt() : 1000000;
+
+    ExcludedFiles excludes;
+    excludes.addExcludeFilePath(EXCLUDE_LIST_FILE);
+    for (int i = 0; i < 80; ++i) {
+        excludes.addManualExclude(QStringLiteral("*.tmp%1").arg(i));
+        excludes.addManualExclude(QStringLiteral("cache%1*").arg(i));
+        excludes.addManualExclude(QStringLiteral("build%1/").arg(i));
+        excludes.addManualExclude(QStringLiteral("project%1/*.o").arg(i));
+    }
+    excludes.reloadExcludeFiles();
+
+    QStringList paths;
+    paths.reserve(pathCount);
+    const char *extensions[] = { "txt", "jpg", "docx", "cpp", "tmp3", "part", "pdf" };
+    for (int i = 0; i < pathCount; ++i) {
+        paths.append(QStringLiteral("dir%1/project%2/file%3.%4")
+                         .arg(i % 97)
+                         .arg(i % 13)
+                         .arg(i)
+                         .arg(QLatin1String(extensions[i % 7])));
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    int excluded = 0;
+    for (const auto &path : qAsConst(paths)) {
+        if (excludes.traversalPatternMatch(path, ItemTypeFile) != CSYNC_NOT_EXCLUDED)
+            ++excluded;
+    }
+    const qint64 msecs = qMax<qint64>(1, timer.elapsed());
+    qDebug() << "traversal:" << pathCount << "paths in" << msecs << "ms,"
+             << pathCount * 1000 / msecs << "paths/s," << excluded << "excluded";
+    return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "syncenginetestutils.h"
+#include "syncfilestatustracker.h"
+
+using namespace OCC;
+
+static void report(const char *name, qint64 msecs, int statuses)
+{
+    msecs = qMax<qint64>(1, msecs);
+    qDebug().nospace() << name << ": " << statuses << " statuses in " << msecs << " ms, "
+                       << statuses * 1000 / msecs << " statuses/s";
+}
+
+// Answers the status requests a file manager sends when it opens a large
+// synced directory, one RETRIEVE_FILE_STATUS lookup per file and with a
+// single RETRIEVE_DIRECTORY_STATUS lookup for the whole directory.
+//
+// Usage: FileStatusBench [number of files]
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int files = argc > 1 ? QByteArray(argv[1]).toInt() : 20000;
+
+    FakeFolder fakeFolder{ FileInfo() };
+    fakeFolder.remoteModifier().mkdir("big");
+    QStringList names;
+    for (int i = 0; i < files; ++i) {
+        names.append(QStringLiteral("file%1.txt").arg(i));
+        fakeFolder.remoteModifier().insert(QString(QStringLiteral("big/") + names.last()), 10);
+    }
+    if (!fakeFolder.syncOnce())
+        return -1;
+
+    auto &tracker = fakeFolder.syncEngine().syncFileStatusTracker();
+    QElapsedTimer timer;
+    int upToDate = 0;
+    timer.start();
+    for (const auto &name : qAsConst(names)) {
+        if (tracker.fileStatus(QStringLiteral("big/") + name).tag() == SyncFileStatus::StatusUpToDate)
+            ++upToDate;
+    }
+    report("one by one", timer.elapsed(), names.size());
+
+    int batchedUpToDate = 0;
+    timer.start();
+    for (const auto &status : tracker.fileStatuses(QStringLiteral("big"), names)) {
+        if (status.tag() == SyncFileStatus::StatusUpToDate)
+            ++batchedUpToDate;
+    }
+    report("batched", timer.elapsed(), names.size());
+
+    return upToDate == files && batchedUpToDate == files ? 0 : -1;
+}
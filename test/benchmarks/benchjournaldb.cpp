@@ -0,0 +1,69 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QDebug>
+
+#include "common/syncjournaldb.h"
+#include "common/syncjournalfilerecord.h"
+
+using namespace OCC;
+
+// Usage: JournalDbBench [rows] [rowsPerDirectory]
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int numRows = argc > 1 ? QByteArray(argv[1]).toInt() : 1000 * 1000;
+    const int rowsPerDir = argc > 2 ? QByteArray(argv[2]).toInt() : 1000;
+    const int numDirs = qMax(1, numRows / rowsPerDir);
+
+    QTemporaryDir tempDir;
+    SyncJournalDb db(tempDir.path() + "/sync.db");
+
+    QElapsedTimer timer;
+    timer.start();
+    db.setFileRecordWriteBehind(500);
+    for (int dirNum = 0; dirNum < numDirs; ++dirNum) {
+        const QByteArray dir = "dir" + QByteArray::number(dirNum);
+        SyncJournalFileRecord record;
+        record._path = dir;
+        record._type = ItemTypeDirectory;
+        record._etag = "etag";
+        record._fileId = "dirid" + QByteArray::number(dirNum);
+        record._remotePerm = RemotePermissions::fromDbValue("CKDNV");
+        db.setFileRecord(record);
+        for (int fileNum = 0; fileNum < rowsPerDir; ++fileNum) {
+            record._path = dir + "/file" + QByteArray::number(fileNum);
+            record._type = ItemTypeFile;
+            record._inode = static_cast<quint64>(dirNum) * rowsPerDir + fileNum + 1;
+            record._modtime = 1500000000 + fileNum;
+            record._fileId = "fileid" + QByteArray::number(record._inode);
+            record._fileSize = fileNum;
+            record._remotePerm = RemotePermissions::fromDbValue("WDNV");
+            record._checksumHeader = "SHA1:da39a3ee5e6b4b0d3255bfef95601890afd80709";
+            db.setFileRecord(record);
+        }
+    }
+    db.setFileRecordWriteBehind(0);
+    db.commit(QStringLiteral("bench setup"), false);
+    qDebug() << "SETUP" << numDirs * (rowsPerDir + 1) << "rows" << timer.restart() << "ms";
+
+    qint64 rows = 0;
+    qint64 pathBytes = 0;
+    for (int dirNum = 0; dirNum < numDirs; ++dirNum) {
+        db.listFilesInPath("dir" + QByteArray::number(dirNum), [&](const SyncJournalFileRecord &rec) {
+            ++rows;
+            pathBytes += rec._path.size();
+        });
+    }
+    const qint64 elapsed = qMax<qint64>(1, timer.elapsed());
+    qDebug() << "LISTFILESINPATH" << rows << "rows in" << elapsed << "ms,"
+             << (rows * 1000 / elapsed) << "rows/s" << "(" << pathBytes << "path bytes )";
+    return rows == qint64(numDirs) * rowsPerDir ? 0 : -1;
+}
@@ -0,0 +1,83 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QLoggingCategory>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QDebug>
+
+#include <memory>
+#include <vector>
+
+#include "logger.h"
+
+using namespace OCC;
+
+Q_LOGGING_CATEGORY(lcBench, "nextcloud.bench.logger", QtInfoMsg)
+
+static int countLines(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+    int lines = 0;
+    while (!file.atEnd()) {
+        const QByteArray data = file.read(1024 * 1024);
+        lines += data.count('\n');
+    }
+    return lines;
+}
+
+// Logs from several threads at once into a log file, with lines about as long
+// as the ones of SyncJournalDb::setFileRecord, and reports how many lines per
+// second get through the logger including the final flush to disk.
+//
+// Usage: LoggerBench [lines per thread]
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int linesPerThread = argc > 1 ? QByteArray(argv[1]).toInt() : 200000;
+
+    QTemporaryDir dir;
+    const QString payload = QStringLiteral("Updating file record for path: \"some/directory/below/the/sync/root/file.txt\""
+                                           " inode: 1234567 modtime: 1588000000 type: 0 etag: \"5ea7f2b1c3d4e\""
+                                           " fileId: \"00001234ocabcdefghij\" remotePerm: \"WDNVR\" fileSize: 123456");
+    bool ok = true;
+    for (int threadCount : { 1, 2, 4, 8 }) {
+        const QString logPath = dir.filePath(QStringLiteral("bench%1.log").arg(threadCount));
+        Logger::instance()->setLogFile(logPath);
+
+        std::vector<std::unique_ptr<QThread>> threads;
+        for (int t = 0; t < threadCount; ++t) {
+            threads.emplace_back(QThread::create([&payload, linesPerThread, t] {
+                for (int i = 0; i < linesPerThread; ++i)
+                    qCInfo(lcBench) << t << i << payload;
+            }));
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        for (auto &thread : threads)
+            thread->start();
+        for (auto &thread : threads)
+            thread->wait();
+        const qint64 producerMsecs = qMax<qint64>(1, timer.elapsed());
+        Logger::instance()->flush();
+        const qint64 msecs = qMax<qint64>(1, timer.elapsed());
+
+        Logger::instance()->setLogFile(QString());
+        const qint64 total = qint64(threadCount) * linesPerThread;
+        const int written = countLines(logPath);
+        qDebug().nospace() << threadCount << " threads: " << total * 1000 / msecs << " lines/s, "
+                           << total * 1000 / producerMsecs << " lines/s seen by the producers, "
+                           << written << " of " << total << " lines written";
+        ok &= written >= total;
+    }
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,124 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include "discoveryphase.h"
+#include "networkjobs.h"
+
+using namespace OCC;
+
+static const char basePath[] = "/remote.php/dav/files/user/bench";
+
+// A multistatus answer like the one of a Depth: infinity PROPFIND with all
+// the properties discovery asks for
+static QByteArray generateMultistatus(int entries)
+{
+    QByteArray xml = "<?xml version=\"1.0\"?>\n"
+                     "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\""
+                     " xmlns:oc=\"http://owncloud.org/ns\" xmlns:nc=\"http://nextcloud.org/ns\">";
+    xml.reserve(entries * 800);
+    for (int i = 0; i < entries; ++i) {
+        const bool isDir = i % 10 == 0;
+        xml += "<d:response><d:href>";
+        xml += basePath;
+        if (i > 0) {
+            xml += "/dir" + QByteArray::number(i / 1000) + "/";
+            if (isDir)
+                xml += "sub" + QByteArray::number(i) + "/";
+            else
+                xml += "file%20" + QByteArray::number(i) + ".txt";
+        } else {
+            xml += "/";
+        }
+        xml += "</d:href><d:propstat><d:prop>";
+        xml += isDir ? "<d:resourcetype><d:collection/></d:resourcetype>" : "<d:resourcetype/>";
+        xml += "<d:getlastmodified>Fri, 06 Feb 2015 13:49:55 GMT</d:getlastmodified>";
+        if (!isDir)
+            xml += "<d:getcontentlength>" + QByteArray::number(i * 37) + "</d:getcontentlength>";
+        xml += "<d:getetag>&quot;5527beb0400b0" + QByteArray::number(i) + "&quot;</d:getetag>"
+               "<oc:id>" + QByteArray::number(i).rightJustified(8, '0') + "ocobzus5kn6s</oc:id>"
+               "<oc:permissions>RDNVW</oc:permissions>"
+               "<oc:checksums><oc:checksum>SHA1:ae2b1fca515949e5d54fb22b8ed95575ade8e2b MD5:e2fc714c4727ee9395f324cd2e7f331f</oc:checksum></oc:checksums>"
+               "<oc:share-types/>"
+               "</d:prop><d:status>HTTP/1.1 200 OK</d:status></d:propstat>"
+               "<d:propstat><d:prop><oc:downloadURL/><oc:dDC/></d:prop>"
+               "<d:status>HTTP/1.1 404 Not Found</d:status></d:propstat></d:response>";
+    }
+    xml += "</d:multistatus>";
+    return xml;
+}
+
+static void report(const char *name, qint64 msecs, int entries, qint64 bytes)
+{
+    msecs = qMax<qint64>(1, msecs);
+    qDebug().nospace() << name << ": " << entries << " entries in " << msecs << " ms, "
+                       << entries * 1000 / msecs << " entries/s, "
+                       << double(bytes) / 1000 / msecs << " MB/s";
+}
+
+// Parses a large synthetic PROPFIND answer with the QMap based LsColXMLParser
+// (and the decoding discovery did on top of it) and with the typed
+// RemoteInfoParser. The answer is fed in 16 KiB chunks like a network reply.
+//
+// Usage: PropfindBench [number of entries]
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int entries = argc > 1 ? QByteArray(argv[1]).toInt() : 100000;
+    const int chunkSize = 16 * 1024;
+
+    const QByteArray xml = generateMultistatus(entries);
+    qDebug() << "answer size:" << xml.size() / 1024 << "KiB";
+
+    QElapsedTimer timer;
+    {
+        LsColXMLParser parser;
+        int count = 0;
+        qint64 size = 0;
+        QObject::connect(&parser, &LsColXMLParser::directoryListingIterated,
+            [&](const QString &file, const QMap<QString, QString> &map) {
+                // Roughly what the discovery did with every map
+                RemoteInfo info;
+                info.name = file.mid(file.lastIndexOf(QLatin1Char('/')) + 1);
+                info.etag = map.value(QStringLiteral("getetag")).toUtf8();
+                info.fileId = map.value(QStringLiteral("id")).toUtf8();
+                info.modtime = QDateTime::fromString(map.value(QStringLiteral("getlastmodified")), Qt::RFC2822Date).toTime_t();
+                info.remotePerm = RemotePermissions::fromServerString(map.value(QStringLiteral("permissions")));
+                info.size = map.value(QStringLiteral("getcontentlength")).toLongLong();
+                size += info.size;
+                ++count;
+            });
+        timer.start();
+        parser.start(nullptr, QString::fromLatin1(basePath));
+        for (int pos = 0; pos < xml.size(); pos += chunkSize)
+            parser.addData(xml.mid(pos, chunkSize));
+        const bool ok = parser.finish();
+        report("LsColXMLParser", timer.elapsed(), count, xml.size());
+        if (!ok)
+            return -1;
+    }
+    {
+        int count = 0;
+        qint64 size = 0;
+        RemoteInfoParser parser([&](RemoteInfoParser::Entry &entry) {
+            size += entry.info.size;
+            ++count;
+        });
+        timer.start();
+        parser.start(QString::fromLatin1(basePath));
+        for (int pos = 0; pos < xml.size(); pos += chunkSize)
+            parser.addData(xml.mid(pos, chunkSize));
+        const bool ok = parser.finish();
+        report("RemoteInfoParser", timer.elapsed(), count, xml.size());
+        if (!ok)
+            return -1;
+    }
+    return 0;
+}
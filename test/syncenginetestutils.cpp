@@ -7,6 +7,9 @@
 
 #include "syncenginetestutils.h"
 
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QJsonObject>
 
 #include <memory>
 
@@ -256,6 +259,40 @@ FileInfo *FileInfo::findInvalidatingEtags(PathComponents pathComponents)
     return find(std::move(pathComponents), true);
 }
 
+static const QString davUri { QStringLiteral("DAV:") };
+static const QString ocUri { QStringLiteral("http://owncloud.org/ns") };
+
+// Writes the <d:response> element a PROPFIND would return for fileInfo
+static void writeDavResponse(QXmlStreamWriter &xml, QIODevice &device, const QString &prefix, const FileInfo &fileInfo)
+{
+    xml.writeStartElement(davUri, QStringLiteral("response"));
+
+    xml.writeTextElement(davUri, QStringLiteral("href"), prefix + QString::fromUtf8(QUrl::toPercentEncoding(fileInfo.path(), "/")));
+    xml.writeStartElement(davUri, QStringLiteral("propstat"));
+    xml.writeStartElement(davUri, QStringLiteral("prop"));
+
+    if (fileInfo.isDir) {
+        xml.writeStartElement(davUri, QStringLiteral("resourcetype"));
+        xml.writeEmptyElement(davUri, QStringLiteral("collection"));
+        xml.writeEndElement(); // resourcetype
+    } else
+        xml.writeEmptyElement(davUri, QStringLiteral("resourcetype"));
+
+    auto gmtDate = fileInfo.lastModified.toUTC();
+    auto stringDate = QLocale::c().toString(gmtDate, QStringLiteral("ddd, dd MMM yyyy HH:mm:ss 'GMT'"));
+    xml.writeTextElement(davUri, QStringLiteral("getlastmodified"), stringDate);
+    xml.writeTextElement(davUri, QStringLiteral("getcontentlength"), QString::number(fileInfo.size));
+    xml.writeTextElement(davUri, QStringLiteral("getetag"), QStringLiteral("\"%1\"").arg(QString::fromLatin1(fileInfo.etag)));
+    xml.writeTextElement(ocUri, QStringLiteral("permissions"), !fileInfo.permissions.isNull() ? QString(fileInfo.permissions.toString()) : fileInfo.isShared ? QStringLiteral("SRDNVCKW") : QStringLiteral("RDNVCKW"));
+    xml.writeTextElement(ocUri, QStringLiteral("id"), QString::fromUtf8(fileInfo.fileId));
+    xml.writeTextElement(ocUri, QStringLiteral("checksums"), QString::fromUtf8(fileInfo.checksums));
+    device.write(fileInfo.extraDavProperties);
+    xml.writeEndElement(); // prop
+    xml.writeTextElement(davUri, QStringLiteral("status"), QStringLiteral("HTTP/1.1 200 OK"));
+    xml.writeEndElement(); // propstat
+    xml.writeEndElement(); // response
+}
+
 FakePropfindReply::FakePropfindReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
     : FakeReply { parent }
 {
@@ -274,8 +311,6 @@ FakePropfindReply::FakePropfindReply(FileInfo &remoteRootFileInfo, QNetworkAcces
     QString prefix = request.url().path().left(request.url().path().size() - fileName.size());
 
     // Don't care about the request and just return a full propfind
-    const QString davUri { QStringLiteral("DAV:") };
-    const QString ocUri { QStringLiteral("http://owncloud.org/ns") };
     QBuffer buffer { &payload };
     buffer.open(QIODevice::WriteOnly);
     QXmlStreamWriter xml(&buffer);
@@ -283,38 +318,16 @@ FakePropfindReply::FakePropfindReply(FileInfo &remoteRootFileInfo, QNetworkAcces
     xml.writeNamespace(ocUri, QStringLiteral("oc"));
     xml.writeStartDocument();
     xml.writeStartElement(davUri, QStringLiteral("multistatus"));
-    auto writeFileResponse = [&](const FileInfo &fileInfo) {
-        xml.writeStartElement(davUri, QStringLiteral("response"));
-
-        xml.writeTextElement(davUri, QStringLiteral("href"), prefix + QString::fromUtf8(QUrl::toPercentEncoding(fileInfo.path(), "/")));
-        xml.writeStartElement(davUri, QStringLiteral("propstat"));
-        xml.writeStartElement(davUri, QStringLiteral("prop"));
-
-        if (fileInfo.isDir) {
-            xml.writeStartElement(davUri, QStringLiteral("resourcetype"));
-            xml.writeEmptyElement(davUri, QStringLiteral("collection"));
-            xml.writeEndElement(); // resourcetype
-        } else
-            xml.writeEmptyElement(davUri, QStringLiteral("resourcetype"));
-
-        auto gmtDate = fileInfo.lastModified.toUTC();
-        auto stringDate = QLocale::c().toString(gmtDate, QStringLiteral("ddd, dd MMM yyyy HH:mm:ss 'GMT'"));
-        xml.writeTextElement(davUri, QStringLiteral("getlastmodified"), stringDate);
-        xml.writeTextElement(davUri, QStringLiteral("getcontentlength"), QString::number(fileInfo.size));
-        xml.writeTextElement(davUri, QStringLiteral("getetag"), QStringLiteral("\"%1\"").arg(QString::fromLatin1(fileInfo.etag)));
-        xml.writeTextElement(ocUri, QStringLiteral("permissions"), !fileInfo.permissions.isNull() ? QString(fileInfo.permissions.toString()) : fileInfo.isShared ? QStringLiteral("SRDNVCKW") : QStringLiteral("RDNVCKW"));
-        xml.writeTextElement(ocUri, QStringLiteral("id"), QString::fromUtf8(fileInfo.fileId));
-        xml.writeTextElement(ocUri, QStringLiteral("checksums"), QString::fromUtf8(fileInfo.checksums));
-        buffer.write(fileInfo.extraDavProperties);
-        xml.writeEndElement(); // prop
-        xml.writeTextElement(davUri, QStringLiteral("status"), QStringLiteral("HTTP/1.1 200 OK"));
-        xml.writeEndElement(); // propstat
-        xml.writeEndElement(); // response
+    writeDavResponse(xml, buffer, prefix, *fileInfo);
+    const bool infinite = request.rawHeader("Depth") == "infinity";
+    std::function<void(const FileInfo &)> writeChildren = [&](const FileInfo &dir) {
+        foreach (const FileInfo &childFileInfo, dir.children) {
+            writeDavResponse(xml, buffer, prefix, childFileInfo);
+            if (infinite)
+                writeChildren(childFileInfo);
+        }
     };
-
-    writeFileResponse(*fileInfo);
-    foreach (const FileInfo &childFileInfo, fileInfo->children)
-        writeFileResponse(childFileInfo);
+    writeChildren(*fileInfo);
     xml.writeEndElement(); // multistatus
     xml.writeEndDocument();
 
@@ -354,6 +367,99 @@ qint64 FakePropfindReply::readData(char *data, qint64 maxlen)
     return len;
 }
 
+// Collects what changed between two states of the remote tree, like a server
+// answering a sync-collection REPORT would
+static void collectSyncChanges(const FileInfo &oldDir, const FileInfo &newDir,
+    QVector<const FileInfo *> &changed, QStringList &removed)
+{
+    std::function<void(const FileInfo &)> addAll = [&](const FileInfo &info) {
+        changed.append(&info);
+        for (const auto &child : info.children)
+            addAll(child);
+    };
+    for (const auto &child : newDir.children) {
+        auto old = oldDir.children.constFind(child.name);
+        if (old == oldDir.children.constEnd() || old->isDir != child.isDir) {
+            addAll(child);
+            continue;
+        }
+        if (old->etag != child.etag || old->fileId != child.fileId || old->permissions != child.permissions
+            || old->isShared != child.isShared || old->size != child.size || old->lastModified != child.lastModified) {
+            changed.append(&child);
+        }
+        if (child.isDir)
+            collectSyncChanges(*old, child, changed, removed);
+    }
+    for (const auto &old : oldDir.children) {
+        if (!newDir.children.contains(old.name))
+            removed.append(old.path());
+    }
+}
+
+FakeSyncCollectionReply::FakeSyncCollectionReply(const FileInfo &oldState, FileInfo &remoteRootFileInfo, const QByteArray &newSyncToken,
+    QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    : FakeReply { parent }
+{
+    setRequest(request);
+    setUrl(request.url());
+    setOperation(op);
+    open(QIODevice::ReadOnly);
+
+    QString fileName = getFilePathFromUrl(request.url());
+    Q_ASSERT(fileName.isEmpty()); // only supported on the root
+    QString prefix = request.url().path();
+
+    QVector<const FileInfo *> changed;
+    QStringList removed;
+    collectSyncChanges(oldState, remoteRootFileInfo, changed, removed);
+
+    QBuffer buffer { &payload };
+    buffer.open(QIODevice::WriteOnly);
+    QXmlStreamWriter xml(&buffer);
+    xml.writeNamespace(davUri, QStringLiteral("d"));
+    xml.writeNamespace(ocUri, QStringLiteral("oc"));
+    xml.writeStartDocument();
+    xml.writeStartElement(davUri, QStringLiteral("multistatus"));
+    for (const auto &path : removed) {
+        xml.writeStartElement(davUri, QStringLiteral("response"));
+        xml.writeTextElement(davUri, QStringLiteral("href"), prefix + QString::fromUtf8(QUrl::toPercentEncoding(path, "/")));
+        xml.writeTextElement(davUri, QStringLiteral("status"), QStringLiteral("HTTP/1.1 404 Not Found"));
+        xml.writeEndElement(); // response
+    }
+    for (const auto *info : changed)
+        writeDavResponse(xml, buffer, prefix, *info);
+    xml.writeTextElement(davUri, QStringLiteral("sync-token"), QString::fromUtf8(newSyncToken));
+    xml.writeEndElement(); // multistatus
+    xml.writeEndDocument();
+
+    QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+}
+
+void FakeSyncCollectionReply::respond()
+{
+    setHeader(QNetworkRequest::ContentLengthHeader, payload.size());
+    setHeader(QNetworkRequest::ContentTypeHeader, QByteArrayLiteral("application/xml; charset=utf-8"));
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 207);
+    setFinished(true);
+    emit metaDataChanged();
+    if (bytesAvailable())
+        emit readyRead();
+    emit finished();
+}
+
+qint64 FakeSyncCollectionReply::bytesAvailable() const
+{
+    return payload.size() + QIODevice::bytesAvailable();
+}
+
+qint64 FakeSyncCollectionReply::readData(char *data, qint64 maxlen)
+{
+    qint64 len = std::min(qint64 { payload.size() }, maxlen);
+    std::copy(payload.cbegin(), payload.cbegin() + len, data);
+    payload.remove(0, static_cast<int>(len));
+    return len;
+}
+
 FakePutReply::FakePutReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, const QByteArray &putPayload, QObject *parent)
     : FakeReply { parent }
 {
@@ -497,14 +603,29 @@ void FakeGetReply::respond()
     }
     payload = fileInfo->contentChar;
     size = fileInfo->size;
+    int status = 200;
+
+    // Closed ranges get a partial answer, resumed downloads the whole file
+    const QRegularExpression bytesPattern(QStringLiteral("^bytes=(?<start>\\d+)-(?<end>\\d+)$"));
+    const QRegularExpressionMatch match = bytesPattern.match(QString::fromUtf8(request().rawHeader("Range")));
+    if (match.hasMatch() && match.captured(QStringLiteral("start")).toInt() < fileInfo->size) {
+        const int start = match.captured(QStringLiteral("start")).toInt();
+        const int end = std::min(match.captured(QStringLiteral("end")).toInt(), int(fileInfo->size) - 1);
+        size = end - start + 1;
+        status = 206;
+        setRawHeader("Content-Range", QStringLiteral("bytes %1-%2/%3").arg(start).arg(end).arg(fileInfo->size).toUtf8());
+    }
+
     setHeader(QNetworkRequest::ContentLengthHeader, size);
-    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, status);
     setRawHeader("OC-ETag", fileInfo->etag);
     setRawHeader("ETag", fileInfo->etag);
     setRawHeader("OC-FileId", fileInfo->fileId);
     emit metaDataChanged();
     if (bytesAvailable())
         emit readyRead();
+    // A bandwidth limited reader leaves data in the reply and relies on isFinished()
+    setFinished(true);
     emit finished();
 }
 
@@ -724,6 +845,59 @@ qint64 FakePayloadReply::bytesAvailable() const
     return _body.size();
 }
 
+FakeBulkUploadReply::FakeBulkUploadReply(FileInfo &remoteRootFileInfo, const QHash<QString, int> &errorPaths,
+    QNetworkAccessManager::Operation op, const QNetworkRequest &request, const QByteArray &body, QObject *parent)
+    : FakePayloadReply { op, request, perform(remoteRootFileInfo, errorPaths, request, body), parent }
+{
+}
+
+QByteArray FakeBulkUploadReply::perform(FileInfo &remoteRootFileInfo, const QHash<QString, int> &errorPaths,
+    const QNetworkRequest &request, const QByteArray &body)
+{
+    const auto contentType = request.header(QNetworkRequest::ContentTypeHeader).toByteArray();
+    const QByteArray delimiter = "--" + contentType.mid(contentType.indexOf("boundary=") + 9);
+
+    QJsonObject results;
+    int pos = body.indexOf(delimiter);
+    while (pos != -1 && body.mid(pos + delimiter.size(), 2) == "\r\n") {
+        const int headersStart = pos + delimiter.size() + 2;
+        const int headersEnd = body.indexOf("\r\n\r\n", headersStart);
+        Q_ASSERT(headersEnd != -1);
+        QMap<QByteArray, QByteArray> headers;
+        for (const auto &line : body.mid(headersStart, headersEnd - headersStart).split('\n')) {
+            const int colon = line.indexOf(':');
+            headers[line.left(colon).trimmed().toLower()] = line.mid(colon + 1).trimmed();
+        }
+        const int contentLength = headers.value("content-length").toInt();
+        const QByteArray content = body.mid(headersEnd + 4, contentLength);
+        pos = body.indexOf(delimiter, headersEnd + 4 + contentLength);
+
+        const QString remotePath = QString::fromUtf8(headers.value("x-file-path"));
+        const QString fileName = remotePath.mid(1);
+        QJsonObject result;
+        if (errorPaths.contains(fileName)) {
+            result[QStringLiteral("error")] = true;
+            result[QStringLiteral("message")] = QStringLiteral("Error %1").arg(errorPaths[fileName]);
+        } else if (headers.value("x-file-md5") != QCryptographicHash::hash(content, QCryptographicHash::Md5).toHex()) {
+            // Like the server, which requires it
+            result[QStringLiteral("error")] = true;
+            result[QStringLiteral("message")] = QStringLiteral("X-File-MD5 is missing or does not match");
+        } else {
+            // Same as a PUT of the file
+            QUrl url = sRootUrl2;
+            url.setPath(sRootUrl2.path() + fileName);
+            QNetworkRequest putRequest(url);
+            putRequest.setRawHeader("X-OC-Mtime", headers.value("x-file-mtime"));
+            const FileInfo *fileInfo = FakePutReply::perform(remoteRootFileInfo, putRequest, content);
+            result[QStringLiteral("error")] = false;
+            result[QStringLiteral("etag")] = QString::fromUtf8(fileInfo->etag);
+            result[QStringLiteral("fileid")] = QString::fromUtf8(fileInfo->fileId);
+        }
+        results[remotePath] = result;
+    }
+    return QJsonDocument(results).toJson();
+}
+
 FakeErrorReply::FakeErrorReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent, int httpErrorCode, const QByteArray &body)
     : FakeReply { parent }
     , _body(body)
@@ -795,6 +969,9 @@ QNetworkReply *FakeQNAM::createRequest(QNetworkAccessManager::Operation op, cons
         if (auto reply = _override(op, request, outgoingData))
             return reply;
     }
+    if (op == QNetworkAccessManager::PostOperation && request.url().path().endsWith(QLatin1String("/remote.php/dav/bulk")))
+        return new FakeBulkUploadReply { _remoteRootFileInfo, _errorPaths, op, request, outgoingData->readAll(), this };
+
     const QString fileName = getFilePathFromUrl(request.url());
     Q_ASSERT(!fileName.isNull());
     if (_errorPaths.contains(fileName))
@@ -805,9 +982,29 @@ QNetworkReply *FakeQNAM::createRequest(QNetworkAccessManager::Operation op, cons
 
     auto verb = request.attribute(QNetworkRequest::CustomVerbAttribute);
     FakeReply *reply = nullptr;
-    if (verb == QLatin1String("PROPFIND"))
+    if (verb == QLatin1String("PROPFIND") && request.rawHeader("Depth") == "infinity" && !_propfindDepthInfinityEnabled) {
+        // Like SabreDAV's default, silently treat it as Depth: 1
+        QNetworkRequest finiteRequest = request;
+        finiteRequest.setRawHeader("Depth", "1");
+        reply = new FakePropfindReply { info, op, finiteRequest, this };
+    } else if (verb == QLatin1String("PROPFIND") && _syncCollectionEnabled && fileName.isEmpty() && !isUpload) {
+        // Advertise the current state as the root's DAV:sync-token
+        const auto extraDavProperties = info.extraDavProperties;
+        info.extraDavProperties += "<d:sync-token>" + issueSyncToken() + "</d:sync-token>";
+        reply = new FakePropfindReply { info, op, request, this };
+        info.extraDavProperties = extraDavProperties;
+    } else if (verb == QLatin1String("PROPFIND"))
         // Ignore outgoingData always returning somethign good enough, works for now.
         reply = new FakePropfindReply { info, op, request, this };
+    else if (verb == QLatin1String("REPORT") && _syncCollectionEnabled) {
+        static const QRegularExpression tokenRx(QStringLiteral("<d:sync-token>(.*)</d:sync-token>"));
+        const auto token = tokenRx.match(QString::fromUtf8(outgoingData->readAll())).captured(1).toUtf8();
+        if (!_syncTokenSnapshots.contains(token))
+            return new FakeErrorReply { op, request, this, 403 };
+        const auto newToken = issueSyncToken();
+        reply = new FakeSyncCollectionReply { _syncTokenSnapshots[token], info, newToken, op, request, this };
+    } else if (verb == QLatin1String("REPORT"))
+        return new FakeErrorReply { op, request, this, 405 };
     else if (verb == QLatin1String("GET") || op == QNetworkAccessManager::GetOperation)
         reply = new FakeGetReply { info, op, request, this };
     else if (verb == QLatin1String("PUT") || op == QNetworkAccessManager::PutOperation)
@@ -827,6 +1024,13 @@ QNetworkReply *FakeQNAM::createRequest(QNetworkAccessManager::Operation op, cons
     return reply;
 }
 
+QByteArray FakeQNAM::issueSyncToken()
+{
+    const auto token = "fake-sync-token-" + QByteArray::number(++_syncTokenCount);
+    _syncTokenSnapshots.insert(token, _remoteRootFileInfo);
+    return token;
+}
+
 FakeFolder::FakeFolder(const FileInfo &fileTemplate)
     : _localModifier(_tempDir.path())
 {
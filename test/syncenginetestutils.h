@@ -196,6 +196,24 @@ public:
     qint64 readData(char *data, qint64 maxlen) override;
 };
 
+// Answers a sync-collection REPORT with the changes between two remote states
+class FakeSyncCollectionReply : public FakeReply
+{
+    Q_OBJECT
+public:
+    QByteArray payload;
+
+    FakeSyncCollectionReply(const FileInfo &oldState, FileInfo &remoteRootFileInfo, const QByteArray &newSyncToken,
+        QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent);
+
+    Q_INVOKABLE void respond();
+
+    void abort() override { }
+
+    qint64 bytesAvailable() const override;
+    qint64 readData(char *data, qint64 maxlen) override;
+};
+
 class FakePutReply : public FakeReply
 {
     Q_OBJECT
@@ -321,6 +339,18 @@ public:
     QByteArray _body;
 };
 
+// Answers a POST to the bulk upload endpoint, paths in errorPaths fail
+class FakeBulkUploadReply : public FakePayloadReply
+{
+    Q_OBJECT
+public:
+    FakeBulkUploadReply(FileInfo &remoteRootFileInfo, const QHash<QString, int> &errorPaths,
+        QNetworkAccessManager::Operation op, const QNetworkRequest &request, const QByteArray &body,
+        QObject *parent);
+
+    static QByteArray perform(FileInfo &remoteRootFileInfo, const QHash<QString, int> &errorPaths,
+        const QNetworkRequest &request, const QByteArray &body);
+};
 
 class FakeErrorReply : public FakeReply
 {
@@ -391,6 +421,11 @@ private:
     QHash<QString, int> _errorPaths;
     // monitor requests and optionally provide custom replies
     Override _override;
+    // the remote state at the time each sync token was handed out
+    QHash<QByteArray, FileInfo> _syncTokenSnapshots;
+    int _syncTokenCount = 0;
+    bool _syncCollectionEnabled = false;
+    bool _propfindDepthInfinityEnabled = false;
 
 public:
     FakeQNAM(FileInfo initialRoot);
@@ -401,6 +436,15 @@ public:
 
     void setOverride(const Override &override) { _override = override; }
 
+    /// Advertise a DAV:sync-token on the root and answer sync-collection REPORTs
+    void setSyncCollectionEnabled(bool enabled) { _syncCollectionEnabled = enabled; }
+    /// Forget all handed out tokens, like a server that expired them
+    void expireSyncTokens() { _syncTokenSnapshots.clear(); }
+    QByteArray issueSyncToken();
+
+    /// Answer PROPFINDs with Depth: infinity instead of treating them as Depth: 1
+    void setPropfindDepthInfinityEnabled(bool enabled) { _propfindDepthInfinityEnabled = enabled; }
+
 protected:
     QNetworkReply *createRequest(Operation op, const QNetworkRequest &request,
         QIODevice *outgoingData = nullptr) override;
@@ -459,6 +503,7 @@ public:
     };
     ErrorList serverErrorPaths() { return {_fakeQnam}; }
     void setServerOverride(const FakeQNAM::Override &override) { _fakeQnam->setOverride(override); }
+    FakeQNAM &fakeServer() { return *_fakeQnam; }
 
     QString localPath() const;
 
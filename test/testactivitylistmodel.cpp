@@ -0,0 +1,174 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include <QAbstractItemModelTester>
+
+#include "tray/ActivityListModel.h"
+#include "syncfileitem.h"
+
+using namespace OCC;
+
+class TestActivityListModel : public QObject
+{
+    Q_OBJECT
+
+    QDateTime _start = QDateTime::currentDateTimeUtc();
+
+    Activity makeActivity(Activity::Type type, const QString &folder, const QString &file, int seconds, qlonglong id)
+    {
+        Activity activity;
+        activity._type = type;
+        activity._id = id;
+        activity._folder = folder;
+        activity._file = file;
+        activity._subject = QStringLiteral("%1:%2").arg(folder, file);
+        activity._dateTime = _start.addSecs(seconds);
+        activity._accName = QStringLiteral("account");
+        activity._status = SyncFileItem::NormalError;
+        return activity;
+    }
+
+    Activity makeError(const QString &folder, const QString &file, int seconds, qlonglong id)
+    {
+        return makeActivity(Activity::SyncFileItemType, folder, file, seconds, id);
+    }
+
+    static QStringList subjects(const ActivityListModel &model)
+    {
+        QStringList result;
+        for (int i = 0; i < model.rowCount(); ++i) {
+            result.append(model.data(model.index(i), ActivityListModel::ActionTextRole).toString());
+        }
+        return result;
+    }
+
+private slots:
+    void testSortedInsertion()
+    {
+        ActivityListModel model(nullptr);
+        QAbstractItemModelTester tester(&model, QAbstractItemModelTester::FailureReportingMode::QtTest);
+
+        model.addErrorToActivityList(makeError("f", "a", 1, 1));
+        model.addErrorToActivityList(makeError("f", "c", 3, 2));
+        model.addErrorToActivityList(makeError("f", "b", 2, 3));
+        QCOMPARE(subjects(model), QStringList({ "f:c", "f:b", "f:a" }));
+
+        // The sections keep their order whatever the times
+        model.addSyncFileItemToActivityList(makeActivity(Activity::SyncFileItemType, "f", "new", 10, 4));
+        model.addNotificationToActivityList(makeActivity(Activity::NotificationType, "", "", 5, 5));
+        model.addErrorToActivityList(makeError("f", "old", 0, 6));
+        QCOMPARE(subjects(model), QStringList({ "f:c", "f:b", "f:a", "f:old", ":", "f:new" }));
+    }
+
+    void testPathCoalescing()
+    {
+        ActivityListModel model(nullptr);
+        QAbstractItemModelTester tester(&model, QAbstractItemModelTester::FailureReportingMode::QtTest);
+
+        auto first = makeError("f", "a", 1, 1);
+        first._subject = "first";
+        model.addErrorToActivityList(first);
+        model.addErrorToActivityList(makeError("f", "b", 2, 2));
+
+        // A newer error for the same path replaces the listed one
+        auto second = makeError("f", "a", 3, 3);
+        second._subject = "second";
+        model.addErrorToActivityList(second);
+        QCOMPARE(subjects(model), QStringList({ "second", "f:b" }));
+
+        // Other folders and entries without a file are kept apart
+        model.addErrorToActivityList(makeError("g", "a", 4, 4));
+        model.addErrorToActivityList(makeError("f", "", 5, 5));
+        model.addErrorToActivityList(makeError("f", "", 6, 6));
+        QCOMPARE(model.rowCount(), 5);
+
+        // Same for the sync file items
+        model.addSyncFileItemToActivityList(makeActivity(Activity::SyncFileItemType, "f", "a", 7, 7));
+        model.addSyncFileItemToActivityList(makeActivity(Activity::SyncFileItemType, "f", "a", 8, 8));
+        QCOMPARE(model.rowCount(), 6);
+    }
+
+    void testWindow()
+    {
+        ActivityListModel model(nullptr);
+        QAbstractItemModelTester tester(&model, QAbstractItemModelTester::FailureReportingMode::QtTest);
+
+        for (int i = 0; i < 250; ++i) {
+            model.addErrorToActivityList(makeError("f", QString::number(i), i, i));
+        }
+        QCOMPARE(model.rowCount(), 100);
+        QCOMPARE(model.activityList().size(), 250);
+        QCOMPARE(subjects(model).first(), QString("f:249"));
+
+        // A new youngest entry pushes the last row out of the window
+        model.addErrorToActivityList(makeError("f", "young", 1000, 1000));
+        QCOMPARE(model.rowCount(), 100);
+        QCOMPARE(subjects(model).first(), QString("f:young"));
+        QCOMPARE(subjects(model).last(), QString("f:151"));
+
+        // An old entry goes below the window
+        model.addErrorToActivityList(makeError("f", "old", -1, 1001));
+        QCOMPARE(model.rowCount(), 100);
+        QCOMPARE(model.activityList().size(), 252);
+
+        QVERIFY(model.canFetchMore(QModelIndex()));
+        model.fetchMore(QModelIndex());
+        QCOMPARE(model.rowCount(), 200);
+        model.fetchMore(QModelIndex());
+        QCOMPARE(model.rowCount(), 252);
+        QCOMPARE(subjects(model).last(), QString("f:old"));
+        QVERIFY(!model.canFetchMore(QModelIndex()));
+
+        // The oldest errors are dropped beyond the cap
+        for (int i = 250; i < 2100; ++i) {
+            model.addErrorToActivityList(makeError("f", QString::number(i), i, i));
+        }
+        const auto errors = model.errorsList();
+        QCOMPARE(errors.size(), 2000);
+        QCOMPARE(errors.first()._file, QString("2099"));
+        QCOMPARE(errors.last()._file, QString("101"));
+    }
+
+    void testRemoval()
+    {
+        ActivityListModel model(nullptr);
+        QAbstractItemModelTester tester(&model, QAbstractItemModelTester::FailureReportingMode::QtTest);
+
+        // Interleaved errors of two folders, more than fit in the window
+        for (int i = 0; i < 200; ++i) {
+            model.addErrorToActivityList(makeError(i % 4 ? "f" : "g", QString::number(i), i, i));
+        }
+        QCOMPARE(model.rowCount(), 100);
+
+        // Single entries, by row and by activity
+        model.removeActivityFromActivityList(0);
+        QCOMPARE(subjects(model).first(), QString("f:198"));
+        model.removeActivityFromActivityList(makeError("f", "198", 198, 198));
+        QCOMPARE(subjects(model).first(), QString("f:197"));
+        QCOMPARE(model.rowCount(), 100);
+        QCOMPARE(model.activityList().size(), 198);
+
+        // All errors of a folder that match at once, the window is refilled
+        model.removeErrorsFromActivityList("f", [](const Activity &activity) {
+            return activity._file != "1";
+        });
+        QCOMPARE(model.rowCount(), 51);
+        QCOMPARE(model.activityList().size(), 51);
+        for (const auto &activity : model.errorsList()) {
+            QVERIFY(activity._folder == "g" || activity._file == "1");
+        }
+        QCOMPARE(subjects(model).first(), QString("g:196"));
+        QCOMPARE(subjects(model).mid(49), QStringList({ "f:1", "g:0" }));
+
+        model.removeErrorsFromActivityList("g", [](const Activity &) { return true; });
+        QCOMPARE(subjects(model), QStringList({ "f:1" }));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestActivityListModel)
+#include "testactivitylistmodel.moc"
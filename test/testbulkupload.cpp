@@ -0,0 +1,174 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+struct RequestCounts
+{
+    int bulk = 0;
+    int put = 0;
+};
+
+static void countRequests(FakeFolder &fakeFolder, RequestCounts &counts)
+{
+    fakeFolder.setServerOverride([&counts](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+        if (op == QNetworkAccessManager::PostOperation && request.url().path().endsWith(QLatin1String("/remote.php/dav/bulk")))
+            ++counts.bulk;
+        if (op == QNetworkAccessManager::PutOperation)
+            ++counts.put;
+        return nullptr;
+    });
+}
+
+static void enableBulkUpload(FakeFolder &fakeFolder)
+{
+    fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "bulkupload", "1.0" } } } });
+}
+
+class TestBulkUpload : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testBulkUpload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        enableBulkUpload(fakeFolder);
+        RequestCounts counts;
+        countRequests(fakeFolder, counts);
+
+        for (int i = 1; i <= 5; ++i)
+            fakeFolder.localModifier().insert(QStringLiteral("A/new%1").arg(i), 100 + i);
+        fakeFolder.localModifier().appendByte("A/a1");
+        fakeFolder.localModifier().insert("A/zbig", 2 * 1000 * 1000);
+        fakeFolder.localModifier().insert("B/new1", 200);
+        fakeFolder.localModifier().insert("B/new2", 300);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // One request per directory, the big file goes on its own
+        QCOMPARE(counts.bulk, 2);
+        QCOMPARE(counts.put, 1);
+
+        // The etags of the results made it to the database
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("A/new3"), &record));
+        QCOMPARE(record._etag, fakeFolder.currentRemoteState().find("A/new3")->etag);
+        QCOMPARE(record._fileId, fakeFolder.currentRemoteState().find("A/new3")->fileId);
+
+        counts = RequestCounts();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(counts.bulk, 0);
+        QCOMPARE(counts.put, 0);
+    }
+
+    // The server requires X-File-MD5 on every part, whatever checksum is transmitted
+    void testChecksumTypes_data()
+    {
+        QTest::addColumn<QString>("checksumType");
+        QTest::newRow("MD5") << QStringLiteral("MD5");
+        QTest::newRow("SHA1") << QStringLiteral("SHA1");
+        QTest::newRow("Adler32") << QStringLiteral("Adler32");
+    }
+
+    void testChecksumTypes()
+    {
+        QFETCH(QString, checksumType);
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setCapabilities({
+            { "dav", QVariantMap{ { "bulkupload", "1.0" } } },
+            { "checksums", QVariantMap{ { "supportedTypes", QStringList{ checksumType } }, { "preferredUploadType", checksumType } } } });
+        RequestCounts counts;
+        countRequests(fakeFolder, counts);
+
+        fakeFolder.localModifier().insert("A/new1", 100);
+        fakeFolder.localModifier().insert("A/new2", 200);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counts.bulk, 1);
+        QCOMPARE(counts.put, 0);
+    }
+
+    void testWithoutCapability()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        RequestCounts counts;
+        countRequests(fakeFolder, counts);
+
+        fakeFolder.localModifier().insert("A/new1", 100);
+        fakeFolder.localModifier().insert("A/new2", 100);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counts.bulk, 0);
+        QCOMPARE(counts.put, 2);
+    }
+
+    // A file the server rejects is uploaded again on its own
+    void testFileError()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        enableBulkUpload(fakeFolder);
+        RequestCounts counts;
+        countRequests(fakeFolder, counts);
+
+        fakeFolder.localModifier().insert("A/new1", 100);
+        fakeFolder.localModifier().insert("A/new2", 100);
+        fakeFolder.localModifier().insert("A/new3", 100);
+        fakeFolder.serverErrorPaths().append("A/new2", 500);
+        QVERIFY(!fakeFolder.syncOnce());
+        QCOMPARE(counts.bulk, 1);
+        QCOMPARE(counts.put, 1);
+        QVERIFY(fakeFolder.currentRemoteState().find("A/new1"));
+        QVERIFY(!fakeFolder.currentRemoteState().find("A/new2"));
+        QVERIFY(fakeFolder.currentRemoteState().find("A/new3"));
+
+        // The separate upload succeeds once the error is gone
+        fakeFolder.serverErrorPaths().clear();
+        fakeFolder.syncJournal().wipeErrorBlacklist();
+        counts = RequestCounts();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counts.put, 1);
+    }
+
+    // If the bulk request fails, its files and all later ones go one by one
+    void testRequestError()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        enableBulkUpload(fakeFolder);
+        int bulkRequests = 0;
+        int putRequests = 0;
+        QObject parent;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PostOperation) {
+                ++bulkRequests;
+                return new FakeErrorReply(op, request, &parent, 404);
+            }
+            if (op == QNetworkAccessManager::PutOperation)
+                ++putRequests;
+            return nullptr;
+        });
+
+        fakeFolder.localModifier().insert("A/new1", 100);
+        fakeFolder.localModifier().insert("A/new2", 100);
+        fakeFolder.localModifier().insert("B/new1", 100);
+        fakeFolder.localModifier().insert("B/new2", 100);
+        fakeFolder.localModifier().insert("C/new1", 100);
+        fakeFolder.localModifier().insert("C/new2", 100);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(bulkRequests >= 1);
+        QCOMPARE(putRequests, 6);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestBulkUpload)
+#include "testbulkupload.moc"
@@ -174,6 +174,43 @@ using namespace OCC::Utility;
         delete vali;
     }
 
+    void testMultipleChecksumsOnePass() {
+        QByteArrayList types = { checkSumMD5C, checkSumSHA1C, "Klaas32" };
+#ifdef ZLIB_FOUND
+        types.append(checkSumAdlerC);
+#endif
+
+        QFile file(_testfile);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        const auto results = ComputeChecksum::computeNow(&file, types);
+        QCOMPARE(results.size(), types.size());
+
+        for (int i = 0; i < types.size(); ++i) {
+            QVERIFY(file.seek(0));
+            QCOMPARE(results.at(i), ComputeChecksum::computeNow(&file, types.at(i)));
+        }
+        QVERIFY(file.seek(0));
+        QCOMPARE(results.at(0), calcMd5(&file));
+        QVERIFY(file.seek(0));
+        QCOMPARE(results.at(1), calcSha1(&file));
+        QVERIFY(results.at(2).isNull());
+#ifdef ZLIB_FOUND
+        QVERIFY(file.seek(0));
+        QCOMPARE(results.at(3), calcAdler32(&file));
+#endif
+
+        // Asynchronously, reporting unknown types as empty
+        ComputeChecksum compute;
+        compute.setChecksumTypes(types);
+        QSignalSpy spy(&compute, &ComputeChecksum::allDone);
+        compute.start(_testfile);
+        QVERIFY(spy.wait());
+        auto expectedTypes = types;
+        expectedTypes[2].clear();
+        QCOMPARE(spy.at(0).at(0).value<QByteArrayList>(), expectedTypes);
+        QCOMPARE(spy.at(0).at(1).value<QByteArrayList>(), results);
+    }
+
     void testDownloadChecksummingAdler() {
 #ifndef ZLIB_FOUND
         QSKIP("ZLIB not found.", SkipSingle);
@@ -18,6 +18,11 @@ static void partialUpload(FakeFolder &fakeFolder, const QString &name, qint64 si
     QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     QCOMPARE(fakeFolder.uploadState().children.count(), 0); // The state should be clean
 
+    // The size check below needs the chunks to be uploaded one after another
+    auto options = fakeFolder.syncEngine().syncOptions();
+    options._maxParallelChunks = 1;
+    fakeFolder.syncEngine().setSyncOptions(options);
+
     fakeFolder.localModifier().insert(name, size);
     // Abort when the upload is at 1/3
     qint64 sizeWhenAbort = -1;
@@ -592,6 +597,94 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    // Several chunks of the same file are uploaded at once
+    void testParallelChunkUpload() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
+        setChunkSize(fakeFolder.syncEngine(), 1 * 1000 * 1000);
+        const int size = 20 * 1000 * 1000; // 20 MB
+
+        QObject parent;
+        int inFlight = 0;
+        int maxInFlight = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+            if (op != QNetworkAccessManager::PutOperation)
+                return nullptr;
+            auto reply = new FakePutReply(fakeFolder.uploadState(), op, request, outgoingData->readAll(), &parent);
+            maxInFlight = qMax(maxInFlight, ++inFlight);
+            connect(reply, &QNetworkReply::finished, [&]() { --inFlight; });
+            return reply;
+        });
+
+        fakeFolder.localModifier().insert("A/a0", size);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/a0")->size, size);
+        QVERIFY(maxInFlight >= 2);
+        QVERIFY(maxInFlight <= SyncOptions()._maxParallelChunks);
+
+        // The window can be closed
+        auto options = fakeFolder.syncEngine().syncOptions();
+        options._maxParallelChunks = 1;
+        fakeFolder.syncEngine().setSyncOptions(options);
+        maxInFlight = 0;
+        fakeFolder.localModifier().appendByte("A/a0");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(maxInFlight, 1);
+    }
+
+    // Resume after an abort left chunks behind a missing one
+    void testParallelChunkResume() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ {"chunking", "1.0"} } } });
+        setChunkSize(fakeFolder.syncEngine(), 1 * 1000 * 1000);
+        const int size = 20 * 1000 * 1000; // 20 MB
+
+        fakeFolder.localModifier().insert("A/a0", size);
+        auto con = QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::transmissionProgress,
+                                    [&](const ProgressInfo &progress) {
+                if (progress.completedSize() > (progress.totalSize() / 3)) {
+                    fakeFolder.syncEngine().abort();
+                }
+        });
+        QVERIFY(!fakeFolder.syncOnce());
+        QObject::disconnect(con);
+
+        QCOMPARE(fakeFolder.uploadState().children.count(), 1);
+        auto chunkingId = fakeFolder.uploadState().children.first().name;
+        auto &chunkMap = fakeFolder.uploadState().children.first().children;
+        QVERIFY(chunkMap.size() >= 3);
+
+        // Remove the second chunk as if it had not finished before the abort
+        QStringList chunksToDelete = chunkMap.keys().mid(2);
+        chunkMap.remove(chunkMap.keys().at(1));
+        const qint64 keptSize = chunkMap.first().size;
+
+        QStringList deletedPaths;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation) {
+                // Only the chunks up to the hole are kept
+                Q_ASSERT(request.rawHeader("OC-Chunk-Offset").toLongLong() >= keptSize);
+            } else if (op == QNetworkAccessManager::DeleteOperation) {
+                deletedPaths.append(request.url().path());
+            }
+            return nullptr;
+        });
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/a0")->size, size);
+        for (const auto &name : qAsConst(chunksToDelete)) {
+            QVERIFY(std::any_of(deletedPaths.cbegin(), deletedPaths.cend(),
+                [&name](const QString &path) { return path.endsWith(name); }));
+        }
+
+        // The same chunk id was re-used
+        QCOMPARE(fakeFolder.uploadState().children.count(), 1);
+        QCOMPARE(fakeFolder.uploadState().children.first().name, chunkingId);
+    }
+
     // Test uploading large files (2.5GiB)
     void testVeryBigFiles() {
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
@@ -0,0 +1,83 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include "configfile.h"
+
+using namespace OCC;
+using namespace std::chrono_literals;
+
+class TestConfigFile : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir _dir;
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(_dir.isValid());
+        ConfigFile::setConfDir(_dir.path()); // we don't want to pollute the user's config file
+    }
+
+    void testWriteThrough()
+    {
+        QSignalSpy changedSpy(ConfigFileNotifier::instance(), &ConfigFileNotifier::changed);
+
+        ConfigFile cfg;
+        cfg.setLogDir(QStringLiteral("/some/dir"));
+        cfg.setRemotePollInterval(42s, QStringLiteral("SomeAccount"));
+        QCOMPARE(changedSpy.count(), 2);
+
+        // Other instances see the values and they are in the file
+        QCOMPARE(ConfigFile().logDir(), QStringLiteral("/some/dir"));
+        QCOMPARE(ConfigFile().remotePollInterval(QStringLiteral("SomeAccount")), std::chrono::milliseconds(42000));
+        QCOMPARE(ConfigFile().remotePollInterval(), std::chrono::milliseconds(30000));
+        QSettings settings(cfg.configFile(), QSettings::IniFormat);
+        QCOMPARE(settings.value(QStringLiteral("logDir")).toString(), QStringLiteral("/some/dir"));
+        QCOMPARE(settings.value(QStringLiteral("SomeAccount/remotePollInterval")).toLongLong(), 42000);
+    }
+
+    void testExternalModification()
+    {
+        ConfigFile cfg;
+        QCOMPARE(cfg.chunkSize(), 10 * 1000 * 1000);
+        QSignalSpy changedSpy(ConfigFileNotifier::instance(), &ConfigFileNotifier::changed);
+
+        // The modification is noticed without reading the file again
+        QSettings settings(cfg.configFile(), QSettings::IniFormat);
+        settings.setValue(QStringLiteral("chunkSize"), 5678);
+        settings.setValue(QStringLiteral("maxChunkSize"), 123456789);
+        settings.sync();
+        QVERIFY(changedSpy.wait());
+        QCOMPARE(cfg.chunkSize(), 5678);
+        QCOMPARE(cfg.maxChunkSize(), 123456789);
+
+        // And so is a removal
+        settings.remove(QStringLiteral("maxChunkSize"));
+        settings.sync();
+        QTRY_COMPARE(cfg.maxChunkSize(), 100 * 1000 * 1000);
+    }
+
+    void testSettingsWithGroup()
+    {
+        QSignalSpy changedSpy(ConfigFileNotifier::instance(), &ConfigFileNotifier::changed);
+
+        // The values are taken over as soon as the settings are written
+        {
+            auto settings = ConfigFile::settingsWithGroup(QStringLiteral("OtherAccount"));
+            settings->setValue(QStringLiteral("remotePollInterval"), 7000);
+        }
+        QCOMPARE(changedSpy.count(), 1);
+        QCOMPARE(ConfigFile().remotePollInterval(QStringLiteral("OtherAccount")), std::chrono::milliseconds(7000));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestConfigFile)
+#include "testconfigfile.moc"
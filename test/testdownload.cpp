@@ -9,6 +9,7 @@
 #include "syncenginetestutils.h"
 #include <syncengine.h>
 #include <owncloudpropagator.h>
+#include <bandwidthmanager.h>
 
 using namespace OCC;
 
@@ -39,6 +40,55 @@ public:
     }
 };
 
+/* A FakePutReply that reads the upload data as it becomes available, like a connection would */
+class StreamingPutReply : public FakeReply
+{
+    Q_OBJECT
+public:
+    StreamingPutReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData, QObject *parent)
+        : FakeReply(parent)
+        , _remoteRootFileInfo(remoteRootFileInfo)
+        , _outgoingData(outgoingData)
+    {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+        connect(&_timer, &QTimer::timeout, this, &StreamingPutReply::readOutgoingData);
+        _timer.start(5);
+    }
+
+    void readOutgoingData()
+    {
+        _payload += _outgoingData->read(64 * 1024);
+        if (!_outgoingData->atEnd())
+            return;
+        _timer.stop();
+        auto fileInfo = FakePutReply::perform(_remoteRootFileInfo, request(), _payload);
+        setRawHeader("OC-ETag", fileInfo->etag);
+        setRawHeader("ETag", fileInfo->etag);
+        setRawHeader("OC-FileID", fileInfo->fileId);
+        setRawHeader("X-OC-MTime", "accepted");
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+        emit metaDataChanged();
+        emit finished();
+    }
+
+    void abort() override
+    {
+        _timer.stop();
+        setError(OperationCanceledError, QStringLiteral("abort"));
+        emit finished();
+    }
+
+    qint64 readData(char *, qint64) override { return 0; }
+
+private:
+    FileInfo &_remoteRootFileInfo;
+    QIODevice *_outgoingData;
+    QByteArray _payload;
+    QTimer _timer;
+};
 
 SyncFileItemPtr getItem(const QSignalSpy &spy, const QString &path)
 {
@@ -91,6 +141,106 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    void testBufferSizes_data()
+    {
+        QTest::addColumn<qint64>("bufferSize");
+        QTest::newRow("minimum") << qint64(8 * 1024);
+        QTest::newRow("default") << SyncOptions()._downloadBufferSize;
+        QTest::newRow("larger than the files") << qint64(16 * 1024 * 1024);
+    }
+
+    void testBufferSizes()
+    {
+        QFETCH(qint64, bufferSize);
+        FakeFolder fakeFolder{ FileInfo{} };
+        auto opts = fakeFolder.syncEngine().syncOptions();
+        opts._downloadBufferSize = bufferSize;
+        fakeFolder.syncEngine().setSyncOptions(opts);
+
+        fakeFolder.remoteModifier().insert("empty", 0);
+        fakeFolder.remoteModifier().insert("small", 1);
+        fakeFolder.remoteModifier().insert("odd", 3 * 1024 * 1024 + 17, 'O');
+        fakeFolder.remoteModifier().insert("large", 10 * 1000 * 1000, 'L');
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        // Preallocation must not change the size of the downloaded file
+        QCOMPARE(QFileInfo(fakeFolder.localPath() + "odd").size(), qint64(3 * 1024 * 1024 + 17));
+    }
+
+    void testAbsoluteDownloadLimit()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        const int fileCount = 6;
+        const qint64 fileSize = 100 * 1000;
+        for (int i = 0; i < fileCount; ++i)
+            fakeFolder.remoteModifier().insert(QStringLiteral("file%1").arg(i), fileSize);
+        const int limit = 400 * 1000; // bytes per second
+        fakeFolder.syncEngine().setNetworkLimits(0, limit);
+
+        // Count the downloads that run at the same time
+        int running = 0;
+        int maxRunning = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op != QNetworkAccessManager::GetOperation)
+                return nullptr;
+            auto reply = new FakeGetReply(fakeFolder.remoteModifier(), op, request, this);
+            maxRunning = qMax(maxRunning, ++running);
+            connect(reply, &QObject::destroyed, this, [&running] { --running; });
+            return reply;
+        });
+
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(fakeFolder.syncOnce());
+        const qint64 elapsed = timer.elapsed();
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // The limit is shared by parallel downloads instead of running them one by one
+        QVERIFY(maxRunning > 1);
+        // The limit holds for all of them together. The bucket may hand out
+        // tokenBurstMsec worth of data ahead of time.
+        const qint64 expected = fileCount * fileSize * 1000 / limit;
+        QVERIFY(elapsed >= expected - BandwidthManager::tokenBurstMsec - BandwidthManager::tokenIntervalMsec);
+        // Without throttling them harder than that. Generous, slow test machines
+        // shouldn't fail it.
+        QVERIFY2(elapsed <= 4 * expected, qPrintable(QString::number(elapsed)));
+    }
+
+    void testAbsoluteUploadLimit()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        const int fileCount = 6;
+        const qint64 fileSize = 100 * 1000;
+        for (int i = 0; i < fileCount; ++i)
+            fakeFolder.localModifier().insert(QStringLiteral("file%1").arg(i), fileSize);
+        const int limit = 400 * 1000; // bytes per second
+        fakeFolder.syncEngine().setNetworkLimits(limit, 0);
+
+        // Count the uploads that run at the same time
+        int running = 0;
+        int maxRunning = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+            if (op != QNetworkAccessManager::PutOperation)
+                return nullptr;
+            auto reply = new StreamingPutReply(fakeFolder.remoteModifier(), op, request, outgoingData, this);
+            maxRunning = qMax(maxRunning, ++running);
+            connect(reply, &QNetworkReply::finished, this, [&running] { --running; });
+            return reply;
+        });
+
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(fakeFolder.syncOnce());
+        const qint64 elapsed = timer.elapsed();
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // Like downloads, the uploads share the limit
+        QVERIFY(maxRunning > 1);
+        const qint64 expected = fileCount * fileSize * 1000 / limit;
+        QVERIFY(elapsed >= expected - BandwidthManager::tokenBurstMsec - BandwidthManager::tokenIntervalMsec);
+        QVERIFY2(elapsed <= 4 * expected, qPrintable(QString::number(elapsed)));
+    }
+
     void testErrorMessage () {
         // This test's main goal is to test that the error string from the server is shown in the UI
 
@@ -586,6 +586,56 @@ private slots:
         QCOMPARE(translate("a/abc*/foo*"), "foo*");
     }
 
+    void check_csync_bname_filter()
+    {
+        auto mayMatch = [](const ExcludeBnameFilter &filter, const QString &name) {
+            return filter.mayMatch(QStringRef(&name));
+        };
+
+        // Whatever the regex for a pattern matches, the filter must accept
+        const QStringList patterns = { "*~", "~$*", ".~lock.*", "~*.tmp", "*.~*", "Icon\r*",
+            ".DS_Store", "._*", ".*.sw?", ".*.*sw?", "*.gnucash.tmp-*", "\\#*#", "a[bc]d", "a[bc",
+            "x\\*y", "*", "?", "", "*.💩", "пятницы.*" };
+        const QStringList names = { "", "a", "~", "file~", "~$doc", ".~lock.file#", "~x.tmp", "~.tmp",
+            "x.~y", "Icon\r", "Icon\rx", ".DS_Store", ".ds_store", "._x", ".a.swp", ".a.sw", ".a.b.swp",
+            "x.gnucash.tmp-1", "\\#x#", "#x#", "abd", "acd", "aed", "a[bc", "x*y", "xzy", "f.💩",
+            "пятницы.txt", "normal.txt", "x\n" };
+        for (const auto &pattern : patterns) {
+            ExcludeBnameFilter filter;
+            filter.addPattern(pattern);
+            QRegularExpression regex("^(?:" + ExcludedFiles::convertToRegexpSyntax(pattern, false) + ")$");
+            for (const auto &name : names) {
+                if (regex.match(name).hasMatch())
+                    QVERIFY2(mayMatch(filter, name), qPrintable(pattern + " / " + name));
+            }
+        }
+
+        // Literal, prefix and suffix patterns reject other names without a regex
+        ExcludeBnameFilter filter;
+        for (const auto &pattern : { "*.part", ".nfs*", "Thumbs.db", "~*.tmp", "*.~*" })
+            filter.addPattern(pattern);
+        QVERIFY(mayMatch(filter, "x.part"));
+        QVERIFY(mayMatch(filter, ".nfs0001"));
+        QVERIFY(mayMatch(filter, "Thumbs.db"));
+        QVERIFY(mayMatch(filter, "~a.tmp"));
+        QVERIFY(mayMatch(filter, "a.~b"));
+        QVERIFY(!mayMatch(filter, "x.parts"));
+        QVERIFY(!mayMatch(filter, "nfs"));
+        QVERIFY(!mayMatch(filter, "Thumbs.db2"));
+        QVERIFY(!mayMatch(filter, "thumbs.db"));
+        QVERIFY(!mayMatch(filter, "~.tmpx"));
+        QVERIFY(!mayMatch(filter, "~tmp"));
+        QVERIFY(!mayMatch(filter, "readme.txt"));
+        QVERIFY(!filter.hasBracketExpressions());
+
+        ExcludeBnameFilter caseInsensitive(Qt::CaseInsensitive);
+        caseInsensitive.addPattern("*.PART");
+        caseInsensitive.addPattern("Thumbs.db");
+        QVERIFY(mayMatch(caseInsensitive, "x.part"));
+        QVERIFY(mayMatch(caseInsensitive, "THUMBS.DB"));
+        QVERIFY(!mayMatch(caseInsensitive, "x.parts"));
+    }
+
     void check_csync_is_windows_reserved_word()
     {
         auto csync_is_windows_reserved_word = [](const char *fn) {
@@ -6,8 +6,9 @@
 
 #include <QtTest>
 
+#include <algorithm>
+
 #include "folderwatcher_linux.h"
-#include "common/utility.h"
 
 using namespace OCC;
 
@@ -15,57 +16,36 @@ class TestInotifyWatcher: public FolderWatcherPrivate
 {
     Q_OBJECT
 
-private:
-    QString _root;
-
 private slots:
-    void initTestCase() {
-        qsrand(QTime::currentTime().msec());
-
-        _root = QDir::tempPath() + "/" + "test_" + QString::number(qrand());
-        qDebug() << "creating test directory tree in " << _root;
-        QDir rootDir(_root);
-
-        rootDir.mkpath(_root + "/a1/b1/c1");
-        rootDir.mkpath(_root + "/a1/b1/c2");
-        rootDir.mkpath(_root + "/a1/b2/c1");
-        rootDir.mkpath(_root + "/a1/b3/c3");
-        rootDir.mkpath(_root + "/a2/b3/c3");
-
-    }
-
-    // Test the recursive path listing function findFoldersBelow
-    void testDirsBelowPath() {
-        QStringList dirs;
-
-        bool ok = findFoldersBelow(QDir(_root), dirs);
-        QVERIFY( dirs.indexOf(_root + "/a1")>-1);
-        QVERIFY( dirs.indexOf(_root + "/a1/b1")>-1);
-        QVERIFY( dirs.indexOf(_root + "/a1/b1/c1")>-1);
-        QVERIFY( dirs.indexOf(_root + "/a1/b1/c2")>-1);
-
-        QVERIFY(Utility::writeRandomFile(_root+"/a1/rand1.dat"));
-        QVERIFY(Utility::writeRandomFile(_root+"/a1/b1/rand2.dat"));
-        QVERIFY(Utility::writeRandomFile(_root+"/a1/b1/c1/rand3.dat"));
-
-        QVERIFY( dirs.indexOf(_root + "/a1/b2")>-1);
-        QVERIFY( dirs.indexOf(_root + "/a1/b2/c1")>-1);
-        QVERIFY( dirs.indexOf(_root + "/a1/b3")>-1);
-        QVERIFY( dirs.indexOf(_root + "/a1/b3/c3")>-1);
-
-        QVERIFY( dirs.indexOf(_root + "/a2"));
-        QVERIFY( dirs.indexOf(_root + "/a2/b3"));
-        QVERIFY( dirs.indexOf(_root + "/a2/b3/c3"));
-
-        QVERIFY2(dirs.count() == 11, "Directory count wrong.");
-
-        QVERIFY2(ok, "findFoldersBelow failed.");
-    }
-
-    void cleanupTestCase() {
-        if( _root.startsWith(QDir::tempPath() )) {
-           system( QString("rm -rf %1").arg(_root).toLocal8Bit() );
-        }
+    void testWatchTree() {
+        InotifyWatchTree tree;
+        const auto root = tree.setRoot("/sync", 1);
+        const auto a = tree.add(root, "a", 2);
+        const auto b = tree.add(a, "b", 3);
+        tree.add(a, "c", 4);
+        const auto d = tree.add(root, "d", 5);
+        QCOMPARE(tree.size(), 5);
+        QCOMPARE(tree.path(root), QByteArray("/sync"));
+        QCOMPARE(tree.path(b), QByteArray("/sync/a/b"));
+        QCOMPARE(tree.child(a, "b"), b);
+        QCOMPARE(tree.child(root, "b"), InotifyWatchTree::NoNode);
+        QCOMPARE(tree.nodeForWatch(5), d);
+
+        QList<int> removed;
+        tree.remove(a, [&removed](int wd) { removed.append(wd); });
+        std::sort(removed.begin(), removed.end());
+        QCOMPARE(removed, QList<int>({ 2, 3, 4 }));
+        QCOMPARE(tree.size(), 2);
+        QVERIFY(!tree.contains(b));
+        QCOMPARE(tree.child(root, "a"), InotifyWatchTree::NoNode);
+        QCOMPARE(tree.nodeForWatch(3), InotifyWatchTree::NoNode);
+
+        // Freed nodes get reused
+        const auto e = tree.add(d, "e", 6);
+        QVERIFY(e < 5);
+        QCOMPARE(tree.path(e), QByteArray("/sync/d/e"));
+        QCOMPARE(tree.child(d, "e"), e);
+        QCOMPARE(tree.size(), 3);
     }
 };
 
@@ -9,6 +9,7 @@
 #include "syncenginetestutils.h"
 #include <syncengine.h>
 #include <localdiscoverytracker.h>
+#include <discoveryphase.h>
 
 using namespace OCC;
 
@@ -204,6 +205,123 @@ private slots:
         QVERIFY(!fakeFolder.currentRemoteState().find("C/.foo"));
         QVERIFY(!fakeFolder.currentRemoteState().find("C/bar"));
     }
+
+    // The walker's listings must match the directories, also when prefetching pauses
+    void testLocalDiscoveryWalker()
+    {
+        QTemporaryDir dir;
+        QDir root(dir.path());
+        for (int i = 0; i < 5; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                const QString path = QString("d%1/s%2").arg(i).arg(j);
+                QVERIFY(root.mkpath(path));
+                for (int k = 0; k < 5; ++k) {
+                    QFile file(root.filePath(QString("%1/f%2").arg(path).arg(k)));
+                    QVERIFY(file.open(QFile::WriteOnly));
+                    file.write(QByteArray(k, 'x'));
+                }
+            }
+        }
+#ifndef Q_OS_WIN
+        // Not followed
+        QVERIFY(QFile::link(root.filePath("d0"), root.filePath("link")));
+#endif
+
+        LocalDiscoveryWalker walker(dir.path() + '/', nullptr, 3);
+        walker.setMaxBufferedEntries(10);
+        walker.start();
+
+        QStringList directories { QString() };
+        int listed = 0;
+        while (!directories.isEmpty()) {
+            const QString path = directories.takeFirst();
+            LocalDiscoveryWalker::Listing listing;
+            auto result = walker.takeListing(path, listing);
+            for (int i = 0; result == LocalDiscoveryWalker::Pending && i < 1000; ++i) {
+                QTest::qWait(5);
+                result = walker.takeListing(path, listing);
+            }
+            QCOMPARE(result, LocalDiscoveryWalker::Ready);
+            QVERIFY(listing.invalidNames.isEmpty());
+
+            QStringList names;
+            for (const auto &entry : listing.entries) {
+                names.append(entry.name);
+                const QString entryPath = path.isEmpty() ? entry.name : QString(path + '/' + entry.name);
+                const QFileInfo info(root.filePath(entryPath));
+                QCOMPARE(entry.isDirectory, info.isDir() && !entry.isSymLink);
+                if (entry.isDirectory)
+                    directories.append(entryPath);
+                else if (!entry.isSymLink)
+                    QCOMPARE(qint64(entry.size), info.size());
+            }
+            names.sort();
+            QCOMPARE(names, QDir(root.filePath(path)).entryList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System, QDir::Name));
+            ++listed;
+        }
+        QCOMPARE(listed, 1 + 5 + 5 * 3);
+
+        // Already taken or never seen
+        LocalDiscoveryWalker::Listing listing;
+        QCOMPARE(walker.takeListing("d0", listing), LocalDiscoveryWalker::Unavailable);
+        QCOMPARE(walker.takeListing("link", listing), LocalDiscoveryWalker::Unavailable);
+    }
+
+    // Directories the filter rejects aren't listed ahead
+    void testLocalDiscoveryWalkerFilter()
+    {
+        QTemporaryDir dir;
+        QDir root(dir.path());
+        QVERIFY(root.mkpath("keep/sub"));
+        QVERIFY(root.mkpath("skip/sub"));
+
+        LocalDiscoveryWalker walker(dir.path() + '/', nullptr, 2);
+        walker.setPrefetchFilter([](const QString &path, const LocalInfo &) { return path != "skip"; });
+        walker.start();
+
+        auto take = [&](const QString &path) {
+            LocalDiscoveryWalker::Listing listing;
+            auto result = walker.takeListing(path, listing);
+            for (int i = 0; result == LocalDiscoveryWalker::Pending && i < 1000; ++i) {
+                QTest::qWait(5);
+                result = walker.takeListing(path, listing);
+            }
+            return result;
+        };
+        QCOMPARE(take(QString()), LocalDiscoveryWalker::Ready);
+        QCOMPARE(take("keep"), LocalDiscoveryWalker::Ready);
+        QCOMPARE(take("keep/sub"), LocalDiscoveryWalker::Ready);
+        QCOMPARE(take("skip"), LocalDiscoveryWalker::Unavailable);
+        QCOMPARE(take("skip/sub"), LocalDiscoveryWalker::Unavailable);
+    }
+
+    // Local discovery with and without the walker finds the same
+    void testLocalDiscoveryWalkerSync()
+    {
+        for (int threads : { 0, 4 }) {
+            FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+            auto options = fakeFolder.syncEngine().syncOptions();
+            options._localDiscoveryThreads = threads;
+            fakeFolder.syncEngine().setSyncOptions(options);
+
+            fakeFolder.localModifier().mkdir("A/X");
+            fakeFolder.localModifier().mkdir("A/X/Y");
+            fakeFolder.localModifier().insert("A/X/Y/y1");
+            fakeFolder.localModifier().insert("B/b3");
+            fakeFolder.localModifier().remove("C/c1");
+            fakeFolder.localModifier().rename("S/s1", "S/s3");
+            // Not prefetched, but still handled by the discovery
+            fakeFolder.syncEngine().excludedFiles().addManualExclude("ignored");
+            fakeFolder.localModifier().mkdir("B/ignored");
+            fakeFolder.localModifier().insert("B/ignored/i1");
+            QVERIFY(fakeFolder.syncOnce());
+            QVERIFY(!fakeFolder.currentRemoteState().find("B/ignored"));
+            fakeFolder.localModifier().remove("B/ignored");
+            QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+            QVERIFY(fakeFolder.currentRemoteState().find("A/X/Y/y1"));
+            QVERIFY(!fakeFolder.currentRemoteState().find("C/c1"));
+        }
+    }
 };
 
 QTEST_GUILESS_MAIN(TestLocalDiscovery)
@@ -9,6 +9,8 @@
 
 #include "propagatedownload.h"
 #include "owncloudpropagator_p.h"
+#include "transferconcurrency.h"
+#include "syncjobbudget.h"
 
 using namespace OCC;
 namespace OCC {
@@ -76,6 +78,104 @@ private slots:
             QCOMPARE(parseEtag(test.first), QByteArray(test.second));
         }
     }
+
+    void testTransferConcurrencyAimd()
+    {
+        TransferConcurrency tc;
+        tc.reset(3, 10);
+        QCOMPARE(tc.limit(), 3);
+
+        // Each transfer gets the same rate regardless of concurrency: the link is not saturated
+        auto runEpoch = [&](qint64 perTransferRate, int concurrency) {
+            const int count = tc.limit();
+            for (int i = 0; i < count; ++i)
+                tc.transferFinished(perTransferRate, 1000, concurrency);
+        };
+        runEpoch(10 * 1000 * 1000, 3);
+        QCOMPARE(tc.limit(), 4); // first epoch probes upwards
+        runEpoch(10 * 1000 * 1000, 4);
+        QCOMPARE(tc.limit(), 5);
+        runEpoch(10 * 1000 * 1000, 5);
+        QCOMPARE(tc.limit(), 6);
+
+        // Saturated: more parallelism only splits the same bandwidth, the limit holds
+        runEpoch(50 * 1000 * 1000 / 6, 6);
+        QCOMPARE(tc.limit(), 6);
+        runEpoch(50 * 1000 * 1000 / 6, 6);
+        QCOMPARE(tc.limit(), 6);
+
+        // Server overload: multiplicative decrease
+        tc.congestionDetected();
+        runEpoch(50 * 1000 * 1000 / 6, 6);
+        QCOMPARE(tc.limit(), 4);
+
+        // Throughput collapse also backs off
+        const int limitBeforeCollapse = tc.limit();
+        runEpoch(1000, 1);
+        QVERIFY(tc.limit() < limitBeforeCollapse);
+        QCOMPARE(tc.limit(), 2);
+
+        // But never below 1
+        for (int i = 0; i < 3; ++i) {
+            tc.congestionDetected();
+            runEpoch(1000, 1);
+        }
+        QCOMPARE(tc.limit(), 1);
+
+        // The maximum is respected
+        tc.reset(9, 10);
+        for (qint64 rate = 1000 * 1000; tc.limit() < 10; rate *= 2)
+            runEpoch(rate, tc.limit());
+        runEpoch(1000 * 1000 * 1000, 10);
+        QCOMPARE(tc.limit(), 10);
+    }
+
+    void testTransferConcurrencyCostClassification()
+    {
+        TransferConcurrency tc;
+        tc.reset(3, 6);
+        // No measurements yet: the historic threshold
+        QCOMPARE(tc.quickTransferSize(), qint64(TransferConcurrency::defaultQuickTransferSize));
+
+        // Fast LAN: 100 MB/s per transfer, 5ms requests
+        tc.transferFinished(1024, 5, 1);
+        tc.transferFinished(100 * 1000 * 1000, 1000, 1);
+        QCOMPARE(tc.latencyMsec(), qint64(5));
+        QCOMPARE(tc.throughputPerTransfer(), qint64(100 * 1000 * 1000));
+        QVERIFY(tc.quickTransferSize() > 10 * 1000 * 1000);
+        QVERIFY(tc.estimatedDurationMsec(50 * 1000 * 1000) < 1000);
+
+        // Slow link: 20 kB/s, even 100 KiB is not quick any more
+        tc.reset(3, 6);
+        tc.transferFinished(200 * 1000, 10 * 1000, 1);
+        QVERIFY(tc.quickTransferSize() < TransferConcurrency::defaultQuickTransferSize);
+        QVERIFY(tc.estimatedDurationMsec(100 * 1024) > TransferConcurrency::quickTransferMsec);
+    }
+
+    void testSyncJobBudget()
+    {
+        SyncJobBudget budget;
+        // Nobody joined yet: everything is available
+        QCOMPARE(budget.share(6), 6);
+
+        budget.join();
+        QCOMPARE(budget.share(6), 6);
+        budget.join();
+        QCOMPARE(budget.share(6), 3);
+        budget.join();
+        budget.join();
+        QCOMPARE(budget.share(6), 1);
+        // Everybody can always run at least one job
+        budget.join();
+        budget.join();
+        budget.join();
+        QCOMPARE(budget.share(6), 1);
+
+        for (int i = 0; i < 6; ++i)
+            budget.leave();
+        QCOMPARE(budget.participants(), 1);
+        QCOMPARE(budget.share(6), 6);
+    }
 };
 
 QTEST_APPLESS_MAIN(TestNextcloudPropagator)
@@ -126,6 +126,46 @@ private slots:
         }
     }
 
+    void testTypedBindAndViews() {
+        const char *sql = "INSERT INTO addresses (id, name, address, entered) VALUES "
+                "(?1, ?2, ?3, ?4);";
+        SqlQuery q(_db);
+        q.prepare(sql);
+        q.bindValue(1, qint64(4));
+        q.bindValue(2, QByteArray("Bytes Name"));
+        const QString address = QString::fromUtf8("проспект 7");
+        q.bindValue(3, QStringView(address));
+        q.bindValue(4, std::numeric_limits<quint64>::max());
+        QVERIFY(q.exec());
+
+        SqlQuery select("SELECT name, address, entered FROM addresses WHERE id=?1", _db);
+        select.bindValue(1, 4);
+        QVERIFY(select.exec());
+        QVERIFY(select.next().hasData);
+        const auto name = select.baValueView(0);
+        QCOMPARE(name.size(), 10);
+        QVERIFY(name == QByteArray("Bytes Name"));
+        QVERIFY(name.startsWith("Bytes"));
+        QCOMPARE(name.indexOf(' '), 5);
+        QCOMPARE(name.indexOf(' ', 6), -1);
+        QCOMPARE(qstrlen(name.data()), 10u);
+        QCOMPARE(name.toByteArray(), QByteArray("Bytes Name"));
+        QCOMPARE(select.stringValueView(1).toString(), address);
+        QCOMPARE(select.int64Value(2), std::numeric_limits<quint64>::max());
+
+        // A null QString still binds NULL
+        SqlQuery update("UPDATE addresses SET address=?1 WHERE id=4", _db);
+        update.bindValue(1, QString());
+        QVERIFY(update.exec());
+        select.reset_and_clear_bindings();
+        select.bindValue(1, 4);
+        QVERIFY(select.exec());
+        QVERIFY(select.next().hasData);
+        QVERIFY(select.nullValue(1));
+        QVERIFY(select.baValueView(1).isEmpty());
+        QVERIFY(select.stringValueView(1).isNull());
+    }
+
     void testDestructor()
     {
         // This test make sure that the destructor of SqlQuery works even if the SqlDatabase
@@ -0,0 +1,149 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+static void enablePipelining(FakeFolder &fakeFolder)
+{
+    auto options = fakeFolder.syncEngine().syncOptions();
+    options._pipelinedPropagation = true;
+    fakeFolder.syncEngine().setSyncOptions(options);
+}
+
+// Records which items were handed over during the discovery and which came after it
+struct PropagationSpy
+{
+    QStringList pipelined;
+    QStringList remaining;
+
+    explicit PropagationSpy(FakeFolder &fakeFolder)
+    {
+        QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::aboutToPropagatePipelined, [this](SyncFileItemVector &items) {
+            for (const auto &item : items)
+                pipelined.append(item->destination());
+        });
+        QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::aboutToPropagate, [this](SyncFileItemVector &items) {
+            for (const auto &item : items)
+                remaining.append(item->destination());
+        });
+    }
+
+    void clear()
+    {
+        pipelined.clear();
+        remaining.clear();
+    }
+};
+
+class TestPipelinedPropagation : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testNewAndChangedFiles()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.remoteModifier().mkdir("D");
+        fakeFolder.remoteModifier().insert("D/d1");
+        QVERIFY(fakeFolder.syncOnce());
+        enablePipelining(fakeFolder);
+        PropagationSpy spy(fakeFolder);
+
+        fakeFolder.localModifier().insert("A/new1");
+        fakeFolder.localModifier().mkdir("A/newdir");
+        fakeFolder.localModifier().insert("A/newdir/f");
+        fakeFolder.localModifier().appendByte("A/a1");
+        fakeFolder.localModifier().rename("A/a2", "A/a2moved");
+        fakeFolder.remoteModifier().insert("B/new2");
+        fakeFolder.remoteModifier().appendByte("B/b1");
+        fakeFolder.remoteModifier().mkdir("C/rdir");
+        fakeFolder.remoteModifier().insert("C/rdir/g");
+        fakeFolder.remoteModifier().remove("D");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        for (const auto &path : { "A/new1", "A/newdir", "A/newdir/f", "A/a1", "B/new2", "B/b1", "C/rdir", "C/rdir/g" }) {
+            QVERIFY(spy.pipelined.contains(path));
+            QVERIFY(!spy.remaining.contains(path));
+        }
+        // Moves and deletions wait for the end of the discovery
+        QVERIFY(!spy.pipelined.contains("A/a2moved"));
+        QVERIFY(spy.remaining.contains("A/a2moved"));
+        QVERIFY(!spy.pipelined.contains("D"));
+        QVERIFY(spy.remaining.contains("D"));
+        QVERIFY(!fakeFolder.currentLocalState().find("D"));
+
+        // The new directories made it to the database
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("C/rdir"), &record));
+        QCOMPARE(record._etag, fakeFolder.currentRemoteState().find("C/rdir")->etag);
+
+        spy.clear();
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(spy.pipelined.isEmpty());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    // Items that depend on a move or on the database wait for the end of the discovery
+    void testDependentItemsWait()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        enablePipelining(fakeFolder);
+        PropagationSpy spy(fakeFolder);
+
+        fakeFolder.localModifier().rename("A", "A2");
+        fakeFolder.localModifier().insert("A2/new");
+        // Restored with the new content, the database still knows it
+        fakeFolder.localModifier().remove("C");
+        fakeFolder.remoteModifier().appendByte("C/c1");
+        fakeFolder.remoteModifier().insert("B/new");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        QCOMPARE(spy.pipelined, QStringList{ "B/new" });
+        QVERIFY(spy.remaining.contains("A2/new"));
+        QVERIFY(spy.remaining.contains("C"));
+        QVERIFY(fakeFolder.currentLocalState().find("C/c1"));
+    }
+
+    // A failed pipelined item keeps the etag of its directory from being stored
+    void testErrorKeepsDirectoryEtag()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        enablePipelining(fakeFolder);
+        PropagationSpy spy(fakeFolder);
+
+        SyncJournalFileRecord oldRecord;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("B"), &oldRecord));
+
+        fakeFolder.remoteModifier().insert("B/remote");
+        fakeFolder.localModifier().insert("B/local");
+        fakeFolder.serverErrorPaths().append("B/local", 500);
+        QVERIFY(!fakeFolder.syncOnce());
+        QVERIFY(spy.pipelined.contains("B/local"));
+        QVERIFY(spy.pipelined.contains("B/remote"));
+        QVERIFY(fakeFolder.currentLocalState().find("B/remote"));
+
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("B"), &record));
+        QCOMPARE(record._etag, oldRecord._etag);
+
+        fakeFolder.serverErrorPaths().clear();
+        fakeFolder.syncJournal().wipeErrorBlacklist();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArrayLiteral("B"), &record));
+        QCOMPARE(record._etag, fakeFolder.currentRemoteState().find("B")->etag);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestPipelinedPropagation)
+#include "testpipelinedpropagation.moc"
@@ -171,6 +171,175 @@ private slots:
         QVERIFY(completeSpy.findItem("nofileid")->_errorString.contains("file id"));
         QVERIFY(completeSpy.findItem("nopermissions/A")->_errorString.contains("permissions"));
     }
+
+    // With a sync token, directories whose etag changed are listed from the db and the reported changes
+    void testSyncCollection()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.fakeServer().setSyncCollectionEnabled(true);
+        fakeFolder.remoteModifier().mkdir("A/deep");
+        fakeFolder.remoteModifier().mkdir("A/deep/er");
+        fakeFolder.remoteModifier().insert("A/deep/er/f");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(!fakeFolder.syncJournal().syncToken().isEmpty());
+
+        int propfinds = 0;
+        int reports = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &req, QIODevice *) -> QNetworkReply * {
+            auto verb = req.attribute(QNetworkRequest::CustomVerbAttribute);
+            if (verb == "PROPFIND")
+                ++propfinds;
+            else if (verb == "REPORT")
+                ++reports;
+            return nullptr;
+        });
+
+        fakeFolder.remoteModifier().appendByte("A/deep/er/f");
+        fakeFolder.remoteModifier().remove("B/b1");
+        fakeFolder.remoteModifier().rename("C/c1", "C/c3");
+        fakeFolder.remoteModifier().insert("S/s3");
+        fakeFolder.localModifier().insert("A/deep/local");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        // Only the root was listed on the server
+        QCOMPARE(reports, 1);
+        QCOMPARE(propfinds, 1);
+
+        // New directories have no db entries and are listed on the server
+        propfinds = reports = 0;
+        fakeFolder.remoteModifier().mkdir("B/new");
+        fakeFolder.remoteModifier().insert("B/new/x");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(reports, 1);
+        QCOMPARE(propfinds, 2);
+
+        // Nothing changed: nothing is listed but the root
+        propfinds = reports = 0;
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(reports, 1);
+        QCOMPARE(propfinds, 1);
+    }
+
+    void testSyncCollectionFallback()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.fakeServer().setSyncCollectionEnabled(true);
+        QVERIFY(fakeFolder.syncOnce());
+        auto token = fakeFolder.syncJournal().syncToken();
+        QVERIFY(!token.isEmpty());
+
+        // The server doesn't know the token anymore: full discovery
+        fakeFolder.fakeServer().expireSyncTokens();
+        fakeFolder.remoteModifier().appendByte("A/a1");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(!fakeFolder.syncJournal().syncToken().isEmpty());
+        QVERIFY(fakeFolder.syncJournal().syncToken() != token);
+
+        // Scheduling a remote discovery drops the token
+        fakeFolder.syncJournal().schedulePathForRemoteDiscovery(QByteArray("B"));
+        QVERIFY(fakeFolder.syncJournal().syncToken().isEmpty());
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(!fakeFolder.syncJournal().syncToken().isEmpty());
+
+        // A failed item keeps the previous token, so the change is reported again
+        token = fakeFolder.syncJournal().syncToken();
+        fakeFolder.remoteModifier().appendByte("C/c1");
+        fakeFolder.serverErrorPaths().append("C/c1");
+        QVERIFY(!fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.syncJournal().syncToken(), token);
+        fakeFolder.serverErrorPaths().clear();
+        fakeFolder.syncJournal().wipeErrorBlacklist();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(fakeFolder.syncJournal().syncToken() != token);
+
+        // Servers without support still work
+        fakeFolder.fakeServer().setSyncCollectionEnabled(false);
+        fakeFolder.remoteModifier().appendByte("S/s1");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(fakeFolder.syncJournal().syncToken().isEmpty());
+    }
+
+    // Directories unknown to the db are listed with everything below them in one request
+    void testSubtreeListing()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        fakeFolder.fakeServer().setPropfindDepthInfinityEnabled(true);
+        fakeFolder.remoteModifier().mkdir("A");
+        fakeFolder.remoteModifier().mkdir("A/deep");
+        fakeFolder.remoteModifier().mkdir("A/deep/er");
+        fakeFolder.remoteModifier().insert("A/deep/er/f");
+        fakeFolder.remoteModifier().insert("A/a1");
+        fakeFolder.remoteModifier().mkdir("B");
+        fakeFolder.remoteModifier().mkdir("B/empty");
+        fakeFolder.remoteModifier().insert("b1");
+
+        int propfinds = 0;
+        int infinite = 0;
+        bool refuseInfinite = false;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &req, QIODevice *) -> QNetworkReply * {
+            if (req.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND") {
+                ++propfinds;
+                if (req.rawHeader("Depth") == "infinity") {
+                    ++infinite;
+                    if (refuseInfinite)
+                        return new FakeErrorReply(op, req, this, 403);
+                }
+            }
+            return nullptr;
+        });
+
+        // First sync: the root on its own and everything below it at once
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(propfinds, 2);
+        QCOMPARE(infinite, 1);
+
+        // A new directory in a known one: only the new one is listed as a subtree
+        propfinds = infinite = 0;
+        fakeFolder.remoteModifier().mkdir("A/new");
+        fakeFolder.remoteModifier().mkdir("A/new/sub");
+        fakeFolder.remoteModifier().insert("A/new/sub/x");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(propfinds, 3); // root, A, A/new
+        QCOMPARE(infinite, 1);
+
+        // A server that answers as for Depth: 1; the levels below are queried one by one
+        fakeFolder.fakeServer().setPropfindDepthInfinityEnabled(false);
+        propfinds = infinite = 0;
+        fakeFolder.remoteModifier().mkdir("C");
+        fakeFolder.remoteModifier().mkdir("C/x");
+        fakeFolder.remoteModifier().mkdir("C/x/y");
+        fakeFolder.remoteModifier().insert("C/x/y/z");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(propfinds, 4); // root, C, C/x, C/x/y
+        QCOMPARE(infinite, 1);
+
+        // A server that refuses: fall back, and don't ask again
+        refuseInfinite = true;
+        propfinds = infinite = 0;
+        fakeFolder.remoteModifier().mkdir("D");
+        fakeFolder.remoteModifier().mkdir("D/e");
+        fakeFolder.remoteModifier().insert("D/e/f");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(propfinds, 4); // root, D refused, D, D/e
+        QCOMPARE(infinite, 1);
+
+        propfinds = infinite = 0;
+        fakeFolder.remoteModifier().mkdir("E");
+        fakeFolder.remoteModifier().insert("E/f");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(propfinds, 2);
+        QCOMPARE(infinite, 0);
+    }
 };
 
 QTEST_GUILESS_MAIN(TestRemoteDiscovery)
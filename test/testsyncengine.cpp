@@ -143,6 +143,41 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    // Local checksums are computed off the main thread during discovery; the
+    // parked items must still be emitted and the directories must not finish early.
+    void testAsyncLocalChecksumsInDiscovery() {
+        FakeFolder fakeFolder{FileInfo{}};
+        for (const auto dir : { "A", "A/B", "C" }) {
+            fakeFolder.localModifier().mkdir(dir);
+            for (int i = 0; i < 5; ++i) {
+                fakeFolder.localModifier().insert(QStringLiteral("%1/same%2.eml").arg(dir).arg(i), 64, 'A');
+                fakeFolder.localModifier().insert(QStringLiteral("%1/changed%2.eml").arg(dir).arg(i), 64, 'A');
+            }
+        }
+        fakeFolder.localModifier().insert("C/tomove.txt", 64, 'M');
+        QVERIFY(fakeFolder.syncOnce());
+
+        ItemCompletedSpy completeSpy(fakeFolder);
+        for (const auto dir : { "A", "A/B", "C" }) {
+            for (int i = 0; i < 5; ++i) {
+                fakeFolder.localModifier().setContents(QStringLiteral("%1/same%2.eml").arg(dir).arg(i), 'A');
+                fakeFolder.localModifier().setContents(QStringLiteral("%1/changed%2.eml").arg(dir).arg(i), 'B');
+            }
+        }
+        // The move is verified with the checksum of the target
+        fakeFolder.localModifier().rename("C/tomove.txt", "A/B/moved.txt");
+        QVERIFY(fakeFolder.syncOnce());
+
+        for (const auto dir : { "A", "A/B", "C" }) {
+            for (int i = 0; i < 5; ++i) {
+                QVERIFY(!itemDidComplete(completeSpy, QStringLiteral("%1/same%2.eml").arg(dir).arg(i)));
+                QVERIFY(itemDidCompleteSuccessfully(completeSpy, QStringLiteral("%1/changed%2.eml").arg(dir).arg(i)));
+            }
+        }
+        QVERIFY(itemInstruction(completeSpy, "A/B/moved.txt", CSYNC_INSTRUCTION_RENAME));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
     void testSelectiveSyncBug() {
         // issue owncloud/enterprise#1965: files from selective-sync ignored
         // folders are uploaded anyway is some circumstances.
@@ -0,0 +1,211 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+#include <syncenginerelay.h>
+
+using namespace OCC;
+
+// Runs the engine of a FakeFolder on a thread of its own, like Folder does
+class EngineThread
+{
+public:
+    explicit EngineThread(FakeFolder &fakeFolder)
+        : _fakeFolder(fakeFolder)
+        , _relay(&fakeFolder.syncEngine())
+    {
+        fakeFolder.syncEngine().syncFileStatusTracker().setRelay(&_relay);
+        _thread.start();
+        fakeFolder.fakeServer().moveToThread(&_thread);
+        fakeFolder.account()->setThreadNetworkAccessManager(&_thread, &fakeFolder.fakeServer());
+        fakeFolder.syncEngine().moveToThread(&_thread);
+    }
+
+    ~EngineThread()
+    {
+        // Hand the engine and the server back to the test
+        auto testThread = QThread::currentThread();
+        auto &engine = _fakeFolder.syncEngine();
+        auto &server = _fakeFolder.fakeServer();
+        QMetaObject::invokeMethod(&engine, [&engine, &server, testThread] {
+            engine.moveToThread(testThread);
+            server.moveToThread(testThread);
+        }, Qt::BlockingQueuedConnection);
+        _fakeFolder.account()->setThreadNetworkAccessManager(&_thread, nullptr);
+        _thread.quit();
+        _thread.wait();
+    }
+
+    QThread *thread() { return &_thread; }
+    SyncEngineRelay &relay() { return _relay; }
+
+    bool syncOnce()
+    {
+        QSignalSpy spy(&_relay, &SyncEngineRelay::finished);
+        _fakeFolder.scheduleSync();
+        if (!spy.wait(60000))
+            return false;
+        return spy[0][0].toBool();
+    }
+
+private:
+    FakeFolder &_fakeFolder;
+    SyncEngineRelay _relay;
+    QThread _thread;
+};
+
+class TestSyncEngineThread : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testSyncOnThread()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        EngineThread engineThread(fakeFolder);
+
+        // Threads seen by the engine, the network and the receivers of the relay
+        QSet<QThread *> engineThreads;
+        QSet<QThread *> requestThreads;
+        QSet<QThread *> relayThreads;
+        QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::itemCompleted, &fakeFolder.syncEngine(), [&](const SyncFileItemPtr &) {
+            engineThreads.insert(QThread::currentThread());
+        }, Qt::DirectConnection);
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &, QIODevice *) -> QNetworkReply * {
+            requestThreads.insert(QThread::currentThread());
+            return nullptr;
+        });
+        QObject::connect(&engineThread.relay(), &SyncEngineRelay::itemCompleted, [&](const SyncFileItemPtr &) {
+            relayThreads.insert(QThread::currentThread());
+        });
+
+        fakeFolder.localModifier().insert("A/new");
+        fakeFolder.localModifier().appendByte("B/b1");
+        fakeFolder.remoteModifier().insert("C/remote");
+        fakeFolder.remoteModifier().rename("S/s1", "S/s1renamed");
+        QVERIFY(engineThread.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        QCOMPARE(engineThreads, QSet<QThread *>{ engineThread.thread() });
+        QCOMPARE(requestThreads, QSet<QThread *>{ engineThread.thread() });
+        QCOMPARE(relayThreads, QSet<QThread *>{ QThread::currentThread() });
+
+        // The engine keeps working on its thread
+        fakeFolder.remoteModifier().appendByte("C/remote");
+        QVERIFY(engineThread.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    // The relay delivers everything in order, with the progress coalesced
+    void testBatchedSignals()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        EngineThread engineThread(fakeFolder);
+
+        QAtomicInt engineItems;
+        QAtomicInt engineProgress;
+        QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::itemCompleted, &fakeFolder.syncEngine(), [&] {
+            engineItems.ref();
+        }, Qt::DirectConnection);
+        QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::transmissionProgress, &fakeFolder.syncEngine(), [&] {
+            engineProgress.ref();
+        }, Qt::DirectConnection);
+
+        QStringList events;
+        int relayItems = 0;
+        int relayProgress = 0;
+        ProgressInfo::Status lastStatus = ProgressInfo::Starting;
+        qint64 lastCompletedFiles = 0;
+        auto &relay = engineThread.relay();
+        QObject::connect(&relay, &SyncEngineRelay::started, [&] { events.append("started"); });
+        QObject::connect(&relay, &SyncEngineRelay::aboutToPropagate, [&](SyncFileItemVector &) { events.append("aboutToPropagate"); });
+        QObject::connect(&relay, &SyncEngineRelay::itemCompleted, [&](const SyncFileItemPtr &item) {
+            if (events.isEmpty() || events.last() != "itemCompleted")
+                events.append("itemCompleted");
+            // A copy, the engine is done with its own
+            QCOMPARE(item->_status, SyncFileItem::Success);
+            ++relayItems;
+        });
+        QObject::connect(&relay, &SyncEngineRelay::transmissionProgress, [&](const ProgressInfo &progress) {
+            lastStatus = progress.status();
+            lastCompletedFiles = progress.completedFiles();
+            ++relayProgress;
+        });
+        QObject::connect(&relay, &SyncEngineRelay::finished, [&] { events.append("finished"); });
+
+        for (int i = 0; i < 100; ++i)
+            fakeFolder.localModifier().insert(QStringLiteral("A/new%1").arg(i));
+        QVERIFY(engineThread.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        QCOMPARE(events, QStringList({ "aboutToPropagate", "started", "itemCompleted", "finished" }));
+        QCOMPARE(relayItems, engineItems.loadAcquire());
+        QVERIFY(relayProgress < engineProgress.loadAcquire());
+        QCOMPARE(lastStatus, ProgressInfo::Done);
+        QCOMPARE(lastCompletedFiles, 100);
+    }
+
+    // The status tracker stays in the test's thread
+    void testStatusTracker()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        EngineThread engineThread(fakeFolder);
+        auto &tracker = fakeFolder.syncEngine().syncFileStatusTracker();
+
+        QVector<SyncFileStatus::SyncFileStatusTag> statuses;
+        QSet<QThread *> trackerThreads;
+        QObject::connect(&tracker, &SyncFileStatusTracker::fileStatusChanged, [&](const QString &path, SyncFileStatus status) {
+            trackerThreads.insert(QThread::currentThread());
+            if (path == fakeFolder.localPath() + "A/new")
+                statuses.append(status.tag());
+        });
+
+        fakeFolder.localModifier().insert("A/new");
+        QVERIFY(engineThread.syncOnce());
+        QCOMPARE(statuses.first(), SyncFileStatus::StatusSync);
+        QCOMPARE(statuses.last(), SyncFileStatus::StatusUpToDate);
+        QCOMPARE(trackerThreads, QSet<QThread *>{ QThread::currentThread() });
+        QCOMPARE(tracker.fileStatus("A/new").tag(), SyncFileStatus::StatusUpToDate);
+    }
+
+    // Aborting from the test's thread, like Folder::slotTerminateSync()
+    void testAbort()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        EngineThread engineThread(fakeFolder);
+
+        QAtomicInt hanging;
+        auto &server = fakeFolder.fakeServer();
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation && request.url().path().endsWith("A/hang")) {
+                hanging.storeRelease(1);
+                return new FakeHangingReply(op, request, &server);
+            }
+            return nullptr;
+        });
+
+        fakeFolder.localModifier().insert("A/hang");
+        QSignalSpy finishedSpy(&engineThread.relay(), &SyncEngineRelay::finished);
+        fakeFolder.scheduleSync();
+        QTRY_VERIFY(hanging.loadAcquire());
+
+        auto &engine = fakeFolder.syncEngine();
+        QMetaObject::invokeMethod(&engine, [&engine] { engine.abort(); });
+        QVERIFY(finishedSpy.wait());
+        QCOMPARE(finishedSpy[0][0].toBool(), false);
+        QVERIFY(!fakeFolder.syncEngine().isSyncRunning());
+
+        fakeFolder.setServerOverride(nullptr);
+        QVERIFY(engineThread.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSyncEngineThread)
+#include "testsyncenginethread.moc"
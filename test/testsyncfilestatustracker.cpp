@@ -8,6 +8,7 @@
 #include <QtTest>
 #include "syncenginetestutils.h"
 #include "csync_exclude.h"
+#include "syncfilestatusindex.h"
 
 using namespace OCC;
 
@@ -64,6 +65,25 @@ class TestSyncFileStatusTracker : public QObject
         }
     }
 
+    // fileStatuses() for every directory must agree with fileStatus() for each entry
+    void verifyThatBatchedMatchesSingle(FakeFolder &fakeFolder) {
+        auto &tracker = fakeFolder.syncEngine().syncFileStatusTracker();
+        const QString root = fakeFolder.localPath();
+        QStringList directories { QString() };
+        QDirIterator it(root, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        while (it.hasNext())
+            directories.append(it.next().mid(root.size()));
+        for (const auto &directory : directories) {
+            const QStringList names = QDir(root + directory).entryList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden);
+            const auto statuses = tracker.fileStatuses(directory, names);
+            QCOMPARE(statuses.size(), names.size());
+            for (int i = 0; i < names.size(); ++i) {
+                const QString path = directory.isEmpty() ? names[i] : QString(directory + '/' + names[i]);
+                QCOMPARE(statuses[i], tracker.fileStatus(path));
+            }
+        }
+    }
+
 private slots:
     void parentsGetSyncStatusUploadDownload() {
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
@@ -466,6 +486,28 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    void batchedStatuses() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        fakeFolder.syncEngine().excludedFiles().addManualExclude("B/b3");
+        fakeFolder.serverErrorPaths().append("A/a1");
+        fakeFolder.localModifier().appendByte("A/a1");
+        fakeFolder.localModifier().insert("B/b3");
+        fakeFolder.localModifier().insert("C/c3");
+        fakeFolder.remoteModifier().find("S/s1")->isShared = true;
+        fakeFolder.remoteModifier().find("S", true);
+
+        fakeFolder.scheduleSync();
+        fakeFolder.execUntilBeforePropagation();
+        verifyThatBatchedMatchesSingle(fakeFolder);
+        fakeFolder.execUntilFinished();
+        verifyThatBatchedMatchesSingle(fakeFolder);
+
+        // Names that are in neither the database nor the folder
+        const auto statuses = fakeFolder.syncEngine().syncFileStatusTracker().fileStatuses("A", { "a1", "missing" });
+        QCOMPARE(statuses.value(0), SyncFileStatus(SyncFileStatus::StatusError));
+        QCOMPARE(statuses.value(1), SyncFileStatus(SyncFileStatus::StatusNone));
+    }
+
     void renameError() {
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
         fakeFolder.serverErrorPaths().append("A/a1");
@@ -509,6 +551,93 @@ private slots:
         statusSpy.clear();
     }
 
+
+    void statusIndex() {
+        SyncFileStatusIndex index;
+
+        QCOMPARE(index.addSyncCount("A/a1", 1), 1);
+        QCOMPARE(index.addSyncCount("A", 1), 1);
+        QCOMPARE(index.addSyncCount("A", 1), 2);
+        QCOMPARE(index.syncCount("A"), 2);
+        QCOMPARE(index.syncCount("A/a2"), 0);
+        QVERIFY(index.hasSyncCounts());
+        QCOMPARE(index.addSyncCount("A/a1", -1), 0);
+        QCOMPARE(index.takeSyncCounts(), QStringList { "A" });
+        QVERIFY(!index.hasSyncCounts());
+        QCOMPARE(index.syncCount("A"), 0);
+        QCOMPARE(index.nodeCount(), 1);
+
+        // The nearest ancestors that start having an error below them are reported
+        QCOMPARE(index.setProblem("A/B/b1", SyncFileStatus::StatusError), 3);
+        QCOMPARE(index.setProblem("A/B/b2", SyncFileStatus::StatusError), 0);
+        QCOMPARE(index.setProblem("A/a1", SyncFileStatus::StatusError), 0);
+        QCOMPARE(index.setProblem("C/c1", SyncFileStatus::StatusExcluded), 0);
+        QCOMPARE(index.effectiveProblem(""), SyncFileStatus::StatusWarning);
+        QCOMPARE(index.effectiveProblem("A"), SyncFileStatus::StatusWarning);
+        QCOMPARE(index.effectiveProblem("A/B/b1"), SyncFileStatus::StatusError);
+        QCOMPARE(index.effectiveProblem("C"), SyncFileStatus::StatusNone);
+        QCOMPARE(index.effectiveProblem("C/c1"), SyncFileStatus::StatusExcluded);
+        QCOMPARE(index.problem("A"), SyncFileStatus::StatusNone);
+
+        // A sibling that starts with the same name isn't below
+        QCOMPARE(index.effectiveProblem("A/B/b"), SyncFileStatus::StatusNone);
+
+        QCOMPARE(index.setProblem("A/B/b1", SyncFileStatus::StatusNone), 0);
+        QCOMPARE(index.setProblem("A/B/b2", SyncFileStatus::StatusExcluded), 1);
+        QCOMPARE(index.effectiveProblem("A/B"), SyncFileStatus::StatusNone);
+        QCOMPARE(index.effectiveProblem("A"), SyncFileStatus::StatusWarning);
+        QCOMPARE(index.setProblem("A/a1", SyncFileStatus::StatusNone), 2);
+        QCOMPARE(index.effectiveProblem(""), SyncFileStatus::StatusNone);
+
+        auto problems = index.takeProblems();
+        std::sort(problems.begin(), problems.end());
+        QCOMPARE(problems.size(), 2);
+        QCOMPARE(problems[0], qMakePair(QString("A/B/b2"), SyncFileStatus::StatusExcluded));
+        QCOMPARE(problems[1], qMakePair(QString("C/c1"), SyncFileStatus::StatusExcluded));
+        QCOMPARE(index.nodeCount(), 1);
+
+        index.setRecordState("A/a1", SyncFileStatusIndex::RecordShared);
+        index.setRecordState("A/a2", SyncFileStatusIndex::RecordMissing);
+        QCOMPARE(index.recordState("A/a1"), SyncFileStatusIndex::RecordShared);
+        QCOMPARE(index.recordState("A"), SyncFileStatusIndex::RecordUnknown);
+        index.setRecordState("A/a1", SyncFileStatusIndex::RecordUnknown);
+        QCOMPARE(index.recordState("A/a1"), SyncFileStatusIndex::RecordUnknown);
+        QCOMPARE(index.recordState("A/a2"), SyncFileStatusIndex::RecordMissing);
+        index.clearRecordStates();
+        QCOMPARE(index.recordState("A/a2"), SyncFileStatusIndex::RecordUnknown);
+        QCOMPARE(index.nodeCount(), 1);
+
+        // Names are compared like the file system does
+        index.setProblem("A/a1", SyncFileStatus::StatusError);
+        QCOMPARE(index.problem("a/A1"), Utility::fsCasePreserving() ? SyncFileStatus::StatusError : SyncFileStatus::StatusNone);
+    }
+
+    // Each parent is announced once per aboutToPropagate, not once per item below it
+    void parentsAnnouncedOnceBeforePropagation() {
+        FakeFolder fakeFolder{FileInfo{}};
+        fakeFolder.remoteModifier().mkdir("A");
+        for (int i = 0; i < 20; ++i)
+            fakeFolder.remoteModifier().insert(QString("A/a%1").arg(i));
+        fakeFolder.syncOnce();
+        for (int i = 0; i < 20; ++i)
+            fakeFolder.serverErrorPaths().append(QString("A/a%1").arg(i));
+        for (int i = 0; i < 20; ++i)
+            fakeFolder.localModifier().appendByte(QString("A/a%1").arg(i));
+        fakeFolder.syncOnce();
+
+        // The second time they are blacklisted
+        StatusPushSpy statusSpy(fakeFolder.syncEngine());
+        fakeFolder.scheduleSync();
+        fakeFolder.execUntilBeforePropagation();
+        verifyThatPushMatchesPull(fakeFolder, statusSpy);
+        QCOMPARE(statusSpy.statusOf("A"), SyncFileStatus(SyncFileStatus::StatusWarning));
+        int announced = 0;
+        const QFileInfo parent(fakeFolder.localPath(), "A");
+        for (const auto &args : statusSpy)
+            announced += QFileInfo(args[0].toString()) == parent;
+        QVERIFY(announced <= 2);
+        fakeFolder.execUntilFinished();
+    }
 };
 
 QTEST_GUILESS_MAIN(TestSyncFileStatusTracker)
@@ -0,0 +1,293 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include "common/vfs.h"
+#include "config.h"
+#include <syncengine.h>
+#include "abstractnetworkjob.h"
+
+#include "vfs/fuse/blockcache.h"
+#include "vfs/fuse/fusefilesystem.h"
+
+#include <atomic>
+#include <climits>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace OCC;
+
+static constexpr qint64 blockSize = FuseFileSystem::blockSize;
+
+SyncJournalFileRecord dbRecord(FakeFolder &folder, const QString &path)
+{
+    SyncJournalFileRecord record;
+    folder.syncJournal().getFileRecord(path, &record);
+    return record;
+}
+
+QSharedPointer<Vfs> setupVfs(FakeFolder &folder)
+{
+    auto fuseVfs = QSharedPointer<Vfs>(createVfsFromPlugin(Vfs::Fuse).release());
+    folder.switchToVfs(fuseVfs);
+
+    // Using this directly doesn't recursively unpin everything and instead leaves
+    // the files in the hydration that that they start with
+    folder.syncJournal().internalPinStates().setForPath(QByteArray(), PinState::Unspecified);
+
+    return fuseVfs;
+}
+
+/// Runs an operation like a FUSE worker thread would, the downloads need the event loop of this thread
+int runInThread(const std::function<int()> &operation, FuseFileSystem &fs)
+{
+    std::atomic<int> result(INT_MIN);
+    std::thread worker([&] { result = operation(); });
+    QElapsedTimer timer;
+    timer.start();
+    while (result == INT_MIN && timer.elapsed() < 10000)
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    if (result == INT_MIN)
+        fs.abortRequests();
+    worker.join();
+    return result;
+}
+
+class TestSyncFuse : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase()
+    {
+        // The tests use the operations directly, a mount needs /dev/fuse
+        qputenv("OWNCLOUD_VFS_FUSE_MOUNT", "0");
+    }
+
+    void testPlaceholderLifecycle()
+    {
+        FakeFolder fakeFolder{ FileInfo() };
+        auto vfs = setupVfs(fakeFolder);
+        FuseFileSystem fs(fakeFolder.localPath().toUtf8(), vfs->params(), nullptr);
+
+        // New remote files become placeholders with the remote size
+        fakeFolder.remoteModifier().mkdir("A");
+        fakeFolder.remoteModifier().insert("A/a1", 64);
+        auto someDate = QDateTime(QDate(1984, 07, 30), QTime(1, 3, 2));
+        fakeFolder.remoteModifier().setModTime("A/a1", someDate);
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(vfs->isDehydratedPlaceholder(fakeFolder.localPath() + "A/a1"));
+        QCOMPARE(*fs.placeholderSize("A/a1"), 64);
+        QCOMPARE(QFileInfo(fakeFolder.localPath() + "A/a1").size(), 0);
+        QCOMPARE(QFileInfo(fakeFolder.localPath() + "A/a1").lastModified(), someDate);
+        QCOMPARE(dbRecord(fakeFolder, "A/a1")._type, ItemTypeVirtualFile);
+
+        // The mount presents the remote size
+        struct stat st;
+        QCOMPARE(fs.getattr("A/a1", &st), 0);
+        QCOMPARE(st.st_size, 64);
+
+        // Another sync doesn't change anything
+        ItemCompletedSpy completeSpy(fakeFolder);
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(completeSpy.isEmpty());
+
+        // A remote change updates the size
+        fakeFolder.remoteModifier().appendByte("A/a1");
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(vfs->isDehydratedPlaceholder(fakeFolder.localPath() + "A/a1"));
+        QCOMPARE(*fs.placeholderSize("A/a1"), 65);
+        QCOMPARE(dbRecord(fakeFolder, "A/a1")._fileSize, 65);
+
+        // Pinning downloads the contents
+        QVERIFY(vfs->setPinState("A", PinState::AlwaysLocal));
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(!vfs->isDehydratedPlaceholder(fakeFolder.localPath() + "A/a1"));
+        QCOMPARE(QFileInfo(fakeFolder.localPath() + "A/a1").size(), 65);
+        QCOMPARE(dbRecord(fakeFolder, "A/a1")._type, ItemTypeFile);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // Online only dehydrates them again
+        QVERIFY(vfs->setPinState("A", PinState::OnlineOnly));
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(vfs->isDehydratedPlaceholder(fakeFolder.localPath() + "A/a1"));
+        QCOMPARE(*fs.placeholderSize("A/a1"), 65);
+        QCOMPARE(QFileInfo(fakeFolder.localPath() + "A/a1").size(), 0);
+        QCOMPARE(dbRecord(fakeFolder, "A/a1")._type, ItemTypeVirtualFile);
+    }
+
+    void testRangedReads()
+    {
+        FakeFolder fakeFolder{ FileInfo() };
+        auto vfs = setupVfs(fakeFolder);
+        fakeFolder.remoteModifier().mkdir("A");
+        fakeFolder.remoteModifier().insert("A/big", 3 * blockSize + 100);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(dbRecord(fakeFolder, "A/big")._type, ItemTypeVirtualFile);
+
+        QStringList ranges;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation)
+                ranges.append(QString::fromUtf8(request.rawHeader("Range")));
+            return nullptr;
+        });
+
+        QTemporaryDir cacheDir;
+        BlockCache cache(cacheDir.path(), blockSize, 16 * blockSize);
+        FuseFileSystem fs(fakeFolder.localPath().toUtf8(), vfs->params(), &cache);
+
+        uint64_t handle = 0;
+        QCOMPARE(fs.open("A/big", O_RDONLY, &handle), 0);
+        QCOMPARE(handle, FuseFileSystem::placeholderHandle);
+
+        auto read = [&](qint64 offset, int size) {
+            QByteArray buffer(size, '\0');
+            const auto result = runInThread([&] { return fs.read("A/big", handle, buffer.data(), buffer.size(), offset); }, fs);
+            return result < 0 ? QByteArray() : buffer.left(result);
+        };
+
+        // Only the block that is read gets downloaded
+        QCOMPARE(read(blockSize + 10, 100), QByteArray(100, 'W'));
+        QCOMPARE(ranges, QStringList{ QStringLiteral("bytes=1048576-2097151") });
+
+        // Reading it again comes from the cache
+        QCOMPARE(read(blockSize, 100), QByteArray(100, 'W'));
+        QCOMPARE(ranges.size(), 1);
+
+        // A sequential read fetches the next block with the same request
+        ranges.clear();
+        QCOMPARE(read(2 * blockSize, 100), QByteArray(100, 'W'));
+        QCOMPARE(ranges, QStringList{ QStringLiteral("bytes=2097152-3145827") });
+        QCOMPARE(read(3 * blockSize + 50, 100), QByteArray(50, 'W'));
+        QCOMPARE(ranges.size(), 1);
+
+        // Reads across blocks and past the end
+        QCOMPARE(read(3 * blockSize - 10, 200), QByteArray(110, 'W'));
+        QCOMPARE(read(3 * blockSize + 100, 10), QByteArray());
+        QCOMPARE(ranges.size(), 1);
+
+        // The thread running the downloads can't wait for them
+        ranges.clear();
+        QByteArray buffer(10, '\0');
+        const auto selfCaller = static_cast<pid_t>(syscall(SYS_gettid));
+        QCOMPARE(fs.read("A/big", handle, buffer.data(), buffer.size(), 0, selfCaller), -EDEADLK);
+        QVERIFY(ranges.isEmpty());
+        QCOMPARE(fs.release(handle), 0);
+
+        // Opening for writing downloads the missing blocks and the file becomes regular
+        QCOMPARE(runInThread([&] { return fs.open("A/big", O_RDWR, &handle); }, fs), 0);
+        QCOMPARE(ranges, QStringList{ QStringLiteral("bytes=0-1048575") });
+        QVERIFY(handle != FuseFileSystem::placeholderHandle);
+        QCOMPARE(fs.release(handle), 0);
+        QVERIFY(!fs.isPlaceholder("A/big"));
+        QCOMPARE(QFileInfo(fakeFolder.localPath() + "A/big").size(), 3 * blockSize + 100);
+        QCOMPARE(dbRecord(fakeFolder, "A/big")._type, ItemTypeFile);
+
+        // The sync agrees
+        ItemCompletedSpy completeSpy(fakeFolder);
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(completeSpy.isEmpty());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testConcurrentReads()
+    {
+        FakeFolder fakeFolder{ FileInfo() };
+        auto vfs = setupVfs(fakeFolder);
+        fakeFolder.remoteModifier().insert("big", 2 * blockSize);
+        QVERIFY(fakeFolder.syncOnce());
+
+        int getCount = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation)
+                ++getCount;
+            return nullptr;
+        });
+
+        QTemporaryDir cacheDir;
+        BlockCache cache(cacheDir.path(), blockSize, 16 * blockSize);
+        FuseFileSystem fs(fakeFolder.localPath().toUtf8(), vfs->params(), &cache);
+
+        // Readers of the same block share the download
+        std::atomic<int> done(0);
+        std::atomic<int> failed(0);
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 4; ++i) {
+            readers.emplace_back([&] {
+                QByteArray buffer(100, '\0');
+                if (fs.read("big", FuseFileSystem::placeholderHandle, buffer.data(), buffer.size(), 0) != 100)
+                    ++failed;
+                ++done;
+            });
+        }
+        QTRY_COMPARE(done.load(), 4);
+        for (auto &reader : readers)
+            reader.join();
+        QCOMPARE(failed.load(), 0);
+        QCOMPARE(getCount, 1);
+        QVERIFY(cache.contains(BlockCache::key(dbRecord(fakeFolder, "big")._fileId, dbRecord(fakeFolder, "big")._etag), 0));
+    }
+
+    void testRemoteChange()
+    {
+        FakeFolder fakeFolder{ FileInfo() };
+        auto vfs = setupVfs(fakeFolder);
+        fakeFolder.remoteModifier().insert("a", 100);
+        QVERIFY(fakeFolder.syncOnce());
+
+        QTemporaryDir cacheDir;
+        BlockCache cache(cacheDir.path(), blockSize, 16 * blockSize);
+        FuseFileSystem fs(fakeFolder.localPath().toUtf8(), vfs->params(), &cache);
+
+        // Until the sync catches up the old contents are not available
+        fakeFolder.remoteModifier().setContents("a", 'X');
+        QByteArray buffer(10, '\0');
+        QCOMPARE(runInThread([&] { return fs.read("a", FuseFileSystem::placeholderHandle, buffer.data(), buffer.size(), 0); }, fs), -EIO);
+
+        // Afterwards the new contents are
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(runInThread([&] { return fs.read("a", FuseFileSystem::placeholderHandle, buffer.data(), buffer.size(), 0); }, fs), 10);
+        QCOMPARE(buffer, QByteArray(10, 'X'));
+    }
+
+    // The sync goes around the mount, and the handlers don't wait for a stuck event loop forever
+    void testNoWaitOnItself()
+    {
+        FakeFolder fakeFolder{ FileInfo() };
+        auto vfs = setupVfs(fakeFolder);
+        fakeFolder.remoteModifier().insert("a", 100);
+        QVERIFY(fakeFolder.syncOnce());
+
+        const auto underlying = vfs->underlyingPath(fakeFolder.localPath() + "a");
+        QVERIFY(underlying.startsWith("/proc/self/fd/"));
+        QVERIFY(QFileInfo::exists(underlying));
+        QVERIFY(vfs->isDehydratedPlaceholder(underlying));
+
+        QTemporaryDir cacheDir;
+        BlockCache cache(cacheDir.path(), blockSize, 16 * blockSize);
+        FuseFileSystem fs(fakeFolder.localPath().toUtf8(), vfs->params(), &cache);
+
+        // This thread doesn't process events while the worker waits
+        const auto oldTimeout = AbstractNetworkJob::httpTimeout;
+        AbstractNetworkJob::httpTimeout = 1;
+        QByteArray buffer(10, '\0');
+        int result = 0;
+        std::thread worker([&] { result = fs.read("a", FuseFileSystem::placeholderHandle, buffer.data(), buffer.size(), 0); });
+        worker.join();
+        AbstractNetworkJob::httpTimeout = oldTimeout;
+        QCOMPARE(result, -EIO);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSyncFuse)
+#include "testsyncfuse.moc"
@@ -320,6 +320,88 @@ private slots:
         QVERIFY(checkElements());
     }
 
+    void testFileRecordWriteBehind()
+    {
+        auto makeEntry = [&](const QByteArray &path, const QByteArray &etag) {
+            SyncJournalFileRecord record;
+            record._path = path;
+            record._etag = etag;
+            record._remotePerm = RemotePermissions::fromDbValue("RW");
+            record._checksumHeader = "MD5:mychecksum";
+            return record;
+        };
+        auto countBelow = [&](const QByteArray &path) {
+            int count = 0;
+            _db.getFilesBelowPath(path, [&](const SyncJournalFileRecord &) { ++count; });
+            return count;
+        };
+
+        _db.setFileRecordWriteBehind(10, std::chrono::hours(1));
+
+        // Queued records are visible through getFileRecord
+        QVERIFY(_db.setFileRecord(makeEntry("wb", "e1")));
+        QVERIFY(_db.setFileRecord(makeEntry("wb/a", "e1")));
+        SyncJournalFileRecord record;
+        QVERIFY(_db.getFileRecord(QByteArrayLiteral("wb/a"), &record));
+        QCOMPARE(record._etag, QByteArray("e1"));
+
+        // Updating a queued record replaces it
+        QVERIFY(_db.setFileRecord(makeEntry("wb/a", "e2")));
+        QVERIFY(_db.getFileRecord(QByteArrayLiteral("wb/a"), &record));
+        QCOMPARE(record._etag, QByteArray("e2"));
+
+        // Other queries flush the queue first
+        QCOMPARE(countBelow("wb"), 1);
+        QVERIFY(_db.getFileRecord(QByteArrayLiteral("wb/a"), &record));
+        QCOMPARE(record._etag, QByteArray("e2"));
+        QCOMPARE(record._checksumHeader, QByteArray("MD5:mychecksum"));
+
+        // More than a full batch, and more rows than fit into one statement
+        for (int i = 0; i < 137; ++i)
+            QVERIFY(_db.setFileRecord(makeEntry("wb/f" + QByteArray::number(i), "e3")));
+        _db.setFileRecordWriteBehind(100);
+        for (int i = 137; i < 500; ++i)
+            QVERIFY(_db.setFileRecord(makeEntry("wb/f" + QByteArray::number(i), "e3")));
+        QVERIFY(_db.flushPendingFileRecords());
+        QCOMPARE(countBelow("wb"), 501);
+
+        // Disabling write-behind writes everything out
+        QVERIFY(_db.setFileRecord(makeEntry("wb/last", "e4")));
+        _db.setFileRecordWriteBehind(0);
+        QCOMPARE(countBelow("wb"), 502);
+
+        // A failed write keeps the records queued for the next attempt
+        _db.setFileRecordWriteBehind(10, std::chrono::hours(1));
+        QVERIFY(_db.setFileRecord(makeEntry("wb/retry", "e5")));
+        _db.autotestFailCounter = 0;
+        QVERIFY(!_db.flushPendingFileRecords());
+        QVERIFY(_db.getFileRecord(QByteArrayLiteral("wb/retry"), &record));
+        QCOMPARE(record._etag, QByteArray("e5"));
+        QVERIFY(_db.flushPendingFileRecords());
+        QCOMPARE(countBelow("wb"), 503);
+
+        // Deleting drops queued records that could not be written yet
+        QVERIFY(_db.setFileRecord(makeEntry("wb/gone", "e6")));
+        _db.autotestFailCounter = 0;
+        QVERIFY(!_db.flushPendingFileRecords());
+        QVERIFY(_db.deleteFileRecord("wb/gone"));
+        QVERIFY(_db.flushPendingFileRecords());
+        QVERIFY(_db.getFileRecord(QByteArrayLiteral("wb/gone"), &record));
+        QVERIFY(!record.isValid());
+
+        // Queued records are written after maxAge without further calls
+        _db.setFileRecordWriteBehind(10, std::chrono::milliseconds(50));
+        QVERIFY(_db.setFileRecord(makeEntry("wb/timer", "e7")));
+        SyncJournalDb other(_db.databaseFilePath());
+        QTRY_VERIFY(other.getFileRecord(QByteArrayLiteral("wb/timer"), &record) && record.isValid());
+        QCOMPARE(record._etag, QByteArray("e7"));
+        other.close();
+
+        _db.setFileRecordWriteBehind(0);
+        QVERIFY(_db.deleteFileRecord("wb", true));
+        QCOMPARE(countBelow("wb"), 0);
+    }
+
     void testPinState()
     {
         auto make = [&](const QByteArray &path, PinState state) {
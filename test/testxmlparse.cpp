@@ -7,6 +7,7 @@
 #include <QtTest>
 
 #include "networkjobs.h"
+#include "discoveryphase.h"
 
 using namespace OCC;
 
@@ -123,6 +124,230 @@ private slots:
         QVERIFY(_subdirs.size() == 1);
     }
 
+    void testParserIncremental() {
+        const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\" xmlns:oc=\"http://owncloud.org/ns\">"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:id>00004213ocobzus5kn6s</oc:id>"
+              "<oc:size>121780</oc:size>"
+              "<d:resourcetype>"
+              "<d:collection/>"
+              "</d:resourcetype>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "</d:response>"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/sub/</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:id>00004214ocobzus5kn6s</oc:id>"
+              "<d:resourcetype>"
+              "<d:collection/>"
+              "</d:resourcetype>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "</d:response>"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/sub/quitte.pdf</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:id>00004215ocobzus5kn6s</oc:id>"
+              "<d:resourcetype/>"
+              "<d:getcontentlength>121780</d:getcontentlength>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "</d:response>"
+              "</d:multistatus>";
+
+        LsColXMLParser parser;
+
+        connect( &parser, SIGNAL(directoryListingSubfolders(const QStringList&)),
+                 this, SLOT(slotDirectoryListingSubFolders(const QStringList&)) );
+        connect( &parser, SIGNAL(directoryListingIterated(const QString&, const QMap<QString,QString>&)),
+                 this, SLOT(slotDirectoryListingIterated(const QString&, const QMap<QString,QString>&)) );
+        connect( &parser, SIGNAL(finishedWithoutError()),
+                 this, SLOT(slotFinishedSuccessfully()) );
+
+        // Feed the document in small pieces, like a slow network would
+        QHash <QString, ExtraFolderInfo> sizes;
+        parser.start(&sizes, "/oc/remote.php/webdav/sharefolder");
+        const int firstResponseEnd = testXml.indexOf("</d:response>") + 13;
+        for (int pos = 0; pos < testXml.size(); pos += 5) {
+            QVERIFY(parser.addData(testXml.mid(pos, 5)));
+            if (pos + 5 < firstResponseEnd)
+                QCOMPARE(_items.size(), 0);
+            else if (pos + 5 < testXml.indexOf("</d:response>", firstResponseEnd))
+                QCOMPARE(_items.size(), 1); // emitted before the document is complete
+        }
+        QVERIFY(!_success);
+        QVERIFY(parser.finish());
+
+        QVERIFY(_success);
+        QCOMPARE(_items, QStringList({ "/oc/remote.php/webdav/sharefolder",
+                             "/oc/remote.php/webdav/sharefolder/sub",
+                             "/oc/remote.php/webdav/sharefolder/sub/quitte.pdf" }));
+        QCOMPARE(_subdirs, QStringList({ "/oc/remote.php/webdav/sharefolder/",
+                               "/oc/remote.php/webdav/sharefolder/sub/" }));
+        QCOMPARE(sizes.value("/oc/remote.php/webdav/sharefolder/").size, qint64(121780));
+        QCOMPARE(sizes.value("/oc/remote.php/webdav/sharefolder/sub/quitte.pdf").fileId, QByteArray("00004215ocobzus5kn6s"));
+    }
+
+    void testParserIncrementalTruncated() {
+        const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\">"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/</d:href>"
+              "</d:response>"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/a</d:href>"; // connection dropped
+
+        LsColXMLParser parser;
+
+        connect( &parser, SIGNAL(directoryListingIterated(const QString&, const QMap<QString,QString>&)),
+                 this, SLOT(slotDirectoryListingIterated(const QString&, const QMap<QString,QString>&)) );
+        connect( &parser, SIGNAL(finishedWithoutError()),
+                 this, SLOT(slotFinishedSuccessfully()) );
+
+        parser.start(nullptr, "/oc/remote.php/webdav/sharefolder");
+        QVERIFY(parser.addData(testXml));
+        QCOMPARE(_items, QStringList("/oc/remote.php/webdav/sharefolder"));
+        QVERIFY(!parser.finish());
+        QVERIFY(!_success);
+    }
+
+    void testRemoteInfoParser() {
+        const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\" xmlns:oc=\"http://owncloud.org/ns\">\n"
+              "<d:response>\n"
+              "  <d:href>/oc/remote.php/webdav/sharefolder/</d:href>\n"
+              "  <d:propstat>\n"
+              "    <d:prop>\n"
+              "      <oc:id>00004213ocobzus5kn6s</oc:id>\n"
+              "      <oc:permissions>RDNVCKM</oc:permissions>\n"
+              "      <oc:size>121780</oc:size>\n"
+              "      <d:getetag>\"5527beb0400b0\"</d:getetag>\n"
+              "      <d:resourcetype>\n"
+              "        <d:collection/>\n"
+              "      </d:resourcetype>\n"
+              "      <oc:data-fingerprint>abc</oc:data-fingerprint>\n"
+              "    </d:prop>\n"
+              "    <d:status>HTTP/1.1 200 OK</d:status>\n"
+              "  </d:propstat>\n"
+              "</d:response>\n"
+              "<d:response>\n"
+              "  <d:href>/oc/remote.php/webdav/sharefolder/a%20b.pdf</d:href>\n"
+              "  <d:propstat>\n"
+              "    <d:prop>\n"
+              "      <oc:permissions>RDNVW</oc:permissions>\n"
+              "      <d:getetag>\"2fa2f0d9ed49ea0c3e409d49e652dea0\"</d:getetag>\n"
+              "      <d:resourcetype/>\n"
+              "      <d:getlastmodified>Fri, 06 Feb 2015 13:49:55 GMT</d:getlastmodified>\n"
+              "      <d:getcontentlength>121780</d:getcontentlength>\n"
+              "      <oc:checksums><oc:checksum>MD5:1234 SHA1:abcd</oc:checksum></oc:checksums>\n"
+              "      <oc:share-types><oc:share-type>0</oc:share-type></oc:share-types>\n"
+              "      <oc:unknown><oc:id>ignored</oc:id></oc:unknown>\n"
+              "    </d:prop>\n"
+              "    <d:status>HTTP/1.1 200 OK</d:status>\n"
+              "  </d:propstat>\n"
+              "  <d:propstat>\n"
+              "    <d:prop>\n"
+              "      <oc:id/>\n"
+              "      <oc:downloadURL/>\n"
+              "    </d:prop>\n"
+              "    <d:status>HTTP/1.1 404 Not Found</d:status>\n"
+              "  </d:propstat>\n"
+              "</d:response>\n"
+              "</d:multistatus>";
+
+        // The result must not depend on where the network splits the answer
+        for (int chunkSize : { 1, 7, 4096 }) {
+            std::vector<RemoteInfoParser::Entry> entries;
+            RemoteInfoParser parser([&entries](RemoteInfoParser::Entry &entry) { entries.push_back(std::move(entry)); });
+            parser.start("/oc/remote.php/webdav/sharefolder");
+            for (int pos = 0; pos < testXml.size(); pos += chunkSize)
+                QVERIFY(parser.addData(testXml.mid(pos, chunkSize)));
+            QVERIFY(parser.finish());
+            QCOMPARE(entries.size(), size_t(2));
+
+            const auto &dir = entries[0];
+            QCOMPARE(dir.path, QStringLiteral("/oc/remote.php/webdav/sharefolder"));
+            QCOMPARE(dir.info.name, QStringLiteral("sharefolder"));
+            QVERIFY(dir.info.isDirectory);
+            QCOMPARE(dir.info.size, int64_t(0));
+            QCOMPARE(dir.info.fileId, QByteArray("00004213ocobzus5kn6s"));
+            QCOMPARE(dir.info.etag, QByteArray("5527beb0400b0"));
+            QCOMPARE(dir.rawEtag, QByteArray("\"5527beb0400b0\""));
+            QCOMPARE(dir.dataFingerprint, QByteArray("abc"));
+            QVERIFY(dir.permissions.hasPermission(RemotePermissions::IsMounted));
+            QVERIFY(!dir.has(RemoteInfoParser::SyncToken));
+
+            const auto &file = entries[1];
+            QCOMPARE(file.path, QStringLiteral("/oc/remote.php/webdav/sharefolder/a b.pdf"));
+            QCOMPARE(file.info.name, QStringLiteral("a b.pdf"));
+            QVERIFY(!file.info.isDirectory);
+            QCOMPARE(file.info.size, int64_t(121780));
+            QCOMPARE(file.info.modtime, time_t(QDateTime::fromString("Fri, 06 Feb 2015 13:49:55 GMT", Qt::RFC2822Date).toTime_t()));
+            QCOMPARE(file.info.checksumHeader, QByteArray("SHA1:abcd"));
+            QVERIFY(file.info.remotePerm.hasPermission(RemotePermissions::IsShared));
+            QVERIFY(!file.permissions.hasPermission(RemotePermissions::IsShared));
+            // Only properties with status 200 are used
+            QVERIFY(!file.has(RemoteInfoParser::Id));
+            QVERIFY(file.info.fileId.isEmpty());
+            QVERIFY(!file.has(RemoteInfoParser::DownloadUrl));
+        }
+    }
+
+    void testRemoteInfoParserBogusHref() {
+        const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\">"
+              "<d:response><d:href>/oc/remote.php/webdav/sharefolder/</d:href></d:response>"
+              "<d:response><d:href>/oc/remote.php/webdav/sharefolder/../other/</d:href></d:response>"
+              "</d:multistatus>";
+
+        int count = 0;
+        RemoteInfoParser parser([&count](RemoteInfoParser::Entry &) { ++count; });
+        QVERIFY(!parser.parse(testXml, "/oc/remote.php/webdav/sharefolder"));
+        QCOMPARE(count, 1);
+
+        // Truncated answers are errors too
+        count = 0;
+        QVERIFY(!parser.parse(testXml.left(testXml.lastIndexOf("<d:response>")), "/oc/remote.php/webdav/sharefolder"));
+        QCOMPARE(count, 1);
+    }
+
+    void testRemoteInfoParserSyncCollection() {
+        const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\" xmlns:oc=\"http://owncloud.org/ns\">"
+              "<d:response><d:href>/oc/remote.php/webdav/sharefolder/gone.txt</d:href>"
+              "<d:status>HTTP/1.1 404 Not Found</d:status></d:response>"
+              "<d:response><d:href>/oc/remote.php/webdav/sharefolder/new.txt</d:href>"
+              "<d:propstat><d:prop><d:getetag>\"e1\"</d:getetag><d:getcontentlength>12</d:getcontentlength></d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status></d:propstat></d:response>"
+              "<d:sync-token>http://example.org/ns/sync/42</d:sync-token>"
+              "</d:multistatus>";
+
+        std::vector<RemoteInfoParser::Entry> entries;
+        RemoteInfoParser parser([&entries](RemoteInfoParser::Entry &entry) { entries.push_back(std::move(entry)); });
+        QVERIFY(parser.parse(testXml, "/oc/remote.php/webdav/sharefolder"));
+        QCOMPARE(parser.syncToken(), QByteArray("http://example.org/ns/sync/42"));
+        QCOMPARE(entries.size(), size_t(2));
+
+        QCOMPARE(entries[0].info.name, QStringLiteral("gone.txt"));
+        QCOMPARE(entries[0].status, 404);
+        QCOMPARE(entries[0].found, quint32(0));
+
+        QCOMPARE(entries[1].info.name, QStringLiteral("new.txt"));
+        QCOMPARE(entries[1].status, 0);
+        QCOMPARE(entries[1].info.etag, QByteArray("e1"));
+        QCOMPARE(entries[1].info.size, int64_t(12));
+    }
+
     void testParserBrokenXml() {
         const QByteArray testXml = "X<?xml version='1.0' encoding='utf-8'?>"
               "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\" xmlns:oc=\"http://owncloud.org/ns\">"